@@ -0,0 +1,215 @@
+#pragma once
+
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+
+#include <maps/grid/VectorGrid.hpp>
+
+namespace maps { namespace grid
+{
+
+    /**
+     * @brief Grid storage whose cells live in memory owned by someone else.
+     * @details
+     * Can be used as storage of a GridMap instead of VectorGrid if several grids
+     * share one allocation, e.g. the shared layers of a LayeredGridMap. The memory
+     * has to hold getNumCells().prod() cells in row-major order and has to outlive
+     * the grid. Copies refer to the same memory. The number of cells is fixed by
+     * the memory, so resize throws if the size changes.
+     */
+    template <typename CellT>
+    class BufferGrid
+    {
+        /** The cells, not owned **/
+        CellT* cells;
+
+        /** Number of cells in X-axis and Y-axis **/
+        Vector2ui num_cells;
+
+        /** Default value **/
+        CellT default_value;
+
+    public:
+
+        typedef CellT CellType;
+        typedef CellT* iterator;
+        typedef const CellT* const_iterator;
+        typedef const CellT& const_reference;
+        typedef CellSpan<CellT> RowSpan;
+        typedef CellSpan<const CellT> ConstRowSpan;
+
+        /** Creates a grid without memory, see setCells */
+        BufferGrid(Vector2ui size, CellT default_value)
+            : cells(NULL),
+              num_cells(size),
+              default_value(default_value)
+        {
+        }
+
+        BufferGrid(Vector2ui size, CellT default_value, CellT* cells)
+            : cells(cells),
+              num_cells(size),
+              default_value(default_value)
+        {
+        }
+
+        BufferGrid()
+            : BufferGrid(Vector2ui(0, 0), CellT())
+        {
+        }
+
+        const CellT &getDefaultValue() const
+        {
+            return default_value;
+        }
+
+        /**
+         * Sets the memory of the cells, which has to hold getNumCells().prod() cells.
+         * The cells are not initialized.
+         */
+        void setCells(CellT* new_cells)
+        {
+            cells = new_cells;
+        }
+
+        CellT* getCells() const
+        {
+            return cells;
+        }
+
+        iterator begin()
+        {
+            return cells;
+        }
+
+        iterator end()
+        {
+            return cells + num_cells.prod();
+        }
+
+        const_iterator begin() const
+        {
+            return cells;
+        }
+
+        const_iterator end() const
+        {
+            return cells + num_cells.prod();
+        }
+
+        void resize(const Vector2ui &new_number_cells)
+        {
+            if(new_number_cells != num_cells)
+                throw std::runtime_error("The size of a grid with external memory can't be changed");
+        }
+
+        /**
+         * @brief Move the content of the grid cells
+         * @details by the offset described in the argument
+         */
+        void moveBy(const Index &idx)
+        {
+            if (abs(idx.x()) >= num_cells.x()
+                || abs(idx.y()) >= num_cells.y())
+            {
+                clear();
+                return;
+            }
+
+            std::vector<CellT> tmp(num_cells.prod(), default_value);
+            for (unsigned int y = 0; y < num_cells.y(); ++y)
+            {
+                for (unsigned int x = 0; x < num_cells.x(); ++x)
+                {
+                    int x_new = x + idx.x();
+                    int y_new = y + idx.y();
+
+                    if ((x_new >= 0 && x_new < num_cells.x())
+                        && (y_new >= 0 && y_new < num_cells.y()))
+                    {
+                        tmp[toIdx(x_new, y_new)] = cells[toIdx(x, y)];
+                    }
+                }
+            }
+            std::copy(tmp.begin(), tmp.end(), cells);
+        }
+
+        const CellT& at(const Index &idx) const
+        {
+            return this->at(idx.x(), idx.y());
+        }
+
+        CellT& at(const Index &idx)
+        {
+            return this->at(idx.x(), idx.y());
+        }
+
+        const CellT& at(size_t x, size_t y) const
+        {
+            if(x >= num_cells.x() || y >= num_cells.y())
+                throw std::runtime_error("Provided index is out of the grid");
+            return cells[toIdx(x, y)];
+        }
+
+        CellT& at(size_t x, size_t y)
+        {
+            if(x >= num_cells.x() || y >= num_cells.y())
+                throw std::runtime_error("Provided index is out of the grid");
+            return cells[toIdx(x, y)];
+        }
+
+        const CellT& atUnchecked(size_t x, size_t y) const
+        {
+            return cells[toIdx(x, y)];
+        }
+
+        CellT& atUnchecked(size_t x, size_t y)
+        {
+            return cells[toIdx(x, y)];
+        }
+
+        const CellT& atUnchecked(const Index &idx) const
+        {
+            return atUnchecked(idx.x(), idx.y());
+        }
+
+        CellT& atUnchecked(const Index &idx)
+        {
+            return atUnchecked(idx.x(), idx.y());
+        }
+
+        /**
+         * Returns the cells of row y as contiguous span of getNumCells().x() cells.
+         */
+        ConstRowSpan getRow(size_t y) const
+        {
+            if(y >= num_cells.y())
+                throw std::runtime_error("Provided row is out of the grid");
+            return ConstRowSpan(cells + y * num_cells.x(), num_cells.x());
+        }
+
+        RowSpan getRow(size_t y)
+        {
+            if(y >= num_cells.y())
+                throw std::runtime_error("Provided row is out of the grid");
+            return RowSpan(cells + y * num_cells.x(), num_cells.x());
+        }
+
+        const Vector2ui &getNumCells() const
+        {
+            return num_cells;
+        };
+
+        void clear()
+        {
+            std::fill(begin(), end(), default_value);
+        };
+
+    protected:
+        size_t toIdx(size_t x, size_t y) const
+        {
+            return x  +  y * num_cells.x();
+        }
+    };
+}}
@@ -1,4 +1,5 @@
 #include "ElevationMap.hpp"
+#include "../tools/ParallelFor.hpp"
 
 namespace maps { namespace grid
 {
@@ -11,11 +12,16 @@ ElevationMap::ElevationMap()
 
 ElevationMap::ElevationMap(const GridMapF &grid_map) 
     : GridMapF(grid_map)
-{}
+{
+    // the tracking of grid_map belongs to the caches of its owner
+    setModificationTracking(false);
+}
 
 
 ElevationMap::ElevationMap(const ElevationMap &elevation_map) 
    : GridMapF(elevation_map) 
+   , height_pyramid(elevation_map.height_pyramid)
+   , normal_cache(elevation_map.normal_cache)
 {}
 
 ElevationMap::ElevationMap(const Vector2ui &num_cells, const Vector2d &resolution)
@@ -31,28 +37,9 @@ ElevationMap::~ElevationMap()
 
 Vector3d ElevationMap::getNormal(const Index& idx) const
 {
-    if (!inGrid(idx))
-        throw std::runtime_error("Provided index is out of grid.");
-    if (!inGrid(idx + Index(1,1)))
-        throw std::runtime_error("Provided index should be at the distance Index(1,1) from the grid border.");
-    if (idx < Index(1,1))
-        throw std::runtime_error("Provided index should be at the distance Index(1,1) from the grid border."); 
-
-    size_t m = idx.x(), n = idx.y();
-
-    // if the neighbour cells have no values
-    if (at(m - 1, n) == ELEVATION_DEFAULT
-        || at(m + 1, n) == ELEVATION_DEFAULT
-        || at(m, n - 1) == ELEVATION_DEFAULT
-        || at(m, n + 1) == ELEVATION_DEFAULT)
-    {
-        return Vector3d(NAN, NAN, NAN);
-    }
-
-    float slope_x = (at(m - 1, n) - at(m + 1, n)) / (getResolution().x() * 2.0); 
-    float slope_y = (at(m, n - 1) - at(m, n + 1)) / (getResolution().y() * 2.0);
+    checkNormalIndex(idx);
 
-    return Vector3d(slope_x, slope_y, 1.0 ).normalized();
+    return computeNormal(idx.x(), idx.y()).cast<double>();
 }
 
 Vector3d ElevationMap::getNormal(const Vector3d& pos) const
@@ -81,7 +68,14 @@ float ElevationMap::getMeanElevation(const Vector3d& pos) const
     pos_t.x() -= pos.x();
     pos_t.y() -= pos.y();
 
-    Vector3d normal = getNormal(pos);
+    Vector3d normal;
+    if (useNormalCache(idx))
+    {
+        checkNormalIndex(idx);
+        normal = normal_cache.atUnchecked(idx).cast<double>();
+    }
+    else
+        normal = getNormal(idx);
 
     // if there are no values in the neighbours cells
     if (normal.hasNaN()) 
@@ -100,23 +94,340 @@ float ElevationMap::getMeanElevation(const Vector3d& pos) const
 
 std::pair<float, float> ElevationMap::getElevationRange() const
 {
+    if (useHeightPyramid())
+    {
+        const MinMaxPyramid::Range& range = height_pyramid.getRange();
+        return std::pair<float, float>(range.min, range.max);
+    }
+
     float max = -std::numeric_limits<float>::infinity();
     float min = std::numeric_limits<float>::infinity();
     for (unsigned int y = 0; y < getNumCells().y(); ++y)
     {
-        for (unsigned int x = 0; x < getNumCells().x(); ++x)
+        for (const float elevation : getRow(y))
         {
-            if (at(x, y) == ELEVATION_DEFAULT)
+            if (!hasElevation(elevation))
                 continue;
 
-            if (at(x, y) > max)
-                max = at(x, y);
+            if (elevation > max)
+                max = elevation;
 
-            if (at(x, y) < min)
-                min = at(x, y);
+            if (elevation < min)
+                min = elevation;
         }
     }
     return std::pair<float, float>(min, max);
 }
 
+std::pair<float, float> ElevationMap::getElevationRange(const Index& min_idx, const Index& max_idx) const
+{
+    MinMaxPyramid::Range range;
+    if (useHeightPyramid())
+    {
+        range = height_pyramid.getRange(min_idx, max_idx);
+    }
+    else
+    {
+        Index min_clipped = min_idx.cwiseMax(0);
+        Index max_clipped = max_idx.cwiseMin(getNumCells().cast<int>());
+        for (int y = min_clipped.y(); y < max_clipped.y(); ++y)
+        {
+            for (int x = min_clipped.x(); x < max_clipped.x(); ++x)
+            {
+                range.extend(getCellRange(Index(x, y)));
+            }
+        }
+    }
+    return std::pair<float, float>(range.min, range.max);
+}
+
+CellExtents ElevationMap::calculateCellExtents(unsigned num_threads) const
+{
+    // the pyramid only matches the default value check if the default has no elevation
+    if (useHeightPyramid() && getDefaultValue() == ELEVATION_DEFAULT)
+        return height_pyramid.getCellExtents();
+    return GridMapF::calculateCellExtents(num_threads);
+}
+
+void ElevationMap::setElevation(const Index& idx, float elevation)
+{
+    if (!inGrid(idx))
+        throw std::runtime_error("Provided index is out of the grid");
+    atUntracked(idx) = elevation;
+    updateHeightPyramid(idx);
+    updateNormalCache(idx);
+}
+
+ElevationMap::NormalMap ElevationMap::computeNormals(unsigned num_threads) const
+{
+    NormalMap normals = createNormalMap();
+    tools::parallelFor(0, getNumCells().y(), [&](size_t begin, size_t end)
+    {
+        for (size_t y = begin; y < end; ++y)
+            computeNormalRow(y, normals.getRow(y).data);
+    }, num_threads, 16);
+    return normals;
+}
+
+GridMapF ElevationMap::computeSlopeMap(unsigned num_threads) const
+{
+    GridMapF slopes(*this, VectorGrid<float>(getNumCells(), ELEVATION_DEFAULT));
+    tools::parallelFor(0, getNumCells().y(), [&](size_t begin, size_t end)
+    {
+        std::vector<Eigen::Vector3f> normals(getNumCells().x());
+        for (size_t y = begin; y < end; ++y)
+        {
+            computeNormalRow(y, normals.data());
+            GridMapF::RowSpan row = slopes.getRow(y);
+            for (size_t x = 0; x < row.size; ++x)
+            {
+                if (!std::isnan(normals[x].z()))
+                    row[x] = std::acos(std::min(normals[x].z(), 1.f));
+            }
+        }
+    }, num_threads, 16);
+    return slopes;
+}
+
+void ElevationMap::enableNormalCache(unsigned num_threads)
+{
+    // pending rows of the height pyramid are kept
+    normal_cache = NormalMap();
+    updateCaches();
+    normal_cache = computeNormals(num_threads);
+    updateModificationTracking();
+}
+
+void ElevationMap::disableNormalCache()
+{
+    normal_cache = NormalMap();
+    updateModificationTracking();
+}
+
+bool ElevationMap::hasNormalCache() const
+{
+    return normal_cache.getNumCells().prod() > 0;
+}
+
+const ElevationMap::NormalMap& ElevationMap::getNormalCache() const
+{
+    return normal_cache;
+}
+
+void ElevationMap::updateNormalCache(const Index& idx)
+{
+    if (!hasNormalCache())
+        return;
+    updateCaches();
+
+    // the normals of the cell and its four neighbours depend on the cell
+    static const Index offsets[] = {Index(0, 0), Index(-1, 0), Index(1, 0), Index(0, -1), Index(0, 1)};
+    for (const Index& offset : offsets)
+    {
+        const Index cell = idx + offset;
+        if (!inGrid(cell))
+            continue;
+        if (cell.x() < 1 || cell.y() < 1 || !inGrid(cell + Index(1, 1)))
+            normal_cache.atUnchecked(cell) = normal_cache.getDefaultValue();
+        else
+            normal_cache.atUnchecked(cell) = computeNormal(cell.x(), cell.y());
+    }
+}
+
+bool ElevationMap::useNormalCache(const Index& idx) const
+{
+    if (!hasNormalCache() || normal_cache.getNumCells() != getNumCells())
+        return false;
+    // the normal depends on the rows above and below
+    for (int y = std::max(idx.y() - 1, 0); y <= idx.y() + 1; ++y)
+    {
+        if (isRowModified(y))
+            return false;
+    }
+    return true;
+}
+
+void ElevationMap::enableHeightPyramid()
+{
+    // pending rows of the normal cache are kept
+    height_pyramid = MinMaxPyramid();
+    updateCaches();
+    rebuildHeightPyramid();
+    updateModificationTracking();
+}
+
+void ElevationMap::rebuildHeightPyramid()
+{
+    height_pyramid.resize(getNumCells());
+    if (!height_pyramid.isInitialized())
+        return;
+    for (unsigned int y = 0; y < getNumCells().y(); ++y)
+    {
+        for (unsigned int x = 0; x < getNumCells().x(); ++x)
+        {
+            height_pyramid.setCell(Index(x, y), getCellRange(Index(x, y)));
+        }
+    }
+    height_pyramid.updateLevels();
+}
+
+void ElevationMap::disableHeightPyramid()
+{
+    height_pyramid = MinMaxPyramid();
+    updateModificationTracking();
+}
+
+bool ElevationMap::hasHeightPyramid() const
+{
+    return height_pyramid.isInitialized();
+}
+
+const MinMaxPyramid& ElevationMap::getHeightPyramid() const
+{
+    return height_pyramid;
+}
+
+void ElevationMap::updateHeightPyramid(const Index& idx)
+{
+    if (!height_pyramid.isInitialized())
+        return;
+    updateCaches();
+    height_pyramid.update(idx, getCellRange(idx));
+}
+
+void ElevationMap::updateModificationTracking()
+{
+    const bool enable = height_pyramid.isInitialized() || hasNormalCache();
+    if (enable != isModificationTracking())
+        setModificationTracking(enable);
+}
+
+void ElevationMap::updateCaches()
+{
+    if (!hasModifiedRows())
+        return;
+
+    const bool all_rows = hasAllRowsModified();
+    std::vector<unsigned int> rows;
+    if (!all_rows)
+    {
+        for (unsigned int y = 0; y < getNumCells().y(); ++y)
+        {
+            if (isRowModified(y))
+                rows.push_back(y);
+        }
+    }
+
+    if (height_pyramid.isInitialized())
+    {
+        // updating a cell touches all levels, so many modified rows are rebuilt at once
+        if (all_rows || height_pyramid.getNumCells() != getNumCells() || rows.size() * 8 > getNumCells().y())
+            rebuildHeightPyramid();
+        else
+        {
+            for (unsigned int y : rows)
+            {
+                for (unsigned int x = 0; x < getNumCells().x(); ++x)
+                    height_pyramid.update(Index(x, y), getCellRange(Index(x, y)));
+            }
+        }
+    }
+
+    if (hasNormalCache())
+    {
+        if (all_rows || normal_cache.getNumCells() != getNumCells())
+            normal_cache = computeNormals();
+        else
+        {
+            // the normals of the rows above and below depend on a modified row
+            std::vector<bool> normal_rows(getNumCells().y(), false);
+            for (unsigned int y : rows)
+            {
+                for (unsigned int ny = std::max(y, 1u) - 1; ny <= y + 1 && ny < getNumCells().y(); ++ny)
+                    normal_rows[ny] = true;
+            }
+            for (unsigned int y = 0; y < getNumCells().y(); ++y)
+            {
+                if (normal_rows[y])
+                    computeNormalRow(y, normal_cache.getRow(y).data);
+            }
+        }
+    }
+    resetModifiedRows();
+}
+
+MinMaxPyramid::Range ElevationMap::getCellRange(const Index& idx) const
+{
+    const float elevation = GridMapF::atUnchecked(idx);
+    if (!hasElevation(elevation))
+        return MinMaxPyramid::Range();
+    return MinMaxPyramid::Range(elevation, elevation);
+}
+
+void ElevationMap::checkNormalIndex(const Index& idx) const
+{
+    if (!inGrid(idx))
+        throw std::runtime_error("Provided index is out of grid.");
+    if (!inGrid(idx + Index(1,1)) || idx.x() < 1 || idx.y() < 1)
+        throw std::runtime_error("Provided index should be at the distance Index(1,1) from the grid border.");
+}
+
+Eigen::Vector3f ElevationMap::computeNormal(size_t x, size_t y) const
+{
+    const size_t width = getNumCells().x();
+    const float* row = getRow(y).data;
+    const float left = row[x - 1];
+    const float right = row[x + 1];
+    const float bottom = row[x - width];
+    const float top = row[x + width];
+
+    if (left == ELEVATION_DEFAULT
+        || right == ELEVATION_DEFAULT
+        || bottom == ELEVATION_DEFAULT
+        || top == ELEVATION_DEFAULT)
+    {
+        return Eigen::Vector3f::Constant(NAN);
+    }
+
+    return normalFromNeighbours(left, right, bottom, top, getSlopeScale());
+}
+
+Eigen::Vector2f ElevationMap::getSlopeScale() const
+{
+    return Eigen::Vector2f(1.0 / (getResolution().x() * 2.0), 1.0 / (getResolution().y() * 2.0));
+}
+
+void ElevationMap::computeNormalRow(size_t y, Eigen::Vector3f* normals) const
+{
+    const size_t width = getNumCells().x();
+    const Eigen::Vector3f invalid = Eigen::Vector3f::Constant(NAN);
+    if (y < 1 || y + 1 >= getNumCells().y() || width < 3)
+    {
+        std::fill(normals, normals + width, invalid);
+        return;
+    }
+
+    const float* bottom = getRow(y - 1).data;
+    const float* row = getRow(y).data;
+    const float* top = getRow(y + 1).data;
+    const Eigen::Vector2f slope_scale = getSlopeScale();
+
+    normals[0] = invalid;
+    normals[width - 1] = invalid;
+    for (size_t x = 1; x + 1 < width; ++x)
+    {
+        // the normal is computed for all cells and replaced if a neighbour has no value,
+        // which avoids a data dependent branch in the loop
+        const bool valid = row[x - 1] != ELEVATION_DEFAULT && row[x + 1] != ELEVATION_DEFAULT
+                           && bottom[x] != ELEVATION_DEFAULT && top[x] != ELEVATION_DEFAULT;
+        const Eigen::Vector3f normal = normalFromNeighbours(row[x - 1], row[x + 1], bottom[x], top[x], slope_scale);
+        normals[x] = valid ? normal : invalid;
+    }
+}
+
+ElevationMap::NormalMap ElevationMap::createNormalMap() const
+{
+    return NormalMap(*this, VectorGrid<Eigen::Vector3f>(getNumCells(), Eigen::Vector3f::Constant(NAN)));
+}
+
 }}
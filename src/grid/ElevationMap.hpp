@@ -2,6 +2,9 @@
 #define __MAPS_ELEVATION_MAP_HPP__
 
 #include "GridMap.hpp"
+#include "MinMaxPyramid.hpp"
+
+#include <cmath>
 
 namespace maps { namespace grid
 {
@@ -13,6 +16,7 @@ namespace maps { namespace grid
     {
     public:
         typedef boost::shared_ptr<float> Ptr;
+        typedef GridMap<Eigen::Vector3f> NormalMap;
         static const float  ELEVATION_DEFAULT;
     public:
         ElevationMap();
@@ -23,6 +27,15 @@ namespace maps { namespace grid
 
         ~ElevationMap();
 
+        /** @brief returns true if elevation is a value, i.e. neither ELEVATION_DEFAULT nor NaN
+         *
+         * Cells without value are skipped by getElevationRange and calculateCellExtents.
+         */
+        static bool hasElevation(float elevation)
+        {
+            return elevation != ELEVATION_DEFAULT && !std::isnan(elevation);
+        }
+
         Vector3d getNormal(const Index& pos) const;
 
         /** @brief get the normal vector at the given position
@@ -35,10 +48,157 @@ namespace maps { namespace grid
         * the center of the cell, and a surface is approximated
         * using the getNormal. The Height value is the value of the
         * plane at that point.
+        * Reads the cached normal if the normal cache is enabled.
         */
         float getMeanElevation(const Vector3d& pos) const;
 
+        /** @brief computes the normals of all cells in one pass
+         *
+         * Uses the same central differences as getNormal(Index). Cells at the
+         * border of the grid and cells with a neighbour without value
+         * (ELEVATION_DEFAULT) get a NaN normal, which is also the default value
+         * of the returned map. The rows are processed in parallel.
+         * @param num_threads number of threads to use, 0 uses all hardware threads
+         */
+        NormalMap computeNormals(unsigned num_threads = 0) const;
+
+        /** @brief computes the slope of all cells in one pass
+         *
+         * The slope is the angle in radians between the normal and the z-axis.
+         * Cells without normal are set to ELEVATION_DEFAULT, which is also the
+         * default value of the returned map.
+         * @param num_threads number of threads to use, 0 uses all hardware threads
+         */
+        GridMapF computeSlopeMap(unsigned num_threads = 0) const;
+
+        /** @brief computes the normals of all cells and keeps them for getMeanElevation
+         *
+         * Cells written with setElevation keep the cache up to date. Like for the height
+         * pyramid, other modifications are detected with the modification tracking of
+         * the grid: getMeanElevation computes the normals next to modified rows until
+         * they are updated by the next setElevation or updateCaches call.
+         * The cache isn't serialized.
+         */
+        void enableNormalCache(unsigned num_threads = 0);
+
+        void disableNormalCache();
+
+        bool hasNormalCache() const;
+
+        const NormalMap& getNormalCache() const;
+
+        /** @brief recomputes the cached normals of the cell at idx and its neighbours, if the cache is enabled
+         *
+         * Also updates the rows modified through the grid interface, see updateCaches.
+         */
+        void updateNormalCache(const Index& idx);
+
+        /** @brief get the minimum and maximum elevation of all cells with value
+         *
+         * This is O(1) if the height pyramid is enabled, otherwise all cells are visited.
+         */
         std::pair<float, float> getElevationRange() const;   
+
+        /** @brief get the minimum and maximum elevation of the cells in [min_idx, max_idx)
+         *
+         * Uses the height pyramid if it is enabled.
+         */
+        std::pair<float, float> getElevationRange(const Index& min_idx, const Index& max_idx) const;
+
+        /** @brief get the extents of the cells which don't have the default value, see GridMap::calculateCellExtents
+         *
+         * Uses the height pyramid if it is enabled and up to date and the default value is
+         * ELEVATION_DEFAULT. The pyramid treats NaN cells as empty, so in this case they
+         * are skipped like in getElevationRange.
+         * @param num_threads number of threads to use without pyramid, 0 uses all hardware threads
+         */
+        CellExtents calculateCellExtents(unsigned num_threads = 0) const;
+
+        /** @brief sets the elevation of a cell and updates the height pyramid and the normal cache
+         */
+        void setElevation(const Index& idx, float elevation);
+
+        /** @brief enables the min/max height pyramid, see MinMaxPyramid
+         *
+         * The pyramid is built from the current cells. Cells written with setElevation
+         * keep it up to date. Other modifications are detected with the modification
+         * tracking of the grid (see VectorGrid::setModificationTracking), also if they are
+         * made through a GridMapF reference: the queries fall back to visiting the cells
+         * until the modified rows are updated by the next setElevation or updateCaches
+         * call. Cells without value (see hasElevation) are treated as empty.
+         * The pyramid isn't serialized.
+         */
+        void enableHeightPyramid();
+
+        void disableHeightPyramid();
+
+        bool hasHeightPyramid() const;
+
+        const MinMaxPyramid& getHeightPyramid() const;
+
+        /** @brief updates the height pyramid after the cell at idx was modified, if the pyramid is enabled
+         *
+         * Also updates the rows modified through the grid interface, see updateCaches.
+         */
+        void updateHeightPyramid(const Index& idx);
+
+        /** @brief updates the height pyramid and the normal cache for the rows modified through the grid interface
+         *
+         * Only the modified rows are visited, unless all rows were modified or the grid was resized.
+         * Both caches share the modification tracking of the grid, so they are updated together.
+         */
+        void updateCaches();
+
+    private:
+        MinMaxPyramid::Range getCellRange(const Index& idx) const;
+
+        /** Builds the height pyramid from all cells */
+        void rebuildHeightPyramid();
+
+        /** Enables the modification tracking if a cache is enabled, otherwise disables it */
+        void updateModificationTracking();
+
+        /** Returns true if the normal cache is enabled and the normal of idx doesn't depend on modified rows */
+        bool useNormalCache(const Index& idx) const;
+
+        /** Returns true if the height pyramid is enabled and no rows were modified since its last update */
+        bool useHeightPyramid() const
+        {
+            return height_pyramid.isInitialized() && !hasModifiedRows() && height_pyramid.getNumCells() == getNumCells();
+        }
+
+        /** Throws if the normal of idx can't be computed because idx is at the border of the grid */
+        void checkNormalIndex(const Index& idx) const;
+
+        /** Normal of a cell which isn't at the border of the grid, NaN if a neighbour has no value */
+        Eigen::Vector3f computeNormal(size_t x, size_t y) const;
+
+        /** Factors converting the elevation differences of the neighbours to slopes */
+        Eigen::Vector2f getSlopeScale() const;
+
+        /**
+         * Central difference normal from the elevations of the four neighbours.
+         * This is the only place the normal is computed, so getNormal, computeNormals
+         * and the normal cache return the same values.
+         */
+        static Eigen::Vector3f normalFromNeighbours(float left, float right, float bottom, float top, const Eigen::Vector2f& slope_scale)
+        {
+            const float slope_x = (left - right) * slope_scale.x();
+            const float slope_y = (bottom - top) * slope_scale.y();
+            const float inv_norm = 1.f / std::sqrt(slope_x * slope_x + slope_y * slope_y + 1.f);
+            return Eigen::Vector3f(slope_x * inv_norm, slope_y * inv_norm, inv_norm);
+        }
+
+        /** Computes the normals of row y, normals has to hold getNumCells().x() elements */
+        void computeNormalRow(size_t y, Eigen::Vector3f* normals) const;
+
+        NormalMap createNormalMap() const;
+
+        /** Optional min/max elevations of the cells */
+        MinMaxPyramid height_pyramid;
+
+        /** Optional cached normals of the cells, empty if disabled */
+        NormalMap normal_cache;
     };
 }}
 
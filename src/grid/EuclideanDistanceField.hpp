@@ -0,0 +1,348 @@
+#pragma once
+
+#include "VoxelGridMap.hpp"
+
+#include <base/Eigen.hpp>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace maps { namespace grid
+{
+
+/**
+ * @brief Euclidean distance field which is updated incrementally.
+ * @details
+ * Stores for each voxel of a dense block the distance to the closest occupied
+ * voxel, up to a maximum distance. The block covers all cells of a VoxelGridMap
+ * in x and y and the range [z_min_idx, z_max_idx) of voxel indices in z.
+ *
+ * Occupied voxels are inserted and removed with setOccupied, update() then
+ * repairs the distances. Removed obstacles invalidate the voxels they were
+ * closest to in a raise wavefront, afterwards the distances are propagated
+ * from the new obstacles and the border of the invalidated region in a lower
+ * wavefront ordered by distance (dynamic brushfire). Each voxel remembers its
+ * closest obstacle, so the propagated distances are Euclidean, the error of the
+ * 26-neighbour propagation is a small fraction of the voxel size.
+ *
+ * The distances are unsigned, occupied voxels have a distance of 0 and voxels
+ * further away than the maximum distance have the maximum distance.
+ * Positions are mapped to voxels in the same way as in VoxelGridMap::toVoxelGrid.
+ */
+class EuclideanDistanceField
+{
+public:
+    /**
+     * @param num_cells number of cells in x and y
+     * @param resolution voxel resolution
+     * @param z_min_idx first voxel index in z
+     * @param z_max_idx voxel index in z after the last one
+     * @param max_distance distance up to which the field is computed
+     */
+    EuclideanDistanceField(const Vector2ui& num_cells, const Eigen::Vector3d& resolution,
+                           int32_t z_min_idx, int32_t z_max_idx, float max_distance,
+                           const base::Transform3d& local_frame = base::Transform3d::Identity())
+        : num_cells(num_cells), resolution(resolution), local_frame(local_frame),
+          z_min_idx(z_min_idx), z_max_idx(std::max(z_min_idx, z_max_idx)), max_distance(max_distance)
+    {
+        voxels.resize(static_cast<size_t>(num_cells.x()) * num_cells.y() * (this->z_max_idx - z_min_idx));
+        for(Voxel& voxel : voxels)
+            voxel.distance = max_distance;
+    }
+
+    /**
+     * Creates a field covering the given map from height z_min to z_max.
+     * Voxels which are already occupied in the map have to be inserted with setOccupied.
+     */
+    template<class CellT>
+    EuclideanDistanceField(const VoxelGridMap<CellT>& map, float z_min, float z_max, float max_distance)
+        : EuclideanDistanceField(map.getNumCells(), map.getVoxelResolution(),
+                                 std::floor(z_min / map.getVoxelResolution().z()),
+                                 std::ceil(z_max / map.getVoxelResolution().z()),
+                                 max_distance, map.getLocalFrame())
+    {
+    }
+
+    const Vector2ui& getNumCells() const { return num_cells; }
+    const Eigen::Vector3d& getResolution() const { return resolution; }
+    const base::Transform3d& getLocalFrame() const { return local_frame; }
+    int32_t getZMinIndex() const { return z_min_idx; }
+    int32_t getZMaxIndex() const { return z_max_idx; }
+    float getMaxDistance() const { return max_distance; }
+
+    bool inField(const Eigen::Vector3i& idx) const
+    {
+        return idx.x() >= 0 && idx.x() < (int)num_cells.x() && idx.y() >= 0 && idx.y() < (int)num_cells.y()
+               && idx.z() >= z_min_idx && idx.z() < z_max_idx;
+    }
+
+    /**
+     * Inserts or removes an obstacle, the distances are updated by the next call of update().
+     * @return false if the voxel is outside of the field
+     */
+    bool setOccupied(const Eigen::Vector3i& idx, bool occupied)
+    {
+        if(!inField(idx))
+            return false;
+
+        const int32_t i = toLinearIndex(idx);
+        Voxel& voxel = voxels[i];
+        if(voxel.occupied == occupied)
+            return true;
+
+        voxel.occupied = occupied;
+        if(occupied)
+        {
+            voxel.distance = 0.f;
+            voxel.obstacle = i;
+            lower_queue.push(QueueEntry(0.f, i));
+        }
+        else
+        {
+            voxel.distance = max_distance;
+            voxel.obstacle = -1;
+            raise_queue.push_back(i);
+        }
+        return true;
+    }
+
+    bool isOccupied(const Eigen::Vector3i& idx) const
+    {
+        return inField(idx) && voxels[toLinearIndex(idx)].occupied;
+    }
+
+    /** Returns true if setOccupied was called since the last update */
+    bool hasPendingChanges() const
+    {
+        return !raise_queue.empty() || !lower_queue.empty();
+    }
+
+    /**
+     * Applies the obstacle changes recorded by the map and clears them afterwards.
+     * Change tracking has to be enabled on the map, see VoxelGridMap::setChangeTracking.
+     */
+    template<class CellT>
+    void integrateChanges(VoxelGridMap<CellT>& map)
+    {
+        for(const VoxelChange& change : map.getChangedVoxels())
+            setOccupied(change.idx, change.occupied);
+        map.clearChangedVoxels();
+        update();
+    }
+
+    /** Propagates the obstacle changes since the last update */
+    void update()
+    {
+        // raise: invalidate all voxels whose closest obstacle was removed,
+        // the valid voxels at the border of this region seed the lower wavefront
+        for(size_t q = 0; q < raise_queue.size(); ++q)
+        {
+            const Eigen::Vector3i idx = fromLinearIndex(raise_queue[q]);
+            forEachNeighbour(idx, [this](int32_t n)
+            {
+                Voxel& neighbour = voxels[n];
+                if(neighbour.obstacle < 0)
+                    return;
+                if(voxels[neighbour.obstacle].occupied)
+                {
+                    lower_queue.push(QueueEntry(neighbour.distance, n));
+                }
+                else
+                {
+                    neighbour.distance = max_distance;
+                    neighbour.obstacle = -1;
+                    raise_queue.push_back(n);
+                }
+            });
+        }
+        raise_queue.clear();
+
+        // lower: propagate the closest obstacles in the order of increasing distance
+        while(!lower_queue.empty())
+        {
+            const QueueEntry entry = lower_queue.top();
+            lower_queue.pop();
+            const Voxel& voxel = voxels[entry.second];
+            // skip outdated entries
+            if(voxel.obstacle < 0 || entry.first > voxel.distance)
+                continue;
+
+            const int32_t obstacle = voxel.obstacle;
+            const Eigen::Vector3i obstacle_idx = fromLinearIndex(obstacle);
+            forEachNeighbour(fromLinearIndex(entry.second), [&](int32_t n)
+            {
+                Voxel& neighbour = voxels[n];
+                if(neighbour.occupied || neighbour.obstacle == obstacle)
+                    return;
+                const float distance = computeDistance(fromLinearIndex(n), obstacle_idx);
+                if(distance < neighbour.distance)
+                {
+                    neighbour.distance = distance;
+                    neighbour.obstacle = obstacle;
+                    lower_queue.push(QueueEntry(distance, n));
+                }
+            });
+        }
+    }
+
+    /** Distance of the voxel to the closest obstacle, the maximum distance outside of the field */
+    float getDistance(const Eigen::Vector3i& idx) const
+    {
+        if(!inField(idx))
+            return max_distance;
+        return voxels[toLinearIndex(idx)].distance;
+    }
+
+    /**
+     * Distance of the voxel containing the position to the closest obstacle.
+     * @return false if the position is outside of the field
+     */
+    bool getDistance(const Eigen::Vector3d& position, float& distance) const
+    {
+        Eigen::Vector3i idx;
+        if(!toVoxel(position, idx))
+            return false;
+        distance = voxels[toLinearIndex(idx)].distance;
+        return true;
+    }
+
+    /**
+     * Closest obstacle of a voxel.
+     * @return false if there is no obstacle within the maximum distance
+     */
+    bool getClosestObstacle(const Eigen::Vector3i& idx, Eigen::Vector3i& obstacle_idx) const
+    {
+        if(!inField(idx))
+            return false;
+        const int32_t obstacle = voxels[toLinearIndex(idx)].obstacle;
+        if(obstacle < 0)
+            return false;
+        obstacle_idx = fromLinearIndex(obstacle);
+        return true;
+    }
+
+    /**
+     * Trilinear interpolation of the distances of the eight voxel centers around the position.
+     * @param gradient if not NULL receives the gradient of the interpolated distance
+     * @return false if one of the eight voxels is outside of the field
+     */
+    bool getInterpolatedDistance(const Eigen::Vector3d& position, float& distance, Eigen::Vector3d* gradient = NULL) const
+    {
+        Eigen::Vector3d pos_in_grid;
+        pos_in_grid << Eigen::Vector3d(local_frame * position).head<2>(), position.z();
+        const Eigen::Vector3d continuous_idx = pos_in_grid.cwiseQuotient(resolution) - Eigen::Vector3d::Constant(0.5);
+        const Eigen::Vector3i base_idx(std::floor(continuous_idx.x()), std::floor(continuous_idx.y()), std::floor(continuous_idx.z()));
+        if(!inField(base_idx) || !inField(base_idx + Eigen::Vector3i::Ones()))
+            return false;
+
+        const Eigen::Vector3d t = continuous_idx - base_idx.cast<double>();
+        double d[2][2][2];
+        for(int z = 0; z < 2; ++z)
+            for(int y = 0; y < 2; ++y)
+                for(int x = 0; x < 2; ++x)
+                    d[z][y][x] = voxels[toLinearIndex(base_idx + Eigen::Vector3i(x, y, z))].distance;
+
+        const double d00 = d[0][0][0] + t.x() * (d[0][0][1] - d[0][0][0]);
+        const double d01 = d[0][1][0] + t.x() * (d[0][1][1] - d[0][1][0]);
+        const double d10 = d[1][0][0] + t.x() * (d[1][0][1] - d[1][0][0]);
+        const double d11 = d[1][1][0] + t.x() * (d[1][1][1] - d[1][1][0]);
+        const double d0 = d00 + t.y() * (d01 - d00);
+        const double d1 = d10 + t.y() * (d11 - d10);
+        distance = d0 + t.z() * (d1 - d0);
+
+        if(gradient)
+        {
+            Eigen::Vector3d grid_gradient;
+            const double dx0 = (1. - t.y()) * (d[0][0][1] - d[0][0][0]) + t.y() * (d[0][1][1] - d[0][1][0]);
+            const double dx1 = (1. - t.y()) * (d[1][0][1] - d[1][0][0]) + t.y() * (d[1][1][1] - d[1][1][0]);
+            grid_gradient.x() = (1. - t.z()) * dx0 + t.z() * dx1;
+            grid_gradient.y() = (1. - t.z()) * (d01 - d00) + t.z() * (d11 - d10);
+            grid_gradient.z() = d1 - d0;
+            grid_gradient = grid_gradient.cwiseQuotient(resolution);
+
+            // the local frame only transforms x and y
+            gradient->head<2>() = local_frame.linear().topRows<2>().leftCols<2>().transpose() * grid_gradient.head<2>();
+            gradient->z() = local_frame.linear().topRows<2>().col(2).dot(grid_gradient.head<2>()) + grid_gradient.z();
+        }
+        return true;
+    }
+
+    /** Voxel containing the position, returns false if it is outside of the field */
+    bool toVoxel(const Eigen::Vector3d& position, Eigen::Vector3i& idx) const
+    {
+        const Eigen::Vector2d pos_in_grid = Eigen::Vector3d(local_frame * position).head<2>();
+        idx << std::floor(pos_in_grid.x() / resolution.x()),
+               std::floor(pos_in_grid.y() / resolution.y()),
+               std::floor(position.z() / resolution.z());
+        return inField(idx);
+    }
+
+protected:
+    struct Voxel
+    {
+        Voxel() : distance(0.f), obstacle(-1), occupied(false) {}
+
+        float distance;
+        /** linear index of the closest obstacle, -1 if there is none within the maximum distance */
+        int32_t obstacle;
+        bool occupied;
+    };
+
+    typedef std::pair<float, int32_t> QueueEntry;
+
+    int32_t toLinearIndex(const Eigen::Vector3i& idx) const
+    {
+        return idx.x() + num_cells.x() * (idx.y() + num_cells.y() * (idx.z() - z_min_idx));
+    }
+
+    Eigen::Vector3i fromLinearIndex(int32_t i) const
+    {
+        const int32_t layer = num_cells.x() * num_cells.y();
+        return Eigen::Vector3i(i % num_cells.x(), (i % layer) / num_cells.x(), i / layer + z_min_idx);
+    }
+
+    float computeDistance(const Eigen::Vector3i& a, const Eigen::Vector3i& b) const
+    {
+        return (a - b).cast<double>().cwiseProduct(resolution).norm();
+    }
+
+    /** Calls f with the linear index of each of the up to 26 neighbours within the field */
+    template<class F>
+    void forEachNeighbour(const Eigen::Vector3i& idx, F f) const
+    {
+        for(int dz = -1; dz <= 1; ++dz)
+            for(int dy = -1; dy <= 1; ++dy)
+                for(int dx = -1; dx <= 1; ++dx)
+                {
+                    const Eigen::Vector3i neighbour = idx + Eigen::Vector3i(dx, dy, dz);
+                    if((dx != 0 || dy != 0 || dz != 0) && inField(neighbour))
+                        f(toLinearIndex(neighbour));
+                }
+    }
+
+    Vector2ui num_cells;
+    Eigen::Vector3d resolution;
+    base::Transform3d local_frame;
+    int32_t z_min_idx;
+    int32_t z_max_idx;
+    float max_distance;
+
+    std::vector<Voxel> voxels;
+
+    /** removed obstacles and the voxels invalidated by them */
+    std::vector<int32_t> raise_queue;
+
+    /** voxels to propagate from, ordered by distance */
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry> > lower_queue;
+};
+
+}}
@@ -3,6 +3,8 @@
 /** std **/
 #include <iostream>
 #include <type_traits>
+#include <limits>
+#include <vector>
 
 /** Boost **/
 #include <boost/shared_ptr.hpp>
@@ -12,6 +14,7 @@
 
 #include <maps/LocalMap.hpp>
 #include <maps/grid/VectorGrid.hpp>
+#include "../tools/ParallelFor.hpp"
 
 namespace maps { namespace grid
 {
@@ -327,139 +330,366 @@ namespace maps { namespace grid
 
         using GridT::at;
 
+        /** Return type of getMax and getMin, a value for GridMap<bool> and a reference otherwise */
+        template<class Q>
+        using ExtremeCell = typename std::conditional<std::is_same<Q, bool>::value, Q, const Q&>::type;
+
         /**
-         * @brief [brief description]
+         * @brief returns the largest cell value
          * @details enable this function only for arithmetic types (integral and floating types)
          * hide this function e.g. for class types
          *
-         * It also has the possibility to exclude the default_value
+         * It also has the possibility to exclude the default_value.
+         * The grid is reduced in parallel blocks, see reduceCells.
          *
-         * @return [description]
+         * @return the first cell with the largest value, or the first cell
+         * if the default value is excluded and all cells are default.
+         * For GridMap<bool> the value is returned, the cells of a std::vector<bool> aren't addressable.
          */
         template<class Q = CellT>
-        const typename std::enable_if<std::is_arithmetic<Q>::value, Q>::type&
-        getMax(const bool include_default_value = true) const
+        typename std::enable_if<std::is_arithmetic<Q>::value, ExtremeCell<Q> >::type
+        getMax(const bool include_default_value = true, unsigned num_threads = 0) const
         {
-            Vector2ui num_cells(getNumCells());
-
-            std::cout << "Num Cells is " << num_cells.transpose() << std::endl;
-            if(num_cells == Vector2ui(0,0))
-                throw std::runtime_error("Tried to compute max on empty map");
-
-            auto it = this->begin();
-            auto endIt = this->end();
+            return findExtremeCell<Q>(include_default_value, [](const Q& current, const Q& value) { return current < value ? value : current; },
+                                      num_threads, HasCellData());
+        }
 
-            const Q *first = &(*it);
-//            const Q *last = &(*(this->end()));
+        /**
+         * @brief returns the smallest cell value
+         * @details enable this function only for arithmetic types (integral and floating types)
+         * hide this function e.g. for class types
+         *
+         * It also has the possibility to exclude the default_value.
+         * The grid is reduced in parallel blocks, see reduceCells.
+         *
+         * @return the first cell with the smallest value, or the first cell
+         * if the default value is excluded and all cells are default.
+         * For GridMap<bool> the value is returned, see getMax.
+         */
+        template<class Q = CellT>
+        typename std::enable_if<std::is_arithmetic<Q>::value, ExtremeCell<Q> >::type
+        getMin(const bool include_default_value = true, unsigned num_threads = 0) const
+        {
+            return findExtremeCell<Q>(include_default_value, [](const Q& current, const Q& value) { return value < current ? value : current; },
+                                      num_threads, HasCellData());
+        }
 
+        /**
+         * @brief computes minimum, maximum and extents of the non default cells in one pass
+         * @details enable this function only for arithmetic types (integral and floating types).
+         * The rows are split into blocks which are processed in parallel.
+         *
+         * @return false if all cells have the default value
+         */
+        template<class Q = CellT>
+        typename std::enable_if<std::is_arithmetic<Q>::value, bool>::type
+        calculateValueRange(Q& min, Q& max, CellExtents& extents, unsigned num_threads = 0) const
+        {
+            RowStatistics<Q> statistics = reduceRows<Q>(true, num_threads, HasCellData());
+            extents = statistics.extents;
+            if(!statistics.has_value)
+                return false;
+            min = statistics.min;
+            max = statistics.max;
+            return true;
+        }
 
-            /** Include the default value as a possible max value to return **/
-            if (include_default_value)
+        bool isDefault(const CellT &value) const
+        {
+            if (boost::math::isnan(this->getDefaultValue()))
             {
-                return *std::max_element(this->begin(), this->end());
+                return boost::math::isnan(value);
             }
             else
             {
-                const Q *largest = first;
+                return value == this->getDefaultValue();
+            }
+        }
 
-                while (it != endIt)
-                {
-                    const Q *curElem = &(*it);
+        void extend(const Vector2ui &minSize)
+        {
+            Vector2ui newSize = minSize.cwiseMax(getNumCells());
+            this->resize(newSize);
+        }
 
-                    if(!this->isDefault(*largest))
-                    {
-                        if ((*largest < *curElem)&&(!this->isDefault(*curElem)))
-                        {
-                            largest = curElem;
-                        }
-                    }
-                    else
-                    {
-                        if (!this->isDefault(*curElem))
-                            largest = curElem;
-                    }
-                    it++;
-                }
-                return *largest;
+        /**
+         * @brief computes the extents of the cells which don't have the default value
+         * @details for arithmetic cell types stored contiguously the rows are scanned from both
+         * ends in parallel, otherwise the borders of the grid are moved inwards until a cell
+         * with value is found.
+         */
+        CellExtents calculateCellExtents(unsigned num_threads = 0) const
+        {
+            return calculateCellExtents(HasCellData(), num_threads);
+        }
+
+    protected:
+        /** Grants access to boost serialization */
+        friend class boost::serialization::access;
+
+        /** Serializes the members of this class*/
+        template <typename Archive>
+        void serialize(Archive &ar, const unsigned int version)
+        {
+            ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(::maps::LocalMap);
+            ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(GridT);
+            ar & BOOST_SERIALIZATION_NVP(resolution);
+        }
+
+    private:
+        /**
+         * True if the cells are arithmetic and stored contiguously, which the parallel
+         * reductions require. std::vector<bool> packs its cells into bits.
+         */
+        typedef std::integral_constant<bool, std::is_arithmetic<CellT>::value && !std::is_same<CellT, bool>::value
+                                             && std::is_same<GridT, VectorGrid<CellT> >::value> HasCellData;
+
+        /** Minimum, maximum and extents of the non default cells of a block of rows */
+        template<class Q>
+        struct RowStatistics
+        {
+            CellExtents extents;
+            Q min;
+            Q max;
+            bool has_value;
+
+            RowStatistics() : has_value(false) {}
+
+            void merge(const RowStatistics& other)
+            {
+                if(!other.has_value)
+                    return;
+                extents.extend(other.extents);
+                min = has_value ? std::min(min, other.min) : other.min;
+                max = has_value ? std::max(max, other.max) : other.max;
+                has_value = true;
             }
+        };
+
+        /** Pointer to the first cell, the cells have to be stored contiguously in rows */
+        const CellT* getCellData() const
+        {
+            static_assert(std::is_same<GridT, VectorGrid<CellT> >::value, "The reductions require a VectorGrid storage");
+            return this->getRow(0).data;
+        }
+
+        /** Number of blocks a reduction over \c num_elements is split into */
+        static size_t getNumBlocks(size_t num_elements, unsigned num_threads)
+        {
+            // small grids are not worth the thread overhead
+            const size_t min_block_size = 1 << 16;
+            return std::max<size_t>(1, std::min<size_t>(tools::getNumThreads(num_threads), num_elements / min_block_size));
         }
 
         /**
-         * @brief [brief description]
-         * @details enable this function only for arithmetic types (integral and floating types)
-         * hide this function e.g. for class types
-         *
-         * It also has the possibility to exclude the default_value
-         *
-         * @return [description]
+         * Reduces all cells with op(current, value), starting with \c init.
+         * Each block is reduced in a tight loop over contiguous memory which the compiler
+         * can vectorize, the block results are reduced in order.
+         * \c op has to be associative and must return one of its arguments.
          */
-        template<class Q = CellT>
-        const typename std::enable_if<std::is_arithmetic<Q>::value, Q>::type&
-        getMin(const bool include_default_value = true) const
+        template<class Q, class Op>
+        Q reduceCells(const Q& init, const Op& op, unsigned num_threads) const
         {
-            Vector2ui num_cells(getNumCells());
+            const Q* data = getCellData();
+            const size_t num_elements = getNumElements();
+            const size_t num_blocks = getNumBlocks(num_elements, num_threads);
+            const size_t block_size = (num_elements + num_blocks - 1) / num_blocks;
 
-            std::cout << "Num Cells is " << num_cells.transpose() << std::endl;
-            if(num_cells == Vector2ui(0,0))
-                throw std::runtime_error("Tried to compute max on empty map");
+            std::vector<Q> results(num_blocks, init);
+            tools::parallelFor(0, num_blocks, [&](size_t begin, size_t end)
+            {
+                for(size_t block = begin; block < end; ++block)
+                {
+                    Q result = init;
+                    const size_t block_end = std::min(num_elements, (block + 1) * block_size);
+                    for(size_t i = block * block_size; i < block_end; ++i)
+                        result = op(result, data[i]);
+                    results[block] = result;
+                }
+            }, num_blocks);
 
-            auto it = this->begin();
-            auto endIt = this->end();
+            Q result = init;
+            for(const Q& block_result : results)
+                result = op(result, block_result);
+            return result;
+        }
 
-            const Q *first = &(*it);
-//            const Q *last = &(*(this->end()));
+        /**
+         * Returns the first cell equal to the reduction of all cells with op,
+         * optionally ignoring default cells. This has the same semantics as
+         * std::max_element / std::min_element with op comparing by operator<.
+         */
+        template<class Q, class Op>
+        const Q& findExtremeCell(bool include_default_value, const Op& op, unsigned num_threads, std::true_type) const
+        {
+            if(getNumCells().prod() == 0)
+                throw std::runtime_error("Tried to compute max on empty map");
 
+            const Q* data = getCellData();
+            const size_t num_elements = getNumElements();
+            const Q default_value = this->getDefaultValue();
+            const bool default_is_nan = boost::math::isnan(default_value);
 
-            /** Include the default value as a possible max value to return **/
-            if (include_default_value)
+            size_t first = 0;
+            Q result;
+            if(include_default_value)
             {
-                return *std::min_element(this->begin(), this->end());
+                result = reduceCells<Q>(data[0], op, num_threads);
             }
             else
             {
-                const Q *smallest = first;
+                // the reduction starts with the first non default cell
+                while(first < num_elements && (default_is_nan ? boost::math::isnan(data[first]) : data[first] == default_value))
+                    ++first;
+                if(first == num_elements)
+                    return data[0];
+
+                const Q init = data[first];
+                if(default_is_nan)
+                    result = reduceCells<Q>(init, [&op](const Q& current, const Q& value) { return value != value ? current : op(current, value); }, num_threads);
+                else
+                    result = reduceCells<Q>(init, [&op, default_value](const Q& current, const Q& value) { return value == default_value ? current : op(current, value); }, num_threads);
+            }
+
+            // a NaN result can only stem from the first cell of the reduction
+            if(result != result)
+                return data[first];
+            for(size_t i = first; i < num_elements; ++i)
+            {
+                if(data[i] == result)
+                    return data[i];
+            }
+            return data[first];
+        }
 
-                while (it != endIt)
+        /**
+         * Computes the extents of the non default cells and optionally their minimum and maximum.
+         * Each row is scanned from both ends for the first and last cell with value,
+         * the values in between are only visited if \c with_values is set.
+         */
+        template<class Q>
+        RowStatistics<Q> reduceRows(bool with_values, unsigned num_threads, std::true_type) const
+        {
+            const Vector2ui num_cells = getNumCells();
+            RowStatistics<Q> statistics;
+            if(num_cells.prod() == 0)
+                return statistics;
+
+            const Q* data = getCellData();
+            const Q default_value = this->getDefaultValue();
+            const bool default_is_nan = boost::math::isnan(default_value);
+            const size_t num_blocks = std::min<size_t>(getNumBlocks(num_cells.prod(), num_threads), num_cells.y());
+            const size_t block_size = (num_cells.y() + num_blocks - 1) / num_blocks;
+
+            std::vector<RowStatistics<Q> > results(num_blocks);
+            tools::parallelFor(0, num_blocks, [&](size_t begin, size_t end)
+            {
+                for(size_t block = begin; block < end; ++block)
                 {
-                    const Q *curElem = &(*it);
-
-                    if(!this->isDefault(*smallest))
+                    RowStatistics<Q>& result = results[block];
+                    const size_t row_end = std::min<size_t>(num_cells.y(), (block + 1) * block_size);
+                    for(size_t y = block * block_size; y < row_end; ++y)
                     {
-                        if ((*curElem < *smallest) &&(!this->isDefault(*curElem)))
-                        {
-                            smallest = curElem;
-                        }
+                        const Q* row = data + y * num_cells.x();
+                        if(default_is_nan)
+                            reduceRow<Q>(row, num_cells.x(), y, with_values, [](const Q& value) { return value != value; }, result);
+                        else
+                            reduceRow<Q>(row, num_cells.x(), y, with_values, [default_value](const Q& value) { return value == default_value; }, result);
                     }
-                    else
-                    {
-                        if (!this->isDefault(*curElem))
-                            smallest = curElem;
-                    }
-                    it++;
                 }
-                return *smallest;
+            }, num_blocks);
+
+            for(const RowStatistics<Q>& result : results)
+                statistics.merge(result);
+            return statistics;
+        }
+
+        template<class Q, class IsDefault>
+        static void reduceRow(const Q* row, size_t size, size_t y, bool with_values, const IsDefault& is_default, RowStatistics<Q>& result)
+        {
+            size_t first = 0;
+            while(first < size && is_default(row[first]))
+                ++first;
+            if(first == size)
+                return;
+            size_t last = size - 1;
+            while(is_default(row[last]))
+                --last;
+
+            result.extents.extend(Vector2ui(first, y));
+            result.extents.extend(Vector2ui(last, y));
+            if(!with_values)
+            {
+                result.has_value = true;
+                return;
+            }
+
+            Q min = result.has_value ? result.min : row[first];
+            Q max = result.has_value ? result.max : row[first];
+            for(size_t x = first; x <= last; ++x)
+            {
+                const Q value = row[x];
+                const bool valid = !is_default(value);
+                min = (valid && value < min) ? value : min;
+                max = (valid && max < value) ? value : max;
             }
+            result.min = min;
+            result.max = max;
+            result.has_value = true;
         }
 
-        bool isDefault(const CellT &value) const
+        /** Serial variant of findExtremeCell for cells without contiguous storage */
+        template<class Q, class Op>
+        Q findExtremeCell(bool include_default_value, const Op& op, unsigned, std::false_type) const
         {
-            if (boost::math::isnan(this->getDefaultValue()))
+            if(getNumCells().prod() == 0)
+                throw std::runtime_error("Tried to compute max on empty map");
+
+            Q result = *this->begin();
+            bool has_result = false;
+            for(auto it = this->begin(); it != this->end(); ++it)
             {
-                return boost::math::isnan(value);
+                const Q value = *it;
+                if(!include_default_value && isDefault(value))
+                    continue;
+                result = has_result ? op(result, value) : value;
+                has_result = true;
             }
-            else
+            return result;
+        }
+
+        /** Serial variant of reduceRows for cells without contiguous storage */
+        template<class Q>
+        RowStatistics<Q> reduceRows(bool with_values, unsigned, std::false_type) const
+        {
+            RowStatistics<Q> statistics;
+            statistics.extents = calculateCellExtents(std::false_type(), 0);
+            if(statistics.extents.isEmpty())
+                return statistics;
+            if(!with_values)
             {
-                return value == this->getDefaultValue();
+                statistics.has_value = true;
+                return statistics;
+            }
+
+            for(auto it = this->begin(); it != this->end(); ++it)
+            {
+                const Q value = *it;
+                if(isDefault(value))
+                    continue;
+                statistics.min = statistics.has_value ? std::min(statistics.min, value) : value;
+                statistics.max = statistics.has_value ? std::max(statistics.max, value) : value;
+                statistics.has_value = true;
             }
+            return statistics;
         }
 
-        void extend(const Vector2ui &minSize)
+        CellExtents calculateCellExtents(std::true_type, unsigned num_threads) const
         {
-            Vector2ui newSize = minSize.cwiseMax(getNumCells());
-            this->resize(newSize);
+            return reduceRows<CellT>(false, num_threads, std::true_type()).extents;
         }
 
-        CellExtents calculateCellExtents() const
+        CellExtents calculateCellExtents(std::false_type, unsigned) const
         {
             Vector2ui num_cells = getNumCells();
 
@@ -535,26 +765,13 @@ namespace maps { namespace grid
             return cell_extents;
         }
 
-    protected:
-        /** Grants access to boost serialization */
-        friend class boost::serialization::access;
 
-        /** Serializes the members of this class*/
-        template <typename Archive>
-        void serialize(Archive &ar, const unsigned int version)
-        {
-            ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(::maps::LocalMap);
-            ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(GridT);
-            ar & BOOST_SERIALIZATION_NVP(resolution);
-        }
-
-    private:
         bool addCellForX(CellExtents &cell_extents, unsigned int x, unsigned int y_start, unsigned int y_end) const
         {
             unsigned int y = y_start;
             while (y <= y_end)
             {
-                if (isDefault(at(x, y)) == false)
+                if (isDefault(this->atUnchecked(x, y)) == false)
                 {
                     cell_extents.extend(Vector2ui(x, y));                  
                     return true;
@@ -569,7 +786,7 @@ namespace maps { namespace grid
             unsigned int x = x_start;
             while (x <= x_end)
             {
-                if (isDefault(at(x, y)) == false)
+                if (isDefault(this->atUnchecked(x, y)) == false)
                 {
                     cell_extents.extend(Vector2ui(x, y));
                     return true;
@@ -0,0 +1,338 @@
+#include "IntervalOccupancyGridMap.hpp"
+#include <boost/format.hpp>
+#include <algorithm>
+#include <maps/tools/VoxelTraversal.hpp>
+
+using namespace maps::grid;
+using namespace maps::tools;
+
+namespace
+{
+
+OccupancyInterval::LogOddsType applyUpdate(OccupancyInterval::LogOddsType log_odds, OccupancyInterval::LogOddsType update,
+                                           OccupancyInterval::LogOddsType min, OccupancyInterval::LogOddsType max)
+{
+    // same arithmetic as QuantizedOccupancyPatch::updateEncodedLogOdds
+    int32_t new_log_odds = (int32_t)log_odds + (int32_t)update;
+    if(new_log_odds < min)
+        new_log_odds = min;
+    else if(new_log_odds > max)
+        new_log_odds = max;
+    return (OccupancyInterval::LogOddsType)new_log_odds;
+}
+
+/** Appends the interval, merging it with the last one if they are adjacent and equal */
+void append(std::vector<OccupancyInterval>& intervals, int32_t begin, int32_t end, OccupancyInterval::LogOddsType log_odds)
+{
+    if(begin >= end)
+        return;
+    if(!intervals.empty() && intervals.back().end == begin && intervals.back().log_odds == log_odds)
+        intervals.back().end = end;
+    else
+        intervals.push_back(OccupancyInterval(begin, end, log_odds));
+}
+
+bool beginsAfter(int32_t z_idx, const OccupancyInterval& interval)
+{
+    return z_idx < interval.begin;
+}
+
+bool endsBefore(const OccupancyInterval& interval, int32_t z_idx)
+{
+    return interval.end <= z_idx;
+}
+
+}
+
+const OccupancyInterval* OccupancyIntervalColumn::find(int32_t z_idx) const
+{
+    std::vector<OccupancyInterval>::const_iterator it = std::upper_bound(intervals.begin(), intervals.end(), z_idx, beginsAfter);
+    if(it == intervals.begin())
+        return NULL;
+    --it;
+    return z_idx < it->end ? &(*it) : NULL;
+}
+
+void OccupancyIntervalColumn::update(int32_t begin, int32_t end, LogOddsType update, LogOddsType min, LogOddsType max)
+{
+    if(begin >= end)
+        return;
+
+    // the affected intervals, including the adjacent ones which might be merged
+    std::vector<OccupancyInterval>::iterator first = std::lower_bound(intervals.begin(), intervals.end(), begin, endsBefore);
+    if(first != intervals.begin() && std::prev(first)->end == begin)
+        --first;
+    std::vector<OccupancyInterval>::iterator last = std::upper_bound(first, intervals.end(), end - 1, beginsAfter);
+    if(last != intervals.end() && last->begin == end)
+        ++last;
+
+    static thread_local std::vector<OccupancyInterval> replacement;
+    replacement.clear();
+    int32_t pos = begin;
+    for(std::vector<OccupancyInterval>::const_iterator it = first; it != last; ++it)
+    {
+        // unknown voxels in front of the interval
+        if(pos < std::min(it->begin, end))
+        {
+            append(replacement, pos, std::min(it->begin, end), applyUpdate(0, update, min, max));
+            pos = std::min(it->begin, end);
+        }
+        append(replacement, it->begin, std::min(it->end, begin), it->log_odds);
+        const int32_t overlap_begin = std::max(it->begin, begin);
+        const int32_t overlap_end = std::min(it->end, end);
+        if(overlap_begin < overlap_end)
+        {
+            append(replacement, overlap_begin, overlap_end, applyUpdate(it->log_odds, update, min, max));
+            pos = overlap_end;
+        }
+        append(replacement, std::max(it->begin, end), it->end, it->log_odds);
+    }
+    if(pos < end)
+        append(replacement, pos, end, applyUpdate(0, update, min, max));
+
+    // overwrite the affected intervals in place and insert or erase the difference
+    const size_t num_affected = last - first;
+    std::copy(replacement.begin(), replacement.begin() + std::min(num_affected, replacement.size()), first);
+    if(replacement.size() > num_affected)
+        intervals.insert(first + num_affected, replacement.begin() + num_affected, replacement.end());
+    else
+        intervals.erase(first + replacement.size(), last);
+}
+
+size_t OccupancyIntervalColumn::getNumVoxels() const
+{
+    size_t num_voxels = 0;
+    for(const OccupancyInterval& interval : intervals)
+        num_voxels += interval.end - interval.begin;
+    return num_voxels;
+}
+
+IntervalOccupancyGridMap::IntervalOccupancyGridMap() :
+    OccupancyGridMapBase(OccupancyConfiguration()),
+    GridMapBase(Vector2ui::Zero(), Vector2d::Ones(), OccupancyIntervalColumn()),
+    z_resolution(1.)
+{
+    updateEncodedConfiguration();
+}
+
+IntervalOccupancyGridMap::IntervalOccupancyGridMap(const Vector2ui& num_cells, const Vector3d& resolution,
+                                                   const OccupancyConfiguration& config) :
+    OccupancyGridMapBase(config),
+    GridMapBase(num_cells, resolution.head<2>(), OccupancyIntervalColumn()),
+    z_resolution(resolution.z())
+{
+    updateEncodedConfiguration();
+}
+
+void IntervalOccupancyGridMap::mergePoint(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3d& measurement)
+{
+    Eigen::Vector3i sensor_origin_idx;
+    if(toVoxelGrid(sensor_origin, sensor_origin_idx))
+    {
+        mergePoint(sensor_origin, sensor_origin_idx, measurement);
+    }
+    else
+        throw std::runtime_error((boost::format("Sensor origin %1% is outside of the grid! Can't add to grid.") % sensor_origin.transpose()).str());
+}
+
+void IntervalOccupancyGridMap::mergePoint(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3i& sensor_origin_idx, const Eigen::Vector3d& measurement)
+{
+    std::vector<VoxelTraversal::RayElement> ray;
+    mergePoint(sensor_origin, sensor_origin_idx, measurement, ray);
+}
+
+void IntervalOccupancyGridMap::mergePoint(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3i& sensor_origin_idx, const Eigen::Vector3d& measurement,
+                                          std::vector<VoxelTraversal::RayElement>& ray)
+{
+    mergeRay(sensor_origin, sensor_origin_idx, measurement, true, ray);
+}
+
+void IntervalOccupancyGridMap::mergeFreeSpaceRay(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3d& ray_end)
+{
+    Eigen::Vector3i sensor_origin_idx;
+    if(!toVoxelGrid(sensor_origin, sensor_origin_idx))
+        throw std::runtime_error((boost::format("Sensor origin %1% is outside of the grid! Can't add to grid.") % sensor_origin.transpose()).str());
+
+    std::vector<VoxelTraversal::RayElement> ray;
+    mergeRay(sensor_origin, sensor_origin_idx, ray_end, false, ray);
+}
+
+void IntervalOccupancyGridMap::mergeRay(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3i& sensor_origin_idx, Eigen::Vector3d ray_end,
+                                        bool hit, std::vector<VoxelTraversal::RayElement>& ray)
+{
+    Eigen::Vector3d ray_start;
+    if(!clipRay(sensor_origin, ray_start, ray_end, hit))
+        return;
+
+    Eigen::Vector3i ray_start_idx = sensor_origin_idx;
+    if(ray_start != sensor_origin && !toVoxelGrid(ray_start, ray_start_idx))
+        throw std::runtime_error((boost::format("Ray start %1% is outside of the grid! Can't add to grid.") % ray_start.transpose()).str());
+
+    Eigen::Vector3i measurement_idx;
+    if(hit && !toVoxelGrid(ray_end, measurement_idx))
+        throw std::runtime_error((boost::format("Point %1% or is outside of the grid! Can't add to grid.") % ray_end.transpose()).str());
+
+    if(!hit)
+        clipRayToGrid(getLocalFrame(), getSize(), getResolution(), ray_start, ray_end);
+
+    VoxelTraversal::computeRay(getVoxelResolution(), ray_start, ray_start_idx, ray_end, ray);
+
+    if(hit)
+        at(Index(measurement_idx.head<2>())).update(measurement_idx.z(), measurement_idx.z() + 1, hit_logodds, min_logodds, max_logodds);
+
+    // each element is a run of voxels in one column, which is updated at once
+    for(const VoxelTraversal::RayElement& element : ray)
+    {
+        // free space rays can leave the grid
+        if(!inGrid(element.idx))
+            break;
+        at(element.idx).update(std::min(element.z_first, element.z_last), std::max(element.z_first, element.z_last) + 1,
+                               miss_logodds, min_logodds, max_logodds);
+    }
+}
+
+void IntervalOccupancyGridMap::mergePointCloud(const Eigen::Vector3d& sensor_origin, const std::vector<Eigen::Vector3d>& measurements)
+{
+    Eigen::Vector3i sensor_origin_idx;
+    if(!toVoxelGrid(sensor_origin, sensor_origin_idx))
+    {
+        std::cerr << "Sensor origin (" << sensor_origin.transpose() << ") is outside of the grid! Can't add corresponding point cloud to grid." << std::endl;
+        return;
+    }
+
+    std::vector<VoxelTraversal::RayElement> ray;
+    for(const Eigen::Vector3d& measurement : measurements)
+    {
+        try
+        {
+            mergePoint(sensor_origin, sensor_origin_idx, measurement, ray);
+        }
+        catch(const std::runtime_error& e)
+        {
+            // TODO use glog or base log for all out prints of this library
+            std::cerr << e.what() << std::endl;
+        }
+    }
+}
+
+void IntervalOccupancyGridMap::filterFreeSpace(const std::vector<Eigen::Vector3d>& points, std::vector<bool>& free_space) const
+{
+    free_space.assign(points.size(), false);
+
+    const OccupancyIntervalColumn* column = NULL;
+    Index column_idx;
+    for(size_t i = 0; i < points.size(); i++)
+    {
+        Index idx;
+        if(!toGrid(points[i], idx))
+            continue;
+
+        // consecutive points are likely to fall into the same column
+        if(column == NULL || idx != column_idx)
+        {
+            column = &at(idx);
+            column_idx = idx;
+        }
+
+        const OccupancyInterval* interval = column->find(getZIndex(points[i].z()));
+        free_space[i] = interval != NULL && interval->log_odds <= free_space_logodds;
+    }
+}
+
+bool IntervalOccupancyGridMap::isOccupied(const Eigen::Vector3d& point) const
+{
+    Index idx;
+    if(toGrid(point, idx))
+        return isOccupied(idx, point.z());
+    throw std::runtime_error((boost::format("Point %1% is outside of the grid!") % point.transpose()).str());
+}
+
+bool IntervalOccupancyGridMap::isOccupied(Index idx, float z) const
+{
+    const OccupancyInterval* interval = at(idx).find(getZIndex(z));
+    return interval != NULL && interval->log_odds >= occupied_logodds;
+}
+
+bool IntervalOccupancyGridMap::isFreeSpace(const Eigen::Vector3d& point) const
+{
+    Index idx;
+    if(toGrid(point, idx))
+        return isFreeSpace(idx, point.z());
+    throw std::runtime_error((boost::format("Point %1% is outside of the grid!") % point.transpose()).str());
+}
+
+bool IntervalOccupancyGridMap::isFreeSpace(Index idx, float z) const
+{
+    const OccupancyInterval* interval = at(idx).find(getZIndex(z));
+    return interval != NULL && interval->log_odds <= free_space_logodds;
+}
+
+bool IntervalOccupancyGridMap::hasSameFrame(const base::Transform3d& local_frame, const Vector2ui& num_cells, const Vector2d& resolution) const
+{
+     if(getResolution() == resolution && getNumCells() == num_cells && getLocalFrame().isApprox(local_frame))
+         return true;
+     return false;
+}
+
+bool IntervalOccupancyGridMap::getEncodedLogOdds(const Eigen::Vector3i& idx, LogOddsType& log_odds) const
+{
+    const OccupancyInterval* interval = at(Index(idx.head<2>())).find(idx.z());
+    if(interval == NULL)
+        return false;
+    log_odds = interval->log_odds;
+    return true;
+}
+
+bool IntervalOccupancyGridMap::toVoxelGrid(const Eigen::Vector3d& position, Eigen::Vector3i& idx) const
+{
+    Index idx_2d;
+    if(toGrid(position, idx_2d))
+    {
+        idx << idx_2d, getZIndex(position.z());
+        return true;
+    }
+    return false;
+}
+
+Eigen::Vector3d IntervalOccupancyGridMap::getVoxelResolution() const
+{
+    Eigen::Vector3d res;
+    res << getResolution(), z_resolution;
+    return res;
+}
+
+size_t IntervalOccupancyGridMap::getNumIntervals() const
+{
+    size_t num_intervals = 0;
+    for(const OccupancyIntervalColumn& column : *this)
+        num_intervals += column.getIntervals().size();
+    return num_intervals;
+}
+
+size_t IntervalOccupancyGridMap::getNumVoxels() const
+{
+    size_t num_voxels = 0;
+    for(const OccupancyIntervalColumn& column : *this)
+        num_voxels += column.getNumVoxels();
+    return num_voxels;
+}
+
+void IntervalOccupancyGridMap::updateEncodedConfiguration()
+{
+    hit_logodds = QuantizedOccupancyPatch::encodeLogOdds(config.hit_logodds);
+    miss_logodds = QuantizedOccupancyPatch::encodeLogOdds(config.miss_logodds);
+    occupied_logodds = QuantizedOccupancyPatch::encodeLogOdds(config.occupied_logodds);
+    free_space_logodds = QuantizedOccupancyPatch::encodeLogOdds(config.free_space_logodds);
+    max_logodds = QuantizedOccupancyPatch::encodeLogOdds(config.max_logodds);
+    min_logodds = QuantizedOccupancyPatch::encodeLogOdds(config.min_logodds);
+}
+
+BOOST_CLASS_EXPORT_IMPLEMENT(maps::grid::IntervalOccupancyGridMap);
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+template void maps::grid::IntervalOccupancyGridMap::serialize(boost::archive::text_iarchive& arch, const unsigned int version);
+template void maps::grid::IntervalOccupancyGridMap::serialize(boost::archive::text_oarchive& arch, const unsigned int version);
+template void maps::grid::IntervalOccupancyGridMap::serialize(boost::archive::binary_iarchive& arch, const unsigned int version);
+template void maps::grid::IntervalOccupancyGridMap::serialize(boost::archive::binary_oarchive& arch, const unsigned int version);
@@ -0,0 +1,207 @@
+#pragma once
+
+#include "SurfacePatches.hpp"
+#include "GridMap.hpp"
+#include "OccupancyGridMapBase.hpp"
+#include "OccupancyConfiguration.hpp"
+#include "../tools/VoxelTraversal.hpp"
+
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/nvp.hpp>
+#include <boost/serialization/vector.hpp>
+#include <boost/serialization/export.hpp>
+
+#include <vector>
+#include <cstdint>
+
+namespace maps { namespace grid
+{
+
+/** Run of voxels [begin, end) of a column sharing the same log-odds */
+struct OccupancyInterval
+{
+    typedef QuantizedOccupancyPatch::LogOddsType LogOddsType;
+
+    OccupancyInterval() : begin(0), end(0), log_odds(0) {}
+    OccupancyInterval(int32_t begin, int32_t end, LogOddsType log_odds) : begin(begin), end(end), log_odds(log_odds) {}
+
+    int32_t begin;
+    int32_t end;
+    LogOddsType log_odds;
+
+    bool operator==(const OccupancyInterval& other) const
+    {
+        return begin == other.begin && end == other.end && log_odds == other.log_odds;
+    }
+
+protected:
+    /** Grants access to boost serialization */
+    friend class boost::serialization::access;
+
+    /** Serializes the members of this class*/
+    template <typename Archive>
+    void serialize(Archive &ar, const unsigned int version)
+    {
+        ar & BOOST_SERIALIZATION_NVP(begin);
+        ar & BOOST_SERIALIZATION_NVP(end);
+        ar & BOOST_SERIALIZATION_NVP(log_odds);
+    }
+};
+
+/**
+ * Column of voxels stored as sorted, disjoint intervals of equal log-odds.
+ * Neighbouring intervals with the same log-odds are always merged, so a
+ * column crossing free space mostly consists of a few intervals clamped to
+ * the minimal log-odds. The log-odds are fixed-point values as in the
+ * QuantizedOccupancyPatch, which keeps equal voxels equal after updates.
+ */
+class OccupancyIntervalColumn
+{
+public:
+    typedef OccupancyInterval::LogOddsType LogOddsType;
+
+    /** Returns the interval containing the voxel z_idx or NULL if the voxel is unknown */
+    const OccupancyInterval* find(int32_t z_idx) const;
+
+    /**
+     * Adds the update to the log-odds of all voxels in [begin, end) and clamps them to [min, max].
+     * Unknown voxels start with log-odds 0.
+     */
+    void update(int32_t begin, int32_t end, LogOddsType update, LogOddsType min, LogOddsType max);
+
+    const std::vector<OccupancyInterval>& getIntervals() const { return intervals; }
+
+    /** Number of known voxels */
+    size_t getNumVoxels() const;
+
+    bool operator==(const OccupancyIntervalColumn& other) const
+    {
+        return intervals == other.intervals;
+    }
+
+    bool operator!=(const OccupancyIntervalColumn& other) const
+    {
+        return !(*this == other);
+    }
+
+protected:
+    std::vector<OccupancyInterval> intervals;
+
+    /** Grants access to boost serialization */
+    friend class boost::serialization::access;
+
+    /** Serializes the members of this class*/
+    template <typename Archive>
+    void serialize(Archive &ar, const unsigned int version)
+    {
+        ar & BOOST_SERIALIZATION_NVP(intervals);
+    }
+};
+
+/**
+ * @brief Occupancy grid map storing each column as intervals of equal log-odds.
+ * @details
+ * Produces the same occupancy as the QuantizedOccupancyGridMap, but the runs
+ * of voxels a ray traverses in a column are updated as a whole and uniform
+ * regions, most notably clamped free space, are collapsed into single intervals.
+ * Large open areas therefore need a small fraction of the memory of a
+ * voxel map. Single voxel lookups are a binary search over the intervals
+ * of a column.
+ */
+class IntervalOccupancyGridMap : public OccupancyGridMapBase, public GridMap<OccupancyIntervalColumn>
+{
+public:
+    typedef OccupancyInterval::LogOddsType LogOddsType;
+    typedef GridMap<OccupancyIntervalColumn> GridMapBase;
+
+    IntervalOccupancyGridMap();
+
+    IntervalOccupancyGridMap(const Vector2ui &num_cells, const Vector3d &resolution,
+                             const OccupancyConfiguration& config);
+
+    virtual ~IntervalOccupancyGridMap() {}
+
+    void mergePoint(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3d& measurement);
+
+    void mergePoint(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3i& sensor_origin_idx, const Eigen::Vector3d& measurement);
+
+    void mergeFreeSpaceRay(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3d& ray_end);
+
+    /** Merges all measurements taken from sensor_origin.
+     *  The sensor origin index and the ray buffer are only computed once per call. */
+    void mergePointCloud(const Eigen::Vector3d& sensor_origin, const std::vector<Eigen::Vector3d>& measurements);
+
+    /** Tests all points for free space in one pass.
+     *  Consecutive points falling into the same column share the column lookup. */
+    void filterFreeSpace(const std::vector<Eigen::Vector3d>& points, std::vector<bool>& free_space) const;
+
+    bool isOccupied(const Eigen::Vector3d& point) const;
+
+    bool isOccupied(Index idx, float z) const;
+
+    bool isFreeSpace(const Eigen::Vector3d& point) const;
+
+    bool isFreeSpace(Index idx, float z) const;
+
+    bool hasSameFrame(const base::Transform3d& local_frame, const Vector2ui &num_cells, const Vector2d &resolution) const;
+
+    /** Returns false if the voxel is unknown */
+    bool getEncodedLogOdds(const Eigen::Vector3i& idx, LogOddsType& log_odds) const;
+
+    bool toVoxelGrid(const Eigen::Vector3d& position, Eigen::Vector3i& idx) const;
+
+    Eigen::Vector3d getVoxelResolution() const;
+
+    /** Number of intervals of all columns */
+    size_t getNumIntervals() const;
+
+    /** Number of known voxels of all columns */
+    size_t getNumVoxels() const;
+
+protected:
+
+    void mergePoint(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3i& sensor_origin_idx, const Eigen::Vector3d& measurement,
+                    std::vector<tools::VoxelTraversal::RayElement>& ray);
+
+    /**
+     * Updates the voxels on the ray as free space after clipping it with clipRay,
+     * and with clipRayToGrid if it has no hit, and the voxel of ray_end as occupied if hit is true.
+     */
+    void mergeRay(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3i& sensor_origin_idx, Eigen::Vector3d ray_end,
+                  bool hit, std::vector<tools::VoxelTraversal::RayElement>& ray);
+
+    int32_t getZIndex(float z) const
+    {
+        return (int32_t)std::floor(z / z_resolution);
+    }
+
+    /** Encodes the log-odds of the configuration into LogOddsType.
+     *  Has to be called each time the configuration changed. */
+    void updateEncodedConfiguration();
+
+    double z_resolution;
+
+    LogOddsType hit_logodds;
+    LogOddsType miss_logodds;
+    LogOddsType occupied_logodds;
+    LogOddsType free_space_logodds;
+    LogOddsType max_logodds;
+    LogOddsType min_logodds;
+
+    /** Grants access to boost serialization */
+    friend class boost::serialization::access;
+
+    /** Serializes the members of this class*/
+    template <typename Archive>
+    void serialize(Archive &ar, const unsigned int version)
+    {
+        ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(OccupancyGridMapBase);
+        ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(GridMapBase);
+        ar & BOOST_SERIALIZATION_NVP(z_resolution);
+        updateEncodedConfiguration();
+    }
+};
+
+}}
+
+BOOST_CLASS_EXPORT_KEY(maps::grid::IntervalOccupancyGridMap);
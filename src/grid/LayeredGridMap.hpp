@@ -4,21 +4,64 @@
 #include <map>
 #include <iostream>
 #include <string>
+#include <vector>
+#include <limits>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
 
 #include <boost/multi_array.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include "GridMap.hpp"
+#include "BufferGrid.hpp"
+#include "../tools/ParallelFor.hpp"
 
 namespace maps { namespace grid
 {
     class LayeredGridMap : public LocalMap
     {
     public:
+        /** Layer stored in the memory shared by all shared layers, see addSharedLayer */
+        template <typename T>
+        using SharedLayer = GridMap<T, BufferGrid<T> >;
+
+        /** Alignment in bytes of the first cell of each shared layer */
+        static const size_t SHARED_LAYER_ALIGNMENT = 64;
+
+        /**
+         * @brief Typed reference to a layer which is resolved once
+         * @details Accessing a layer through its handle is O(1) and doesn't need
+         * a key lookup or type check. A handle becomes invalid when its layer is removed
+         * and can only be used with the map which created it.
+         * GridT is BufferGrid<T> for shared layers.
+         */
+        template <typename T, typename GridT = VectorGrid<T> >
+        class LayerHandle
+        {
+        public:
+            LayerHandle()
+                : owner(NULL),
+                  index(std::numeric_limits<size_t>::max())
+            {}
+
+        private:
+            friend class LayeredGridMap;
+
+            LayerHandle(const LayeredGridMap* owner, size_t index)
+                : owner(owner),
+                  index(index)
+            {}
+
+            const LayeredGridMap* owner;
+            size_t index;
+        };
+
         LayeredGridMap()
         : LocalMap(maps::LocalMapType::GRID_MAP),
           num_cells(0,0),
-          resolution(0.0,0.0)
+          resolution(0.0,0.0),
+          shared_size(0)
         {}
         /**
          * @brief creat an empty grid of specific size and resolution
@@ -34,7 +77,8 @@ namespace maps { namespace grid
         LayeredGridMap(const Vector2ui &num_cells, const Vector2d &resolution)
             : LocalMap(maps::LocalMapType::GRID_MAP),
               num_cells(num_cells), 
-              resolution(resolution)
+              resolution(resolution),
+              shared_size(0)
         {}
 
         virtual ~LayeredGridMap() 
@@ -64,11 +108,102 @@ namespace maps { namespace grid
             }
 
             GridMap<T> *new_grid = new GridMap<T>(num_cells, resolution, default_value, this->getLocalMapData());
-            layers[key] = new_grid;
+            layers[key] = layer_slots.size();
+            layer_slots.push_back(new_grid);
 
             return *new_grid;
         }
 
+        /**
+         * @brief creates a layer in the memory shared by all shared layers
+         * @details The shared layers are allocated one after another in a single
+         * buffer (structure of arrays), the first cell of each layer is aligned to
+         * SHARED_LAYER_ALIGNMENT bytes. Kernels over several shared layers, e.g.
+         * forEachCell, then read neighbouring memory instead of separate allocations.
+         * The buffer grows when layers are added, which invalidates pointers to the
+         * cells of the shared layers but not the layers themselves. The memory of
+         * removed shared layers is only released by removeAllLayers.
+         * Shared layers can't be resized, access them with getLayer<T, BufferGrid<T> >
+         * or a LayerHandle<T, BufferGrid<T> >.
+         * @throw std::out_of_range if a layer with the key exists already
+         */
+        template <typename T>
+        SharedLayer<T>& addSharedLayer(const std::string &key, const T &default_value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "Shared layers require trivially copyable cells");
+            static_assert(SHARED_LAYER_ALIGNMENT % alignof(T) == 0, "The cells can't be aligned in the shared memory");
+
+            if (hasLayer(key) == true)
+            {
+                throw std::out_of_range("LayeredGridMap::addSharedLayer: The grid with the key '" + key + "' exists already.");
+            }
+
+            const size_t offset = shared_size;
+            const size_t size = num_cells.prod() * sizeof(T);
+            reserveSharedMemory(offset + size);
+            shared_size = (offset + size + SHARED_LAYER_ALIGNMENT - 1) / SHARED_LAYER_ALIGNMENT * SHARED_LAYER_ALIGNMENT;
+
+            SharedLayer<T> *new_grid = new SharedLayer<T>(num_cells, resolution, default_value, this->getLocalMapData());
+            new_grid->setCells(reinterpret_cast<T*>(getSharedMemory() + offset));
+            new_grid->clear();
+
+            SharedLayerSlot slot = {layer_slots.size(), offset, &setSharedCells<T>};
+            shared_slots.push_back(slot);
+            layers[key] = layer_slots.size();
+            layer_slots.push_back(new_grid);
+
+            return *new_grid;
+        }
+
+        /**
+         * @brief returns the handle of the layer with the given key
+         * @details The key lookup and the type check are done once here,
+         * afterwards the layer can be accessed in O(1) with getLayer(handle).
+         * Use GridT = BufferGrid<T> for shared layers.
+         */
+        template <typename T, typename GridT = VectorGrid<T> >
+        LayerHandle<T, GridT> getLayerHandle(const std::string &key) const
+        {
+            getGridMapPtr<T, GridT>(key);
+            return LayerHandle<T, GridT>(this, layers.at(key));
+        }
+
+        template <typename T, typename GridT>
+        const GridMap<T, GridT>& getLayer(const LayerHandle<T, GridT> &handle) const
+        {
+            return *getGridMapPtr(handle);
+        }
+
+        template <typename T, typename GridT>
+        GridMap<T, GridT>& getLayer(const LayerHandle<T, GridT> &handle)
+        {
+            return *getGridMapPtr(handle);
+        }
+
+        /**
+         * @brief calls f(cell_1, cell_2, ...) with the cells of the given layers for each cell index
+         * @details The rows of all layers are traversed in lockstep, so each layer
+         * is read sequentially. Shared layers (see addSharedLayer) keep these reads
+         * within one allocation. For kernels which always need the same set of values
+         * a GridMap of a struct (interleaved storage) is the better fit.
+         */
+        template <class Function, typename... T, typename... GridT>
+        void forEachCell(const Function &f, const LayerHandle<T, GridT>&... handles)
+        {
+            processRows(0, num_cells.y(), f, getGridMapPtr(handles)...);
+        }
+
+        /**
+         * @brief same as forEachCell, but the rows are distributed over num_threads threads
+         * @details f must only modify the cells passed to it.
+         * @param num_threads number of threads to use, 0 uses all hardware threads
+         */
+        template <class Function, typename... T, typename... GridT>
+        void parallelForEachCell(unsigned num_threads, const Function &f, const LayerHandle<T, GridT>&... handles)
+        {
+            forEachRowRange(num_threads, f, getGridMapPtr(handles)...);
+        }
+
         /**
          * @brief [brief description]
          * @details [long description]
@@ -92,7 +227,10 @@ namespace maps { namespace grid
                 return false;
             }
 
-            delete layers[key];
+            // the slot stays empty so that the handles of the other layers remain valid
+            const size_t index = layers[key];
+            delete layer_slots[index];
+            layer_slots[index] = NULL;
             layers.erase(key);
 
             return true;
@@ -100,25 +238,29 @@ namespace maps { namespace grid
 
         void removeAllLayers() 
         {
-            // TODO: check if the 
-            typename LayerType::iterator it;
-            for (it = layers.begin(); it != layers.end(); ++it)
+            // the slots stay empty so that new layers don't reuse the indices of old handles
+            for (size_t i = 0; i < layer_slots.size(); ++i)
             {
-                delete it->second;
+                delete layer_slots[i];
+                layer_slots[i] = NULL;
             }
             layers.clear();
+            shared_slots.clear();
+            shared_memory.clear();
+            shared_size = 0;
         }
 
-        template <typename T>
-        const GridMap<T>& getLayer(const std::string &key) const
+        /** Use GridT = BufferGrid<T> for shared layers, see addSharedLayer */
+        template <typename T, typename GridT = VectorGrid<T> >
+        const GridMap<T, GridT>& getLayer(const std::string &key) const
         {
-            return *getGridMapPtr<T>(key);
+            return *getGridMapPtr<T, GridT>(key);
         }           
 
-        template <typename T>
-        GridMap<T>& getLayer(const std::string &key)
+        template <typename T, typename GridT = VectorGrid<T> >
+        GridMap<T, GridT>& getLayer(const std::string &key)
         {
-            return *getGridMapPtr<T>(key);
+            return *getGridMapPtr<T, GridT>(key);
         }
 
         std::vector<std::string> getAllLayerKeys() const
@@ -136,18 +278,78 @@ namespace maps { namespace grid
         Vector2ui num_cells;
         Vector2d resolution;
 
-        typedef std::map<std::string, LocalMap*> LayerType;
+        /** Index of the layer in layer_slots by key */
+        typedef std::map<std::string, size_t> LayerType;
         LayerType layers;
 
+        /** The layers in order of creation, removed layers leave an empty slot */
+        std::vector<LocalMap*> layer_slots;
+
+        /** A shared layer and the offset of its cells in the shared memory */
+        struct SharedLayerSlot
+        {
+            size_t index;
+            size_t offset;
+            /** Sets the cell memory of the layer, which has the type of the layer */
+            void (*set_cells)(LocalMap* layer, char* cells);
+        };
+
+        /** The shared layers in order of creation, see addSharedLayer */
+        std::vector<SharedLayerSlot> shared_slots;
+
+        /** Cells of the shared layers, starting at the first aligned byte */
+        std::vector<char> shared_memory;
+
+        /** Bytes of shared_memory used by the shared layers, a multiple of SHARED_LAYER_ALIGNMENT */
+        size_t shared_size;
+
         template <typename T>
-        GridMap<T>* getGridMapPtr(const std::string &key) const
+        static void setSharedCells(LocalMap* layer, char* cells)
+        {
+            static_cast<SharedLayer<T>*>(layer)->setCells(reinterpret_cast<T*>(cells));
+        }
+
+        /** Returns the first aligned byte of memory */
+        static char* alignSharedMemory(std::vector<char>& memory)
+        {
+            const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(memory.data());
+            return memory.data() + (SHARED_LAYER_ALIGNMENT - address % SHARED_LAYER_ALIGNMENT) % SHARED_LAYER_ALIGNMENT;
+        }
+
+        char* getSharedMemory()
+        {
+            return alignSharedMemory(shared_memory);
+        }
+
+        /** Grows the shared memory to at least size bytes and moves the cells of the shared layers */
+        void reserveSharedMemory(size_t size)
         {
-            GridMap<T>* grid = NULL;
+            if (size + SHARED_LAYER_ALIGNMENT <= shared_memory.size())
+                return;
+
+            std::vector<char> old_memory;
+            old_memory.swap(shared_memory);
+            const char* old_cells = alignSharedMemory(old_memory);
+
+            shared_memory.resize(std::max(size, 2 * shared_size) + SHARED_LAYER_ALIGNMENT);
+            if (shared_size > 0)
+                std::memcpy(getSharedMemory(), old_cells, shared_size);
+            for (const SharedLayerSlot& slot : shared_slots)
+            {
+                if (layer_slots[slot.index] != NULL)
+                    slot.set_cells(layer_slots[slot.index], getSharedMemory() + slot.offset);
+            }
+        }
+
+        template <typename T, typename GridT = VectorGrid<T> >
+        GridMap<T, GridT>* getGridMapPtr(const std::string &key) const
+        {
+            GridMap<T, GridT>* grid = NULL;
 
             if (hasLayer(key) == false)
                 throw std::out_of_range("The map does not contain the grid with the key '" + key + "'.");
 
-            grid = dynamic_cast<GridMap<T>*>(layers.at(key));   
+            grid = dynamic_cast<GridMap<T, GridT>*>(layer_slots[layers.at(key)]);   
                 
             if (grid == NULL)
                 throw std::runtime_error("The grid with the key '" + key + "' is not of required type.");
@@ -155,6 +357,41 @@ namespace maps { namespace grid
             return grid;
         }
 
+        template <typename T, typename GridT>
+        GridMap<T, GridT>* getGridMapPtr(const LayerHandle<T, GridT> &handle) const
+        {
+            if (handle.owner != this)
+                throw std::out_of_range("The layer handle belongs to another map.");
+            if (handle.index >= layer_slots.size() || layer_slots[handle.index] == NULL)
+                throw std::out_of_range("The layer handle is invalid.");
+
+            // the type was checked when the handle was created by this map, slots are never reused
+            return static_cast<GridMap<T, GridT>*>(layer_slots[handle.index]);
+        }
+
+        template <class Function, typename... T, typename... GridT>
+        void forEachRowRange(unsigned num_threads, const Function &f, GridMap<T, GridT>*... grids)
+        {
+            tools::parallelFor(0, num_cells.y(), [&](size_t begin, size_t end)
+            {
+                processRows(begin, end, f, grids...);
+            }, num_threads, 16);
+        }
+
+        template <class Function, typename... T, typename... GridT>
+        void processRows(size_t begin, size_t end, const Function &f, GridMap<T, GridT>*... grids)
+        {
+            for (size_t y = begin; y < end; ++y)
+                processRow(f, grids->getRow(y).data...);
+        }
+
+        template <class Function, typename... T>
+        void processRow(const Function &f, T*... rows)
+        {
+            for (size_t x = 0; x < num_cells.x(); ++x)
+                f(rows[x]...);
+        }
+
 
     };
 }}
@@ -4,6 +4,8 @@
 #include <vector>
 #include <set>
 #include <exception>
+#include <algorithm>
+#include <numeric>
 
 #include <Eigen/Geometry>
 
@@ -18,6 +20,7 @@
 #include "MLSConfig.hpp"
 #include "SurfacePatches.hpp"
 #include "OccupancyGridMapBase.hpp"
+#include "../tools/ParallelFor.hpp"
 
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
@@ -29,6 +32,9 @@ namespace maps { namespace grid
 {
     typedef pcl::PointCloud<pcl::PointXYZ> PointCloud;
 
+    template<enum MLSConfig::update_model SurfaceType>
+    class MLSPyramid;
+
     template<enum MLSConfig::update_model  SurfaceType>
     class MLSMap : public MultiLevelGridMap<SurfacePatch<SurfaceType> >
     {
@@ -43,19 +49,22 @@ namespace maps { namespace grid
                 const MLSConfig &config_)
         : Base(num_cells, resolution)
         , config(config_)
+        , pre_aggregation(false)
         {
             // TODO assert that config is compatible to SurfaceType ...
+            // merging keeps the patches of a cell disjoint, precalculated patches are never merged
+            Base::setDisjointPatches(SurfaceType != MLSConfig::PRECALCULATED);
         }
 
-        MLSMap()
+        MLSMap() : pre_aggregation(false)
         {
-            // empty
+            Base::setDisjointPatches(SurfaceType != MLSConfig::PRECALCULATED);
         }
 
         template<enum MLSConfig::update_model OtherSurfaceType>
-        MLSMap(const MLSMap<OtherSurfaceType>& other) : Base(other)
+        MLSMap(const MLSMap<OtherSurfaceType>& other) : Base(other), pre_aggregation(false)
         {
-
+            Base::setDisjointPatches(SurfaceType != MLSConfig::PRECALCULATED && other.hasDisjointPatches());
         }
 
         const MLSConfig& getConfig() const
@@ -84,33 +93,35 @@ namespace maps { namespace grid
             return free_space_map.get() != NULL;
         }
 
+        /**
+         * Enables the pre-aggregation of point clouds.
+         * If enabled, mergePointCloud first combines all points of the point cloud falling into
+         * the same cell and the same height bin of size MLSConfig::thickness into a single patch,
+         * which is then merged into the map once. This saves most of the updates of the cells in
+         * case of dense point clouds. The result is equivalent to merging the points one by one
+         * within floating point tolerance, but the order in which the points are merged changes.
+         * Not serialized, the default is disabled.
+         */
+        void setPreAggregation(bool enable)
+        {
+            pre_aggregation = enable;
+        }
+
+        bool isPreAggregation() const
+        {
+            return pre_aggregation;
+        }
+
         bool getClosestContactPoint(const Vector3d& point, Vector3d& contact_point) const
         {
             Index idx;
             Vector3d pos_in_cell;
             if(Base::toGrid(point, idx, pos_in_cell))
             {
-                Vector3 pos_in_cell_f = pos_in_cell.cast<float>();
-                const CellType& cell = Base::at(idx);
-                float min_dist;
-                bool found_patch = false;
-                Vector3d contact_point_in_cell;
-                for(const Patch& patch : cell)
+                Vector3 contact_point_f; // in local cell-coordinate system
+                if(getClosestContactPointInCell(Base::at(idx), pos_in_cell.cast<float>(), contact_point_f))
                 {
-                    Vector3 contact_point_f; // in local cell-coordinate system
-                    float dist = std::abs(patch.getClosestContactPoint(pos_in_cell_f, contact_point_f));
-                    if(found_patch && dist > min_dist)
-                        break; // we already found a patch and the current patch is farer away. Since patches are sorted, we can't get closer
-                    else
-                    {
-                        found_patch = true;
-                        min_dist = dist;
-                        contact_point_in_cell = contact_point_f.cast<double>();
-                    }
-                }
-                if(!base::isInfinity<float>(min_dist))
-                {
-                    Base::fromGrid(idx, contact_point, contact_point_in_cell, false);
+                    Base::fromGrid(idx, contact_point, contact_point_f.cast<double>(), false);
                     return true;
                 }
             }
@@ -123,23 +134,8 @@ namespace maps { namespace grid
             Vector3d pos_in_cell;
             if(Base::toGrid(point, idx, pos_in_cell))
             {
-                const CellType& cell = Base::at(idx);
-                Vector3 pos_in_cell_f = pos_in_cell.cast<float>();
-                float min_dist = base::infinity<float>();
-                float cell_surface_pos = base::NaN<float>();
-                for(const Patch& patch : cell)
-                {
-                    float surface_pos_f = patch.getSurfacePos(pos_in_cell_f);
-                    float dist = std::abs(surface_pos_f - pos_in_cell_f.z());
-                    if(dist > min_dist)
-                        break;
-                    else
-                    {
-                        min_dist = dist;
-                        cell_surface_pos = surface_pos_f;
-                    }
-                }
-                if(!base::isInfinity<float>(min_dist))
+                float cell_surface_pos;
+                if(getClosestSurfacePosInCell(Base::at(idx), pos_in_cell.cast<float>(), cell_surface_pos))
                 {
                     // transform from grid to map frame
                     pos_in_cell.z() = cell_surface_pos;
@@ -152,6 +148,219 @@ namespace maps { namespace grid
             return false;
         }
 
+        /**
+         * Batch variant of getClosestContactPoint.
+         * The queries are grouped by cell and distributed over \c num_threads threads,
+         * 0 uses all hardware threads. \c contact_points is resized to the number of points,
+         * the contact point of queries without result is set to NaN.
+         * @return the number of queries with result
+         */
+        size_t getClosestContactPoint(const std::vector<Vector3d>& points, std::vector<Vector3d>& contact_points, unsigned num_threads = 0) const
+        {
+            contact_points.resize(points.size());
+            const base::Transform3d grid2map = Base::getLocalFrame().inverse(Eigen::Isometry);
+            return processQueriesByCell(points, [&](size_t query, const CellType& cell, const Vector3d& cell_center, const Vector3d& pos_in_cell)
+            {
+                Vector3 contact_point_f;
+                if(!getClosestContactPointInCell(cell, pos_in_cell.cast<float>(), contact_point_f))
+                    return false;
+                contact_points[query] = grid2map * (cell_center + contact_point_f.cast<double>());
+                return true;
+            }, [&](size_t query)
+            {
+                contact_points[query].setConstant(base::NaN<double>());
+            }, num_threads);
+        }
+
+        /**
+         * Batch variant of getClosestSurfacePos.
+         * The queries are grouped by cell and distributed over \c num_threads threads,
+         * 0 uses all hardware threads. \c surface_pos is resized to the number of points,
+         * the surface position of queries without result is set to NaN.
+         * @return the number of queries with result
+         */
+        size_t getClosestSurfacePos(const std::vector<Vector3d>& points, std::vector<double>& surface_pos, unsigned num_threads = 0) const
+        {
+            surface_pos.resize(points.size());
+            const base::Transform3d grid2map = Base::getLocalFrame().inverse(Eigen::Isometry);
+            return processQueriesByCell(points, [&](size_t query, const CellType& cell, const Vector3d& cell_center, const Vector3d& pos_in_cell)
+            {
+                float cell_surface_pos;
+                if(!getClosestSurfacePosInCell(cell, pos_in_cell.cast<float>(), cell_surface_pos))
+                    return false;
+                // transform from grid to map frame
+                Vector3d surface_in_grid = cell_center + pos_in_cell;
+                surface_in_grid.z() = cell_surface_pos;
+                surface_pos[query] = (grid2map * surface_in_grid).z();
+                return true;
+            }, [&](size_t query)
+            {
+                surface_pos[query] = base::NaN<double>();
+            }, num_threads);
+        }
+
+        /**
+         * Caches the surface planes of all patches, see SurfacePatch::updatePlane.
+         * Subsequent queries don't need to recompute the plane until a patch is merged again.
+         * The cells are distributed over \c num_threads threads, 0 uses all hardware threads.
+         */
+        void updatePlanes(unsigned num_threads = 0)
+        {
+            tools::parallelFor(0, Base::getNumElements(), [this](size_t begin, size_t end)
+            {
+                // the planes don't change the patch heights, so the cells aren't tracked as modified
+                const size_t width = Base::getNumCells().x();
+                for(size_t i = begin; i < end; ++i)
+                {
+                    for(Patch& patch : Base::atUntracked(i % width, i / width))
+                        patch.updatePlane();
+                }
+            }, num_threads, 4096);
+        }
+
+        /**
+         * Casts a ray from \c origin along \c direction and computes the distance to the first patch hit.
+         * The cells are traversed in the order the ray passes them, i.e. the traversal
+         * stops at the first cell containing a hit.
+         * Origin and direction are given in map frame, \c direction doesn't need to be normalized.
+         * @param max_range the maximum distance along the ray
+         * @param range distance from origin to the hit, only set if a patch was hit
+         * @return true if a patch was hit within \c max_range
+         */
+        bool raycast(const Vector3d& origin, const Vector3d& direction, double max_range, double& range) const
+        {
+            const double norm = direction.norm();
+            if(norm <= 0.0 || !(max_range > 0.0))
+                return false;
+
+            const Vector3d origin_grid = Base::getLocalFrame() * origin;
+            const Vector3d direction_grid = Base::getLocalFrame().linear() * direction / norm;
+            const Vector2d& res = Base::getResolution();
+            const Vector2d size = Base::getSize();
+            const Vector2ui& num_cells = Base::getNumCells();
+
+            // clip the ray to the extents of the grid
+            double t_begin = 0.0, t_end = max_range;
+            for(int i = 0; i < 2; ++i)
+            {
+                if(direction_grid[i] == 0.0)
+                {
+                    if(origin_grid[i] < 0.0 || origin_grid[i] >= size[i])
+                        return false;
+                    continue;
+                }
+                double t0 = -origin_grid[i] / direction_grid[i];
+                double t1 = (size[i] - origin_grid[i]) / direction_grid[i];
+                if(t0 > t1)
+                    std::swap(t0, t1);
+                t_begin = std::max(t_begin, t0);
+                t_end = std::min(t_end, t1);
+            }
+            if(t_begin > t_end)
+                return false;
+
+            // initialize the 2D traversal of the cells along the ray (Amanatides & Woo)
+            const Vector2d entry = origin_grid.head<2>() + t_begin * direction_grid.head<2>();
+            Index idx;
+            Vector2i step;
+            Vector2d t_next, t_delta;
+            for(int i = 0; i < 2; ++i)
+            {
+                idx[i] = std::min(std::max((int)std::floor(entry[i] / res[i]), 0), (int)num_cells[i] - 1);
+                if(direction_grid[i] > 0.0)
+                {
+                    step[i] = 1;
+                    t_delta[i] = res[i] / direction_grid[i];
+                    t_next[i] = ((idx[i] + 1) * res[i] - origin_grid[i]) / direction_grid[i];
+                }
+                else if(direction_grid[i] < 0.0)
+                {
+                    step[i] = -1;
+                    t_delta[i] = -res[i] / direction_grid[i];
+                    t_next[i] = (idx[i] * res[i] - origin_grid[i]) / direction_grid[i];
+                }
+                else
+                {
+                    step[i] = 0;
+                    t_delta[i] = base::infinity<double>();
+                    t_next[i] = base::infinity<double>();
+                }
+            }
+
+            const Vector3 direction_f = direction_grid.cast<float>();
+            double t_cell_begin = t_begin;
+            while(true)
+            {
+                const double t_cell_end = std::min(t_end, t_next.minCoeff());
+
+                // intersect patches relative to the point where the ray enters the cell
+                const Vector3d cell_center((idx.x() + 0.5) * res.x(), (idx.y() + 0.5) * res.y(), 0.0);
+                const Vector3 entry_in_cell = (origin_grid + t_cell_begin * direction_grid - cell_center).cast<float>();
+                const float t_cell_max = std::max(0.0, t_cell_end - t_cell_begin);
+                float t_hit = base::infinity<float>();
+                for(const Patch& patch : Base::at(idx))
+                {
+                    float t;
+                    if(patch.intersectRay(entry_in_cell, direction_f, 0.f, t_cell_max, t) && t < t_hit)
+                        t_hit = t;
+                }
+                if(!base::isInfinity<float>(t_hit))
+                {
+                    range = t_cell_begin + t_hit;
+                    return true;
+                }
+
+                if(t_cell_end >= t_end)
+                    return false;
+
+                // step to the next cell
+                if(t_next.x() < t_next.y())
+                {
+                    idx.x() += step.x();
+                    t_next.x() += t_delta.x();
+                }
+                else
+                {
+                    idx.y() += step.y();
+                    t_next.y() += t_delta.y();
+                }
+                if(!Base::inGrid(idx))
+                    return false;
+                t_cell_begin = t_cell_end;
+            }
+        }
+
+        /**
+         * Same as raycast above, but returns the hit point in map frame.
+         */
+        bool raycast(const Vector3d& origin, const Vector3d& direction, double max_range, Vector3d& hit_point) const
+        {
+            double range;
+            if(!raycast(origin, direction, max_range, range))
+                return false;
+            hit_point = origin + range * direction.normalized();
+            return true;
+        }
+
+        /**
+         * Casts a batch of rays from a common \c origin, e.g. the rays of a depth sensor.
+         * The rays are distributed over \c num_threads threads, 0 uses all hardware threads.
+         * For rays without hit within \c max_range the range is set to infinity.
+         */
+        void raycast(const Vector3d& origin, const std::vector<Vector3d>& directions, double max_range,
+                     std::vector<double>& ranges, unsigned num_threads = 0) const
+        {
+            ranges.resize(directions.size());
+            tools::parallelFor(0, directions.size(), [&](size_t begin, size_t end)
+            {
+                for(size_t i = begin; i < end; ++i)
+                {
+                    if(!raycast(origin, directions[i], max_range, ranges[i]))
+                        ranges[i] = base::infinity<double>();
+                }
+            }, num_threads, 64);
+        }
+
         void mergeMLS(const MLSMap& other)
         {
             // TODO implement
@@ -165,17 +374,24 @@ namespace maps { namespace grid
             {
                 Eigen::Vector3d sensor_origin = pc.sensor_origin_.block(0,0,3,1).cast<double>();
                 Eigen::Vector3d sensor_origin_in_mls = pc2mls * sensor_origin;
+                std::vector<Eigen::Vector3d> measurements_in_map;
+                measurements_in_map.reserve(pc.size());
                 for(PointCloud::const_iterator it=pc.begin(); it != pc.end(); ++it)
+                    measurements_in_map.push_back(pc2mls * it->getArray3fMap().cast<double>());
+
+                // all points are tested against the free space known before this point cloud
+                std::vector<bool> free_space;
+                free_space_map->filterFreeSpace(measurements_in_map, free_space);
+
+                size_t i = 0;
+                for(PointCloud::const_iterator it=pc.begin(); it != pc.end(); ++it, ++i)
                 {
-                    Eigen::Vector3d measurement = it->getArray3fMap().cast<double>();
-                    Eigen::Vector3d measurement_in_map = pc2mls * measurement;
+                    if(free_space[i])
+                        continue;
 
                     try
                     {
-                        if(!free_space_map->isFreeSpace(measurement_in_map))
-                            mergePoint(measurement, pc2grid, measurement_variance);
-
-                        free_space_map->mergePoint(sensor_origin_in_mls, measurement_in_map);
+                        mergeScanPoint(it->getArray3fMap().cast<double>(), pc2grid, measurement_variance);
                     }
                     catch(const std::runtime_error& e)
                     {
@@ -183,6 +399,9 @@ namespace maps { namespace grid
                         std::cerr << e.what() << std::endl;
                     }
                 }
+                mergeAggregatedPatches();
+
+                free_space_map->mergePointCloud(sensor_origin_in_mls, measurements_in_map);
             }
             else
             {
@@ -190,7 +409,7 @@ namespace maps { namespace grid
                 {
                     try
                     {
-                        mergePoint(it->getArray3fMap().cast<double>(), pc2grid, measurement_variance);
+                        mergeScanPoint(it->getArray3fMap().cast<double>(), pc2grid, measurement_variance);
                     }
                     catch(const std::runtime_error& e)
                     {
@@ -198,6 +417,7 @@ namespace maps { namespace grid
                         std::cerr << e.what() << std::endl;
                     }
                 }
+                mergeAggregatedPatches();
             }
         }
 
@@ -208,25 +428,12 @@ namespace maps { namespace grid
             {
                 Eigen::Vector3d sensor_origin = pc.sensor_origin_.block(0,0,3,1).cast<double>();
                 Eigen::Vector3d sensor_origin_in_mls = pc2mls.getTransform() * sensor_origin;
+                std::vector<Eigen::Vector3d> measurements;
+                measurements.reserve(pc.size());
                 for(PointCloud::const_iterator it=pc.begin(); it != pc.end(); ++it)
-                {
-                    Eigen::Vector3d measurement = it->getArray3fMap().cast<double>();
-                    std::pair<Eigen::Vector3d, Eigen::Matrix3d> measurement_in_map = pc2mls.composePointWithCovariance(measurement, Eigen::Matrix3d::Zero());
+                    measurements.push_back(it->getArray3fMap().cast<double>());
 
-                    try
-                    {
-                        if(!free_space_map->isFreeSpace(measurement_in_map.first))
-                            mergePoint(measurement, pc2grid, measurement_variance + measurement_in_map.second(2,2));
-
-                        if(measurement_in_map.second(2,2) <= free_space_map->getConfig().uncertainty_threshold)
-                            free_space_map->mergePoint(sensor_origin_in_mls, measurement_in_map.first);
-                    }
-                    catch(const std::runtime_error& e)
-                    {
-                        // TODO use glog or base log for all out prints of this library
-                        std::cerr << e.what() << std::endl;
-                    }
-                }
+                mergePointCloudWithFreeSpace(measurements, pc2mls, pc2grid, sensor_origin_in_mls, measurement_variance);
             }
             else
             {
@@ -236,7 +443,7 @@ namespace maps { namespace grid
                     std::pair<Eigen::Vector3d, Eigen::Matrix3d> point_with_cov = pc2mls.composePointWithCovariance(point, Eigen::Matrix3d::Zero());
                     try
                     {
-                        mergePoint(point, pc2grid, measurement_variance + point_with_cov.second(2,2));
+                        mergeScanPoint(point, pc2grid, measurement_variance + point_with_cov.second(2,2));
                     }
                     catch(const std::runtime_error& e)
                     {
@@ -244,6 +451,7 @@ namespace maps { namespace grid
                         std::cerr << e.what() << std::endl;
                     }
                 }
+                mergeAggregatedPatches();
             }
         }
 
@@ -255,24 +463,7 @@ namespace maps { namespace grid
             if(hasFreeSpaceMap())
             {
                 base::Vector3d sensor_origin_in_mls = pc2mls.getTransform() * sensor_origin_in_pc;
-                for(typename std::vector< Eigen::Matrix<double, 3, 1, _MatrixOptions> >::const_iterator it = pc.begin(); it != pc.end(); ++it)
-                {
-                    std::pair<Eigen::Vector3d, Eigen::Matrix3d> measurement_in_map = pc2mls.composePointWithCovariance(*it, Eigen::Matrix3d::Zero());
-
-                    try
-                    {
-                        if(!free_space_map->isFreeSpace(measurement_in_map.first))
-                            mergePoint(*it, pc2grid, measurement_variance + measurement_in_map.second(2,2));
-
-                        if(measurement_in_map.second(2,2) <= free_space_map->getConfig().uncertainty_threshold)
-                            free_space_map->mergePoint(sensor_origin_in_mls, measurement_in_map.first);
-                    }
-                    catch(const std::runtime_error& e)
-                    {
-                        // TODO use glog or base log for all out prints of this library
-                        std::cerr << e.what() << std::endl;
-                    }
-                }
+                mergePointCloudWithFreeSpace(pc, pc2mls, pc2grid, sensor_origin_in_mls, measurement_variance);
             }
             else
             {
@@ -281,7 +472,7 @@ namespace maps { namespace grid
                     std::pair<Eigen::Vector3d, Eigen::Matrix3d> point_with_cov = pc2mls.composePointWithCovariance(*it, Eigen::Matrix3d::Zero());
                     try
                     {
-                        mergePoint(*it, pc2grid, measurement_variance + point_with_cov.second(2,2));
+                        mergeScanPoint(*it, pc2grid, measurement_variance + point_with_cov.second(2,2));
                     }
                     catch(const std::runtime_error& e)
                     {
@@ -289,27 +480,78 @@ namespace maps { namespace grid
                         std::cerr << e.what() << std::endl;
                     }
                 }
+                mergeAggregatedPatches();
             }
         }
 
+        /**
+         * Merges the patch into the cell at @p idx, see mergePatchIntoCell, and updates the height pyramid.
+         */
         void mergePatch(const Index &idx, const Patch& new_patch)
         {
-            CellType &list = Base::at(idx);
+            if(!Base::inGrid(idx))
+                throw std::runtime_error("Provided index is out of the grid");
+            // the height pyramid is updated for this cell only, see VectorGrid::setModificationTracking
+            mergePatchIntoCell(Base::atUntracked(idx), new_patch);
+            Base::updateHeightPyramid(idx);
+        }
 
-            for(typename CellType::iterator patch_it = list.begin(); patch_it != list.end(); patch_it++)
+        /**
+         * Merges the patch with the lowest patch of the cell it can be merged with or inserts it as new patch.
+         * Since the patches of a cell can't be merged with each other, only the patches next to the position
+         * of the new patch have to be tested. Starting below the position, the neighbors are tested downwards
+         * until the first patch which can't be merged, followed by the first patch above the position.
+         * For KALMAN the merge tolerance depends on the variances of both patches, so all patches below
+         * the position are tested, like mergePatch did before the binary search was introduced.
+         * Only the given cell is modified, so different cells can be merged concurrently. The caller has to
+         * call updateHeightPyramid for the cell afterwards.
+         */
+        void mergePatchIntoCell(CellType &list, const Patch& new_patch) const
+        {
+            const typename CellType::iterator upper = list.upper_bound(new_patch);
+            typename CellType::iterator target = list.end();
+            if(SurfaceType == MLSConfig::KALMAN)
             {
-                // test if it can be merged with an existing patch
-                if(merge(*patch_it, new_patch))
+                // a failed merge doesn't modify the patch
+                for(typename CellType::iterator patch_it = list.begin(); patch_it != upper; ++patch_it)
                 {
-                    // since patch_it was changed test if it can be merged with any of the existing patches
-                    mergePatchRecursive(list, patch_it);
+                    if(merge(*patch_it, new_patch))
+                    {
+                        target = patch_it;
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                Patch merged_patch;
+                for(typename CellType::iterator patch_it = upper; patch_it != list.begin();)
+                {
+                    --patch_it;
+                    Patch candidate = *patch_it;
+                    if(!merge(candidate, new_patch))
+                        break;
+                    target = patch_it;
+                    merged_patch = candidate;
+                }
+                if(target != list.end())
+                    *target = merged_patch;
+            }
+
+            if(target == list.end())
+            {
+                if(upper != list.end() && merge(*upper, new_patch))
+                    target = upper;
+                else
+                {
+                    // insert as new patch
+                    list.insert(upper, new_patch);
                     return;
                 }
-                else if(new_patch < *patch_it)
-                    break;
             }
-            // insert as new patch
-            list.insert(new_patch);
+
+            // since target was changed test if it can be merged with its neighbors
+            compactPatches(list, target);
         }
 
         void mergePoint(const Eigen::Vector3d& point, double measurement_variance = 0.01)
@@ -340,17 +582,240 @@ namespace maps { namespace grid
         }
 
     private:
+        /** Finds the contact point of the closest patch in \c cell, all coordinates are relative to the cell center */
+        static bool getClosestContactPointInCell(const CellType& cell, const Vector3& pos_in_cell, Vector3& contact_point)
+        {
+            float min_dist = base::infinity<float>();
+            bool found_patch = false;
+            for(const Patch& patch : cell)
+            {
+                Vector3 contact_point_f;
+                float dist = std::abs(patch.getClosestContactPoint(pos_in_cell, contact_point_f));
+                if(found_patch && dist > min_dist)
+                    break; // we already found a patch and the current patch is farer away. Since patches are sorted, we can't get closer
+                found_patch = true;
+                min_dist = dist;
+                contact_point = contact_point_f;
+            }
+            return found_patch && !base::isInfinity<float>(min_dist);
+        }
+
+        /** Finds the surface position of the closest patch in \c cell, all coordinates are relative to the cell center */
+        static bool getClosestSurfacePosInCell(const CellType& cell, const Vector3& pos_in_cell, float& surface_pos)
+        {
+            float min_dist = base::infinity<float>();
+            for(const Patch& patch : cell)
+            {
+                float surface_pos_f = patch.getSurfacePos(pos_in_cell);
+                float dist = std::abs(surface_pos_f - pos_in_cell.z());
+                if(dist > min_dist)
+                    break;
+                min_dist = dist;
+                surface_pos = surface_pos_f;
+            }
+            return !base::isInfinity<float>(min_dist);
+        }
+
+        /**
+         * Sorts the queries by cell and calls query_f(query, cell, cell_center, pos_in_cell) for each
+         * query inside of the grid, with cell center and position in grid frame.
+         * no_result_f(query) is called for queries outside of the grid or if query_f returns false.
+         * The sorted queries are split between \c num_threads threads, query indices are unique,
+         * so the callbacks may write to per query outputs.
+         * @return the number of queries for which query_f returned true
+         */
+        template<class QueryFunction, class NoResultFunction>
+        size_t processQueriesByCell(const std::vector<Vector3d>& points, const QueryFunction& query_f,
+                                    const NoResultFunction& no_result_f, unsigned num_threads) const
+        {
+            const base::Transform3d& map2grid = Base::getLocalFrame();
+            const Vector2d& res = Base::getResolution();
+            const Vector2ui& num_cells = Base::getNumCells();
+            const size_t outside = num_cells.prod();
+
+            // pairs of the linear cell index and the query index
+            std::vector<std::pair<size_t, size_t> > queries(points.size());
+            tools::parallelFor(0, points.size(), [&](size_t begin, size_t end)
+            {
+                for(size_t i = begin; i < end; ++i)
+                {
+                    const Vector2d pos_grid = (map2grid * points[i]).head<2>();
+                    const Index idx(std::floor(pos_grid.x() / res.x()), std::floor(pos_grid.y() / res.y()));
+                    queries[i].first = Base::inGrid(idx) ? idx.x() + idx.y() * num_cells.x() : outside;
+                    queries[i].second = i;
+                }
+            }, num_threads, 1024);
+            std::sort(queries.begin(), queries.end());
+
+            std::vector<size_t> results(tools::getNumThreads(num_threads), 0);
+            const size_t chunk_size = (queries.size() + results.size() - 1) / std::max<size_t>(results.size(), 1);
+            tools::parallelFor(0, results.size(), [&](size_t begin, size_t end)
+            {
+                for(size_t chunk = begin; chunk < end; ++chunk)
+                {
+                    const size_t chunk_end = std::min(queries.size(), (chunk + 1) * chunk_size);
+                    size_t current_cell = outside;
+                    const CellType* cell = NULL;
+                    Vector3d cell_center;
+                    for(size_t i = chunk * chunk_size; i < chunk_end; ++i)
+                    {
+                        const size_t query = queries[i].second;
+                        if(queries[i].first == outside)
+                        {
+                            no_result_f(query);
+                            continue;
+                        }
+                        if(queries[i].first != current_cell)
+                        {
+                            current_cell = queries[i].first;
+                            const Index idx(current_cell % num_cells.x(), current_cell / num_cells.x());
+                            cell = &Base::at(idx);
+                            cell_center << (idx.cast<double>() + Vector2d(0.5, 0.5)).cwiseProduct(res), 0.0;
+                        }
+                        if(query_f(query, *cell, cell_center, map2grid * points[query] - cell_center))
+                            results[chunk]++;
+                        else
+                            no_result_f(query);
+                    }
+                }
+            }, results.size());
+
+            return std::accumulate(results.begin(), results.end(), size_t(0));
+        }
+
+        /** Patch of a point cloud which is not yet merged into the map, see setPreAggregation */
+        struct AggregatedPatch
+        {
+            AggregatedPatch(size_t cell, int32_t bin, const Patch& patch) : cell(cell), bin(bin), patch(patch) {}
+
+            size_t cell;
+            int32_t bin;
+            Patch patch;
+
+            bool operator<(const AggregatedPatch& other) const
+            {
+                return cell < other.cell || (cell == other.cell && bin < other.bin);
+            }
+        };
+
         MLSConfig config;
         boost::shared_ptr<OccupancyGridMapBase> free_space_map;
+        bool pre_aggregation;
+        std::vector<AggregatedPatch> aggregated_patches;
 
-        bool merge(Patch& a, const Patch& b)
+        bool merge(Patch& a, const Patch& b) const
         {
             return a.merge(b, config);
         }
 
+        /**
+         * Merges a point of a point cloud into the map or, if pre-aggregation is enabled,
+         * into the pending patch of its cell and height bin.
+         * Consecutive points of the same cell and bin are merged right away, all other
+         * patches are combined by mergeAggregatedPatches.
+         */
+        void mergeScanPoint(const Eigen::Vector3d& point, const base::Transform3d& pc2gridframe, double measurement_variance)
+        {
+            if(!pre_aggregation)
+            {
+                mergePoint(point, pc2gridframe, measurement_variance);
+                return;
+            }
+
+            Eigen::Vector3d pos_diff;
+            Index idx;
+            if(!Base::toGridOptimized(point, idx, pos_diff, pc2gridframe))
+                throw std::runtime_error((boost::format("Point %1% is outside of the grid! Can't add to grid.") % point.transpose()).str());
+
+            const size_t cell = idx.x() + idx.y() * Base::getNumCells().x();
+            const int32_t bin = config.thickness > 0.f ? (int32_t)std::floor(pos_diff.z() / config.thickness) : 0;
+            const Patch patch(pos_diff.cast<float>(), measurement_variance);
+            if(!aggregated_patches.empty() && aggregated_patches.back().cell == cell && aggregated_patches.back().bin == bin
+                && merge(aggregated_patches.back().patch, patch))
+                return;
+            aggregated_patches.push_back(AggregatedPatch(cell, bin, patch));
+        }
+
+        /**
+         * Combines the pending patches of each cell and height bin and merges them into the map.
+         * Patches of the same bin which can't be merged, e.g. due to a small gap size, are merged separately.
+         */
+        void mergeAggregatedPatches()
+        {
+            if(aggregated_patches.empty())
+                return;
+
+            // keep the order of the points within a bin
+            std::stable_sort(aggregated_patches.begin(), aggregated_patches.end());
+
+            const size_t num_cells_x = Base::getNumCells().x();
+            typename std::vector<AggregatedPatch>::iterator current = aggregated_patches.begin();
+            for(typename std::vector<AggregatedPatch>::iterator it = current + 1; it != aggregated_patches.end(); ++it)
+            {
+                if(it->cell == current->cell && it->bin == current->bin && merge(current->patch, it->patch))
+                    continue;
+                mergePatch(Index(current->cell % num_cells_x, current->cell / num_cells_x), current->patch);
+                current = it;
+            }
+            mergePatch(Index(current->cell % num_cells_x, current->cell / num_cells_x), current->patch);
+
+            aggregated_patches.clear();
+        }
+
+        /**
+         * Merges the points which are not in free space and afterwards updates the free space map
+         * with all points having a low enough uncertainty.
+         * The free space test is done for the whole point cloud at once, i.e. all points are tested
+         * against the free space known before this point cloud was added.
+         */
+        template<class PointT, class Alloc>
+        void mergePointCloudWithFreeSpace(const std::vector<PointT, Alloc>& pc, const base::TransformWithCovariance& pc2mls,
+                                          const base::Transform3d& pc2grid, const Eigen::Vector3d& sensor_origin_in_mls,
+                                          double measurement_variance)
+        {
+            std::vector<Eigen::Vector3d> measurements_in_map;
+            std::vector<double> z_variances;
+            measurements_in_map.reserve(pc.size());
+            z_variances.reserve(pc.size());
+            for(typename std::vector<PointT, Alloc>::const_iterator it = pc.begin(); it != pc.end(); ++it)
+            {
+                std::pair<Eigen::Vector3d, Eigen::Matrix3d> measurement_in_map = pc2mls.composePointWithCovariance(*it, Eigen::Matrix3d::Zero());
+                measurements_in_map.push_back(measurement_in_map.first);
+                z_variances.push_back(measurement_in_map.second(2,2));
+            }
+
+            std::vector<bool> free_space;
+            free_space_map->filterFreeSpace(measurements_in_map, free_space);
+
+            std::vector<Eigen::Vector3d> free_space_measurements;
+            free_space_measurements.reserve(pc.size());
+            const float uncertainty_threshold = free_space_map->getConfig().uncertainty_threshold;
+            for(size_t i = 0; i < pc.size(); i++)
+            {
+                if(!free_space[i])
+                {
+                    try
+                    {
+                        mergeScanPoint(pc[i], pc2grid, measurement_variance + z_variances[i]);
+                    }
+                    catch(const std::runtime_error& e)
+                    {
+                        // TODO use glog or base log for all out prints of this library
+                        std::cerr << e.what() << std::endl;
+                    }
+                }
+
+                if(z_variances[i] <= uncertainty_threshold)
+                    free_space_measurements.push_back(measurements_in_map[i]);
+            }
+            mergeAggregatedPatches();
+
+            free_space_map->mergePointCloud(sensor_origin_in_mls, free_space_measurements);
+        }
+
         bool isCovered(const Index &idx, float zPos, const float gapSize = 0.0)
         {
-            CellType &list = Base::at(idx);
+            const CellType &list = Base::getCell(idx);
 
             for(typename CellType::const_iterator it = list.begin(); it!= list.end(); ++it)
             {
@@ -360,33 +825,37 @@ namespace maps { namespace grid
         }
 
         /**
-         * Checks if a existing patch in the current cell list can be merged with any of the other patches.
-         * Recursively resolves all possible following merge tasks.
+         * Merges the changed patch with its neighbors in the cell list as long as possible.
+         * A patch which grew is first merged into the patch below, afterwards the patch above
+         * is merged into it. For KALMAN the lowest patch below which can be merged is used,
+         * see mergePatchIntoCell.
          * Note: Since the CellType is a boost::flat_set which invalidates all following iterators if an element
-         * is erased the implementation has to take care of the order in which patches are merged.
+         * is erased, the lower patch of a merge is always the one which is kept.
          */
-        void mergePatchRecursive(CellType& list, typename CellType::iterator& patch)
+        void compactPatches(CellType& list, typename CellType::iterator patch) const
         {
-            for(typename CellType::iterator patch_it = list.begin(); patch_it != list.end(); patch_it++)
+            while(true)
             {
-                if(patch_it == patch)
-                    continue;
-                else if(patch_it < patch && merge(*patch_it, *patch))
+                // the tested patches below, only the direct neighbor unless KALMAN
+                typename CellType::iterator below = patch;
+                if(patch != list.begin())
+                    below = SurfaceType == MLSConfig::KALMAN ? list.begin() : patch - 1;
+                while(below != patch && !merge(*below, *patch))
+                    ++below;
+                if(below != patch)
                 {
-                    patch = list.erase(patch);
-                    patch = list.end();
-                    mergePatchRecursive(list, patch_it);
-                    return;
+                    list.erase(patch);
+                    patch = below;
+                    continue;
                 }
-                else if(patch < patch_it)
+
+                typename CellType::iterator above = patch + 1;
+                if(above != list.end() && merge(*patch, *above))
                 {
-                    if(merge(*patch, *patch_it))
-                    {
-                        patch_it = list.erase(patch_it);
-                        mergePatchRecursive(list, patch);
-                    }
-                    return;
+                    list.erase(above);
+                    continue;
                 }
+                return;
             }
         }
 
@@ -394,6 +863,9 @@ namespace maps { namespace grid
         /** Grants access to boost serialization */
         friend class boost::serialization::access;
 
+        /** Merges the child cells of a level without tracking them as modified */
+        friend class MLSPyramid<SurfaceType>;
+
         /** Serializes the members of this class*/
         template<class Archive>
         void save(Archive & ar, const unsigned int version) const
@@ -410,6 +882,10 @@ namespace maps { namespace grid
             ar & BOOST_SERIALIZATION_NVP(config);
             if(version >= 1)
                 ar & BOOST_SERIALIZATION_NVP(free_space_map);
+
+            // the height pyramid isn't serialized, rebuild it for the loaded cells if it is used
+            if(Base::hasHeightPyramid())
+                Base::enableHeightPyramid();
         }
 
         BOOST_SERIALIZATION_SPLIT_MEMBER()
@@ -0,0 +1,338 @@
+#ifndef __MAPS_MLS_PYRAMID_HPP__
+#define __MAPS_MLS_PYRAMID_HPP__
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+#include <boost/format.hpp>
+
+#include "MLSMap.hpp"
+#include "../tools/ParallelFor.hpp"
+
+namespace maps { namespace grid
+{
+
+    /**
+     * @brief Stack of MLS maps with decreasing resolution.
+     * @details
+     * Level 0 is the finest level which is fed with measurements, each further
+     * level has half the number of cells and twice the resolution of the level
+     * below. A cell of a coarser level is built by merging the patches of its
+     * (up to) four child cells with the merge semantics of the patch type, i.e.
+     * the result is the same as merging the measurements into a map of the coarser
+     * resolution directly, up to the order of the merges.
+     *
+     * Cells modified on level 0 are marked as dirty, update() recomputes only the
+     * coarser cells depending on them. All levels share the same local frame.
+     */
+    template<enum MLSConfig::update_model SurfaceType>
+    class MLSPyramid
+    {
+    public:
+        typedef MLSMap<SurfaceType> Level;
+        typedef typename Level::Patch Patch;
+        typedef typename Level::CellType CellType;
+
+        /**
+         * @param num_cells number of cells of the finest level
+         * @param resolution resolution of the finest level
+         * @param num_levels number of levels including the finest, at least one
+         */
+        MLSPyramid(const Vector2ui &num_cells, const Vector2d &resolution, const MLSConfig &config, size_t num_levels)
+            : lod_distance(base::infinity<double>())
+        {
+            if(num_levels == 0)
+                throw std::runtime_error("The pyramid needs at least one level");
+
+            Vector2ui level_cells = num_cells;
+            Vector2d level_resolution = resolution;
+            for(size_t i = 0; i < num_levels; ++i)
+            {
+                levels.push_back(Level(level_cells, level_resolution, config));
+                level_cells = Vector2ui((level_cells.x() + 1) / 2, (level_cells.y() + 1) / 2);
+                level_resolution *= 2.;
+            }
+            dirty_cells.resize(num_levels);
+            for(size_t i = 0; i < num_levels; ++i)
+                dirty_cells[i].resize(levels[i].getNumCells());
+        }
+
+        MLSPyramid()
+            : lod_distance(base::infinity<double>())
+        {
+        }
+
+        size_t getNumLevels() const
+        {
+            return levels.size();
+        }
+
+        const Level& getLevel(size_t level) const
+        {
+            return levels.at(level);
+        }
+
+        /**
+         * Non-const access to the finest level.
+         * Cells modified through this have to be reported with markDirty.
+         */
+        Level& getFinestLevel()
+        {
+            return levels.front();
+        }
+
+        const base::Transform3d& getLocalFrame() const
+        {
+            return levels.front().getLocalFrame();
+        }
+
+        /** Sets the local frame of all levels */
+        void setLocalFrame(const base::Transform3d& local_frame)
+        {
+            for(Level& level : levels)
+                level.getLocalFrame() = local_frame;
+        }
+
+        /**
+         * Enables the height pyramid of all levels, see MultiLevelGridMap::enableHeightPyramid.
+         * The coarser levels keep it up to date in update().
+         */
+        void enableHeightPyramid()
+        {
+            for(Level& level : levels)
+                level.enableHeightPyramid();
+        }
+
+        /** Marks a cell of the finest level as modified */
+        void markDirty(const Index& idx)
+        {
+            dirty_cells.front().insert(idx);
+        }
+
+        /** Returns true if the coarser levels don't reflect all changes of the finest level */
+        bool hasDirtyCells() const
+        {
+            return !dirty_cells.empty() && !dirty_cells.front().cells.empty();
+        }
+
+        void mergePoint(const Eigen::Vector3d& point, double measurement_variance = 0.01)
+        {
+            Eigen::Vector3d pos_diff;
+            Index idx;
+            if(!levels.front().toGrid(point, idx, pos_diff))
+                throw std::runtime_error((boost::format("Point %1% is outside of the grid! Can't add to grid.") % point.transpose()).str());
+            levels.front().mergePatch(idx, Patch(pos_diff.cast<float>(), measurement_variance));
+            markDirty(idx);
+        }
+
+        /**
+         * Merges the point cloud into the finest level, points outside of the grid are skipped.
+         * Call update() afterwards to propagate the changes to the coarser levels.
+         */
+        void mergePointCloud(const PointCloud& pc, const base::Transform3d& pc2mls, double measurement_variance = 0.01)
+        {
+            Level& finest = levels.front();
+            const base::Transform3d pc2grid = finest.prepareToGridOptimized(pc2mls);
+            for(PointCloud::const_iterator it = pc.begin(); it != pc.end(); ++it)
+            {
+                Eigen::Vector3d pos_diff;
+                Index idx;
+                if(finest.toGridOptimized(it->getArray3fMap().cast<double>(), idx, pos_diff, pc2grid))
+                {
+                    finest.mergePatch(idx, Patch(pos_diff.cast<float>(), measurement_variance));
+                    markDirty(idx);
+                }
+            }
+        }
+
+        /**
+         * Recomputes the cells of the coarser levels which depend on dirty cells.
+         * The cells of a level are independent, so they are processed in parallel.
+         * @param num_threads number of threads to use, 0 uses all hardware threads
+         */
+        void update(unsigned num_threads = 0)
+        {
+            for(size_t level = 1; level < levels.size(); ++level)
+            {
+                DirtyCells& children = dirty_cells[level - 1];
+                DirtyCells& parents = dirty_cells[level];
+                for(const Index& child : children.cells)
+                    parents.insert(Index(child.x() / 2, child.y() / 2));
+                children.clear();
+
+                const std::vector<Index>& cells = parents.cells;
+                tools::parallelFor(0, cells.size(), [&](size_t begin, size_t end)
+                {
+                    for(size_t i = begin; i < end; ++i)
+                        updateCell(level, cells[i]);
+                }, num_threads, 64);
+
+                // the height pyramid is shared by all cells of the level, so it is updated serially
+                if(levels[level].hasHeightPyramid())
+                {
+                    for(const Index& idx : cells)
+                        levels[level].updateHeightPyramid(idx);
+                }
+            }
+            if(!dirty_cells.empty())
+                dirty_cells.back().clear();
+        }
+
+        /** Marks all cells as dirty and recomputes all coarser levels */
+        void rebuild(unsigned num_threads = 0)
+        {
+            const Vector2ui& num_cells = levels.front().getNumCells();
+            for(unsigned int y = 0; y < num_cells.y(); ++y)
+                for(unsigned int x = 0; x < num_cells.x(); ++x)
+                    markDirty(Index(x, y));
+            update(num_threads);
+        }
+
+        /**
+         * Returns the index of the coarsest level whose resolution isn't coarser than
+         * @p resolution, i.e. the finest level if all levels are coarser.
+         */
+        size_t getLevelForResolution(double resolution) const
+        {
+            size_t result = 0;
+            for(size_t level = 1; level < levels.size(); ++level)
+            {
+                if(levels[level].getResolution().maxCoeff() > resolution)
+                    break;
+                result = level;
+            }
+            return result;
+        }
+
+        /**
+         * Sets the distance up to which the finest level is used by getLevelForDistance.
+         * Each further level is used up to twice the distance of the level below.
+         * By default the finest level is used for all distances.
+         */
+        void setLodDistance(double distance)
+        {
+            lod_distance = distance;
+        }
+
+        double getLodDistance() const
+        {
+            return lod_distance;
+        }
+
+        /** Returns the index of the level of detail for a query at @p distance to the viewer */
+        size_t getLevelForDistance(double distance) const
+        {
+            if(!(distance > lod_distance))
+                return 0;
+            const size_t level = 1 + static_cast<size_t>(std::log2(distance / lod_distance));
+            return std::min(level, levels.size() - 1);
+        }
+
+        const Level& getLevelByResolution(double resolution) const
+        {
+            return levels[getLevelForResolution(resolution)];
+        }
+
+        const Level& getLevelByDistance(double distance) const
+        {
+            return levels[getLevelForDistance(distance)];
+        }
+
+        /**
+         * Closest surface position on the level of detail for the distance between @p point and @p viewpoint.
+         * The coarser levels have to be up to date, see update().
+         */
+        bool getClosestSurfacePos(const Vector3d& point, const Vector3d& viewpoint, double& surface_pos) const
+        {
+            return getLevelByDistance((point - viewpoint).norm()).getClosestSurfacePos(point, surface_pos);
+        }
+
+        /**
+         * Closest contact point on the level of detail for the distance between @p point and @p viewpoint.
+         * The coarser levels have to be up to date, see update().
+         */
+        bool getClosestContactPoint(const Vector3d& point, const Vector3d& viewpoint, Vector3d& contact_point) const
+        {
+            return getLevelByDistance((point - viewpoint).norm()).getClosestContactPoint(point, contact_point);
+        }
+
+    private:
+        /** Set of cells with constant time insertion */
+        struct DirtyCells
+        {
+            std::vector<uint8_t> flags;
+            std::vector<Index> cells;
+            unsigned int width;
+
+            void resize(const Vector2ui& num_cells)
+            {
+                flags.assign(num_cells.prod(), 0);
+                cells.clear();
+                width = num_cells.x();
+            }
+
+            void insert(const Index& idx)
+            {
+                uint8_t& flag = flags[idx.x() + idx.y() * width];
+                if(!flag)
+                {
+                    flag = 1;
+                    cells.push_back(idx);
+                }
+            }
+
+            void clear()
+            {
+                for(const Index& idx : cells)
+                    flags[idx.x() + idx.y() * width] = 0;
+                cells.clear();
+            }
+        };
+
+        /**
+         * Merges the patches of the child cells into the cell of the given level.
+         * Only modifies this cell, the height pyramid of the level is updated by the caller.
+         */
+        void updateCell(size_t level, const Index& idx)
+        {
+            Level& parent = levels[level];
+            const Level& children = levels[level - 1];
+            // the height pyramid of the level is updated for the cell by the caller
+            typename Level::CellType& cell = parent.atUntracked(idx);
+            cell.clear();
+
+            const Vector2d& child_resolution = children.getResolution();
+            for(unsigned int cy = 2 * idx.y(); cy < std::min<unsigned int>(2 * idx.y() + 2, children.getNumCells().y()); ++cy)
+            {
+                for(unsigned int cx = 2 * idx.x(); cx < std::min<unsigned int>(2 * idx.x() + 2, children.getNumCells().x()); ++cx)
+                {
+                    // the child cell centers are half a child cell off the parent cell center
+                    const Vector3 offset((cx % 2 == 0 ? -0.5f : 0.5f) * child_resolution.x(),
+                                         (cy % 2 == 0 ? -0.5f : 0.5f) * child_resolution.y(), 0.f);
+                    for(const Patch& child_patch : children.atUnchecked(cx, cy))
+                    {
+                        Patch patch(child_patch);
+                        patch.translate(offset);
+                        parent.mergePatchIntoCell(cell, patch);
+                    }
+                }
+            }
+        }
+
+        /** The levels from fine to coarse */
+        std::vector<Level> levels;
+
+        /** Cells per level which changed since the last update */
+        std::vector<DirtyCells> dirty_cells;
+
+        double lod_distance;
+    };
+
+    typedef MLSPyramid<MLSConfig::SLOPE> MLSPyramidSloped;
+    typedef MLSPyramid<MLSConfig::KALMAN> MLSPyramidKalman;
+
+}}
+
+#endif // __MAPS_MLS_PYRAMID_HPP__
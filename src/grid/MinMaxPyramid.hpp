@@ -0,0 +1,375 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include "Index.hpp"
+
+namespace maps { namespace grid
+{
+
+    /**
+     * @brief Quadtree of the minimum and maximum height over blocks of grid cells.
+     * @details
+     * Level 0 stores one height range per cell, each further level merges 2x2 blocks
+     * of the level below until the top level consists of a single block.
+     * This allows to reject regions which are empty or out of a given height range
+     * without touching the cells of the grid.
+     *
+     * The pyramid doesn't know about the grid it describes, the owner has to keep it
+     * up to date by calling update() for every modified cell.
+     */
+    class MinMaxPyramid
+    {
+    public:
+        /** Height range of a cell or block, empty blocks have min > max */
+        struct Range
+        {
+            float min;
+            float max;
+
+            Range()
+                : min(std::numeric_limits<float>::infinity())
+                , max(-std::numeric_limits<float>::infinity())
+            {}
+
+            Range(float min, float max)
+                : min(min), max(max)
+            {}
+
+            bool isEmpty() const
+            {
+                return min > max;
+            }
+
+            void extend(const Range& other)
+            {
+                min = std::min(min, other.min);
+                max = std::max(max, other.max);
+            }
+
+            /** Closed interval overlap, same as tools::overlap */
+            bool overlaps(float other_min, float other_max) const
+            {
+                return min <= other_max && max >= other_min;
+            }
+
+            bool operator==(const Range& other) const
+            {
+                return (min == other.min && max == other.max) || (isEmpty() && other.isEmpty());
+            }
+
+            bool operator!=(const Range& other) const
+            {
+                return !(*this == other);
+            }
+        };
+
+        MinMaxPyramid()
+        {
+        }
+
+        MinMaxPyramid(const Vector2ui& num_cells)
+        {
+            resize(num_cells);
+        }
+
+        /** Resizes the pyramid to the given number of cells, all cells are empty afterwards */
+        void resize(const Vector2ui& num_cells)
+        {
+            levels.clear();
+            level_sizes.clear();
+            if(num_cells.prod() == 0)
+                return;
+            Vector2ui size = num_cells;
+            while(true)
+            {
+                level_sizes.push_back(size);
+                levels.push_back(std::vector<Range>(size.prod()));
+                if(size.x() <= 1 && size.y() <= 1)
+                    break;
+                size = Vector2ui((size.x() + 1) / 2, (size.y() + 1) / 2);
+            }
+        }
+
+        /** Sets all cells to empty */
+        void clear()
+        {
+            for(std::vector<Range>& level : levels)
+                std::fill(level.begin(), level.end(), Range());
+        }
+
+        /** Returns false if the pyramid wasn't resized to a grid yet */
+        bool isInitialized() const
+        {
+            return !levels.empty();
+        }
+
+        size_t getNumLevels() const
+        {
+            return levels.size();
+        }
+
+        const Vector2ui& getNumCells() const
+        {
+            return level_sizes.front();
+        }
+
+        /** Number of blocks in x and y direction of the given level */
+        const Vector2ui& getNumBlocks(size_t level) const
+        {
+            return level_sizes[level];
+        }
+
+        /** Range of block (x, y) of the given level, level 0 are the cells */
+        const Range& getBlock(size_t level, unsigned int x, unsigned int y) const
+        {
+            return levels[level][x + y * level_sizes[level].x()];
+        }
+
+        /** Returns true if any cell of block (x, y) of the given level contains data */
+        bool isOccupied(size_t level, unsigned int x, unsigned int y) const
+        {
+            return !getBlock(level, x, y).isEmpty();
+        }
+
+        /** Returns the range of a single cell */
+        const Range& getCell(const Index& idx) const
+        {
+            return getBlock(0, idx.x(), idx.y());
+        }
+
+        /** Returns the range of all cells, this is O(1) */
+        const Range& getRange() const
+        {
+            static const Range empty;
+            if(levels.empty())
+                return empty;
+            return levels.back().front();
+        }
+
+        /**
+         * Sets the range of a cell and updates the coarser levels.
+         * The update stops as soon as a block doesn't change.
+         * @throw std::runtime_error if the index is outside of the pyramid
+         */
+        void update(const Index& idx, const Range& range)
+        {
+            if(levels.empty() || idx.x() < 0 || idx.y() < 0 ||
+               (unsigned int)idx.x() >= level_sizes[0].x() || (unsigned int)idx.y() >= level_sizes[0].y())
+                throw std::runtime_error("Provided index is out of the pyramid");
+            unsigned int x = idx.x(), y = idx.y();
+            levels[0][x + y * level_sizes[0].x()] = range;
+            for(size_t level = 1; level < levels.size(); ++level)
+            {
+                x /= 2;
+                y /= 2;
+                Range& block = levels[level][x + y * level_sizes[level].x()];
+                const Range merged = mergeChildren(level, x, y);
+                if(merged == block)
+                    break;
+                block = merged;
+            }
+        }
+
+        /**
+         * Sets the range of a cell without updating the coarser levels.
+         * Call updateLevels() after all cells are set.
+         */
+        void setCell(const Index& idx, const Range& range)
+        {
+            levels[0][idx.x() + idx.y() * level_sizes[0].x()] = range;
+        }
+
+        /** Recomputes all coarser levels from the cells */
+        void updateLevels()
+        {
+            for(size_t level = 1; level < levels.size(); ++level)
+            {
+                for(unsigned int y = 0; y < level_sizes[level].y(); ++y)
+                    for(unsigned int x = 0; x < level_sizes[level].x(); ++x)
+                        levels[level][x + y * level_sizes[level].x()] = mergeChildren(level, x, y);
+            }
+        }
+
+        /**
+         * Returns the range of the cells in [min_idx, max_idx).
+         * Blocks completely inside of the region are used as a whole,
+         * so only blocks along the border of the region are refined.
+         */
+        Range getRange(const Index& min_idx, const Index& max_idx) const
+        {
+            Range range;
+            Index min_clipped, max_clipped;
+            if(clip(min_idx, max_idx, min_clipped, max_clipped))
+                collectRange(levels.size() - 1, 0, 0, min_clipped, max_clipped, range);
+            return range;
+        }
+
+        /**
+         * Returns the bounding box of all cells containing data, the box is empty if there are none.
+         * For each border only the blocks which can still extend it are refined.
+         */
+        CellExtents getCellExtents() const
+        {
+            CellExtents extents;
+            if(getRange().isEmpty())
+                return extents;
+
+            for(int axis = 0; axis < 2; ++axis)
+            {
+                for(int maximum = 0; maximum < 2; ++maximum)
+                {
+                    Index extreme;
+                    int best = maximum ? -1 : std::numeric_limits<int>::max();
+                    findExtremeCell(levels.size() - 1, 0, 0, axis, maximum, best, extreme);
+                    extents.extend(extreme.cast<unsigned int>());
+                }
+            }
+            return extents;
+        }
+
+        /** Returns true if any cell in [min_idx, max_idx) overlaps with [min, max] */
+        bool overlaps(const Index& min_idx, const Index& max_idx, float min, float max) const
+        {
+            bool found = false;
+            visitOverlapping(min_idx, max_idx, min, max, [&found](const Index&)
+            {
+                found = true;
+                return true;
+            });
+            return found;
+        }
+
+        /**
+         * Calls f(idx) for each cell in [min_idx, max_idx) which overlaps with [min, max].
+         * Blocks not overlapping with the height range are skipped as a whole,
+         * the cells are visited in quadtree order.
+         * If f returns true the traversal is aborted.
+         * @return true if the traversal was aborted
+         */
+        template<class Function>
+        bool visitOverlapping(const Index& min_idx, const Index& max_idx, float min, float max, Function&& f) const
+        {
+            Index min_clipped, max_clipped;
+            if(!clip(min_idx, max_idx, min_clipped, max_clipped))
+                return false;
+            return visitBlock(levels.size() - 1, 0, 0, min_clipped, max_clipped, min, max, f);
+        }
+
+    private:
+        /** Range per block, starting with the cells on level 0 */
+        std::vector<std::vector<Range> > levels;
+
+        /** Number of blocks per level */
+        std::vector<Vector2ui> level_sizes;
+
+        Range mergeChildren(size_t level, unsigned int x, unsigned int y) const
+        {
+            const std::vector<Range>& children = levels[level - 1];
+            const Vector2ui& child_size = level_sizes[level - 1];
+            const unsigned int x_end = std::min(2 * x + 2, child_size.x());
+            const unsigned int y_end = std::min(2 * y + 2, child_size.y());
+            Range merged;
+            for(unsigned int cy = 2 * y; cy < y_end; ++cy)
+                for(unsigned int cx = 2 * x; cx < x_end; ++cx)
+                    merged.extend(children[cx + cy * child_size.x()]);
+            return merged;
+        }
+
+        bool clip(const Index& min_idx, const Index& max_idx, Index& min_clipped, Index& max_clipped) const
+        {
+            if(levels.empty())
+                return false;
+            min_clipped = min_idx.cwiseMax(0);
+            max_clipped = max_idx.cwiseMin(getNumCells().cast<int>());
+            return (min_clipped.array() < max_clipped.array()).all();
+        }
+
+        /** Cell range [begin, end) covered by a block */
+        static void getBlockCells(size_t level, unsigned int x, unsigned int y, Index& begin, Index& end)
+        {
+            begin = Index(x << level, y << level);
+            end = Index((x + 1) << level, (y + 1) << level);
+        }
+
+        void collectRange(size_t level, unsigned int x, unsigned int y, const Index& min_idx, const Index& max_idx, Range& range) const
+        {
+            const Range& block = getBlock(level, x, y);
+            if(block.isEmpty())
+                return;
+
+            Index begin, end;
+            getBlockCells(level, x, y, begin, end);
+            if((end.array() <= min_idx.array()).any() || (begin.array() >= max_idx.array()).any())
+                return;
+            if(level == 0 || ((begin.array() >= min_idx.array()).all() && (end.array() <= max_idx.array()).all()))
+            {
+                range.extend(block);
+                return;
+            }
+
+            const Vector2ui& child_size = level_sizes[level - 1];
+            for(unsigned int cy = 2 * y; cy < std::min(2 * y + 2, child_size.y()); ++cy)
+                for(unsigned int cx = 2 * x; cx < std::min(2 * x + 2, child_size.x()); ++cx)
+                    collectRange(level - 1, cx, cy, min_idx, max_idx, range);
+        }
+
+        /** Finds the occupied cell with the smallest or largest coordinate along axis */
+        void findExtremeCell(size_t level, unsigned int x, unsigned int y, int axis, bool maximum, int& best, Index& extreme) const
+        {
+            if(!isOccupied(level, x, y))
+                return;
+
+            Index begin, end;
+            getBlockCells(level, x, y, begin, end);
+            if(maximum ? std::min<int>(end[axis], getNumCells()[axis]) - 1 <= best : begin[axis] >= best)
+                return;
+            if(level == 0)
+            {
+                best = begin[axis];
+                extreme = begin;
+                return;
+            }
+
+            // visit the children closest to the searched border first
+            const Vector2ui& child_size = level_sizes[level - 1];
+            for(int i = 0; i < 2; ++i)
+            {
+                const int along = maximum ? 1 - i : i;
+                for(int j = 0; j < 2; ++j)
+                {
+                    Index child = axis == 0 ? Index(2 * x + along, 2 * y + j) : Index(2 * x + j, 2 * y + along);
+                    if(child.isInside(child_size))
+                        findExtremeCell(level - 1, child.x(), child.y(), axis, maximum, best, extreme);
+                }
+            }
+        }
+
+        template<class Function>
+        bool visitBlock(size_t level, unsigned int x, unsigned int y, const Index& min_idx, const Index& max_idx,
+                        float min, float max, Function& f) const
+        {
+            const Range& block = getBlock(level, x, y);
+            if(!block.overlaps(min, max))
+                return false;
+
+            Index begin, end;
+            getBlockCells(level, x, y, begin, end);
+            if((end.array() <= min_idx.array()).any() || (begin.array() >= max_idx.array()).any())
+                return false;
+            if(level == 0)
+                return f(begin);
+
+            const Vector2ui& child_size = level_sizes[level - 1];
+            for(unsigned int cy = 2 * y; cy < std::min(2 * y + 2, child_size.y()); ++cy)
+                for(unsigned int cx = 2 * x; cx < std::min(2 * x + 2, child_size.x()); ++cx)
+                    if(visitBlock(level - 1, cx, cy, min_idx, max_idx, min, max, f))
+                        return true;
+            return false;
+        }
+    };
+
+}}
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <algorithm>
+
 #include "LevelList.hpp"
 #include "GridMap.hpp"
+#include "SparseGrid.hpp"
+#include "MinMaxPyramid.hpp"
 #include "../tools/Overlap.hpp"
 
 namespace maps { namespace grid
@@ -17,16 +21,18 @@ namespace maps { namespace grid
         MultiLevelGridMap(const Vector2ui &num_cells,
                     const Eigen::Vector2d &resolution,
                     const boost::shared_ptr<LocalMapData> &data) : GridMap<LevelList<P> >(num_cells, resolution, LevelList<P>(), data)
+                    , disjoint_patches(false)
         {}
 
         MultiLevelGridMap(const Vector2ui &num_cells,
                     const Eigen::Vector2d &resolution) : GridMap<LevelList<P> >(num_cells, resolution, LevelList<P>())
+                    , disjoint_patches(false)
         {}
         
-        MultiLevelGridMap() {}
+        MultiLevelGridMap() : disjoint_patches(false) {}
         
         template<class Q>
-        MultiLevelGridMap(const MultiLevelGridMap<Q> &other) : GridMap<CellType>(other, other)
+        MultiLevelGridMap(const MultiLevelGridMap<Q> &other) : GridMap<CellType>(other, other), disjoint_patches(false)
         {
         }
 
@@ -42,12 +48,139 @@ namespace maps { namespace grid
             {
             };
         };
+
+        /**
+         * Result of intersectCuboidSparse. Only cells containing intersecting patches are stored,
+         * so the iterators visit (linear index, cell) pairs, see SparseGrid.
+         */
+        class SparseView : public GridMap<LevelList<const P *>, SparseGrid<LevelList<const P *> > >
+        {
+            typedef GridMap<LevelList<const P *>, SparseGrid<LevelList<const P *> > > Base;
+        public:
+            SparseView(const Vector2ui &num_cells,
+                const Eigen::Vector2d &resolution) : Base(num_cells, resolution, LevelList<const P *>())
+            {
+            };
+            
+            SparseView() : Base()
+            {
+            };
+        };
+
+        /**
+         * Enables the min/max height pyramid over the cells, see MinMaxPyramid.
+         * The intersection tests use it to skip empty or out of range blocks of cells.
+         * The pyramid is built from the current cells. Modifications through the grid
+         * interface (at, the iterators, resize, moveBy, clear, ...) are detected with the
+         * modification tracking of the grid, see VectorGrid::setModificationTracking:
+         * the intersection tests visit all cells until updateHeightPyramid is called.
+         * MLSMap::mergePatch keeps the pyramid up to date. The pyramid isn't serialized.
+         */
+        void enableHeightPyramid()
+        {
+            this->setModificationTracking(true);
+            rebuildHeightPyramid();
+        }
+
+        void disableHeightPyramid()
+        {
+            height_pyramid = MinMaxPyramid();
+            this->setModificationTracking(false);
+        }
+
+        /**
+         * Declares that the patches of each cell don't overlap, i.e. that their minimum
+         * and maximum are sorted in the same order as the patches. The intersection tests
+         * then use a binary search within the cells instead of testing all patches.
+         * This is only valid if every modification of the cells keeps the patches disjoint,
+         * MLSMap enables it for the update models merging overlapping patches.
+         * Disabled by default.
+         */
+        void setDisjointPatches(bool disjoint)
+        {
+            disjoint_patches = disjoint;
+        }
+
+        bool hasDisjointPatches() const
+        {
+            return disjoint_patches;
+        }
+
+        bool hasHeightPyramid() const
+        {
+            return height_pyramid.isInitialized();
+        }
+
+        const MinMaxPyramid& getHeightPyramid() const
+        {
+            return height_pyramid;
+        }
+
+        /**
+         * Updates the height pyramid after the cell at @p idx was modified, if the pyramid is enabled.
+         * Also updates the rows modified through the grid interface, see updateHeightPyramid().
+         */
+        void updateHeightPyramid(const Index& idx)
+        {
+            if(!height_pyramid.isInitialized())
+                return;
+            updateHeightPyramid();
+            height_pyramid.update(idx, computeHeightRange(getCell(idx)));
+        }
+
+        /**
+         * Updates the height pyramid for the rows modified through the grid interface, if the pyramid is enabled.
+         * Only the modified rows are visited, unless all rows were modified or the grid was resized.
+         */
+        void updateHeightPyramid()
+        {
+            if(!height_pyramid.isInitialized() || !this->hasModifiedRows())
+                return;
+
+            const Vector2ui& num_cells = this->getNumCells();
+            std::vector<unsigned int> rows;
+            if(!this->hasAllRowsModified() && height_pyramid.getNumCells() == num_cells)
+            {
+                for(unsigned int y = 0; y < num_cells.y(); ++y)
+                    if(this->isRowModified(y))
+                        rows.push_back(y);
+            }
+
+            // updating a cell touches all levels, so many modified rows are rebuilt at once
+            if(rows.empty() || rows.size() * 8 > num_cells.y())
+            {
+                rebuildHeightPyramid();
+                return;
+            }
+            for(unsigned int y : rows)
+                for(unsigned int x = 0; x < num_cells.x(); ++x)
+                    height_pyramid.update(Index(x, y), computeHeightRange(getCell(Index(x, y))));
+            this->resetModifiedRows();
+        }
+
+        /**
+         * Returns the first patch in @p cell whose top is not below @p min_height.
+         * Uses a binary search, which requires that the patches in the cell don't overlap,
+         * i.e. that minimum and maximum are sorted in the same order as the patches.
+         * See setDisjointPatches.
+         */
+        static typename CellType::const_iterator findFirstAbove(const CellType& cell, double min_height)
+        {
+            return std::partition_point(cell.begin(), cell.end(),
+                [min_height](const P& p) { return p.getMax() < min_height; });
+        }
     
         View intersectCuboid(const Eigen::AlignedBox3d& box) const
         {
             size_t ignore;
             return intersectCuboid(box, ignore);
         }
+
+        SparseView intersectCuboidSparse(const Eigen::AlignedBox3d& box) const
+        {
+            size_t ignore;
+            return intersectCuboidSparse(box, ignore);
+        }
         
         typedef std::vector<std::pair<Index, const P*>> PatchVector;
 
@@ -73,7 +206,9 @@ namespace maps { namespace grid
          *            The return value of the the callback indicates whether
          *            the intersection test should abort or not.
          *            I.e. if the callback returns true, the intersection test
-         *            will be aborted.*/
+         *            will be aborted.
+         * If the height pyramid is enabled the cells are visited in quadtree order,
+         * otherwise row by row. */
         template<class CallBack>
         void intersectAABB_callback(const Eigen::AlignedBox3d& box, CallBack&& cb) const
         {
@@ -86,21 +221,10 @@ namespace maps { namespace grid
             minIdx = minIdx.cwiseMax(0);
             maxIdx = maxIdx.cwiseMin(this->getNumCells().template cast<int>());
 
-            for(int y = minIdx.y(); y < maxIdx.y(); y++)
+            forEachIntersectingCell(minIdx, maxIdx, minHeight, maxHeight, [&](const Index& curIdx)
             {
-                for(int x = minIdx.x();x < maxIdx.x(); x++)
-                {
-                    const Index curIdx(x,y);
-                    for(const P &p: this->at(curIdx))
-                    {
-                        if(::maps::tools::overlap(p.getMin(), p.getMax(), minHeight, maxHeight))
-                        {
-                            if(cb(curIdx, p))
-                                return;
-                        }
-                    }
-                }
-            }
+                return intersectCell(curIdx, minHeight, maxHeight, cb);
+            });
         }
         
 
@@ -109,6 +233,28 @@ namespace maps { namespace grid
         /** @param outNumIntersections contains the number of mls patches that
                                        intersected the @p box*/
         View intersectCuboid(const Eigen::AlignedBox3d& box, size_t& outNumIntersections) const
+        {
+            return intersectCuboid<View>(box, outNumIntersections);
+        }
+
+        /** Like intersectCuboid, but the result only stores the cells containing intersecting patches.
+         *  This saves memory and time for large boxes with few intersections.
+         *  @param outNumIntersections contains the number of mls patches that
+                                       intersected the @p box*/
+        SparseView intersectCuboidSparse(const Eigen::AlignedBox3d& box, size_t& outNumIntersections) const
+        {
+            return intersectCuboid<SparseView>(box, outNumIntersections);
+        }
+
+    protected:
+        /** Optional min/max heights of the cells, see enableHeightPyramid */
+        MinMaxPyramid height_pyramid;
+
+        /** If set, the patches of a cell don't overlap, see setDisjointPatches */
+        bool disjoint_patches;
+
+        template<class ViewT>
+        ViewT intersectCuboid(const Eigen::AlignedBox3d& box, size_t& outNumIntersections) const
         {
             double minHeight = box.min().z();
             double maxHeight = box.max().z();
@@ -119,38 +265,125 @@ namespace maps { namespace grid
             
             if(!this->toGrid(box.min(), minIdx))
             {
-                return View();
+                return ViewT();
             }
 
             if(!this->toGrid(box.max(), maxIdx))
             {
-                return View();
+                return ViewT();
             }
             
             Index newSize(maxIdx-minIdx);
             
-            View ret(Vector2ui(newSize.x(), newSize.y()) , this->getResolution());
+            ViewT ret(Vector2ui(newSize.x(), newSize.y()) , this->getResolution());
             
-            for(Index::Scalar y = minIdx.y(); y < maxIdx.y(); y++)
+            forEachIntersectingCell(minIdx, maxIdx, minHeight, maxHeight, [&](const Index& curIdx)
             {
-                for(Index::Scalar x = minIdx.x();x < maxIdx.x(); x++)
+                LevelList<const P *> *retList = NULL;
+                return intersectCell(curIdx, minHeight, maxHeight, [&](const Index&, const P& p)
                 {
-                    Index curIdx(x,y);
-                    
-                    LevelList<const P *> &retList(ret.at(Index(curIdx - minIdx)));
-                    
-                    for(const P &p: this->at(curIdx))
+                    // only cells with intersections are accessed, a SparseView only stores these
+                    if(!retList)
+                        retList = &ret.at(Index(curIdx - minIdx));
+                    retList->insert(retList->end(), &p);
+                    ++outNumIntersections;
+                    return false;
+                });
+            });
+            
+            return ret;
+        }
+
+        /** Read access to a cell which doesn't count as modification, see VectorGrid::setModificationTracking */
+        const CellType& getCell(const Index& idx) const
+        {
+            return this->at(idx);
+        }
+
+        /** Builds the height pyramid from all cells and resets the modified rows */
+        void rebuildHeightPyramid()
+        {
+            const Vector2ui& num_cells = this->getNumCells();
+            height_pyramid.resize(num_cells);
+            this->resetModifiedRows();
+            if(!height_pyramid.isInitialized())
+                return;
+            for(unsigned int y = 0; y < num_cells.y(); ++y)
+                for(unsigned int x = 0; x < num_cells.x(); ++x)
+                    height_pyramid.setCell(Index(x, y), computeHeightRange(getCell(Index(x, y))));
+            height_pyramid.updateLevels();
+        }
+
+        /** Returns true if the height pyramid is enabled and no rows were modified since its last update */
+        bool useHeightPyramid() const
+        {
+            return height_pyramid.isInitialized() && !this->hasModifiedRows() && height_pyramid.getNumCells() == this->getNumCells();
+        }
+
+        static MinMaxPyramid::Range computeHeightRange(const CellType& cell)
+        {
+            MinMaxPyramid::Range range;
+            for(const P& p : cell)
+                range.extend(MinMaxPyramid::Range(p.getMin(), p.getMax()));
+            return range;
+        }
+
+        /**
+         * Calls f(idx) for the cells in [minIdx, maxIdx) which may contain patches
+         * overlapping with [minHeight, maxHeight], until f returns true.
+         */
+        template<class Function>
+        void forEachIntersectingCell(const Index& minIdx, const Index& maxIdx, double minHeight, double maxHeight, Function&& f) const
+        {
+            if(useHeightPyramid())
+            {
+                height_pyramid.visitOverlapping(minIdx, maxIdx, minHeight, maxHeight, f);
+                return;
+            }
+
+            for(int y = minIdx.y(); y < maxIdx.y(); y++)
+            {
+                for(int x = minIdx.x();x < maxIdx.x(); x++)
+                {
+                    if(f(Index(x,y)))
+                        return;
+                }
+            }
+        }
+
+        /**
+         * Calls cb(idx, patch) for each patch in the cell overlapping with [minHeight, maxHeight].
+         * @return true if the callback aborted the search
+         */
+        template<class CallBack>
+        bool intersectCell(const Index& idx, double minHeight, double maxHeight, CallBack&& cb) const
+        {
+            const CellType& cell = this->at(idx);
+            if(!disjoint_patches)
+            {
+                for(const P &p : cell)
+                {
+                    if(::maps::tools::overlap(p.getMin(), p.getMax(), minHeight, maxHeight))
                     {
-                        if(::maps::tools::overlap(p.getMin(), p.getMax(), minHeight, maxHeight))
-                        {
-                            retList.insert(&p);
-                            ++outNumIntersections;
-                        }
+                        if(cb(idx, p))
+                            return true;
                     }
                 }
+                return false;
             }
-            
-            return ret;
+
+            for(typename CellType::const_iterator it = findFirstAbove(cell, minHeight); it != cell.end(); ++it)
+            {
+                // patches are sorted, none of the following patches can overlap
+                if(it->getMin() > maxHeight)
+                    break;
+                if(::maps::tools::overlap(it->getMin(), it->getMax(), minHeight, maxHeight))
+                {
+                    if(cb(idx, *it))
+                        return true;
+                }
+            }
+            return false;
         }
         
     };
@@ -4,6 +4,7 @@
 
 #include <boost/serialization/access.hpp>
 #include <boost/serialization/nvp.hpp>
+#include <boost/serialization/version.hpp>
 
 namespace maps { namespace grid
 {
@@ -13,14 +14,16 @@ struct OccupancyConfiguration
     OccupancyConfiguration(double hit_probability = 0.7, double miss_probability = 0.4,
                          double occupied_probability = 0.8, double free_space_probability = 0.3,
                          double max_probability = 0.971, double min_probability = 0.1192,
-                         float uncertainty_threshold = 0.25) :
+                         float uncertainty_threshold = 0.25, float max_range = 0.f, float min_range = 0.f) :
                         hit_logodds(OccupancyPatch::logodds(hit_probability)),
                         miss_logodds(OccupancyPatch::logodds(miss_probability)),
                         occupied_logodds(OccupancyPatch::logodds(occupied_probability)),
                         free_space_logodds(OccupancyPatch::logodds(free_space_probability)),
                         max_logodds(OccupancyPatch::logodds(max_probability)) ,
                         min_logodds(OccupancyPatch::logodds(min_probability)),
-                        uncertainty_threshold(uncertainty_threshold) {}
+                        uncertainty_threshold(uncertainty_threshold),
+                        max_range(max_range),
+                        min_range(min_range) {}
 
     float hit_logodds;
     float miss_logodds;
@@ -30,6 +33,12 @@ struct OccupancyConfiguration
     float min_logodds;
     float uncertainty_threshold;
 
+    /** Measurements further away are only used to update the free space up to this range, 0 disables the limit */
+    float max_range;
+
+    /** Measurements closer to the sensor are ignored and the rays start at this range */
+    float min_range;
+
 protected:
     /** Grants access to boost serialization */
     friend class boost::serialization::access;
@@ -45,7 +54,14 @@ protected:
         ar & BOOST_SERIALIZATION_NVP(max_logodds);
         ar & BOOST_SERIALIZATION_NVP(min_logodds);
         ar & BOOST_SERIALIZATION_NVP(uncertainty_threshold);
+        if(version >= 1)
+        {
+            ar & BOOST_SERIALIZATION_NVP(max_range);
+            ar & BOOST_SERIALIZATION_NVP(min_range);
+        }
     }
 };
 
-}}
\ No newline at end of file
+}}
+
+BOOST_CLASS_VERSION(maps::grid::OccupancyConfiguration, 1)
@@ -5,7 +5,8 @@
 using namespace maps::grid;
 using namespace maps::tools;
 
-void OccupancyGridMap::mergePointCloud(const OccupancyGridMap::PointCloud& pc, const base::Transform3d& pc2grid)
+template<class CellT>
+void OccupancyVoxelGridMap<CellT>::mergePointCloud(const PointCloud& pc, const base::Transform3d& pc2grid)
 {
     Eigen::Vector3d sensor_origin = pc.sensor_origin_.block(0,0,3,1).cast<double>();
     Eigen::Vector3d sensor_origin_in_grid = pc2grid * sensor_origin;
@@ -15,11 +16,11 @@ void OccupancyGridMap::mergePointCloud(const OccupancyGridMap::PointCloud& pc, c
         std::cerr << "Sensor origin (" << sensor_origin_in_grid.transpose() << ") is outside of the grid! Can't add corresponding point cloud to grid." << std::endl;
         return;
     }
-    for(PointCloud::const_iterator it=pc.begin(); it != pc.end(); ++it)
+    for(typename PointCloud::const_iterator it=pc.begin(); it != pc.end(); ++it)
     {
         try
         {
-            Eigen::Vector3d measurement = it->getArray3fMap().cast<double>();
+            Eigen::Vector3d measurement = it->getArray3fMap().template cast<double>();
             mergePoint(sensor_origin_in_grid, sensor_origin_idx, pc2grid * measurement);
         }
         catch(const std::runtime_error& e)
@@ -28,9 +29,11 @@ void OccupancyGridMap::mergePointCloud(const OccupancyGridMap::PointCloud& pc, c
             std::cerr << e.what() << std::endl;
         }
     }
+    VoxelGridBase::enforceMemoryBudget(PrunePredicate(*this));
 }
 
-void OccupancyGridMap::mergePoint(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3d& measurement)
+template<class CellT>
+void OccupancyVoxelGridMap<CellT>::mergePoint(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3d& measurement)
 {
     Eigen::Vector3i sensor_origin_idx;
     if(VoxelGridBase::toVoxelGrid(sensor_origin, sensor_origin_idx))
@@ -41,32 +44,131 @@ void OccupancyGridMap::mergePoint(const Eigen::Vector3d& sensor_origin, const Ei
         throw std::runtime_error((boost::format("Sensor origin %1% is outside of the grid! Can't add to grid.") % sensor_origin.transpose()).str());
 }
 
-void OccupancyGridMap::mergePoint(const Eigen::Vector3d& sensor_origin, Eigen::Vector3i sensor_origin_idx, const Eigen::Vector3d& measurement)
+template<class CellT>
+void OccupancyVoxelGridMap<CellT>::mergePoint(const Eigen::Vector3d& sensor_origin, Eigen::Vector3i sensor_origin_idx, const Eigen::Vector3d& measurement)
 {
+    std::vector<VoxelTraversal::RayElement> ray;
+    mergePoint(sensor_origin, sensor_origin_idx, measurement, ray);
+}
+
+template<class CellT>
+void OccupancyVoxelGridMap<CellT>::mergePoint(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3i& sensor_origin_idx, const Eigen::Vector3d& measurement,
+                                              std::vector<VoxelTraversal::RayElement>& ray)
+{
+    mergeRay(sensor_origin, sensor_origin_idx, measurement, true, ray);
+}
+
+template<class CellT>
+void OccupancyVoxelGridMap<CellT>::mergeFreeSpaceRay(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3d& ray_end)
+{
+    Eigen::Vector3i sensor_origin_idx;
+    if(!VoxelGridBase::toVoxelGrid(sensor_origin, sensor_origin_idx))
+        throw std::runtime_error((boost::format("Sensor origin %1% is outside of the grid! Can't add to grid.") % sensor_origin.transpose()).str());
+
+    std::vector<VoxelTraversal::RayElement> ray;
+    mergeRay(sensor_origin, sensor_origin_idx, ray_end, false, ray);
+}
+
+template<class CellT>
+void OccupancyVoxelGridMap<CellT>::mergeRay(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3i& sensor_origin_idx, Eigen::Vector3d ray_end,
+                                            bool hit, std::vector<VoxelTraversal::RayElement>& ray)
+{
+    Eigen::Vector3d ray_start;
+    if(!OccupancyGridMapBase::clipRay(sensor_origin, ray_start, ray_end, hit))
+        return;
+
+    Eigen::Vector3i ray_start_idx = sensor_origin_idx;
+    if(ray_start != sensor_origin && !VoxelGridBase::toVoxelGrid(ray_start, ray_start_idx))
+        throw std::runtime_error((boost::format("Ray start %1% is outside of the grid! Can't add to grid.") % ray_start.transpose()).str());
+
     Eigen::Vector3i measurement_idx;
-    if(VoxelGridBase::toVoxelGrid(measurement, measurement_idx))
+    if(hit && !VoxelGridBase::toVoxelGrid(ray_end, measurement_idx))
+        throw std::runtime_error((boost::format("Point %1% or is outside of the grid! Can't add to grid.") % ray_end.transpose()).str());
+
+    if(!hit)
+        clipRayToGrid(VoxelGridBase::getLocalFrame(), VoxelGridBase::getSize(), VoxelGridBase::getResolution(), ray_start, ray_end);
+
+    VoxelTraversal::computeRay(VoxelGridBase::getVoxelResolution(), ray_start, ray_start_idx, ray_end, ray);
+
+    if(hit)
+        updateVoxel(VoxelGridBase::getVoxelCell(measurement_idx), measurement_idx, hit_logodds);
+
+    for(const VoxelTraversal::RayElement& element : ray)
     {
-        std::vector<VoxelTraversal::RayElement> ray;
-        VoxelTraversal::computeRay(VoxelGridBase::getVoxelResolution(), sensor_origin, sensor_origin_idx, measurement, ray);
+        // free space rays can leave the grid
+        if(!GridMapBase::inGrid(element.idx))
+            break;
+        DiscreteTree<VoxelCellType>& tree = GridMapBase::at(element.idx);
+        int32_t z_end = element.z_last + element.z_step;
+        for(int32_t z_idx = element.z_first; z_idx != z_end; z_idx += element.z_step)
+        {
+            updateVoxel(tree.getCellAt(z_idx), Eigen::Vector3i(element.idx.x(), element.idx.y(), z_idx), miss_logodds);
+        }
+    }
+}
 
-        VoxelCellType& cell = getVoxelCell(measurement_idx);
-        cell.updateLogOdds(config.hit_logodds, config.min_logodds, config.max_logodds);
+template<class CellT>
+void OccupancyVoxelGridMap<CellT>::mergePointCloud(const Eigen::Vector3d& sensor_origin, const std::vector<Eigen::Vector3d>& measurements)
+{
+    Eigen::Vector3i sensor_origin_idx;
+    if(!VoxelGridBase::toVoxelGrid(sensor_origin, sensor_origin_idx))
+    {
+        std::cerr << "Sensor origin (" << sensor_origin.transpose() << ") is outside of the grid! Can't add corresponding point cloud to grid." << std::endl;
+        return;
+    }
 
-        for(const VoxelTraversal::RayElement& element : ray)
+    std::vector<VoxelTraversal::RayElement> ray;
+    for(const Eigen::Vector3d& measurement : measurements)
+    {
+        try
+        {
+            mergePoint(sensor_origin, sensor_origin_idx, measurement, ray);
+        }
+        catch(const std::runtime_error& e)
         {
-            DiscreteTree<VoxelCellType>& tree = at(element.idx);
-            int32_t z_end = element.z_last + element.z_step;
-            for(int32_t z_idx = element.z_first; z_idx != z_end; z_idx += element.z_step)
-            {
-                tree.getCellAt(z_idx).updateLogOdds(config.miss_logodds, config.min_logodds, config.max_logodds);
-            }
+            // TODO use glog or base log for all out prints of this library
+            std::cerr << e.what() << std::endl;
         }
     }
-    else
-        throw std::runtime_error((boost::format("Point %1% or is outside of the grid! Can't add to grid.") % measurement.transpose()).str());
+    VoxelGridBase::enforceMemoryBudget(PrunePredicate(*this));
+}
+
+template<class CellT>
+void OccupancyVoxelGridMap<CellT>::filterFreeSpace(const std::vector<Eigen::Vector3d>& points, std::vector<bool>& free_space) const
+{
+    free_space.assign(points.size(), false);
+    if(points.empty())
+        return;
+
+    // compute the 2D grid positions of all points at once (same arithmetic as in toGrid)
+    const base::Transform3d& local_frame = GridMapBase::getLocalFrame();
+    Eigen::Map<const Eigen::Matrix3Xd> points_mat(points.front().data(), 3, points.size());
+    Eigen::Array2Xd idx_double = ((local_frame.linear().template topRows<2>() * points_mat).colwise()
+                                    + local_frame.translation().template head<2>()).array().colwise()
+                                    / GridMapBase::getResolution().array();
+
+    const DiscreteTree<VoxelCellType>* cell_tree = NULL;
+    Index cell_tree_idx;
+    for(size_t i = 0; i < points.size(); i++)
+    {
+        Index idx(std::floor(idx_double(0, i)), std::floor(idx_double(1, i)));
+        if(!GridMapBase::inGrid(idx))
+            continue;
+
+        // consecutive points are likely to fall into the same column
+        if(cell_tree == NULL || idx != cell_tree_idx)
+        {
+            cell_tree = &GridMapBase::at(idx);
+            cell_tree_idx = idx;
+        }
+
+        typename DiscreteTree<VoxelCellType>::const_iterator it = cell_tree->find((float)points[i].z());
+        free_space[i] = it != cell_tree->end() && it->second.getEncodedLogOdds() <= free_space_logodds;
+    }
 }
 
-bool OccupancyGridMap::isOccupied(const Eigen::Vector3d& point) const
+template<class CellT>
+bool OccupancyVoxelGridMap<CellT>::isOccupied(const Eigen::Vector3d& point) const
 {
     Index idx;
     if(GridMapBase::toGrid(point, idx))
@@ -74,14 +176,16 @@ bool OccupancyGridMap::isOccupied(const Eigen::Vector3d& point) const
     throw std::runtime_error((boost::format("Point %1% is outside of the grid!") % point.transpose()).str());
 }
 
-bool OccupancyGridMap::isOccupied(Index idx, float z) const
+template<class CellT>
+bool OccupancyVoxelGridMap<CellT>::isOccupied(Index idx, float z) const
 {
-    const DiscreteTree<VoxelCellType>& cell_tree = at(idx);
-    DiscreteTree<VoxelCellType>::const_iterator it = cell_tree.find(z);
-    return it != cell_tree.end() && it->second.getLogOdds() >= config.occupied_logodds;
+    const DiscreteTree<VoxelCellType>& cell_tree = GridMapBase::at(idx);
+    typename DiscreteTree<VoxelCellType>::const_iterator it = cell_tree.find(z);
+    return it != cell_tree.end() && it->second.getEncodedLogOdds() >= occupied_logodds;
 }
 
-bool OccupancyGridMap::isFreeSpace(const Eigen::Vector3d& point) const
+template<class CellT>
+bool OccupancyVoxelGridMap<CellT>::isFreeSpace(const Eigen::Vector3d& point) const
 {
     Index idx;
     if(GridMapBase::toGrid(point, idx))
@@ -89,21 +193,27 @@ bool OccupancyGridMap::isFreeSpace(const Eigen::Vector3d& point) const
     throw std::runtime_error((boost::format("Point %1% is outside of the grid!") % point.transpose()).str());
 }
 
-bool OccupancyGridMap::isFreeSpace(Index idx, float z) const
+template<class CellT>
+bool OccupancyVoxelGridMap<CellT>::isFreeSpace(Index idx, float z) const
 {
-    const DiscreteTree<VoxelCellType>& cell_tree = at(idx);
-    DiscreteTree<VoxelCellType>::const_iterator it = cell_tree.find(z);
-    return it != cell_tree.end() && it->second.getLogOdds() <= config.free_space_logodds;
+    const DiscreteTree<VoxelCellType>& cell_tree = GridMapBase::at(idx);
+    typename DiscreteTree<VoxelCellType>::const_iterator it = cell_tree.find(z);
+    return it != cell_tree.end() && it->second.getEncodedLogOdds() <= free_space_logodds;
 }
 
-bool OccupancyGridMap::hasSameFrame(const base::Transform3d& local_frame, const Vector2ui& num_cells, const Vector2d& resolution) const
+template<class CellT>
+bool OccupancyVoxelGridMap<CellT>::hasSameFrame(const base::Transform3d& local_frame, const Vector2ui& num_cells, const Vector2d& resolution) const
 {
-     if(getResolution() == resolution && getNumCells() == num_cells && getLocalFrame().isApprox(local_frame))
+     if(GridMapBase::getResolution() == resolution && GridMapBase::getNumCells() == num_cells && GridMapBase::getLocalFrame().isApprox(local_frame))
          return true;
      return false;
 }
 
+template class maps::grid::OccupancyVoxelGridMap<OccupancyPatch>;
+template class maps::grid::OccupancyVoxelGridMap<QuantizedOccupancyPatch>;
+
 BOOST_CLASS_EXPORT_IMPLEMENT(maps::grid::OccupancyGridMap);
+BOOST_CLASS_EXPORT_IMPLEMENT(maps::grid::QuantizedOccupancyGridMap);
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
@@ -111,4 +221,8 @@ BOOST_CLASS_EXPORT_IMPLEMENT(maps::grid::OccupancyGridMap);
 template void maps::grid::OccupancyGridMap::serialize(boost::archive::text_iarchive& arch, const unsigned int version);
 template void maps::grid::OccupancyGridMap::serialize(boost::archive::text_oarchive& arch, const unsigned int version);
 template void maps::grid::OccupancyGridMap::serialize(boost::archive::binary_iarchive& arch, const unsigned int version);
-template void maps::grid::OccupancyGridMap::serialize(boost::archive::binary_oarchive& arch, const unsigned int version);
\ No newline at end of file
+template void maps::grid::OccupancyGridMap::serialize(boost::archive::binary_oarchive& arch, const unsigned int version);
+template void maps::grid::QuantizedOccupancyGridMap::serialize(boost::archive::text_iarchive& arch, const unsigned int version);
+template void maps::grid::QuantizedOccupancyGridMap::serialize(boost::archive::text_oarchive& arch, const unsigned int version);
+template void maps::grid::QuantizedOccupancyGridMap::serialize(boost::archive::binary_iarchive& arch, const unsigned int version);
+template void maps::grid::QuantizedOccupancyGridMap::serialize(boost::archive::binary_oarchive& arch, const unsigned int version);
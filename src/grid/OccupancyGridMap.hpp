@@ -4,6 +4,7 @@
 #include "VoxelGridMap.hpp"
 #include "OccupancyGridMapBase.hpp"
 #include "OccupancyConfiguration.hpp"
+#include "../tools/VoxelTraversal.hpp"
 
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
@@ -11,25 +12,36 @@
 #include <boost/serialization/nvp.hpp>
 #include <boost/serialization/export.hpp>
 
+#include <limits>
+
 namespace maps { namespace grid
 {
 
-class OccupancyGridMap : public OccupancyGridMapBase, public VoxelGridMap<OccupancyPatch>
+/**
+ * Occupancy grid map storing voxels of type CellT.
+ * CellT has to provide the interface of the OccupancyPatch. All log-odds of the
+ * configuration are encoded once into CellT::LogOddsType, so updates and
+ * occupancy tests are done in the native representation of the voxel.
+ */
+template<class CellT>
+class OccupancyVoxelGridMap : public OccupancyGridMapBase, public VoxelGridMap<CellT>
 {
 public:
-    typedef OccupancyPatch VoxelCellType;
+    typedef CellT VoxelCellType;
+    typedef typename CellT::LogOddsType LogOddsType;
     typedef GridMap< DiscreteTree<VoxelCellType> > GridMapBase;
     typedef VoxelGridMap<VoxelCellType> VoxelGridBase;
     typedef pcl::PointCloud<pcl::PointXYZ> PointCloud;
 
-    OccupancyGridMap(): OccupancyGridMapBase(OccupancyConfiguration()),
-                        VoxelGridMap<OccupancyPatch>(Vector2ui::Zero(), Vector3d::Ones()) {}
-
-    OccupancyGridMap(const Vector2ui &num_cells, const Vector3d &resolution,
-                    const OccupancyConfiguration& config) :
-                    OccupancyGridMapBase(config),
-                    VoxelGridMap<OccupancyPatch>(num_cells, resolution) {}
-    virtual ~OccupancyGridMap() {}
+    OccupancyVoxelGridMap(const Vector2ui &num_cells, const Vector3d &resolution,
+                          const OccupancyConfiguration& config) :
+                          OccupancyGridMapBase(config),
+                          VoxelGridMap<CellT>(num_cells, resolution),
+                          prune_free_space(false)
+    {
+        updateEncodedConfiguration();
+    }
+    virtual ~OccupancyVoxelGridMap() {}
 
     void mergePointCloud(const PointCloud& pc, const base::Transform3d& pc2mls);
 
@@ -56,12 +68,24 @@ public:
                 std::cerr << e.what() << std::endl;
             }
         }
+        VoxelGridBase::enforceMemoryBudget(PrunePredicate(*this));
     }
 
     void mergePoint(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3d& measurement);
 
     void mergePoint(const Eigen::Vector3d& sensor_origin, Eigen::Vector3i sensor_origin_idx, const Eigen::Vector3d& measurement);
 
+    void mergeFreeSpaceRay(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3d& ray_end);
+
+    /** Merges all measurements taken from sensor_origin.
+     *  The sensor origin index and the ray buffer are only computed once per call. */
+    void mergePointCloud(const Eigen::Vector3d& sensor_origin, const std::vector<Eigen::Vector3d>& measurements);
+
+    /** Tests all points for free space in one pass.
+     *  The grid indices of all points are computed at once and consecutive
+     *  points falling into the same column share the column lookup. */
+    void filterFreeSpace(const std::vector<Eigen::Vector3d>& points, std::vector<bool>& free_space) const;
+
     bool isOccupied(const Eigen::Vector3d& point) const;
 
     bool isOccupied(Index idx, float z) const;
@@ -72,6 +96,107 @@ public:
 
     bool hasSameFrame(const base::Transform3d& local_frame, const Vector2ui &num_cells, const Vector2d &resolution) const;
 
+    /**
+     * Removes the voxels which still have the prior log-odds and, if enabled
+     * by setPruneFreeSpace, the voxels clamped to the minimal log-odds.
+     * Only num_columns grid columns are processed, the next call continues
+     * with the following columns. This allows to spread the pruning over time.
+     * Merging a point cloud prunes automatically if the memory budget is exceeded,
+     * see VoxelGridMap::setMemoryBudget.
+     * @return number of removed voxels
+     */
+    size_t prune(size_t num_columns = std::numeric_limits<size_t>::max())
+    {
+        return VoxelGridBase::pruneColumns(PrunePredicate(*this), num_columns);
+    }
+
+    /**
+     * If enabled, pruning also removes the voxels clamped to the minimal log-odds.
+     * These are unknown afterwards, i.e. they are no longer free space. Disabled by default.
+     */
+    void setPruneFreeSpace(bool enable)
+    {
+        prune_free_space = enable;
+    }
+
+    bool getPruneFreeSpace() const
+    {
+        return prune_free_space;
+    }
+
+protected:
+
+    struct PrunePredicate
+    {
+        PrunePredicate(const OccupancyVoxelGridMap& map) :
+            prior_logodds(CellT().getEncodedLogOdds()),
+            max_free_logodds(map.prune_free_space ? map.min_logodds : std::numeric_limits<LogOddsType>::lowest()) {}
+
+        bool operator()(const CellT& cell) const
+        {
+            const LogOddsType logodds = cell.getEncodedLogOdds();
+            return logodds == prior_logodds || logodds <= max_free_logodds;
+        }
+
+        LogOddsType prior_logodds;
+        LogOddsType max_free_logodds;
+    };
+
+    void mergePoint(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3i& sensor_origin_idx, const Eigen::Vector3d& measurement,
+                    std::vector<tools::VoxelTraversal::RayElement>& ray);
+
+    /**
+     * Updates the voxels on the ray as free space after clipping it with clipRay,
+     * and with clipRayToGrid if it has no hit, and the voxel of ray_end as occupied if hit is true.
+     */
+    void mergeRay(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3i& sensor_origin_idx, Eigen::Vector3d ray_end,
+                  bool hit, std::vector<tools::VoxelTraversal::RayElement>& ray);
+
+    /** Applies the log-odds update to a voxel and records it if it became occupied or free */
+    void updateVoxel(VoxelCellType& cell, const Eigen::Vector3i& idx, LogOddsType update)
+    {
+        const bool was_occupied = cell.getEncodedLogOdds() >= occupied_logodds;
+        cell.updateEncodedLogOdds(update, min_logodds, max_logodds);
+        if(was_occupied != (cell.getEncodedLogOdds() >= occupied_logodds))
+            VoxelGridBase::addChangedVoxel(idx, !was_occupied);
+    }
+
+    /** Encodes the log-odds of the configuration into LogOddsType.
+     *  Has to be called each time the configuration changed. */
+    void updateEncodedConfiguration()
+    {
+        hit_logodds = CellT::encodeLogOdds(config.hit_logodds);
+        miss_logodds = CellT::encodeLogOdds(config.miss_logodds);
+        occupied_logodds = CellT::encodeLogOdds(config.occupied_logodds);
+        free_space_logodds = CellT::encodeLogOdds(config.free_space_logodds);
+        max_logodds = CellT::encodeLogOdds(config.max_logodds);
+        min_logodds = CellT::encodeLogOdds(config.min_logodds);
+    }
+
+    LogOddsType hit_logodds;
+    LogOddsType miss_logodds;
+    LogOddsType occupied_logodds;
+    LogOddsType free_space_logodds;
+    LogOddsType max_logodds;
+    LogOddsType min_logodds;
+
+    /** not serialized */
+    bool prune_free_space;
+};
+
+/**
+ * Occupancy grid map using floating point log-odds voxels.
+ */
+class OccupancyGridMap : public OccupancyVoxelGridMap<OccupancyPatch>
+{
+public:
+    OccupancyGridMap(): OccupancyVoxelGridMap<OccupancyPatch>(Vector2ui::Zero(), Vector3d::Ones(), OccupancyConfiguration()) {}
+
+    OccupancyGridMap(const Vector2ui &num_cells, const Vector3d &resolution,
+                    const OccupancyConfiguration& config) :
+                    OccupancyVoxelGridMap<OccupancyPatch>(num_cells, resolution, config) {}
+    virtual ~OccupancyGridMap() {}
+
 protected:
 
     /** Grants access to boost serialization */
@@ -83,9 +208,41 @@ protected:
     {
         ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(OccupancyGridMapBase);
         ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(VoxelGridMap<OccupancyPatch>);
+        updateEncodedConfiguration();
+    }
+};
+
+/**
+ * Occupancy grid map using 16 bit fixed-point log-odds voxels.
+ * Needs half the voxel memory of the OccupancyGridMap and reduces
+ * the occupancy tests to integer comparisons.
+ */
+class QuantizedOccupancyGridMap : public OccupancyVoxelGridMap<QuantizedOccupancyPatch>
+{
+public:
+    QuantizedOccupancyGridMap(): OccupancyVoxelGridMap<QuantizedOccupancyPatch>(Vector2ui::Zero(), Vector3d::Ones(), OccupancyConfiguration()) {}
+
+    QuantizedOccupancyGridMap(const Vector2ui &num_cells, const Vector3d &resolution,
+                              const OccupancyConfiguration& config) :
+                              OccupancyVoxelGridMap<QuantizedOccupancyPatch>(num_cells, resolution, config) {}
+    virtual ~QuantizedOccupancyGridMap() {}
+
+protected:
+
+    /** Grants access to boost serialization */
+    friend class boost::serialization::access;
+
+    /** Serializes the members of this class*/
+    template <typename Archive>
+    void serialize(Archive &ar, const unsigned int version)
+    {
+        ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(OccupancyGridMapBase);
+        ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(VoxelGridMap<QuantizedOccupancyPatch>);
+        updateEncodedConfiguration();
     }
 };
 
 }}
 
-BOOST_CLASS_EXPORT_KEY(maps::grid::OccupancyGridMap);
\ No newline at end of file
+BOOST_CLASS_EXPORT_KEY(maps::grid::OccupancyGridMap);
+BOOST_CLASS_EXPORT_KEY(maps::grid::QuantizedOccupancyGridMap);
@@ -3,6 +3,10 @@
 #include "OccupancyConfiguration.hpp"
 
 #include <Eigen/Core>
+#include <algorithm>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
 #include <boost/serialization/access.hpp>
 #include <boost/serialization/nvp.hpp>
 #include <boost/serialization/assume_abstract.hpp>
@@ -17,15 +21,127 @@ public:
     virtual ~OccupancyGridMapBase() {}
 
     virtual void mergePoint(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3d& measurement) = 0;
+
+    /**
+     * Updates the voxels from the sensor origin to ray_end as free space
+     * without a hit at the end, e.g. for beams without return.
+     * The ray is clipped to the grid and to the range limits of the configuration.
+     * Throws a std::runtime_error if the map doesn't support free space rays.
+     */
+    virtual void mergeFreeSpaceRay(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3d& ray_end)
+    {
+        throw std::runtime_error("This occupancy map doesn't support free space rays");
+    }
+
     virtual bool isOccupied(const Eigen::Vector3d& point) const = 0;
     virtual bool isOccupied(Index idx, float z) const = 0;
     virtual bool isFreeSpace(const Eigen::Vector3d& point) const = 0;
     virtual bool isFreeSpace(Index idx, float z) const = 0;
     virtual bool hasSameFrame(const base::Transform3d& local_frame, const Vector2ui &num_cells, const Vector2d &resolution) const = 0;
 
+    /**
+     * Tests all given points for free space.
+     * After the call free_space has the size of points and is true for each point
+     * located in free space. Points outside of the grid are not considered as free space.
+     * Implementations should override this to avoid the per point overhead of isFreeSpace.
+     */
+    virtual void filterFreeSpace(const std::vector<Eigen::Vector3d>& points, std::vector<bool>& free_space) const
+    {
+        free_space.resize(points.size());
+        for(size_t i = 0; i < points.size(); i++)
+        {
+            try
+            {
+                free_space[i] = isFreeSpace(points[i]);
+            }
+            catch(const std::runtime_error& e)
+            {
+                free_space[i] = false;
+            }
+        }
+    }
+
+    /**
+     * Merges all measurements taken from the same sensor origin.
+     * Measurements which can't be added are reported and skipped.
+     * Implementations should override this to avoid the per point overhead of mergePoint.
+     */
+    virtual void mergePointCloud(const Eigen::Vector3d& sensor_origin, const std::vector<Eigen::Vector3d>& measurements)
+    {
+        for(const Eigen::Vector3d& measurement : measurements)
+        {
+            try
+            {
+                mergePoint(sensor_origin, measurement);
+            }
+            catch(const std::runtime_error& e)
+            {
+                // TODO use glog or base log for all out prints of this library
+                std::cerr << e.what() << std::endl;
+            }
+        }
+    }
+
     const OccupancyConfiguration& getConfig() const {return config;}
 
 protected:
+    /**
+     * Applies the range limits of the configuration to a ray starting at the sensor origin.
+     * The ray starts at min_range, if it ends beyond max_range it is
+     * shortened to max_range and has no hit at its end.
+     * @param hit has to be true if the ray ends in a measurement, set to false if the end was clipped
+     * @return false if the ray ends within min_range
+     * @throws std::runtime_error if the end of the ray is not finite
+     */
+    bool clipRay(const Eigen::Vector3d& sensor_origin, Eigen::Vector3d& ray_start, Eigen::Vector3d& ray_end, bool& hit) const
+    {
+        if(!ray_end.allFinite())
+            throw std::runtime_error("The end of the ray is not finite! Can't add to grid.");
+
+        ray_start = sensor_origin;
+        if(config.min_range <= 0.f && config.max_range <= 0.f)
+            return true;
+
+        const Eigen::Vector3d diff = ray_end - sensor_origin;
+        const double length = diff.norm();
+        if(length < config.min_range)
+            return false;
+        if(config.min_range > 0.f)
+            ray_start = sensor_origin + diff * (config.min_range / length);
+        if(config.max_range > 0.f && length > config.max_range)
+        {
+            ray_end = sensor_origin + diff * (config.max_range / length);
+            hit = false;
+        }
+        return true;
+    }
+
+    /**
+     * Shortens a free space ray which leaves the grid to one cell beyond the border
+     * of the grid, so the traversal, which leaves out the end voxel, still covers
+     * the border cells but doesn't follow the ray further.
+     * Only the xy extent is limited, the columns are unbounded.
+     * @param local_frame the local frame of the grid, see LocalMap::getLocalFrame
+     * @param size the size of the grid, ray_start has to be inside of it
+     * @param resolution the resolution of the grid
+     */
+    static void clipRayToGrid(const base::Transform3d& local_frame, const Vector2d& size, const Vector2d& resolution,
+                              const Eigen::Vector3d& ray_start, Eigen::Vector3d& ray_end)
+    {
+        const Eigen::Vector2d start = (local_frame * ray_start).head<2>();
+        const Eigen::Vector2d diff = (local_frame * ray_end).head<2>() - start;
+        double t = 1.0;
+        for(unsigned i = 0; i < 2; i++)
+        {
+            if(diff(i) > 0.0)
+                t = std::min(t, (size(i) + resolution(i) - start(i)) / diff(i));
+            else if(diff(i) < 0.0)
+                t = std::min(t, (-resolution(i) - start(i)) / diff(i));
+        }
+        if(t < 1.0)
+            ray_end = ray_start + (ray_end - ray_start) * std::max(t, 0.0);
+    }
+
     /** Grants access to boost serialization */
     friend class boost::serialization::access;
 
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <map>
+#include <stdexcept>
+
+#include <maps/grid/Index.hpp>
+
+namespace maps { namespace grid
+{
+
+    /**
+     * @brief Grid storage which only stores cells that were accessed for writing.
+     * @details
+     * Can be used as storage of a GridMap instead of VectorGrid if only few cells
+     * differ from the default value. Reading a cell which isn't stored returns the
+     * default value, non-const access adds the cell.
+     * Iteration only covers the stored cells in row-major order, use getIndex()
+     * to obtain the index of a stored cell.
+     */
+    template <typename CellT>
+    class SparseGrid
+    {
+        typedef std::map<size_t, CellT> Storage;
+
+        /** The stored cells, indexed by x + y * num_cells.x() **/
+        Storage cells;
+
+        /** Number of cells in X-axis and Y-axis **/
+        Vector2ui num_cells;
+
+        /** Default value **/
+        CellT default_value;
+
+    public:
+
+        typedef CellT CellType;
+        typedef typename Storage::iterator iterator;
+        typedef typename Storage::const_iterator const_iterator;
+
+        SparseGrid(Vector2ui size, CellT default_value)
+            : num_cells(size),
+              default_value(default_value)
+        {
+        }
+
+        SparseGrid(Vector2ui size)
+            : SparseGrid(size, CellT())
+        {
+        }
+
+        SparseGrid()
+            : SparseGrid(Vector2ui(0,0), CellT())
+        {
+        }
+
+        const CellT &getDefaultValue() const
+        {
+            return default_value;
+        }
+
+        iterator begin()
+        {
+            return cells.begin();
+        }
+
+        iterator end()
+        {
+            return cells.end();
+        }
+
+        const_iterator begin() const
+        {
+            return cells.begin();
+        }
+
+        const_iterator end() const
+        {
+            return cells.end();
+        }
+
+        /** Returns the index of a stored cell */
+        Index getIndex(const const_iterator& it) const
+        {
+            return Index(it->first % num_cells.x(), it->first / num_cells.x());
+        }
+
+        /** Number of stored cells */
+        size_t getNumStoredCells() const
+        {
+            return cells.size();
+        }
+
+        void resize(const Vector2ui &new_number_cells)
+        {
+            // stored cells would change their index, so the grid is cleared
+            if(new_number_cells != num_cells)
+                cells.clear();
+            num_cells = new_number_cells;
+        }
+
+        void moveBy(const Index &idx)
+        {
+            Storage tmp;
+            for(typename Storage::value_type& cell : cells)
+            {
+                const Index new_idx = Index(cell.first % num_cells.x(), cell.first / num_cells.x()) + idx;
+                if(new_idx.isInside(num_cells))
+                    tmp[toIdx(new_idx.x(), new_idx.y())] = std::move(cell.second);
+            }
+            cells.swap(tmp);
+        }
+
+        const CellT& at(const Index &idx) const
+        {
+            return this->at(idx.x(), idx.y());
+        }
+
+        CellT& at(const Index &idx)
+        {
+            return this->at(idx.x(), idx.y());
+        }
+
+        const CellT& at(size_t x, size_t y) const
+        {
+            if(x >= num_cells.x() || y >= num_cells.y())
+                throw std::runtime_error("Provided index is out of the grid");
+            const_iterator it = cells.find(toIdx(x, y));
+            if(it == cells.end())
+                return default_value;
+            return it->second;
+        }
+
+        CellT& at(size_t x, size_t y)
+        {
+            if(x >= num_cells.x() || y >= num_cells.y())
+                throw std::runtime_error("Provided index is out of the grid");
+            return cells.insert(std::make_pair(toIdx(x, y), default_value)).first->second;
+        }
+
+        /** Same as at(), there is no faster unchecked access for sparse storage */
+        const CellT& atUnchecked(size_t x, size_t y) const
+        {
+            return at(x, y);
+        }
+
+        CellT& atUnchecked(size_t x, size_t y)
+        {
+            return at(x, y);
+        }
+
+        const Vector2ui &getNumCells() const
+        {
+            return num_cells;
+        };
+
+        void clear()
+        {
+            cells.clear();
+        };
+
+    protected:
+        size_t toIdx(size_t x, size_t y) const
+        {
+            return x  +  y * num_cells.x();
+        }
+    };
+}}
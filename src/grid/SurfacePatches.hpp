@@ -19,6 +19,8 @@
 #include <cmath>
 #include <limits>
 #include <vector>
+#include <type_traits>
+#include <cstdint>
 
 
 namespace maps { namespace grid
@@ -98,7 +100,107 @@ public:
         return max;
     }
 
+    /**
+     * Precomputes derived values used by the queries, e.g. the surface plane.
+     * Nothing to do for this patch type.
+     */
+    void updatePlane()
+    {
+    }
+
+    /**
+     * Moves the patch by offset, e.g. to express it relative to the center of another cell.
+     */
+    void translate(const Vector3& offset)
+    {
+        min += offset.z();
+        max += offset.z();
+    }
+
+    /**
+     * Intersects the ray origin_in_cell + t * direction, t in [t_min, t_max], with this patch.
+     * The patch is treated as horizontal surface at its top.
+     * See intersectRayWithPlane for the details.
+     */
+    bool intersectRay(const Vector3& origin_in_cell, const Vector3& direction, float t_min, float t_max, float& t) const
+    {
+        return intersectRayWithPlane(Eigen::Hyperplane<float, 3>(Vector3::UnitZ(), -max), min, max, origin_in_cell, direction, t_min, t_max, t);
+    }
+
 protected:
+    /**
+     * Intersects the ray origin + t * direction, t in [t_min, t_max], with the solid below \c plane.
+     * All coordinates are relative to the cell center.
+     * The solid is the volume behind the plane between the heights \c min and \c max,
+     * i.e. a ray entering it through the side of the cell hits at \c t_min.
+     * As the fitted plane can leave the height band towards the cell borders,
+     * rays crossing the plane from the front are also accepted up to max - min below \c min.
+     * @return true if the ray hits, in this case \c t is set to the entry into the solid.
+     */
+    static bool intersectRayWithPlane(const Eigen::Hyperplane<float, 3>& plane, float min, float max,
+                                      const Vector3& origin, const Vector3& direction, float t_min, float t_max, float& t)
+    {
+        // tolerance on the height band, avoids missing flat patches due to rounding
+        const float z_tolerance = 1e-4f;
+        const float z_low = min - z_tolerance;
+        const float z_high = max + z_tolerance;
+
+        // clip the ray against the height band
+        float t_enter = t_min, t_exit = t_max;
+        if(direction.z() == 0.f)
+        {
+            if(origin.z() > z_high)
+                return false;
+            if(origin.z() < z_low)
+                t_exit = -1.f;
+        }
+        else
+        {
+            float t_low = (z_low - origin.z()) / direction.z();
+            float t_high = (z_high - origin.z()) / direction.z();
+            if(t_low > t_high)
+                std::swap(t_low, t_high);
+            t_enter = std::max(t_enter, t_low);
+            t_exit = std::min(t_exit, t_high);
+        }
+
+        // clip against the half space behind the plane
+        const float distance = plane.signedDistance(origin);
+        const float denominator = plane.normal().dot(direction);
+        float t_plane = -1.f;
+        if(denominator == 0.f)
+        {
+            if(distance > 0.f)
+                return false;
+        }
+        else
+        {
+            t_plane = -distance / denominator;
+            if(denominator < 0.f)
+                t_enter = std::max(t_enter, t_plane);
+            else
+                t_exit = std::min(t_exit, t_plane);
+        }
+
+        if(t_enter <= t_exit)
+        {
+            t = t_enter;
+            return true;
+        }
+
+        // the ray crosses the plane from the front slightly below min
+        if(denominator < 0.f && t_plane >= t_min && t_plane <= t_max)
+        {
+            const float z = origin.z() + t_plane * direction.z();
+            if(z <= z_high && z >= z_low - (max - min))
+            {
+                t = t_plane;
+                return true;
+            }
+        }
+        return false;
+    }
+
     /** Grants access to boost serialization */
     friend class boost::serialization::access;
 
@@ -130,15 +232,22 @@ class SurfacePatch<MLSConfig::SLOPE> : public SurfacePatchBase
     numeric::PlaneFitting<float> plane;
     float n;
 
+    /**
+     * Coefficients of the cached surface plane, NaN if not cached. Not serialized.
+     * Unaligned, so the cache adds 16 bytes to each patch but no alignment requirement.
+     */
+    Eigen::Matrix<float, 4, 1, Eigen::DontAlign> plane_coeffs;
+
 public:
 
-    SurfacePatch() : n(0)
+    SurfacePatch() : n(0), plane_coeffs(Eigen::Vector4f::Constant(base::NaN<float>()))
     {}
 
     SurfacePatch(const Eigen::Vector3f& point, const float& cov)
         : Base(point.z())
         , plane(point, 1.0f/cov)
         , n(1)
+        , plane_coeffs(Eigen::Vector4f::Constant(base::NaN<float>()))
     {}
 
     /**
@@ -183,25 +292,77 @@ public:
 
     Eigen::Vector3f getNormal() const
     {
+        if(hasCachedPlane()) return plane_coeffs.head<3>();
         if(n<=1.0f) return Eigen::Vector3f::UnitZ();
         return plane.getNormal();
     }
 
+    /**
+     * Returns the plane through the center with the normal of this patch.
+     * The plane is cached by updatePlane, otherwise it is computed on each call.
+     */
+    Eigen::Hyperplane<float, 3> getPlane() const
+    {
+        if(!hasCachedPlane())
+            return Eigen::Hyperplane<float, 3>(getNormal(), getCenter());
+        Eigen::Hyperplane<float, 3> cached_plane;
+        cached_plane.coeffs() = plane_coeffs;
+        return cached_plane;
+    }
+
+    /**
+     * Caches the surface plane until the next merge.
+     * Computing the normal requires an eigen decomposition, so this should be called
+     * before read heavy workloads, e.g. by MLSMap::updatePlanes.
+     */
+    void updatePlane()
+    {
+        if(!hasCachedPlane())
+            plane_coeffs = Eigen::Hyperplane<float, 3>(getNormal(), getCenter()).coeffs();
+    }
+
+    bool hasCachedPlane() const
+    {
+        return !std::isnan(plane_coeffs.x());
+    }
+
     bool merge(const SurfacePatch& other, const MLSConfig& config)
     {
         if(Base::merge(other, config.gapSize))
         {
             plane.update(other.plane);
             n+= other.n;
+            plane_coeffs.setConstant(base::NaN<float>());
             return true;
         }
 
         return false;
     }
 
+    /**
+     * Moves the patch by offset, the sums of the plane fitting are shifted accordingly.
+     */
+    void translate(const Vector3& offset)
+    {
+        Base::translate(offset);
+        const float dx = offset.x(), dy = offset.y(), dz = offset.z();
+        const float w = plane.n;
+        // the second order sums depend on the first order sums before the shift
+        plane.xx += 2.f * dx * plane.x + w * dx * dx;
+        plane.yy += 2.f * dy * plane.y + w * dy * dy;
+        plane.zz += 2.f * dz * plane.z + w * dz * dz;
+        plane.xy += dx * plane.y + dy * plane.x + w * dx * dy;
+        plane.xz += dx * plane.z + dz * plane.x + w * dx * dz;
+        plane.yz += dy * plane.z + dz * plane.y + w * dy * dz;
+        plane.x += w * dx;
+        plane.y += w * dy;
+        plane.z += w * dz;
+        plane_coeffs.setConstant(base::NaN<float>());
+    }
+
     float getClosestContactPoint(const Vector3& pos_in_cell, Vector3& contact_point) const
     {
-        Eigen::Hyperplane<float, 3> plane(getNormal(), getCenter());
+        const Eigen::Hyperplane<float, 3> plane = getPlane();
         const float distance = plane.signedDistance(pos_in_cell);
         contact_point = plane.projection(pos_in_cell);
         return distance;
@@ -209,13 +370,20 @@ public:
 
     float getSurfacePos(const Vector3& pos_in_cell) const
     {
-        Eigen::Hyperplane<float, 3> plane(getNormal(), getCenter());
+        const Eigen::Hyperplane<float, 3> plane = getPlane();
         float z_pos = (-plane.coeffs()(0) * pos_in_cell(0) - plane.coeffs()(1) * pos_in_cell(1) - plane.coeffs()(3)) / plane.coeffs()(2);
         if(z_pos > max) 
             z_pos = max;
         return z_pos;
     }
 
+    /** Intersects a ray given in cell coordinates with the fitted plane of this patch.
+     *  See SurfacePatchBase::intersectRayWithPlane for the details. */
+    bool intersectRay(const Vector3& origin_in_cell, const Vector3& direction, float t_min, float t_max, float& t) const
+    {
+        return intersectRayWithPlane(getPlane(), min, max, origin_in_cell, direction, t_min, t_max, t);
+    }
+
 protected:
     /** Grants access to boost serialization */
     friend class boost::serialization::access;
@@ -240,6 +408,7 @@ protected:
             TYPE type;
             ar & BOOST_SERIALIZATION_NVP(type);
         }
+        plane_coeffs.setConstant(base::NaN<float>());
     }    
 }; // SurfacePatch<MLSConfig::SLOPE>
 
@@ -303,6 +472,15 @@ public:
         return true;
     }
 
+    /**
+     * Moves the patch by offset, only the height is relevant for this patch type.
+     */
+    void translate(const Vector3& offset)
+    {
+        Base::translate(offset);
+        mean += offset.z();
+    }
+
     Eigen::Vector3f getCenter() const
     {
         Eigen::Vector3f center(0.0f, 0.0f, mean);
@@ -381,6 +559,16 @@ public:
         return max + std_dev;
     }
 
+    /** Intersects a ray given in cell coordinates with this patch.
+     *  The patch is treated as solid box between the bounds used by getClosestContactPoint.
+     *  See SurfacePatchBase::intersectRayWithPlane for the details. */
+    bool intersectRay(const Vector3& origin_in_cell, const Vector3& direction, float t_min, float t_max, float& t) const
+    {
+        const float std_dev = getStandardDeviation();
+        return intersectRayWithPlane(Eigen::Hyperplane<float, 3>(Vector3::UnitZ(), -(max + std_dev)), min - std_dev, max + std_dev,
+                                     origin_in_cell, direction, t_min, t_max, t);
+    }
+
 protected:
     /** Grants access to boost serialization */
     friend class boost::serialization::access;
@@ -444,6 +632,15 @@ public:
         return plane.offset() < other.plane.offset();
     }
 
+    /**
+     * Moves the patch by offset.
+     */
+    void translate(const Vector3& offset)
+    {
+        Base::translate(offset);
+        plane.offset() -= plane.normal().dot(offset);
+    }
+
     bool operator==(const SurfacePatch& other) const
     {
         return Base::operator==(other) && plane.coeffs() == other.plane.coeffs();
@@ -464,6 +661,13 @@ public:
         return z_pos;
     }
 
+    /** Intersects a ray given in cell coordinates with the plane of this patch.
+     *  See SurfacePatchBase::intersectRayWithPlane for the details. */
+    bool intersectRay(const Vector3& origin_in_cell, const Vector3& direction, float t_min, float t_max, float& t) const
+    {
+        return intersectRayWithPlane(plane, min, max, origin_in_cell, direction, t_min, t_max, t);
+    }
+
 protected:
     /** Grants access to boost serialization */
     friend class boost::serialization::access;
@@ -498,14 +702,21 @@ protected:
 }; // SurfacePatch<MLSConfig::PRECALCULATED>
 
 
+/**
+ * Voxel type of the OccupancyGridMap.
+ * Note: This class is intentionally kept free of virtual methods, so that it stays
+ * trivially copyable and voxels don't carry a vtable pointer next to their payload.
+ */
 class OccupancyPatch
 {
     float log_odds;
 
 public:
+    /** Type in which the log-odds are stored and updated */
+    typedef float LogOddsType;
+
     OccupancyPatch(double initial_probability) : log_odds(logodds(initial_probability)) {}
     OccupancyPatch(float initial_log_odds = 0.f) : log_odds(initial_log_odds) {}
-    virtual ~OccupancyPatch() {}
 
     double getPropability() const
     {
@@ -541,6 +752,22 @@ public:
             log_odds = max;
     }
 
+    LogOddsType getEncodedLogOdds() const
+    {
+        return log_odds;
+    }
+
+    void updateEncodedLogOdds(LogOddsType update_logodds, LogOddsType min, LogOddsType max)
+    {
+        updateLogOdds(update_logodds, min, max);
+    }
+
+    // converts log-odds to the type they are stored in
+    static inline LogOddsType encodeLogOdds(float logodds)
+    {
+        return logodds;
+    }
+
     bool operator==(const OccupancyPatch& other) const
     {
         return this == &other;
@@ -563,6 +790,155 @@ protected:
     /** Grants access to boost serialization */
     friend class boost::serialization::access;
 
+    /** Serializes the members of this class.
+     *  Version 0 has been written while the class was polymorphic, the layout
+     *  of the serialized members is the same in both versions. */
+    template <typename Archive>
+    void serialize(Archive &ar, const unsigned int version)
+    {
+        ar & BOOST_SERIALIZATION_NVP(log_odds);
+    }
+};
+
+/**
+ * Occupancy voxel type storing the log-odds as 16 bit fixed-point value.
+ * All updates are done in saturating integer arithmetic and the occupancy
+ * probability is read from a precomputed table, i.e. neither exp nor log are
+ * evaluated once the thresholds have been encoded by encodeLogOdds.
+ * The interface is the same as the one of the OccupancyPatch.
+ */
+class QuantizedOccupancyPatch
+{
+    int16_t log_odds;
+
+public:
+    /** Type in which the log-odds are stored and updated */
+    typedef int16_t LogOddsType;
+
+    enum
+    {
+        /** number of fractional bits of the fixed-point log-odds */
+        FRACTION_BITS = 10,
+        /** number of log-odds steps covered by one entry of the probability table */
+        PROBABILITY_TABLE_SHIFT = 4,
+        PROBABILITY_TABLE_SIZE = (1 << 16) >> PROBABILITY_TABLE_SHIFT
+    };
+
+    QuantizedOccupancyPatch(double initial_probability) : log_odds(encodeLogOdds(logodds(initial_probability))) {}
+    QuantizedOccupancyPatch(float initial_log_odds = 0.f) : log_odds(encodeLogOdds(initial_log_odds)) {}
+
+    double getPropability() const
+    {
+        return getProbabilityTable()[tableIndex(log_odds)];
+    }
+
+    float getLogOdds() const
+    {
+        return decodeLogOdds(log_odds);
+    }
+
+    bool isOccupied(double occupied_tresshold = 0.8) const
+    {
+        return getPropability() >= occupied_tresshold;
+    }
+
+    bool isFreeSpace(double not_occupied_tresshold = 0.3) const
+    {
+        return getPropability() < not_occupied_tresshold;
+    }
+
+    void updatePropability(double update_prob, double min_prob = 0.1192, double max_prob = 0.971)
+    {
+        updateLogOdds(logodds(update_prob), logodds(min_prob), logodds(max_prob));
+    }
+
+    void updateLogOdds(float update_logodds, float min = -2.f, float max = 3.5f)
+    {
+        updateEncodedLogOdds(encodeLogOdds(update_logodds), encodeLogOdds(min), encodeLogOdds(max));
+    }
+
+    LogOddsType getEncodedLogOdds() const
+    {
+        return log_odds;
+    }
+
+    void updateEncodedLogOdds(LogOddsType update_logodds, LogOddsType min, LogOddsType max)
+    {
+        int32_t new_log_odds = (int32_t)log_odds + (int32_t)update_logodds;
+        if(new_log_odds < min)
+            new_log_odds = min;
+        else if(new_log_odds > max)
+            new_log_odds = max;
+        log_odds = (LogOddsType)new_log_odds;
+    }
+
+    bool operator==(const QuantizedOccupancyPatch& other) const
+    {
+        return this == &other;
+    }
+
+    // converts log-odds to fixed-point, values out of range are saturated
+    static inline LogOddsType encodeLogOdds(float logodds)
+    {
+        float scaled = std::round(logodds * (float)(1 << FRACTION_BITS));
+        if(!(scaled > (float)std::numeric_limits<LogOddsType>::min()))
+            return std::numeric_limits<LogOddsType>::min();
+        if(scaled > (float)std::numeric_limits<LogOddsType>::max())
+            return std::numeric_limits<LogOddsType>::max();
+        return (LogOddsType)scaled;
+    }
+
+    // converts fixed-point log-odds back to floating point
+    static inline float decodeLogOdds(LogOddsType logodds)
+    {
+        return (float)logodds * (1.f / (float)(1 << FRACTION_BITS));
+    }
+
+    // compute log-odds from probability
+    static inline float logodds(double probability)
+    {
+        return OccupancyPatch::logodds(probability);
+    }
+
+    // compute probability from log-odds
+    static inline double probability(double logodds)
+    {
+        return OccupancyPatch::probability(logodds);
+    }
+
+    /**
+     * Returns the probability lookup table. Each entry holds the probability
+     * at the center of the log-odds range it covers.
+     * The table is created once on first use.
+     */
+    static const std::vector<float>& getProbabilityTable()
+    {
+        static const std::vector<float> table = createProbabilityTable();
+        return table;
+    }
+
+protected:
+
+    static inline size_t tableIndex(LogOddsType logodds)
+    {
+        return ((int32_t)logodds - (int32_t)std::numeric_limits<LogOddsType>::min()) >> PROBABILITY_TABLE_SHIFT;
+    }
+
+    static std::vector<float> createProbabilityTable()
+    {
+        std::vector<float> table(PROBABILITY_TABLE_SIZE);
+        const int32_t half_step = (1 << PROBABILITY_TABLE_SHIFT) / 2;
+        for(size_t i = 0; i < table.size(); i++)
+        {
+            int32_t center = ((int32_t)i << PROBABILITY_TABLE_SHIFT) + (int32_t)std::numeric_limits<LogOddsType>::min() + half_step;
+            table[i] = (float)probability(center * (1.0 / (double)(1 << FRACTION_BITS)));
+        }
+        return table;
+    }
+
+    /** Grants access to boost serialization */
+    friend class boost::serialization::access;
+
     /** Serializes the members of this class*/
     template <typename Archive>
     void serialize(Archive &ar, const unsigned int version)
@@ -571,6 +947,10 @@ protected:
     }
 };
 
+/**
+ * Voxel type of the TSDFVolumetricMap.
+ * Note: Like the OccupancyPatch this class has to stay trivially copyable.
+ */
 class TSDFPatch
 {
     float distance;
@@ -588,7 +968,6 @@ class TSDFPatch
 public:
     TSDFPatch() : distance(base::NaN<float>()), var(1.f) {}
     TSDFPatch(float distance, float var) : distance(distance), var(var) {}
-    virtual ~TSDFPatch() {}
 
     void update(float distance, float var, float truncation = 1.f, float min_var = 0.001f)
     {
@@ -631,7 +1010,9 @@ protected:
     /** Grants access to boost serialization */
     friend class boost::serialization::access;
 
-    /** Serializes the members of this class*/
+    /** Serializes the members of this class.
+     *  Version 0 has been written while the class was polymorphic, the layout
+     *  of the serialized members is the same in both versions. */
     template <typename Archive>
     void serialize(Archive &ar, const unsigned int version)
     {
@@ -640,6 +1021,10 @@ protected:
     }
 };
 
+static_assert(std::is_trivially_copyable<OccupancyPatch>::value, "OccupancyPatch must be trivially copyable");
+static_assert(std::is_trivially_copyable<QuantizedOccupancyPatch>::value, "QuantizedOccupancyPatch must be trivially copyable");
+static_assert(std::is_trivially_copyable<TSDFPatch>::value, "TSDFPatch must be trivially copyable");
+
 
 /**
  * Given the width of the cells, this outputs the bounding polygon points when intersecting
@@ -763,5 +1148,7 @@ void getPolygon(std::vector<Eigen::Vector3f>& points, const SurfacePatch<S> &sp,
 
 BOOST_CLASS_VERSION(maps::grid::SurfacePatch<maps::grid::MLSConfig::SLOPE>, 1);
 BOOST_CLASS_VERSION(maps::grid::SurfacePatch<maps::grid::MLSConfig::PRECALCULATED>, 1);
+BOOST_CLASS_VERSION(maps::grid::OccupancyPatch, 1);
+BOOST_CLASS_VERSION(maps::grid::TSDFPatch, 1);
 
 #endif /* __MAPS_SURFACEPATCHES_HPP_ */
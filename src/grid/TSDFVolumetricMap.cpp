@@ -1,5 +1,6 @@
 #include "TSDFVolumetricMap.hpp"
 #include <boost/format.hpp>
+#include <algorithm>
 #include <maps/tools/VoxelTraversal.hpp>
 
 using namespace maps::grid;
@@ -25,6 +26,7 @@ void TSDFVolumetricMap::mergePointCloud(const TSDFVolumetricMap::PointCloud& pc,
             std::cerr << e.what() << std::endl;
         }
     }
+    enforceMemoryBudget(PrunePredicate(truncation));
 }
 
 void TSDFVolumetricMap::mergePoint(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3d& measurement, double measurement_variance)
@@ -35,14 +37,23 @@ void TSDFVolumetricMap::mergePoint(const Eigen::Vector3d& sensor_origin, const E
     Eigen::Vector3d start_point = sensor_origin;
     Eigen::Vector3d end_point = measurement + truncated_direction;
 
+    // in band mode the ray starts at the beginning of the truncation band
+    const double free_space_length = ray_length - truncation;
+    if(integration_mode == TRUNCATION_BAND && free_space_length > 0.)
+        start_point = measurement - truncated_direction;
+
     Eigen::Vector3i start_point_idx;
     Eigen::Vector3i end_point_idx;
     Eigen::Vector3d start_point_cell_center;
     if(VoxelGridBase::toVoxelGrid(start_point, start_point_idx) &&
-        VoxelGridBase::toVoxelGrid(end_point, end_point_idx, false))
+        VoxelGridBase::toVoxelGrid(end_point, end_point_idx, false) &&
+        VoxelGridBase::fromVoxelGrid(start_point_idx, start_point_cell_center))
     {
-        std::vector<VoxelTraversal::RayElement> ray;
-        VoxelTraversal::computeRay(VoxelGridBase::getVoxelResolution(), start_point, start_point_idx, end_point, ray);
+        // the traversal is aligned to the voxel grid, so rays starting at different
+        // points of the same line traverse the same voxels
+        std::vector<VoxelTraversal::RayElement>& ray = ray_buffer;
+        VoxelTraversal::computeRay(VoxelGridBase::getVoxelResolution(), start_point, start_point_idx, start_point_cell_center,
+                                   end_point, end_point_idx, ray);
 
         if(ray.empty())
             throw std::runtime_error("Ray is empty!");
@@ -50,46 +61,152 @@ void TSDFVolumetricMap::mergePoint(const Eigen::Vector3d& sensor_origin, const E
         // re-add last cell in ray
         ray.push_back(VoxelTraversal::RayElement(end_point_idx, 1));
 
-        const float res_sigma = 2.f * VoxelGridBase::getVoxelResolution().squaredNorm() / (5.2f*5.2f);
-        const float res_sigma_inv = 1.f / res_sigma;
+        if(integration_mode == TRUNCATION_BAND && free_space_stride > 0 && free_space_length > 0.)
+            carveFreeSpace(sensor_origin, measurement_normal, free_space_length, measurement_variance);
+
+        integrateRay(ray, sensor_origin, measurement_normal, ray_length, measurement_variance);
+    }
+    else
+        throw std::runtime_error((boost::format("Sensor origin %1% is outside of the grid! Can't add measurement to grid.") % start_point.transpose()).str());
+}
+
+namespace
+{
+
+/**
+ * Tabulated inverse measurement weight 1/phi = exp(u) with u being the squared
+ * distance of a voxel center to the ray, scaled by the inverse variance.
+ * Values in between the samples are linearly interpolated, the relative error is below 1e-4.
+ */
+class InverseWeightTable
+{
+public:
+    /** phi is below 1e-7 beyond this, such measurements are ignored */
+    static constexpr float max_u = 16.f;
+    static constexpr int size = 1024;
+
+    InverseWeightTable()
+    {
+        for(int i = 0; i <= size; ++i)
+            table[i] = std::exp(i * (max_u / size));
+    }
+
+    /** Returns false if the weight is negligible */
+    bool lookup(double u, float& inverse_weight) const
+    {
+        if(!(u < max_u))
+            return false;
+        const float x = std::max(u, 0.) * (size / max_u);
+        const int i = static_cast<int>(x);
+        inverse_weight = table[i] + (x - i) * (table[i + 1] - table[i]);
+        return true;
+    }
+
+private:
+    float table[size + 1];
+};
 
-        for(const VoxelTraversal::RayElement& element : ray)
+const InverseWeightTable& getInverseWeightTable()
+{
+    static const InverseWeightTable table;
+    return table;
+}
+
+/**
+ * Returns the cell z_idx of the tree, inserting it if needed.
+ * @p near has to be the cell z_idx, one of its neighbours or the position the cell would be inserted at.
+ */
+DiscreteTree<TSDFPatch>::iterator findOrInsert(DiscreteTree<TSDFPatch>& tree, DiscreteTree<TSDFPatch>::iterator near, int32_t z_idx)
+{
+    if(near != tree.end())
+    {
+        if(near->first == z_idx)
+            return near;
+        if(near->first < z_idx)
         {
-            try
+            ++near;
+            if(near != tree.end() && near->first == z_idx)
+                return near;
+        }
+    }
+    if(near != tree.begin())
+    {
+        DiscreteTree<TSDFPatch>::iterator prev = std::prev(near);
+        if(prev->first == z_idx)
+            return prev;
+    }
+    // near is the successor of z_idx now
+    return tree.insert(near, std::make_pair(z_idx, TSDFPatch()));
+}
+
+}
+
+void TSDFVolumetricMap::integrateRay(const std::vector<VoxelTraversal::RayElement>& ray, const Eigen::Vector3d& sensor_origin,
+                                     const Eigen::Vector3d& measurement_normal, double ray_length, double measurement_variance)
+{
+    const float res_sigma = 2.f * VoxelGridBase::getVoxelResolution().squaredNorm() / (5.2f*5.2f);
+    const float res_sigma_inv = 1.f / res_sigma;
+    const InverseWeightTable& weights = getInverseWeightTable();
+
+    for(const VoxelTraversal::RayElement& element : ray)
+    {
+        try
+        {
+            DiscreteTree<VoxelCellType>& tree = GridMapBase::at(element.idx);
+            Eigen::Vector3d cell_center;
+            if(GridMapBase::fromGrid(element.idx, cell_center))
             {
-                DiscreteTree<VoxelCellType>& tree = GridMapBase::at(element.idx);
-                Eigen::Vector3d cell_center;
-                if(GridMapBase::fromGrid(element.idx, cell_center))
-                {
-                    int32_t z_end = element.z_last + element.z_step;
-                    for(int32_t z_idx = element.z_first; z_idx != z_end; z_idx += element.z_step)
-                    {
-                        cell_center.z() = tree.getCellCenter(z_idx);
-
-                        // compute point on ray closest to the current cell center
-                        Eigen::Hyperplane<double, 3> plane(measurement_normal, cell_center);
-                        Eigen::Vector3d point_on_ray = plane.projection(sensor_origin);
-
-                        // weight the current measurement according to the distance to the cell center with the inverse normal distribution
-                        float phi = std::exp(-(point_on_ray - cell_center).squaredNorm() * res_sigma_inv);
-                        if(phi > 0.f)
-                            tree.getCellAt(z_idx).update(ray_length - (point_on_ray - sensor_origin).norm(), (1.f/phi) * measurement_variance, truncation, min_variance);
-                    }
-                }
-                else
+                // the cell centers of a z-run only differ in z, so the terms in x and y are computed once.
+                // t is the position of the cell center projected on the ray, the squared
+                // distance to the ray is |center - origin|^2 - t^2
+                const double dx = cell_center.x() - sensor_origin.x();
+                const double dy = cell_center.y() - sensor_origin.y();
+                const double t_xy = measurement_normal.x() * dx + measurement_normal.y() * dy;
+                const double squared_dist_xy = dx * dx + dy * dy;
+
+                // the cells of a run are neighbours in the tree, so after the first lookup
+                // each cell is either the next element or inserted with the exact hint
+                DiscreteTree<VoxelCellType>::iterator cell = tree.lower_bound(element.z_first);
+                int32_t z_end = element.z_last + element.z_step;
+                for(int32_t z_idx = element.z_first; z_idx != z_end; z_idx += element.z_step)
                 {
-                    std::cerr << "Failed to receive cell center of " << element.idx << " from grid." << std::endl;
+                    const double dz = tree.getCellCenter(z_idx) - sensor_origin.z();
+                    const double t = t_xy + measurement_normal.z() * dz;
+
+                    // weight the current measurement according to the distance to the cell center with the inverse normal distribution
+                    float inverse_phi;
+                    if(!weights.lookup((squared_dist_xy + dz * dz - t * t) * res_sigma_inv, inverse_phi))
+                        continue;
+
+                    cell = findOrInsert(tree, cell, z_idx);
+                    updateVoxel(cell->second, Eigen::Vector3i(element.idx.x(), element.idx.y(), z_idx),
+                                ray_length - std::abs(t), inverse_phi * measurement_variance);
                 }
             }
-            catch(const std::runtime_error& e)
+            else
             {
-                // rest of the ray is probably out of grid
-                break;
+                std::cerr << "Failed to receive cell center of " << element.idx << " from grid." << std::endl;
             }
         }
+        catch(const std::runtime_error& e)
+        {
+            // rest of the ray is probably out of grid
+            break;
+        }
+    }
+}
+
+void TSDFVolumetricMap::carveFreeSpace(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3d& measurement_normal,
+                                       double free_space_length, double measurement_variance)
+{
+    const double step = free_space_stride * VoxelGridBase::getVoxelResolution().minCoeff();
+    Eigen::Vector3i idx;
+    for(double t = 0.5 * step; t < free_space_length; t += step)
+    {
+        if(!VoxelGridBase::toVoxelGrid(sensor_origin + t * measurement_normal, idx))
+            break;
+        updateVoxel(VoxelGridBase::getVoxelCell(idx), idx, truncation, measurement_variance);
     }
-    else
-        throw std::runtime_error((boost::format("Sensor origin %1% is outside of the grid! Can't add measurement to grid.") % start_point.transpose()).str());
 }
 
 bool TSDFVolumetricMap::hasSameFrame(const base::Transform3d& local_frame, const Vector2ui& num_cells, const Vector2d& resolution) const
@@ -118,3 +235,28 @@ void TSDFVolumetricMap::setMinVariance(float min_varaince)
 {
     this->min_variance = min_varaince;
 }
+
+void TSDFVolumetricMap::setIntegrationMode(TSDFVolumetricMap::IntegrationMode mode)
+{
+    integration_mode = mode;
+}
+
+TSDFVolumetricMap::IntegrationMode TSDFVolumetricMap::getIntegrationMode() const
+{
+    return integration_mode;
+}
+
+void TSDFVolumetricMap::setFreeSpaceStride(unsigned int stride)
+{
+    free_space_stride = stride;
+}
+
+unsigned int TSDFVolumetricMap::getFreeSpaceStride() const
+{
+    return free_space_stride;
+}
+
+size_t TSDFVolumetricMap::prune(size_t num_columns)
+{
+    return pruneColumns(PrunePredicate(truncation), num_columns);
+}
@@ -3,6 +3,7 @@
 #include "SurfacePatches.hpp"
 #include "VoxelGridMap.hpp"
 #include "MLSMap.hpp"
+#include "../tools/VoxelTraversal.hpp"
 
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
@@ -10,6 +11,7 @@
 #include <boost/serialization/nvp.hpp>
 #include <boost/serialization/export.hpp>
 #include <cmath>
+#include <limits>
 #include <base/TransformWithCovariance.hpp>
 
 namespace maps { namespace grid
@@ -25,11 +27,21 @@ public:
     typedef VoxelGridMap<VoxelCellType> VoxelGridBase;
     typedef pcl::PointCloud<pcl::PointXYZ> PointCloud;
 
+    /** Defines which part of the ray of a measurement is integrated */
+    enum IntegrationMode
+    {
+        /** all voxels from the sensor origin to the end of the truncation band */
+        FULL_RAY,
+        /** only the voxels within the truncation band around the measurement */
+        TRUNCATION_BAND
+    };
+
     TSDFVolumetricMap(): VoxelGridMap<VoxelCellType>(Vector2ui::Zero(), Vector3d::Ones()),
-                         truncation(1.f), min_variance(0.001f) {}
+                         truncation(1.f), min_variance(0.001f), integration_mode(FULL_RAY), free_space_stride(0) {}
 
     TSDFVolumetricMap(const Vector2ui &num_cells, const Vector3d &resolution, float truncation = 1.f, float min_varaince = 0.001f) :
-                    VoxelGridMap<VoxelCellType>(num_cells, resolution), truncation(truncation), min_variance(min_varaince) {}
+                    VoxelGridMap<VoxelCellType>(num_cells, resolution), truncation(truncation), min_variance(min_varaince),
+                    integration_mode(FULL_RAY), free_space_stride(0) {}
     virtual ~TSDFVolumetricMap() {}
 
     void mergePointCloud(const PointCloud& pc, const base::Transform3d& pc2grid, double measurement_variance = 0.01);
@@ -56,14 +68,98 @@ public:
 
     float getMinVariance();
 
+    /**
+     * In TRUNCATION_BAND mode a measurement only traverses the voxels within
+     * [range - truncation, range + truncation] along its ray instead of all
+     * voxels from the sensor origin. The voxels in front of the band keep their
+     * value, see setFreeSpaceStride to carve them sparsely.
+     * The default is FULL_RAY.
+     */
+    void setIntegrationMode(IntegrationMode mode);
+
+    IntegrationMode getIntegrationMode() const;
+
+    /**
+     * In TRUNCATION_BAND mode the free space between the sensor and the band
+     * is sampled every @p stride voxels, the sampled voxels are updated
+     * with the truncation distance. 0 disables free space carving (default).
+     */
+    void setFreeSpaceStride(unsigned int stride);
+
+    unsigned int getFreeSpaceStride() const;
+
+    /**
+     * Removes the voxels on the free side of the surface which are at least
+     * the truncation distance away from it. These are skipped by raycasting
+     * like unknown voxels, a later measurement starts them from scratch.
+     * Only num_columns grid columns are processed, the next call continues
+     * with the following columns. This allows to spread the pruning over time.
+     * Merging a point cloud prunes automatically if the memory budget is exceeded,
+     * see VoxelGridMap::setMemoryBudget.
+     * @return number of removed voxels
+     */
+    size_t prune(size_t num_columns = std::numeric_limits<size_t>::max());
+
 protected:
 
+    struct PrunePredicate
+    {
+        PrunePredicate(float truncation) : truncation(truncation) {}
+
+        bool operator()(const VoxelCellType& cell) const
+        {
+            // also removes voxels without measurement
+            return !(cell.getDistance() < truncation);
+        }
+
+        float truncation;
+    };
+
+    /**
+     * Updates the voxels of the ray with the signed distance to the measurement.
+     * The weight of a voxel depends on its squared distance to the ray and is taken from a table.
+     */
+    void integrateRay(const std::vector<tools::VoxelTraversal::RayElement>& ray, const Eigen::Vector3d& sensor_origin,
+                      const Eigen::Vector3d& measurement_normal, double ray_length, double measurement_variance);
+
+    /** Updates every stride-th voxel position on the ray up to free_space_length with the truncation distance */
+    void carveFreeSpace(const Eigen::Vector3d& sensor_origin, const Eigen::Vector3d& measurement_normal,
+                        double free_space_length, double measurement_variance);
+
+    /**
+     * Applies a measurement to a voxel. If change tracking is enabled, voxels
+     * entering or leaving the surface are recorded, the surface being the voxels
+     * whose distance is below half of the voxel diagonal.
+     */
+    void updateVoxel(VoxelCellType& cell, const Eigen::Vector3i& idx, float distance, float variance)
+    {
+        if(!track_changes)
+        {
+            cell.update(distance, variance, truncation, min_variance);
+            return;
+        }
+        const float surface_distance = 0.5f * getVoxelResolution().norm();
+        const bool was_surface = std::abs(cell.getDistance()) < surface_distance;
+        cell.update(distance, variance, truncation, min_variance);
+        if(was_surface != (std::abs(cell.getDistance()) < surface_distance))
+            addChangedVoxel(idx, !was_surface);
+    }
+
     /** truncation level of the signed distance function */
     float truncation;
 
     /** lower bound of the variance of each cell */
     float min_variance;
 
+    /** part of the ray which is integrated, not serialized */
+    IntegrationMode integration_mode;
+
+    /** stride of the free space carving in voxels, 0 disables it, not serialized */
+    unsigned int free_space_stride;
+
+    /** reused by mergePoint to avoid an allocation per measurement */
+    std::vector<tools::VoxelTraversal::RayElement> ray_buffer;
+
     /** Grants access to boost serialization */
     friend class boost::serialization::access;
 
@@ -97,6 +193,7 @@ void TSDFVolumetricMap::mergePointCloud(const std::vector< Eigen::Matrix<double,
             std::cerr << e.what() << std::endl;
         }
     }
+    enforceMemoryBudget(PrunePredicate(truncation));
 }
 
 template<enum MLSConfig::update_model SurfaceType>
@@ -128,8 +225,7 @@ void TSDFVolumetricMap::projectMLSMap(const maps::grid::MLSMap<SurfaceType>& mls
                         float distance = diff.norm();
                         if(distance < truncation)
                         {
-                            VoxelCellType& cell = getVoxelCell(idx);
-                            cell.update(std::copysign(distance, diff.z()), variance, truncation, min_variance);
+                            updateVoxel(getVoxelCell(idx), idx, std::copysign(distance, diff.z()), variance);
                         }
                     }
                 }
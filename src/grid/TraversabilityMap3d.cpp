@@ -1,5 +1,8 @@
 #include "TraversabilityMap3d.hpp"
 
+#include <algorithm>
+#include <unordered_map>
+
 namespace maps { namespace grid
 {
 
@@ -77,5 +80,96 @@ TraversabilityNodeBase *TraversabilityNodeBase::getConnectedNode(const Index &to
     return nullptr;
 }
 
+CompactTraversabilityGraph::CompactTraversabilityGraph()
+    : num_cells(0, 0), cell_offsets(1, 0), offsets(1, 0)
+{
+
+}
+
+CompactTraversabilityGraph::CompactTraversabilityGraph(const Vector2ui &num_cells,
+                                                       const std::vector<const TraversabilityNodeBase *> &source,
+                                                       std::vector<const TraversabilityNodeBase *> *source_nodes)
+    : num_cells(num_cells)
+{
+    if(source.size() >= std::numeric_limits<NodeId>::max())
+        throw std::runtime_error("Too many nodes for a CompactTraversabilityGraph");
+
+    // counting sort of the nodes by cell
+    cell_offsets.assign(num_cells.prod() + 1, 0);
+    for(const TraversabilityNodeBase *node : source)
+        cell_offsets[toCell(node->getIndex()) + 1]++;
+    for(size_t i = 1; i < cell_offsets.size(); ++i)
+        cell_offsets[i] += cell_offsets[i - 1];
+
+    std::vector<const TraversabilityNodeBase *> sorted(source.size());
+    std::vector<NodeId> next(cell_offsets.begin(), cell_offsets.end() - 1);
+    for(const TraversabilityNodeBase *node : source)
+        sorted[next[toCell(node->getIndex())]++] = node;
+
+    for(size_t cell = 0; cell + 1 < cell_offsets.size(); ++cell)
+    {
+        std::stable_sort(sorted.begin() + cell_offsets[cell], sorted.begin() + cell_offsets[cell + 1],
+                         [](const TraversabilityNodeBase *a, const TraversabilityNodeBase *b) { return *a < *b; });
+    }
+
+    std::unordered_map<const TraversabilityNodeBase *, NodeId> ids;
+    ids.reserve(sorted.size());
+    nodes.resize(sorted.size());
+    offsets.resize(sorted.size() + 1);
+    offsets[0] = 0;
+    size_t num_connections = 0;
+    for(NodeId id = 0; id < sorted.size(); ++id)
+    {
+        const TraversabilityNodeBase *node = sorted[id];
+        ids[node] = id;
+
+        Node &compact = nodes[id];
+        compact.idx = node->getIndex();
+        compact.height = node->getHeight();
+        compact.flags = 0;
+        compact.setType(node->getType());
+        if(node->isExpanded())
+            compact.setExpanded();
+
+        num_connections += node->getConnections().size();
+        if(num_connections >= std::numeric_limits<NodeId>::max())
+            throw std::runtime_error("Too many connections for a CompactTraversabilityGraph");
+        offsets[id + 1] = num_connections;
+    }
+
+    neighbors.reserve(num_connections);
+    for(const TraversabilityNodeBase *node : sorted)
+    {
+        for(const TraversabilityNodeBase *connected : node->getConnections())
+        {
+            std::unordered_map<const TraversabilityNodeBase *, NodeId>::const_iterator it = ids.find(connected);
+            if(it == ids.end())
+                throw std::runtime_error("Node is connected to a node which is not part of the graph");
+            neighbors.push_back(it->second);
+        }
+    }
+
+    if(source_nodes)
+        source_nodes->swap(sorted);
+}
+
+const CompactTraversabilityNode *CompactTraversabilityGraph::getConnectedNode(const Node *node, const Index &toIdx) const
+{
+    for(const Node *con : getConnections(node))
+    {
+        if(toIdx == con->getIndex())
+        {
+            return con;
+        }
+    }
+    return nullptr;
+}
+
+void CompactTraversabilityGraph::setAllNotExpanded()
+{
+    for(Node &node : nodes)
+        node.setNotExpanded();
+}
+
 
 }}
@@ -4,6 +4,7 @@
 #include "MultiLevelGridMap.hpp"
 #include "SurfacePatches.hpp"
 #include <map>
+#include <cstdint>
 
 namespace maps { namespace grid
 {
@@ -80,6 +81,336 @@ namespace maps { namespace grid
         }
     };
 
+    /**
+     * @brief Node of a CompactTraversabilityGraph
+     * @details Provides the same accessors as TraversabilityNodeBase, the type and
+     * the expanded flag are packed into a single byte. The connections are stored
+     * in the graph, see CompactTraversabilityGraph::getConnections.
+     */
+    class CompactTraversabilityNode
+    {
+    public:
+        typedef TraversabilityNodeBase::TYPE TYPE;
+
+        float getHeight() const
+        {
+            return height;
+        }
+
+        const Index &getIndex() const
+        {
+            return idx;
+        }
+
+        bool isExpanded() const
+        {
+            return flags & EXPANDED;
+        }
+
+        void setExpanded()
+        {
+            flags |= EXPANDED;
+        }
+
+        void setNotExpanded()
+        {
+            flags &= ~EXPANDED;
+        }
+
+        void setType(TYPE t)
+        {
+            flags = (flags & ~TYPE_MASK) | static_cast<uint8_t>(t);
+        }
+
+        TYPE getType() const
+        {
+            return static_cast<TYPE>(flags & TYPE_MASK);
+        }
+
+        bool operator<(const CompactTraversabilityNode& other) const
+        {
+            return height < other.height;
+        }
+
+    private:
+        friend class CompactTraversabilityGraph;
+
+        enum FLAGS
+        {
+            TYPE_MASK = 0x07,
+            EXPANDED = 0x08,
+        };
+
+        Index idx;
+        float height;
+        uint8_t flags;
+    };
+
+    /**
+     * @brief Read-only topology of a traversability graph in contiguous storage
+     * @details
+     * The nodes are stored in one array ordered by cell (row-major) and by height
+     * within a cell. The connections are stored in compressed sparse row format,
+     * i.e. the neighbour ids of node i are neighbors[offsets[i]] to
+     * neighbors[offsets[i + 1]]. This needs a fraction of the memory of the heap
+     * allocated nodes and keeps the neighbours of a node in one cache line for
+     * typical graphs.
+     *
+     * Nodes are handed out as pointers, so code written for TraversabilityNodeBase
+     * pointers can be used with this graph as well. The id of a node is its
+     * position in the node array and can be used to index per node data.
+     * Types and expanded flags can be modified, the topology is fixed.
+     */
+    class CompactTraversabilityGraph
+    {
+    public:
+        typedef CompactTraversabilityNode Node;
+        typedef uint32_t NodeId;
+
+        /** Range of node pointers given by node ids */
+        template <class NodeT>
+        class ConnectionRange
+        {
+        public:
+            class iterator
+            {
+            public:
+                iterator(NodeT *nodes, const NodeId *id)
+                    : nodes(nodes), id(id)
+                {}
+
+                NodeT *operator*() const
+                {
+                    return nodes + *id;
+                }
+
+                iterator &operator++()
+                {
+                    ++id;
+                    return *this;
+                }
+
+                bool operator==(const iterator &other) const
+                {
+                    return id == other.id;
+                }
+
+                bool operator!=(const iterator &other) const
+                {
+                    return id != other.id;
+                }
+
+            private:
+                NodeT *nodes;
+                const NodeId *id;
+            };
+
+            ConnectionRange(NodeT *nodes, const NodeId *begin_id, const NodeId *end_id)
+                : nodes(nodes), begin_id(begin_id), end_id(end_id)
+            {}
+
+            iterator begin() const
+            {
+                return iterator(nodes, begin_id);
+            }
+
+            iterator end() const
+            {
+                return iterator(nodes, end_id);
+            }
+
+            size_t size() const
+            {
+                return end_id - begin_id;
+            }
+
+            bool empty() const
+            {
+                return begin_id == end_id;
+            }
+
+        private:
+            NodeT *nodes;
+            const NodeId *begin_id;
+            const NodeId *end_id;
+        };
+
+        /** Range of consecutive nodes, iterates over pointers to the nodes */
+        template <class NodeT>
+        class NodeRange
+        {
+        public:
+            class iterator
+            {
+            public:
+                explicit iterator(NodeT *node)
+                    : node(node)
+                {}
+
+                NodeT *operator*() const
+                {
+                    return node;
+                }
+
+                iterator &operator++()
+                {
+                    ++node;
+                    return *this;
+                }
+
+                bool operator==(const iterator &other) const
+                {
+                    return node == other.node;
+                }
+
+                bool operator!=(const iterator &other) const
+                {
+                    return node != other.node;
+                }
+
+            private:
+                NodeT *node;
+            };
+
+            NodeRange(NodeT *begin_node, NodeT *end_node)
+                : begin_node(begin_node), end_node(end_node)
+            {}
+
+            iterator begin() const
+            {
+                return iterator(begin_node);
+            }
+
+            iterator end() const
+            {
+                return iterator(end_node);
+            }
+
+            size_t size() const
+            {
+                return end_node - begin_node;
+            }
+
+            bool empty() const
+            {
+                return begin_node == end_node;
+            }
+
+        private:
+            NodeT *begin_node;
+            NodeT *end_node;
+        };
+
+        CompactTraversabilityGraph();
+
+        /**
+         * Builds the graph from the given nodes. All connected nodes have to be part of @p nodes.
+         * @param num_cells number of cells of the map the nodes belong to
+         * @param source_nodes if not NULL, receives the original node of each node id
+         */
+        CompactTraversabilityGraph(const Vector2ui &num_cells,
+                                   const std::vector<const TraversabilityNodeBase *> &nodes,
+                                   std::vector<const TraversabilityNodeBase *> *source_nodes = NULL);
+
+        size_t getNumNodes() const
+        {
+            return nodes.size();
+        }
+
+        size_t getNumConnections() const
+        {
+            return neighbors.size();
+        }
+
+        const Vector2ui &getNumCells() const
+        {
+            return num_cells;
+        }
+
+        NodeId getNodeId(const Node *node) const
+        {
+            return node - nodes.data();
+        }
+
+        const Node *getNode(NodeId id) const
+        {
+            return &nodes[id];
+        }
+
+        Node *getNode(NodeId id)
+        {
+            return &nodes[id];
+        }
+
+        /** All nodes of the graph */
+        NodeRange<const Node> getNodes() const
+        {
+            return NodeRange<const Node>(nodes.data(), nodes.data() + nodes.size());
+        }
+
+        NodeRange<Node> getNodes()
+        {
+            return NodeRange<Node>(nodes.data(), nodes.data() + nodes.size());
+        }
+
+        /** The nodes of a cell ordered by height, replaces the level list of the map */
+        NodeRange<const Node> getNodes(const Index &idx) const
+        {
+            const size_t cell = toCell(idx);
+            return NodeRange<const Node>(nodes.data() + cell_offsets[cell], nodes.data() + cell_offsets[cell + 1]);
+        }
+
+        NodeRange<Node> getNodes(const Index &idx)
+        {
+            const size_t cell = toCell(idx);
+            return NodeRange<Node>(nodes.data() + cell_offsets[cell], nodes.data() + cell_offsets[cell + 1]);
+        }
+
+        ConnectionRange<const Node> getConnections(const Node *node) const
+        {
+            const NodeId id = getNodeId(node);
+            return ConnectionRange<const Node>(nodes.data(), neighbors.data() + offsets[id], neighbors.data() + offsets[id + 1]);
+        }
+
+        ConnectionRange<Node> getConnections(const Node *node)
+        {
+            const NodeId id = getNodeId(node);
+            return ConnectionRange<Node>(nodes.data(), neighbors.data() + offsets[id], neighbors.data() + offsets[id + 1]);
+        }
+
+        /** Returns the first connected node in cell @p toIdx or nullptr */
+        const Node *getConnectedNode(const Node *node, const Index &toIdx) const;
+
+        Node *getConnectedNode(const Node *node, const Index &toIdx)
+        {
+            return const_cast<Node *>(static_cast<const CompactTraversabilityGraph *>(this)->getConnectedNode(node, toIdx));
+        }
+
+        /** Resets the expanded flag of all nodes */
+        void setAllNotExpanded();
+
+    private:
+        size_t toCell(const Index &idx) const
+        {
+            if(!idx.isInside(num_cells))
+                throw std::out_of_range("Index is outside of the graph");
+            return idx.x() + idx.y() * num_cells.x();
+        }
+
+        Vector2ui num_cells;
+
+        std::vector<Node> nodes;
+
+        /** First node of each cell, has one more entry than cells */
+        std::vector<NodeId> cell_offsets;
+
+        /** First connection of each node, has one more entry than nodes */
+        std::vector<NodeId> offsets;
+
+        /** Ids of the connected nodes */
+        std::vector<NodeId> neighbors;
+    };
+
     template <class T>
     class TraversabilityMap3d : public ::maps::grid::MultiLevelGridMap<T>
     {
@@ -91,7 +422,27 @@ namespace maps { namespace grid
                     const boost::shared_ptr<LocalMapData> &data) : MultiLevelGridMap<T>(num_cells, resolution, data)
         {}
 
-        Eigen::Vector3f getNodePosition(const TraversabilityNodeBase *node) const
+        /**
+         * Converts the nodes of the map into a CompactTraversabilityGraph, only
+         * available if the cells store pointers to TraversabilityNodeBase.
+         * The graph doesn't reference the nodes of the map, so they can be freed afterwards.
+         * @param source_nodes if not NULL, receives the original node of each node id,
+         * e.g. to transfer user data
+         */
+        CompactTraversabilityGraph compact(std::vector<const TraversabilityNodeBase *> *source_nodes = NULL) const
+        {
+            std::vector<const TraversabilityNodeBase *> nodes;
+            for(const LevelList<T> &list : *this)
+            {
+                for(const TraversabilityNodeBase *node : list)
+                    nodes.push_back(node);
+            }
+            return CompactTraversabilityGraph(this->getNumCells(), nodes, source_nodes);
+        }
+
+        /** Works for TraversabilityNodeBase and CompactTraversabilityNode */
+        template <class NodeT>
+        Eigen::Vector3f getNodePosition(const NodeT *node) const
         {
             Eigen::Vector3d pos;
             if(!this->fromGrid(node->getIndex(), pos))
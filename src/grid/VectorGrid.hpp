@@ -2,6 +2,8 @@
 
 #include <vector>
 #include <stdexcept>
+#include <algorithm>
+#include <atomic>
 
 #include <boost/serialization/access.hpp>
 #include <boost/serialization/nvp.hpp>
@@ -14,6 +16,75 @@
 namespace maps { namespace grid
 {
 
+    /**
+     * @brief View on a contiguous range of cells, e.g. a row of a VectorGrid.
+     */
+    template <typename T>
+    struct CellSpan
+    {
+        T* data;
+        size_t size;
+
+        CellSpan(T* data, size_t size)
+            : data(data), size(size)
+        {}
+
+        T* begin() const
+        {
+            return data;
+        }
+
+        T* end() const
+        {
+            return data + size;
+        }
+
+        T& operator[](size_t i) const
+        {
+            return data[i];
+        }
+    };
+
+    /**
+     * @brief Flag which can be set by several threads at once, e.g. to record modified rows.
+     */
+    class ModificationFlag
+    {
+        std::atomic<bool> flag;
+
+    public:
+        ModificationFlag(bool set = false)
+            : flag(set)
+        {}
+
+        ModificationFlag(const ModificationFlag& other)
+            : flag(other.isSet())
+        {}
+
+        ModificationFlag& operator=(const ModificationFlag& other)
+        {
+            flag.store(other.isSet(), std::memory_order_relaxed);
+            return *this;
+        }
+
+        void set()
+        {
+            // avoids writing the cache line if the flag is already set
+            if(!isSet())
+                flag.store(true, std::memory_order_relaxed);
+        }
+
+        void reset()
+        {
+            flag.store(false, std::memory_order_relaxed);
+        }
+
+        bool isSet() const
+        {
+            return flag.load(std::memory_order_relaxed);
+        }
+    };
+
     template <typename CellT>
     class VectorGrid
     {
@@ -26,15 +97,32 @@ namespace maps { namespace grid
         /** Default value **/
         CellT default_value;
 
+        /** If set, mutable accesses are recorded, see setModificationTracking */
+        bool modification_tracking;
+
+        /** Rows accessed mutably since the last resetModifiedRows */
+        std::vector<ModificationFlag> modified_rows;
+
+        /** Set if all rows were accessed mutably, e.g. by resize or the iterators */
+        ModificationFlag all_rows_modified;
+
+        /** Set if any row was accessed mutably */
+        ModificationFlag any_row_modified;
+
     public:
 
         typedef CellT CellType;
         typedef typename std::vector<CellT>::iterator iterator;
         typedef typename std::vector<CellT>::const_iterator const_iterator;
+        /** const CellT&, except for std::vector<bool> whose cells aren't addressable */
+        typedef typename std::vector<CellT>::const_reference const_reference;
+        typedef CellSpan<CellT> RowSpan;
+        typedef CellSpan<const CellT> ConstRowSpan;
 
         VectorGrid(Vector2ui size, CellT default_value) 
             : num_cells(size), 
-              default_value(default_value)
+              default_value(default_value),
+              modification_tracking(false)
         {
             resize(size);
         }
@@ -52,7 +140,11 @@ namespace maps { namespace grid
         VectorGrid(const VectorGrid &other) 
             : cells(other.cells), 
               num_cells(other.num_cells), 
-              default_value(other.default_value)
+              default_value(other.default_value),
+              modification_tracking(other.modification_tracking),
+              modified_rows(other.modified_rows),
+              all_rows_modified(other.all_rows_modified),
+              any_row_modified(other.any_row_modified)
         {
         }
 
@@ -61,6 +153,7 @@ namespace maps { namespace grid
             : cells(other.begin(), other.end())
             , num_cells(other.getNumCells())
             , default_value(other.getDefaultValue())
+            , modification_tracking(false)
         {
         }
 
@@ -69,13 +162,16 @@ namespace maps { namespace grid
             return default_value;
         }
 
+        /** Mutable iterator, records all rows as modified, see setModificationTracking */
         iterator begin()
         {
+            markAllRowsModified();
             return cells.begin();
         }
 
         iterator end()
         {
+            markAllRowsModified();
             return cells.end();
         }
 
@@ -93,6 +189,7 @@ namespace maps { namespace grid
         {
             this->num_cells = new_number_cells;
             cells.resize(new_number_cells.prod(), default_value);
+            markAllRowsModified();
         };
 
         /**
@@ -132,9 +229,10 @@ namespace maps { namespace grid
             }
 
             cells.swap(tmp);
+            markAllRowsModified();
         }
 
-        const CellT& at(const Index &idx) const
+        const_reference at(const Index &idx) const
         {
             return this->at(idx.x(), idx.y());
         }
@@ -144,7 +242,7 @@ namespace maps { namespace grid
             return this->at(idx.x(), idx.y());
         }
 
-        const CellT& at(size_t x, size_t y) const
+        const_reference at(size_t x, size_t y) const
         {
             if(x >= num_cells.x() || y >= num_cells.y())
                 throw std::runtime_error("Provided index is out of the grid");
@@ -155,9 +253,75 @@ namespace maps { namespace grid
         {
             if(x >= num_cells.x() || y >= num_cells.y())
                 throw std::runtime_error("Provided index is out of the grid");
+            markRowModified(y);
             return cells[x + y * num_cells.x()];
         }
         
+        /**
+         * Access without bounds check, the caller has to ensure that the index is inside of the grid.
+         * Use this in inner loops after checking the range once.
+         */
+        const_reference atUnchecked(size_t x, size_t y) const
+        {
+            return cells[x + y * num_cells.x()];
+        }
+
+        CellT& atUnchecked(size_t x, size_t y)
+        {
+            markRowModified(y);
+            return cells[x + y * num_cells.x()];
+        }
+
+        const_reference atUnchecked(const Index &idx) const
+        {
+            return atUnchecked(idx.x(), idx.y());
+        }
+
+        CellT& atUnchecked(const Index &idx)
+        {
+            return atUnchecked(idx.x(), idx.y());
+        }
+
+        /**
+         * Returns the cells of row y as contiguous span of getNumCells().x() cells.
+         */
+        ConstRowSpan getRow(size_t y) const
+        {
+            if(y >= num_cells.y())
+                throw std::runtime_error("Provided row is out of the grid");
+            return ConstRowSpan(cells.data() + y * num_cells.x(), num_cells.x());
+        }
+
+        RowSpan getRow(size_t y)
+        {
+            if(y >= num_cells.y())
+                throw std::runtime_error("Provided row is out of the grid");
+            markRowModified(y);
+            return RowSpan(cells.data() + y * num_cells.x(), num_cells.x());
+        }
+
+        /**
+         * Splits the grid into tiles of at most tile_size cells and calls
+         * f(tile_min, tile_max) for each tile, with tile_max being exclusive.
+         * The tiles are visited row by row. Processing a grid tile wise
+         * keeps the rows of a neighborhood in cache.
+         */
+        template<class Function>
+        void visitTiles(const Vector2ui &tile_size, Function&& f) const
+        {
+            if(tile_size.x() == 0 || tile_size.y() == 0)
+                throw std::runtime_error("Tile size has to be larger than zero");
+            for(unsigned int y = 0; y < num_cells.y(); y += tile_size.y())
+            {
+                for(unsigned int x = 0; x < num_cells.x(); x += tile_size.x())
+                {
+                    const Index tile_min(x, y);
+                    const Index tile_max(std::min(x + tile_size.x(), num_cells.x()), std::min(y + tile_size.y(), num_cells.y()));
+                    f(tile_min, tile_max);
+                }
+            }
+        }
+
         const Vector2ui &getNumCells() const
         {
             return num_cells;
@@ -169,9 +333,96 @@ namespace maps { namespace grid
             {
                 e = default_value;
             }
+            markAllRowsModified();
         };      
-        
+
+        /**
+         * Enables recording which rows are accessed mutably, i.e. by the non-const
+         * at, atUnchecked and getRow, and all rows by the mutable iterators, resize,
+         * moveBy, clear and deserialization. Reading a cell through a non-const
+         * reference counts as modification as well.
+         *
+         * Owners of data derived from the cells, like a height pyramid, use this to
+         * detect modifications made through a reference to the grid. Recording is
+         * thread-safe, so rows can still be written in parallel. Enabling the
+         * tracking resets the recorded rows. Disabled by default.
+         */
+        void setModificationTracking(bool enable)
+        {
+            modification_tracking = enable;
+            modified_rows.clear();
+            if(enable)
+                modified_rows.resize(num_cells.y());
+            all_rows_modified.reset();
+            any_row_modified.reset();
+        }
+
+        bool isModificationTracking() const
+        {
+            return modification_tracking;
+        }
+
+        /** Returns true if any row was accessed mutably since the last resetModifiedRows */
+        bool hasModifiedRows() const
+        {
+            return any_row_modified.isSet();
+        }
+
+        /** Returns true if all rows were accessed mutably since the last resetModifiedRows */
+        bool hasAllRowsModified() const
+        {
+            return all_rows_modified.isSet();
+        }
+
+        /** Returns true if row y was accessed mutably since the last resetModifiedRows */
+        bool isRowModified(size_t y) const
+        {
+            return all_rows_modified.isSet() || (y < modified_rows.size() && modified_rows[y].isSet());
+        }
+
+        void resetModifiedRows()
+        {
+            for(ModificationFlag& row : modified_rows)
+                row.reset();
+            all_rows_modified.reset();
+            any_row_modified.reset();
+        }
+
     protected:
+        /**
+         * Mutable access which isn't recorded by the modification tracking,
+         * for owners which keep their derived data up to date themselves.
+         */
+        CellT& atUntracked(size_t x, size_t y)
+        {
+            return cells[x + y * num_cells.x()];
+        }
+
+        CellT& atUntracked(const Index &idx)
+        {
+            return atUntracked(idx.x(), idx.y());
+        }
+
+        void markRowModified(size_t y)
+        {
+            if(modification_tracking)
+            {
+                modified_rows[y].set();
+                any_row_modified.set();
+            }
+        }
+
+        void markAllRowsModified()
+        {
+            if(modification_tracking)
+            {
+                if(modified_rows.size() != num_cells.y())
+                    modified_rows.resize(num_cells.y());
+                all_rows_modified.set();
+                any_row_modified.set();
+            }
+        }
+
         size_t toIdx(size_t x, size_t y) const
         {
             return x  +  y * num_cells.x();
@@ -244,6 +495,7 @@ namespace maps { namespace grid
             ar >> BOOST_SERIALIZATION_NVP(default_value);
             cells.clear();
             cells.resize(num_cells.x() * num_cells.y(), default_value);
+            markAllRowsModified();
 
             if (version == 0)
             {
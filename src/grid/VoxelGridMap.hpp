@@ -3,9 +3,21 @@
 #include "GridMap.hpp"
 #include "DiscreteTree.hpp"
 
+#include <algorithm>
+#include <vector>
+
 namespace maps { namespace grid
 {
 
+/** A voxel which became occupied or stopped being occupied */
+struct VoxelChange
+{
+    VoxelChange(const Eigen::Vector3i& idx, bool occupied) : idx(idx), occupied(occupied) {}
+
+    Eigen::Vector3i idx;
+    bool occupied;
+};
+
 template<class CellT>
 class VoxelGridMap : public GridMap< DiscreteTree<CellT> >
 {
@@ -14,7 +26,78 @@ public:
     VoxelGridMap(const Vector2ui &num_cells,
                 const Eigen::Vector3d &resolution) :
                 GridMap< DiscreteTree<CellT> >(num_cells,
-                resolution.head<2>(), DiscreteTree<CellT>(resolution.z())) {}
+                resolution.head<2>(), DiscreteTree<CellT>(resolution.z())),
+                track_changes(false), memory_budget(0), prune_retry_usage(0), prune_cursor(0) {}
+
+    /**
+     * If enabled, the voxels whose occupancy changes while merging measurements
+     * are recorded until clearChangedVoxels is called. This allows to update
+     * derived data like a EuclideanDistanceField incrementally. What counts as
+     * occupied depends on the map type. Changes are not recorded by default.
+     */
+    void setChangeTracking(bool enable)
+    {
+        track_changes = enable;
+        if(!enable)
+            changed_voxels.clear();
+    }
+
+    bool isChangeTracking() const
+    {
+        return track_changes;
+    }
+
+    /** The recorded changes in the order they happened, a voxel can occur multiple times */
+    const std::vector<VoxelChange>& getChangedVoxels() const
+    {
+        return changed_voxels;
+    }
+
+    void clearChangedVoxels()
+    {
+        changed_voxels.clear();
+    }
+
+    /** Number of voxels stored in all columns, linear in the number of cells */
+    size_t getNumVoxels() const
+    {
+        size_t num_voxels = 0;
+        for(const DiscreteTree<CellT>& tree : *this)
+            num_voxels += tree.size();
+        return num_voxels;
+    }
+
+    /**
+     * Estimated memory usage in bytes, i.e. the columns of the grid and a tree
+     * node per voxel.
+     */
+    size_t getMemoryUsage() const
+    {
+        return _Base::getNumCells().prod() * sizeof(DiscreteTree<CellT>) + getNumVoxels() * getVoxelMemoryUsage();
+    }
+
+    /** Estimated memory usage of a single voxel in bytes */
+    static size_t getVoxelMemoryUsage()
+    {
+        // a red-black tree node holds three pointers and the color besides the value
+        return sizeof(typename DiscreteTree<CellT>::value_type) + 4 * sizeof(void*);
+    }
+
+    /**
+     * Sets the memory usage in bytes above which merging a point cloud
+     * prunes the map, see getMemoryUsage. 0 disables the automatic pruning (default).
+     * What is pruned depends on the map type. The budget is not serialized.
+     */
+    void setMemoryBudget(size_t bytes)
+    {
+        memory_budget = bytes;
+        prune_retry_usage = 0;
+    }
+
+    size_t getMemoryBudget() const
+    {
+        return memory_budget;
+    }
 
     bool hasVoxelCell(const Eigen::Vector3d &position) const
     {
@@ -85,6 +168,86 @@ public:
 
 protected:
 
+    /** Records a change of the occupancy of a voxel if tracking is enabled */
+    void addChangedVoxel(const Eigen::Vector3i& idx, bool occupied)
+    {
+        if(track_changes)
+            changed_voxels.push_back(VoxelChange(idx, occupied));
+    }
+
+    /**
+     * Removes the voxels for which is_prunable returns true from the next
+     * num_columns columns. Consecutive calls continue where the last one stopped
+     * and wrap around, so the pruning can be spread over several calls.
+     * @return number of removed voxels
+     */
+    template<class Predicate>
+    size_t pruneColumns(Predicate is_prunable, size_t num_columns)
+    {
+        const size_t total_columns = _Base::getNumCells().prod();
+        if(total_columns == 0)
+            return 0;
+        num_columns = std::min(num_columns, total_columns);
+
+        size_t num_removed = 0;
+        for(size_t i = 0; i < num_columns; ++i)
+        {
+            if(prune_cursor >= total_columns)
+                prune_cursor = 0;
+            const Index idx(prune_cursor % _Base::getNumCells().x(), prune_cursor / _Base::getNumCells().x());
+            DiscreteTree<CellT>& tree = _Base::at(idx);
+            for(typename DiscreteTree<CellT>::iterator it = tree.begin(); it != tree.end();)
+            {
+                if(is_prunable(it->second))
+                {
+                    it = tree.erase(it);
+                    ++num_removed;
+                }
+                else
+                    ++it;
+            }
+            ++prune_cursor;
+        }
+        return num_removed;
+    }
+
+    /**
+     * Prunes chunks of columns while the memory budget is exceeded,
+     * at most once over the whole grid. If a sweep didn't free anything,
+     * the next one is postponed until the map grew by an eighth of the budget.
+     */
+    template<class Predicate>
+    void enforceMemoryBudget(Predicate is_prunable)
+    {
+        if(memory_budget == 0)
+            return;
+        size_t usage = getMemoryUsage();
+        if(usage <= memory_budget || usage < prune_retry_usage)
+            return;
+
+        const size_t total_columns = _Base::getNumCells().prod();
+        const size_t chunk_size = 4096;
+        size_t num_removed = 0;
+        for(size_t pruned = 0; pruned < total_columns && usage > memory_budget; pruned += chunk_size)
+        {
+            const size_t removed = pruneColumns(is_prunable, chunk_size);
+            usage -= removed * getVoxelMemoryUsage();
+            num_removed += removed;
+        }
+        prune_retry_usage = num_removed == 0 ? usage + memory_budget / 8 : 0;
+    }
+
+    bool track_changes;
+    std::vector<VoxelChange> changed_voxels;
+
+    size_t memory_budget;
+
+    /** memory usage below which no pruning is tried, 0 if the last sweep freed voxels */
+    size_t prune_retry_usage;
+
+    /** next column to prune, as linear index */
+    size_t prune_cursor;
+
     /** Grants access to boost serialization */
     friend class boost::serialization::access;
 
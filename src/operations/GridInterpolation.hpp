@@ -1,12 +1,18 @@
 #ifndef __MAPS_GRIDINTERPOLATION_HPP__
 #define __MAPS_GRIDINTERPOLATION_HPP__
 
-#include "../GridMap.hpp"
+#include "../grid/GridMap.hpp"
+#include "../tools/ParallelFor.hpp"
 
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include <CGAL/Projection_traits_xy_3.h>
 #include <CGAL/Delaunay_triangulation_2.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
 namespace maps { namespace operations
 {
     class GridInterpolation
@@ -16,84 +22,295 @@ namespace maps { namespace operations
         ~GridInterpolation() {};
 
         /**
-         * @brief [brief description]
-         * @details nore only for doubles
-         * (cell_value = Vector3d(x,y,1).dot( A.inverse() * b );)
-         * uncertanty for integral types
-         * 
-         * @param grid [description]
+         * @brief Fills the cells without value by linear interpolation over the
+         * Delaunay triangulation of the cells with value.
+         * @details
+         * Each face of the triangulation is visited once and scan-converted into
+         * the grid, the covered cells get the barycentric interpolation of the
+         * face vertices. Cells outside of the convex hull of the cells with value
+         * keep the default value. Cells on an edge shared by two faces are filled
+         * by exactly one of them, so the faces are rasterized in parallel.
+         * The values are truncated for integral types.
+         *
+         * @param grid grid to fill, cells with the default value are interpolated
+         * @param num_threads number of threads to use, 0 uses all hardware threads
          */
-        template <class T, 
+        template <class T,
                 class = typename std::enable_if<std::is_arithmetic<T>::value>::type>
-        static void interpolate(GridMap<T> &grid)
+        static void interpolate(grid::GridMap<T> &grid, unsigned num_threads = 0)
         {
+            static_assert(!std::is_same<T, bool>::value, "The cells of a GridMap<bool> can't be written in parallel");
             typedef CGAL::Exact_predicates_inexact_constructions_kernel K;
             typedef CGAL::Projection_traits_xy_3<K>  Gt;
-            typedef CGAL::Delaunay_triangulation_2<Gt> Delaunay;                
+            typedef CGAL::Delaunay_triangulation_2<Gt> Delaunay;
             typedef K::Point_3 Point;
 
+            std::vector<Point> points;
+            for(size_t y = 0; y < grid.getNumCells().y(); ++y)
+            {
+                const typename grid::GridMap<T>::ConstRowSpan row = static_cast<const grid::GridMap<T>&>(grid).getRow(y);
+                for(size_t x = 0; x < row.size; ++x)
+                {
+                    if(!grid.isDefault(row[x]))
+                        points.push_back(Point(x, y, row[x]));
+                }
+            }
+
+            // inserting a range spatially sorts the points first
             Delaunay dt;
+            dt.insert(points.begin(), points.end());
+
+            std::vector<Triangle> triangles;
+            triangles.reserve(dt.number_of_faces());
+            for(typename Delaunay::Finite_faces_iterator face = dt.finite_faces_begin(); face != dt.finite_faces_end(); ++face)
+            {
+                Triangle triangle;
+                for(int i = 0; i < 3; i++)
+                {
+                    const Point &p(face->vertex(i)->point());
+                    triangle.x[i] = std::lround(p.x());
+                    triangle.y[i] = std::lround(p.y());
+                    triangle.z[i] = p.z();
+                    // edge i is opposite to vertex i
+                    triangle.on_hull[i] = dt.is_infinite(face->neighbor(i));
+                }
+                triangles.push_back(triangle);
+            }
 
-            size_t min_width = grid.getNumCells().x() - 1;
-            size_t max_width = 0;
-            size_t min_height = grid.getNumCells().y() - 1;
-            size_t max_height = 0;   
+            tools::parallelFor(0, triangles.size(), [&](size_t begin, size_t end)
+            {
+                for(size_t i = begin; i < end; ++i)
+                    rasterizeTriangle(grid, triangles[i]);
+            }, num_threads, 256);
+        }
 
-            T default_value = grid.getDefaultValue();
+        /**
+         * @brief Fills the cells without value by push-pull interpolation.
+         * @details
+         * Builds an image pyramid by averaging the cells with value (push) and
+         * fills the missing cells from the bilinearly upsampled coarser levels
+         * (pull). This doesn't need a triangulation and fills all cells of the
+         * grid, which suits dense grids with small holes. Large holes get a
+         * smooth but not linear fill. The rows of each level are processed in parallel.
+         *
+         * @param grid grid to fill, cells with the default value are interpolated
+         * @param num_threads number of threads to use, 0 uses all hardware threads
+         */
+        template <class T,
+                class = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+        static void interpolatePushPull(grid::GridMap<T> &grid, unsigned num_threads = 0)
+        {
+            static_assert(!std::is_same<T, bool>::value, "The cells of a GridMap<bool> can't be written in parallel");
+            if(grid.getNumCells().prod() == 0)
+                return;
 
-            for(size_t y = 0; y < grid.getNumCells().y(); ++y)
+            std::vector<Level> levels(1);
+            levels[0].resize(grid.getNumCells());
+            tools::parallelFor(0, grid.getNumCells().y(), [&](size_t begin, size_t end)
             {
-                for(size_t x = 0; x < grid.getNumCells().x(); ++x)
+                for(size_t y = begin; y < end; ++y)
                 {
-                    T const &cell_value = grid.at(x, y);
-                    if(cell_value != default_value )
+                    const typename grid::GridMap<T>::ConstRowSpan row = static_cast<const grid::GridMap<T>&>(grid).getRow(y);
+                    for(size_t x = 0; x < row.size; ++x)
                     {
-                        Point p(x, y, cell_value);
-                        dt.insert( p );
-                            
-                        min_width = std::min(min_width, x);
-                        max_width = std::max(max_width, x);
-                        min_height = std::min(min_height, y);
-                        max_height = std::max(max_height, y);
+                        if(!grid.isDefault(row[x]))
+                        {
+                            levels[0].value(x, y) = row[x];
+                            levels[0].weight(x, y) = 1.f;
+                        }
                     }
                 }
+            }, num_threads, 16);
+
+            // push: each level averages the 2x2 blocks of the level below
+            while(levels.back().size.x() > 1 || levels.back().size.y() > 1)
+            {
+                const grid::Vector2ui size = levels.back().size;
+                levels.push_back(Level());
+                levels.back().resize(grid::Vector2ui((size.x() + 1) / 2, (size.y() + 1) / 2));
+                push(levels[levels.size() - 2], levels.back(), num_threads);
             }
+            if(levels.back().weight(0, 0) == 0.f)
+                return;
 
-            for(size_t x = min_width; x < max_width; x++)
+            // pull: the missing part of each cell is filled from the level above
+            for(size_t level = levels.size() - 1; level > 0; --level)
+                pull(levels[level], levels[level - 1], num_threads);
+
+            tools::parallelFor(0, grid.getNumCells().y(), [&](size_t begin, size_t end)
             {
-                for(size_t y = min_height; y < max_height; y++)
+                for(size_t y = begin; y < end; ++y)
                 {
-                    T &cell_value = grid.at(x, y);
-                    if(cell_value == default_value)
+                    typename grid::GridMap<T>::RowSpan row = grid.getRow(y);
+                    for(size_t x = 0; x < row.size; ++x)
                     {
-                        // no data point in grid, so value needs to be interpolated
+                        if(grid.isDefault(row[x]))
+                            row[x] = static_cast<T>(levels[0].value(x, y));
+                    }
+                }
+            }, num_threads, 16);
+        }
 
-                        // Solve linear equation system to find plane that is spanned by
-                        // the three points
-                        Eigen::Matrix3d A;
-                        Eigen::Vector3d b;
+    private:
 
-                        Delaunay::Face_handle face = dt.locate(Point(x, y, 0));
-                        if( face == NULL || face->vertex(0) == NULL 
-                            || face->vertex(1) == NULL || face->vertex(2) == NULL)
-                            continue;
+        /** Face of the triangulation in cell coordinates */
+        struct Triangle
+        {
+            int64_t x[3];
+            int64_t y[3];
+            double z[3];
+            /** true if the edge opposite to the vertex is on the convex hull */
+            bool on_hull[3];
+        };
 
-                        for(int i = 0; i < 3; i++)
+        /** Level of the push-pull pyramid */
+        struct Level
+        {
+            grid::Vector2ui size;
+            std::vector<double> values;
+            std::vector<float> weights;
+
+            void resize(const grid::Vector2ui& new_size)
+            {
+                size = new_size;
+                values.assign(size.prod(), 0.);
+                weights.assign(size.prod(), 0.f);
+            }
+
+            double& value(size_t x, size_t y)
+            {
+                return values[x + y * size.x()];
+            }
+
+            float& weight(size_t x, size_t y)
+            {
+                return weights[x + y * size.x()];
+            }
+        };
+
+        /**
+         * Twice the signed area of (a, b, p), exact since all coordinates are integral.
+         */
+        static int64_t edgeFunction(int64_t ax, int64_t ay, int64_t bx, int64_t by, int64_t px, int64_t py)
+        {
+            return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+        }
+
+        /**
+         * Cells on an edge belong to the face for which the edge points down or,
+         * for horizontal edges, to the right. The neighbouring face traverses the
+         * edge in the opposite direction, so each cell is covered exactly once.
+         */
+        static bool ownsEdge(int64_t ax, int64_t ay, int64_t bx, int64_t by)
+        {
+            return by < ay || (by == ay && bx > ax);
+        }
+
+        template <class T>
+        static void rasterizeTriangle(grid::GridMap<T> &grid, Triangle triangle)
+        {
+            int64_t area = edgeFunction(triangle.x[0], triangle.y[0], triangle.x[1], triangle.y[1], triangle.x[2], triangle.y[2]);
+            if(area == 0)
+                return;
+            if(area < 0)
+            {
+                // counter clockwise order
+                std::swap(triangle.x[1], triangle.x[2]);
+                std::swap(triangle.y[1], triangle.y[2]);
+                std::swap(triangle.z[1], triangle.z[2]);
+                std::swap(triangle.on_hull[1], triangle.on_hull[2]);
+                area = -area;
+            }
+
+            const int64_t* x = triangle.x;
+            const int64_t* y = triangle.y;
+            // edges on the convex hull have no neighbouring face
+            const bool owns[3] = {triangle.on_hull[0] || ownsEdge(x[1], y[1], x[2], y[2]),
+                                  triangle.on_hull[1] || ownsEdge(x[2], y[2], x[0], y[0]),
+                                  triangle.on_hull[2] || ownsEdge(x[0], y[0], x[1], y[1])};
+
+            const int64_t min_x = std::max<int64_t>(std::min({x[0], x[1], x[2]}), 0);
+            const int64_t max_x = std::min<int64_t>(std::max({x[0], x[1], x[2]}), grid.getNumCells().x() - 1);
+            const int64_t min_y = std::max<int64_t>(std::min({y[0], y[1], y[2]}), 0);
+            const int64_t max_y = std::min<int64_t>(std::max({y[0], y[1], y[2]}), grid.getNumCells().y() - 1);
+
+            for(int64_t py = min_y; py <= max_y; ++py)
+            {
+                typename grid::GridMap<T>::RowSpan row = grid.getRow(py);
+                for(int64_t px = min_x; px <= max_x; ++px)
+                {
+                    // w[i] is the weight of vertex i, i.e. the area opposite to it
+                    const int64_t w[3] = {edgeFunction(x[1], y[1], x[2], y[2], px, py),
+                                          edgeFunction(x[2], y[2], x[0], y[0], px, py),
+                                          edgeFunction(x[0], y[0], x[1], y[1], px, py)};
+                    bool inside = true;
+                    for(int i = 0; i < 3; i++)
+                        inside &= w[i] > 0 || (w[i] == 0 && owns[i]);
+                    if(!inside || !grid.isDefault(row[px]))
+                        continue;
+
+                    row[px] = static_cast<T>((w[0] * triangle.z[0] + w[1] * triangle.z[1] + w[2] * triangle.z[2]) / area);
+                }
+            }
+        }
+
+        static void push(Level& fine, Level& coarse, unsigned num_threads)
+        {
+            tools::parallelFor(0, coarse.size.y(), [&](size_t begin, size_t end)
+            {
+                for(size_t y = begin; y < end; ++y)
+                {
+                    for(size_t x = 0; x < coarse.size.x(); ++x)
+                    {
+                        double sum = 0.;
+                        float weight_sum = 0.f;
+                        for(size_t fy = 2 * y; fy < std::min<size_t>(2 * y + 2, fine.size.y()); ++fy)
                         {
-                            Point &p(face->vertex(i)->point());
-                            A.block<1,3>(i,0) = Vector3d(p.x(), p.y(), 1);
-                            b(i) = p.z();
+                            for(size_t fx = 2 * x; fx < std::min<size_t>(2 * x + 2, fine.size.x()); ++fx)
+                            {
+                                sum += fine.weight(fx, fy) * fine.value(fx, fy);
+                                weight_sum += fine.weight(fx, fy);
+                            }
                         }
-
-                        // evaluate the point at x, y
-                        cell_value = Vector3d(x,y,1).dot( A.inverse() * b );
+                        if(weight_sum > 0.f)
+                            coarse.value(x, y) = sum / weight_sum;
+                        coarse.weight(x, y) = std::min(weight_sum, 1.f);
                     }
                 }
-            }       
+            }, num_threads, 16);
         }
 
-    private:
+        static void pull(Level& coarse, Level& fine, unsigned num_threads)
+        {
+            tools::parallelFor(0, fine.size.y(), [&](size_t begin, size_t end)
+            {
+                for(size_t y = begin; y < end; ++y)
+                {
+                    // position of the fine cell center in the coarse level
+                    const double cy = (y + 0.5) / 2. - 0.5;
+                    const int y0 = std::max<int>(std::floor(cy), 0);
+                    const int y1 = std::min<int>(y0 + 1, coarse.size.y() - 1);
+                    const double ty = std::min(std::max(cy - y0, 0.), 1.);
+                    for(size_t x = 0; x < fine.size.x(); ++x)
+                    {
+                        const float weight = fine.weight(x, y);
+                        if(weight >= 1.f)
+                            continue;
 
+                        const double cx = (x + 0.5) / 2. - 0.5;
+                        const int x0 = std::max<int>(std::floor(cx), 0);
+                        const int x1 = std::min<int>(x0 + 1, coarse.size.x() - 1);
+                        const double tx = std::min(std::max(cx - x0, 0.), 1.);
+                        const double upsampled =
+                            (1. - ty) * ((1. - tx) * coarse.value(x0, y0) + tx * coarse.value(x1, y0))
+                            + ty * ((1. - tx) * coarse.value(x0, y1) + tx * coarse.value(x1, y1));
+
+                        fine.value(x, y) = weight * fine.value(x, y) + (1.f - weight) * upsampled;
+                        fine.weight(x, y) = 1.f;
+                    }
+                }
+            }, num_threads, 16);
+        }
     };
 }}
 
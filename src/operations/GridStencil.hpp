@@ -0,0 +1,423 @@
+#ifndef __MAPS_GRIDSTENCIL_HPP__
+#define __MAPS_GRIDSTENCIL_HPP__
+
+#include "../grid/GridMap.hpp"
+#include "../tools/ParallelFor.hpp"
+
+#include <Eigen/Core>
+
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace maps { namespace operations
+{
+    /**
+     * @brief Neighborhood operations on GridMaps.
+     * @details
+     * Applies a functor or a convolution kernel to the (2 * radius + 1)^2
+     * neighborhood of every cell. The grid is split into tiles which are
+     * processed in parallel, so the output cells have to be independent,
+     * i.e. the result must not be a GridMap<bool>.
+     *
+     * Cells with the default value of the input are treated as missing.
+     */
+    class GridStencil
+    {
+    public:
+        enum BorderMode
+        {
+            /** neighbours outside of the grid have the default value */
+            BORDER_DEFAULT,
+            /** neighbours outside of the grid are replaced by the closest cell of the grid */
+            BORDER_CLAMP
+        };
+
+        /** Edge length of the tiles which are processed by one thread at a time */
+        static const unsigned int TILE_SIZE = 64;
+
+        /**
+         * @brief View on the neighborhood of a cell which is passed to the functor of apply().
+         */
+        template <class T>
+        class Neighborhood
+        {
+        public:
+            Neighborhood(const grid::GridMap<T>& grid, const grid::Index& idx, int radius, BorderMode border)
+                : grid(grid), idx(idx), radius(radius), border(border)
+            {
+                const grid::Vector2ui& num_cells = grid.getNumCells();
+                inside = idx.x() >= radius && idx.y() >= radius
+                    && idx.x() + radius < (int)num_cells.x() && idx.y() + radius < (int)num_cells.y();
+            }
+
+            /** Cell at the offset (dx, dy) to the center, the offsets have to be in [-radius, radius] */
+            const T& operator()(int dx, int dy) const
+            {
+                int x = idx.x() + dx, y = idx.y() + dy;
+                if(!inside)
+                {
+                    const grid::Vector2ui& num_cells = grid.getNumCells();
+                    if(x < 0 || y < 0 || x >= (int)num_cells.x() || y >= (int)num_cells.y())
+                    {
+                        if(border == BORDER_DEFAULT)
+                            return grid.getDefaultValue();
+                        x = std::min(std::max(x, 0), (int)num_cells.x() - 1);
+                        y = std::min(std::max(y, 0), (int)num_cells.y() - 1);
+                    }
+                }
+                return grid.atUnchecked(x, y);
+            }
+
+            const T& center() const
+            {
+                return grid.atUnchecked(idx.x(), idx.y());
+            }
+
+            /** Returns true if the cell at the offset (dx, dy) is missing */
+            bool isDefault(int dx, int dy) const
+            {
+                return grid.isDefault((*this)(dx, dy));
+            }
+
+            const grid::Index& getIndex() const
+            {
+                return idx;
+            }
+
+            int getRadius() const
+            {
+                return radius;
+            }
+
+            /** Returns true if the whole neighborhood is inside of the grid */
+            bool isInside() const
+            {
+                return inside;
+            }
+
+            const grid::GridMap<T>& getGrid() const
+            {
+                return grid;
+            }
+
+        private:
+            const grid::GridMap<T>& grid;
+            grid::Index idx;
+            int radius;
+            BorderMode border;
+            bool inside;
+        };
+
+        /**
+         * @brief Sets each cell of output to f(neighborhood) of the corresponding input cell.
+         *
+         * @param output has to have the same number of cells as input and must not be input
+         * @param f functor taking a const Neighborhood<T>& and returning a value convertible to R.
+         *          The same instance is called concurrently from all threads, so it has to be thread-safe.
+         * @param num_threads number of threads to use, 0 uses all hardware threads
+         */
+        template <class T, class R, class Function>
+        static void apply(const grid::GridMap<T>& input, grid::GridMap<R>& output, unsigned int radius, Function f,
+                          BorderMode border = BORDER_DEFAULT, unsigned num_threads = 0)
+        {
+            static_assert(!std::is_same<R, bool>::value, "The cells of a GridMap<bool> can't be written in parallel");
+            checkOutput(input, output);
+
+            forEachTile(input, num_threads, [&](const grid::Index& tile_min, const grid::Index& tile_max)
+            {
+                for(int y = tile_min.y(); y < tile_max.y(); ++y)
+                {
+                    typename grid::GridMap<R>::RowSpan row = output.getRow(y);
+                    for(int x = tile_min.x(); x < tile_max.x(); ++x)
+                        row[x] = f(Neighborhood<T>(input, grid::Index(x, y), radius, border));
+                }
+            });
+        }
+
+        /**
+         * @brief Same as above, returns a new grid with the default value and frame of input.
+         */
+        template <class T, class Function>
+        static grid::GridMap<T> apply(const grid::GridMap<T>& input, unsigned int radius, Function f,
+                                      BorderMode border = BORDER_DEFAULT, unsigned num_threads = 0)
+        {
+            grid::GridMap<T> output = createOutput(input);
+            apply(input, output, radius, f, border, num_threads);
+            return output;
+        }
+
+        /**
+         * @brief Convolves an arithmetic grid with a square kernel of odd size.
+         *
+         * The kernel is indexed as kernel(dy + radius, dx + radius).
+         * If \c normalize is true missing cells are left out and the result is divided by the
+         * sum of the weights of the remaining cells (normalized convolution). Otherwise
+         * the result is the plain weighted sum and missing if any cell with a non-zero weight is missing.
+         * Missing cells stay missing unless \c fill_holes is true.
+         *
+         * Tiles are processed in parallel, for cells whose neighborhood is inside of the
+         * grid the kernel is applied directly on the rows of the grid. If these rows only
+         * contain finite cells with value, the weighted sum is computed without branches.
+         */
+        template <class T>
+        static void convolve(const grid::GridMap<T>& input, grid::GridMap<T>& output, const Eigen::MatrixXf& kernel,
+                             bool normalize = true, bool fill_holes = false,
+                             BorderMode border = BORDER_DEFAULT, unsigned num_threads = 0)
+        {
+            static_assert(std::is_arithmetic<T>::value, "convolve requires an arithmetic cell type");
+            if(kernel.rows() != kernel.cols() || kernel.rows() % 2 == 0)
+                throw std::runtime_error("The kernel has to be square with an odd size");
+            checkOutput(input, output);
+
+            const int radius = kernel.rows() / 2;
+            const T default_value = input.getDefaultValue();
+            const bool default_is_nan = std::isnan(default_value);
+            auto is_default = [default_value, default_is_nan](T value)
+            {
+                return default_is_nan ? std::isnan(value) : value == default_value;
+            };
+
+            // rows without missing or non-finite cells, where zero weights can't change the result
+            const int height = input.getNumCells().y();
+            std::vector<char> complete_rows(height);
+            tools::parallelFor(0, height, [&](size_t begin, size_t end)
+            {
+                for(size_t y = begin; y < end; ++y)
+                {
+                    typename grid::GridMap<T>::ConstRowSpan row = input.getRow(y);
+                    bool complete = true;
+                    for(size_t x = 0; x < row.size; ++x)
+                        complete &= !is_default(row[x]) && std::isfinite(row[x]);
+                    complete_rows[y] = complete;
+                }
+            }, num_threads, 16);
+
+            const Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> weights = kernel;
+            const double kernel_sum = kernel.cast<double>().sum();
+
+            forEachTile(input, num_threads, [&](const grid::Index& tile_min, const grid::Index& tile_max)
+            {
+                for(int y = tile_min.y(); y < tile_max.y(); ++y)
+                {
+                    typename grid::GridMap<T>::ConstRowSpan input_row = input.getRow(y);
+                    typename grid::GridMap<T>::RowSpan output_row = output.getRow(y);
+                    for(int x = tile_min.x(); x < tile_max.x(); ++x)
+                    {
+                        if(!fill_holes && is_default(input_row[x]))
+                        {
+                            output_row[x] = default_value;
+                            continue;
+                        }
+
+                        double sum = 0., weight_sum = 0.;
+                        bool missing = false;
+                        const Neighborhood<T> neighborhood(input, grid::Index(x, y), radius, border);
+                        if(neighborhood.isInside() && isComplete(complete_rows, y - radius, y + radius))
+                        {
+                            for(int ky = 0; ky < kernel.rows(); ++ky)
+                            {
+                                const T* values = input.getRow(y + ky - radius).data + x - radius;
+                                const float* row_weights = weights.data() + ky * weights.cols();
+                                for(int kx = 0; kx < kernel.cols(); ++kx)
+                                    sum += row_weights[kx] * values[kx];
+                            }
+                            weight_sum = kernel_sum;
+                        }
+                        else if(neighborhood.isInside())
+                        {
+                            for(int ky = 0; ky < kernel.rows(); ++ky)
+                            {
+                                const T* values = input.getRow(y + ky - radius).data + x - radius;
+                                for(int kx = 0; kx < kernel.cols(); ++kx)
+                                    accumulate(values[kx], kernel(ky, kx), is_default(values[kx]), sum, weight_sum, missing);
+                            }
+                        }
+                        else
+                        {
+                            for(int ky = 0; ky < kernel.rows(); ++ky)
+                            {
+                                for(int kx = 0; kx < kernel.cols(); ++kx)
+                                {
+                                    const T& value = neighborhood(kx - radius, ky - radius);
+                                    accumulate(value, kernel(ky, kx), is_default(value), sum, weight_sum, missing);
+                                }
+                            }
+                        }
+
+                        if(normalize)
+                            output_row[x] = weight_sum != 0. ? static_cast<T>(sum / weight_sum) : default_value;
+                        else
+                            output_row[x] = missing ? default_value : static_cast<T>(sum);
+                    }
+                }
+            });
+        }
+
+        /**
+         * @brief Same as above, returns a new grid with the default value and frame of input.
+         */
+        template <class T>
+        static grid::GridMap<T> convolve(const grid::GridMap<T>& input, const Eigen::MatrixXf& kernel,
+                                         bool normalize = true, bool fill_holes = false,
+                                         BorderMode border = BORDER_DEFAULT, unsigned num_threads = 0)
+        {
+            grid::GridMap<T> output = createOutput(input);
+            convolve(input, output, kernel, normalize, fill_holes, border, num_threads);
+            return output;
+        }
+
+        /**
+         * @brief Normalized gaussian kernel of size 2 * radius + 1
+         */
+        static Eigen::MatrixXf gaussianKernel(unsigned int radius, double sigma)
+        {
+            const int size = 2 * radius + 1;
+            Eigen::MatrixXf kernel(size, size);
+            for(int y = 0; y < size; ++y)
+            {
+                for(int x = 0; x < size; ++x)
+                {
+                    const double dx = x - (int)radius, dy = y - (int)radius;
+                    kernel(y, x) = std::exp(-(dx * dx + dy * dy) / (2. * sigma * sigma));
+                }
+            }
+            return kernel / kernel.sum();
+        }
+
+        /**
+         * @brief Sets each cell to the maximum of its square neighborhood, e.g. to inflate obstacles in a cost map.
+         *
+         * Missing cells are left out, so missing cells next to cells with value get a value.
+         * The square window is separable, so the cost is linear in the radius.
+         */
+        template <class T>
+        static grid::GridMap<T> dilate(const grid::GridMap<T>& input, unsigned int radius, unsigned num_threads = 0)
+        {
+            return rankFilter(input, radius, true, num_threads);
+        }
+
+        /**
+         * @brief Sets each cell to the minimum of its square neighborhood, see dilate().
+         */
+        template <class T>
+        static grid::GridMap<T> erode(const grid::GridMap<T>& input, unsigned int radius, unsigned num_threads = 0)
+        {
+            return rankFilter(input, radius, false, num_threads);
+        }
+
+    private:
+        template <class T>
+        static grid::GridMap<T> createOutput(const grid::GridMap<T>& input)
+        {
+            return grid::GridMap<T>(input, grid::VectorGrid<T>(input.getNumCells(), input.getDefaultValue()));
+        }
+
+        template <class T, class R>
+        static void checkOutput(const grid::GridMap<T>& input, const grid::GridMap<R>& output)
+        {
+            if(output.getNumCells() != input.getNumCells())
+                throw std::runtime_error("The output grid has to have the same number of cells as the input grid");
+            if(static_cast<const void*>(&input) == static_cast<const void*>(&output))
+                throw std::runtime_error("The output grid must not be the input grid");
+        }
+
+        /** Calls f(tile_min, tile_max) for all tiles of the grid in parallel */
+        template <class T, class Function>
+        static void forEachTile(const grid::GridMap<T>& grid, unsigned num_threads, const Function& f)
+        {
+            const unsigned int tile_size = TILE_SIZE;
+            std::vector<std::pair<grid::Index, grid::Index> > tiles;
+            grid.visitTiles(grid::Vector2ui(tile_size, tile_size), [&tiles](const grid::Index& tile_min, const grid::Index& tile_max)
+            {
+                tiles.push_back(std::make_pair(tile_min, tile_max));
+            });
+
+            tools::parallelFor(0, tiles.size(), [&](size_t begin, size_t end)
+            {
+                for(size_t i = begin; i < end; ++i)
+                    f(tiles[i].first, tiles[i].second);
+            }, num_threads);
+        }
+
+        /** Returns true if all rows in [min_row, max_row] are complete */
+        static bool isComplete(const std::vector<char>& complete_rows, int min_row, int max_row)
+        {
+            for(int y = min_row; y <= max_row; ++y)
+            {
+                if(!complete_rows[y])
+                    return false;
+            }
+            return true;
+        }
+
+        template <class T>
+        static void accumulate(const T& value, float weight, bool is_default, double& sum, double& weight_sum, bool& missing)
+        {
+            if(weight == 0.f)
+                return;
+            if(is_default)
+            {
+                missing = true;
+                return;
+            }
+            sum += weight * value;
+            weight_sum += weight;
+        }
+
+        /** Separable min or max filter, first along the rows, then along the columns */
+        template <class T>
+        static grid::GridMap<T> rankFilter(const grid::GridMap<T>& input, unsigned int radius, bool maximum, unsigned num_threads)
+        {
+            static_assert(std::is_arithmetic<T>::value, "dilate and erode require an arithmetic cell type");
+            const int width = input.getNumCells().x();
+            const int height = input.getNumCells().y();
+            const int r = radius;
+
+            auto combine = [&input, maximum](const T& current, const T& value)
+            {
+                if(input.isDefault(value))
+                    return current;
+                if(input.isDefault(current))
+                    return value;
+                return maximum ? std::max(current, value) : std::min(current, value);
+            };
+
+            grid::GridMap<T> rows = createOutput(input);
+            tools::parallelFor(0, height, [&](size_t begin, size_t end)
+            {
+                for(size_t y = begin; y < end; ++y)
+                {
+                    typename grid::GridMap<T>::ConstRowSpan input_row = input.getRow(y);
+                    typename grid::GridMap<T>::RowSpan output_row = rows.getRow(y);
+                    for(int x = 0; x < width; ++x)
+                    {
+                        T result = input.getDefaultValue();
+                        for(int i = std::max(x - r, 0); i <= std::min(x + r, width - 1); ++i)
+                            result = combine(result, input_row[i]);
+                        output_row[x] = result;
+                    }
+                }
+            }, num_threads, 16);
+
+            grid::GridMap<T> output = createOutput(input);
+            tools::parallelFor(0, height, [&](size_t begin, size_t end)
+            {
+                for(size_t y = begin; y < end; ++y)
+                {
+                    typename grid::GridMap<T>::RowSpan output_row = output.getRow(y);
+                    for(int i = std::max((int)y - r, 0); i <= std::min((int)y + r, height - 1); ++i)
+                    {
+                        typename grid::GridMap<T>::ConstRowSpan row = static_cast<const grid::GridMap<T>&>(rows).getRow(i);
+                        for(int x = 0; x < width; ++x)
+                            output_row[x] = combine(output_row[x], row[x]);
+                    }
+                }
+            }, num_threads, 16);
+            return output;
+        }
+    };
+}}
+
+#endif // __MAPS_GRIDSTENCIL_HPP__
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace maps { namespace tools
+{
+
+/**
+ * Returns the number of threads to use for a parallel operation.
+ * If \c num_threads is 0 the number of hardware threads is used.
+ */
+inline unsigned getNumThreads(unsigned num_threads = 0)
+{
+    if(num_threads == 0)
+        num_threads = std::thread::hardware_concurrency();
+    return std::max(num_threads, 1u);
+}
+
+/**
+ * Splits the range [begin, end) in contiguous chunks and calls
+ * f(chunk_begin, chunk_end) for each chunk in a separate thread.
+ * The calling thread processes the first chunk itself.
+ * Ranges smaller than \c min_chunk_size per thread are processed in fewer threads.
+ * The first exception thrown by \c f is rethrown after all threads have finished.
+ *
+ * @param num_threads number of threads to use, 0 uses all hardware threads
+ */
+template<class Function>
+void parallelFor(size_t begin, size_t end, const Function& f, unsigned num_threads = 0, size_t min_chunk_size = 1)
+{
+    if(end <= begin)
+        return;
+
+    const size_t size = end - begin;
+    size_t num_chunks = std::min<size_t>(getNumThreads(num_threads), size / std::max<size_t>(min_chunk_size, 1));
+    if(num_chunks <= 1)
+    {
+        f(begin, end);
+        return;
+    }
+
+    const size_t chunk_size = (size + num_chunks - 1) / num_chunks;
+    std::vector<std::exception_ptr> exceptions(num_chunks);
+    std::vector<std::thread> threads;
+    threads.reserve(num_chunks - 1);
+    for(size_t i = 1; i < num_chunks; i++)
+    {
+        const size_t chunk_begin = begin + i * chunk_size;
+        const size_t chunk_end = std::min(end, chunk_begin + chunk_size);
+        if(chunk_begin >= chunk_end)
+            break;
+        threads.push_back(std::thread([&f, &exceptions, i, chunk_begin, chunk_end]()
+        {
+            try
+            {
+                f(chunk_begin, chunk_end);
+            }
+            catch(...)
+            {
+                exceptions[i] = std::current_exception();
+            }
+        }));
+    }
+
+    try
+    {
+        f(begin, std::min(end, begin + chunk_size));
+    }
+    catch(...)
+    {
+        exceptions[0] = std::current_exception();
+    }
+
+    for(std::thread& thread : threads)
+        thread.join();
+
+    for(const std::exception_ptr& exception : exceptions)
+    {
+        if(exception)
+            std::rethrow_exception(exception);
+    }
+}
+
+}}
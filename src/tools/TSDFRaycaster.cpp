@@ -0,0 +1,296 @@
+#include "TSDFRaycaster.hpp"
+#include "ParallelFor.hpp"
+
+#include <cmath>
+#include <limits>
+
+using namespace maps::tools;
+using namespace maps::grid;
+
+TSDFRaycaster::SensorModel TSDFRaycaster::SensorModel::pinhole(unsigned width, unsigned height, double fx, double fy, double cx, double cy)
+{
+    SensorModel model;
+    model.type = PINHOLE;
+    model.width = width;
+    model.height = height;
+    model.fx = fx;
+    model.fy = fy;
+    model.cx = cx;
+    model.cy = cy;
+    model.min_azimuth = model.max_azimuth = model.min_elevation = model.max_elevation = 0.;
+    return model;
+}
+
+TSDFRaycaster::SensorModel TSDFRaycaster::SensorModel::spherical(unsigned width, unsigned height, double min_azimuth, double max_azimuth,
+                                                                 double min_elevation, double max_elevation)
+{
+    SensorModel model;
+    model.type = SPHERICAL;
+    model.width = width;
+    model.height = height;
+    model.fx = model.fy = model.cx = model.cy = 0.;
+    model.min_azimuth = min_azimuth;
+    model.max_azimuth = max_azimuth;
+    model.min_elevation = min_elevation;
+    model.max_elevation = max_elevation;
+    return model;
+}
+
+Eigen::Vector3d TSDFRaycaster::SensorModel::getRayDirection(unsigned u, unsigned v) const
+{
+    if(type == PINHOLE)
+        return Eigen::Vector3d((u - cx) / fx, (v - cy) / fy, 1.).normalized();
+
+    const double azimuth = min_azimuth + (width > 1 ? (max_azimuth - min_azimuth) * u / (width - 1) : 0.);
+    const double elevation = max_elevation - (height > 1 ? (max_elevation - min_elevation) * v / (height - 1) : 0.);
+    return Eigen::Vector3d(std::cos(elevation) * std::cos(azimuth), std::cos(elevation) * std::sin(azimuth), std::sin(elevation));
+}
+
+TSDFRaycaster::TSDFRaycaster() : voxel_res(Eigen::Vector3d::Ones()), map2grid_linear(Eigen::Matrix3d::Identity()),
+                                 map2grid_translation(Eigen::Vector3d::Zero()), min_range(0.), max_range(100.), std_threshold(1.f)
+{
+}
+
+void TSDFRaycaster::setTSDFMap(TSDFVolumetricMap::Ptr map)
+{
+    tsdf_map = map;
+    voxel_res = tsdf_map->getVoxelResolution();
+
+    // the local frame is applied to x and y only, see VoxelGridMap::toVoxelGrid
+    const base::Transform3d& local_frame = tsdf_map->getLocalFrame();
+    map2grid_linear = local_frame.linear();
+    map2grid_linear.row(2) = Eigen::Vector3d::UnitZ();
+    map2grid_translation = local_frame.translation();
+    map2grid_translation.z() = 0.;
+}
+
+void TSDFRaycaster::setRangeLimits(double min_range, double max_range)
+{
+    this->min_range = min_range;
+    this->max_range = max_range;
+}
+
+bool TSDFRaycaster::castRay(const Eigen::Vector3d& origin, const Eigen::Vector3d& direction, float& range, Eigen::Vector3f& normal) const
+{
+    std::vector<VoxelTraversal::RayElement> ray;
+    return castRay(origin, direction, range, normal, ray);
+}
+
+void TSDFRaycaster::raycast(const base::Transform3d& sensor2map, const SensorModel& model, RangeImage& image, unsigned num_threads) const
+{
+    if(!tsdf_map)
+        throw std::runtime_error("TSDF map is not set!");
+
+    image.width = model.width;
+    image.height = model.height;
+    image.ranges.assign(model.width * model.height, std::numeric_limits<float>::quiet_NaN());
+    image.normals.assign(model.width * model.height, Eigen::Vector3f::Constant(std::numeric_limits<float>::quiet_NaN()));
+
+    const Eigen::Vector3d origin = sensor2map.translation();
+    const Eigen::Matrix3d rotation = sensor2map.linear();
+    parallelFor(0, model.height, [&](size_t begin, size_t end)
+    {
+        std::vector<VoxelTraversal::RayElement> ray;
+        for(size_t v = begin; v < end; ++v)
+        {
+            for(unsigned u = 0; u < model.width; ++u)
+            {
+                const size_t pixel = u + v * model.width;
+                castRay(origin, rotation * model.getRayDirection(u, v), image.ranges[pixel], image.normals[pixel], ray);
+            }
+        }
+    }, num_threads, 4);
+}
+
+bool TSDFRaycaster::castRay(const Eigen::Vector3d& origin, const Eigen::Vector3d& direction, float& range, Eigen::Vector3f& normal,
+                            std::vector<VoxelTraversal::RayElement>& ray) const
+{
+    if(!tsdf_map)
+        throw std::runtime_error("TSDF map is not set!");
+
+    const Eigen::Vector3d origin_in_grid = map2grid_linear * origin + map2grid_translation;
+    const Eigen::Vector3d direction_in_grid = map2grid_linear * direction;
+
+    // clip the ray to the extents of the grid in x and y
+    double t_begin = min_range;
+    double t_end = max_range;
+    const Eigen::Vector2d size = tsdf_map->getSize();
+    for(int i = 0; i < 2; ++i)
+    {
+        // stay a bit inside of the grid to get valid indices at the border
+        const double border = 1e-6 * voxel_res[i];
+        if(std::abs(direction_in_grid[i]) < 1e-12)
+        {
+            if(origin_in_grid[i] < border || origin_in_grid[i] > size[i] - border)
+                return false;
+            continue;
+        }
+        double t0 = (border - origin_in_grid[i]) / direction_in_grid[i];
+        double t1 = (size[i] - border - origin_in_grid[i]) / direction_in_grid[i];
+        if(t0 > t1)
+            std::swap(t0, t1);
+        t_begin = std::max(t_begin, t0);
+        t_end = std::min(t_end, t1);
+    }
+    if(!(t_begin < t_end))
+        return false;
+
+    const Eigen::Vector3d start = origin_in_grid + t_begin * direction_in_grid;
+    const Eigen::Vector3d end = origin_in_grid + t_end * direction_in_grid;
+    const Eigen::Vector3i start_idx = start.cwiseQuotient(voxel_res).array().floor().cast<int>();
+    const Eigen::Vector3i end_idx = end.cwiseQuotient(voxel_res).array().floor().cast<int>();
+    const Eigen::Vector3d start_cell_center = (start_idx.cast<double>() + Eigen::Vector3d::Constant(0.5)).cwiseProduct(voxel_res);
+    VoxelTraversal::computeRay(voxel_res, start, start_idx, start_cell_center, end, end_idx, ray);
+    // the traversal leaves out the last voxel
+    if(ray.empty() || ray.back().idx != end_idx.head<2>())
+        ray.push_back(VoxelTraversal::RayElement(end_idx, 1));
+    else
+        ray.back().z_last = end_idx.z();
+
+    // distance which can be skipped after a voxel far from the surface
+    const float truncation = tsdf_map->getTruncation();
+    const double skip_distance = truncation - voxel_res.norm();
+    const double inv_squared_norm = 1. / direction_in_grid.squaredNorm();
+
+    double t_skip = t_begin;
+    bool has_previous = false;
+    double t_previous = 0.;
+    float distance_previous = 0.f;
+    for(const VoxelTraversal::RayElement& element : ray)
+    {
+        if(!tsdf_map->inGrid(element.idx))
+            continue;
+        const DiscreteTree<TSDFPatch>& tree = tsdf_map->at(element.idx);
+        if(tree.empty())
+        {
+            has_previous = false;
+            continue;
+        }
+
+        const int32_t z_end = element.z_last + element.z_step;
+        for(int32_t z_idx = element.z_first; z_idx != z_end; z_idx += element.z_step)
+        {
+            // position of the voxel center on the ray
+            const Eigen::Vector3d center = (Eigen::Vector3d(element.idx.x(), element.idx.y(), z_idx) + Eigen::Vector3d::Constant(0.5)).cwiseProduct(voxel_res);
+            const double t = (center - origin_in_grid).dot(direction_in_grid) * inv_squared_norm;
+            if(t < t_skip || t > t_end)
+                continue;
+
+            // a sample within the voxel always depends on the voxel itself
+            DiscreteTree<TSDFPatch>::const_iterator voxel = tree.find(z_idx);
+            if(voxel == tree.end() || voxel->second.getStandardDeviation() >= std_threshold)
+            {
+                has_previous = false;
+                continue;
+            }
+            if(voxel->second.getDistance() >= truncation)
+            {
+                if(skip_distance > 0.)
+                    t_skip = t + skip_distance;
+                has_previous = false;
+                continue;
+            }
+
+            float sample;
+            if(!interpolate(origin_in_grid + t * direction_in_grid, sample))
+            {
+                has_previous = false;
+                continue;
+            }
+
+            if(has_previous && t > t_previous && distance_previous > 0.f && sample <= 0.f)
+            {
+                // refine the zero crossing with regula falsi
+                double t_front = t_previous, t_back = t;
+                float d_front = distance_previous, d_back = sample;
+                double t_hit = t_front + (t_back - t_front) * d_front / (d_front - d_back);
+                for(int i = 0; i < 2; ++i)
+                {
+                    float d_hit;
+                    if(!interpolate(origin_in_grid + t_hit * direction_in_grid, d_hit))
+                        break;
+                    if(d_hit > 0.f)
+                    {
+                        t_front = t_hit;
+                        d_front = d_hit;
+                    }
+                    else
+                    {
+                        t_back = t_hit;
+                        d_back = d_hit;
+                    }
+                    if(d_front == d_back)
+                        break;
+                    t_hit = t_front + (t_back - t_front) * d_front / (d_front - d_back);
+                }
+
+                if(t_hit < min_range || t_hit > max_range)
+                    return false;
+
+                float d_hit;
+                Eigen::Vector3d gradient;
+                if(!interpolate(origin_in_grid + t_hit * direction_in_grid, d_hit, &gradient))
+                    interpolate(origin_in_grid + t * direction_in_grid, d_hit, &gradient);
+
+                range = t_hit;
+                normal = (map2grid_linear.transpose() * gradient).normalized().cast<float>();
+                return true;
+            }
+
+            has_previous = true;
+            t_previous = t;
+            distance_previous = sample;
+        }
+    }
+    return false;
+}
+
+bool TSDFRaycaster::interpolate(const Eigen::Vector3d& pos_in_grid, float& distance, Eigen::Vector3d* gradient) const
+{
+    // continuous voxel coordinates with the voxel centers at integral values
+    const Eigen::Vector3d pos = pos_in_grid.cwiseQuotient(voxel_res) - Eigen::Vector3d::Constant(0.5);
+    const Eigen::Vector3d base_pos = pos.array().floor();
+    const Eigen::Vector3i base = base_pos.cast<int>();
+    const Eigen::Vector3d f = pos - base_pos;
+
+    // corner values c[dz][dy][dx]
+    float c[2][2][2];
+    for(int dy = 0; dy < 2; ++dy)
+    {
+        for(int dx = 0; dx < 2; ++dx)
+        {
+            const Index idx(base.x() + dx, base.y() + dy);
+            if(!tsdf_map->inGrid(idx))
+                return false;
+            const DiscreteTree<TSDFPatch>& tree = tsdf_map->at(idx);
+            DiscreteTree<TSDFPatch>::const_iterator voxel = tree.find(base.z());
+            for(int dz = 0; dz < 2; ++dz, ++voxel)
+            {
+                if(voxel == tree.end() || voxel->first != base.z() + dz || voxel->second.getStandardDeviation() >= std_threshold)
+                    return false;
+                c[dz][dy][dx] = voxel->second.getDistance();
+            }
+        }
+    }
+
+    // interpolate along x, then y, then z
+    const double c00 = c[0][0][0] + f.x() * (c[0][0][1] - c[0][0][0]);
+    const double c01 = c[0][1][0] + f.x() * (c[0][1][1] - c[0][1][0]);
+    const double c10 = c[1][0][0] + f.x() * (c[1][0][1] - c[1][0][0]);
+    const double c11 = c[1][1][0] + f.x() * (c[1][1][1] - c[1][1][0]);
+    const double c0 = c00 + f.y() * (c01 - c00);
+    const double c1 = c10 + f.y() * (c11 - c10);
+    distance = c0 + f.z() * (c1 - c0);
+
+    if(gradient)
+    {
+        const double dx0 = (1. - f.y()) * (c[0][0][1] - c[0][0][0]) + f.y() * (c[0][1][1] - c[0][1][0]);
+        const double dx1 = (1. - f.y()) * (c[1][0][1] - c[1][0][0]) + f.y() * (c[1][1][1] - c[1][1][0]);
+        const double dy0 = c01 - c00;
+        const double dy1 = c11 - c10;
+        *gradient = Eigen::Vector3d((1. - f.z()) * dx0 + f.z() * dx1,
+                                    (1. - f.z()) * dy0 + f.z() * dy1,
+                                    c1 - c0).cwiseQuotient(voxel_res);
+    }
+    return true;
+}
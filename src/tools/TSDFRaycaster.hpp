@@ -0,0 +1,126 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <vector>
+
+#include <maps/grid/TSDFVolumetricMap.hpp>
+#include "VoxelTraversal.hpp"
+
+namespace maps { namespace tools
+{
+
+/**
+ * @brief Renders range images of a TSDFVolumetricMap.
+ * @details
+ * Each ray walks the voxels it crosses using VoxelTraversal. Voxels which are
+ * unknown or at least the truncation distance away from the surface are
+ * skipped, close to the surface the signed distance is sampled with trilinear
+ * interpolation and the zero crossing from positive to negative distance
+ * is returned as the hit. The normal is the normalized gradient of the
+ * interpolated distance field.
+ *
+ * Sensor poses, ranges and normals are given in the frame of the points
+ * passed to TSDFVolumetricMap::mergePoint.
+ */
+class TSDFRaycaster
+{
+public:
+    /** Projection model defining the ray of each pixel */
+    struct SensorModel
+    {
+        enum Type
+        {
+            /** z axis forward, x right, y down */
+            PINHOLE,
+            /** x axis forward, azimuth around z, elevation towards z */
+            SPHERICAL
+        };
+
+        Type type;
+        unsigned width;
+        unsigned height;
+
+        /** pinhole parameters in pixels */
+        double fx, fy, cx, cy;
+
+        /** spherical parameters in radians, column 0 is min_azimuth, row 0 is max_elevation */
+        double min_azimuth, max_azimuth, min_elevation, max_elevation;
+
+        static SensorModel pinhole(unsigned width, unsigned height, double fx, double fy, double cx, double cy);
+
+        static SensorModel spherical(unsigned width, unsigned height, double min_azimuth, double max_azimuth,
+                                     double min_elevation, double max_elevation);
+
+        /** Unit direction of the ray of pixel (u, v) in the sensor frame */
+        Eigen::Vector3d getRayDirection(unsigned u, unsigned v) const;
+    };
+
+    /** Range and normal per pixel, row-major. Pixels without hit are NaN. */
+    struct RangeImage
+    {
+        unsigned width;
+        unsigned height;
+        std::vector<float> ranges;
+        std::vector<Eigen::Vector3f> normals;
+
+        float getRange(unsigned u, unsigned v) const
+        {
+            return ranges[u + v * width];
+        }
+
+        const Eigen::Vector3f& getNormal(unsigned u, unsigned v) const
+        {
+            return normals[u + v * width];
+        }
+    };
+
+    TSDFRaycaster();
+
+    void setTSDFMap(grid::TSDFVolumetricMap::Ptr map);
+
+    /** Only hits within [min_range, max_range] are returned, the default is [0, 100] */
+    void setRangeLimits(double min_range, double max_range);
+
+    /** Voxels with a larger standard deviation are treated as unknown, the default is 1 */
+    void setStdThreshold(float threshold) { std_threshold = threshold; }
+    float getStdThreshold() const { return std_threshold; }
+
+    /**
+     * Casts a single ray.
+     * @param direction unit direction of the ray
+     * @return false if no surface was hit
+     */
+    bool castRay(const Eigen::Vector3d& origin, const Eigen::Vector3d& direction, float& range, Eigen::Vector3f& normal) const;
+
+    /**
+     * Renders the range image seen from the given sensor pose.
+     * The rows of the image are processed in parallel.
+     * @param num_threads number of threads to use, 0 uses all hardware threads
+     */
+    void raycast(const base::Transform3d& sensor2map, const SensorModel& model, RangeImage& image, unsigned num_threads = 0) const;
+
+protected:
+    bool castRay(const Eigen::Vector3d& origin, const Eigen::Vector3d& direction, float& range, Eigen::Vector3f& normal,
+                 std::vector<VoxelTraversal::RayElement>& ray) const;
+
+    /**
+     * Trilinear interpolation of the signed distance at a position in grid coordinates.
+     * Returns false if one of the eight surrounding voxels is unknown.
+     * @param gradient if not NULL receives the gradient in grid coordinates
+     */
+    bool interpolate(const Eigen::Vector3d& pos_in_grid, float& distance, Eigen::Vector3d* gradient = NULL) const;
+
+    grid::TSDFVolumetricMap::Ptr tsdf_map;
+    Eigen::Vector3d voxel_res;
+
+    /** map to grid coordinates, z isn't transformed as in VoxelGridMap::toVoxelGrid */
+    Eigen::Matrix3d map2grid_linear;
+    Eigen::Vector3d map2grid_translation;
+
+    double min_range;
+    double max_range;
+    float std_threshold;
+};
+
+}}
@@ -63,8 +63,12 @@ void VoxelTraversal::computeRay(const Eigen::Vector3d& grid_res, const Eigen::Ve
     if(step.x() == 0 && step.y() == 0 && step.z() == 0)
         return;
 
+    // the z-runs of a ray without z component consist of a single voxel,
+    // a step of 1 keeps loops over [z_first, z_last] non-empty
+    const int32_t z_step = step.z() != 0 ? step.z() : 1;
+
     Eigen::Vector3i ray_idx = origin_idx;
-    ray.push_back(RayElement(ray_idx, step.z()));
+    ray.push_back(RayElement(ray_idx, z_step));
 
     // traverse ray
     while(true)
@@ -92,7 +96,7 @@ void VoxelTraversal::computeRay(const Eigen::Vector3d& grid_res, const Eigen::Ve
         ray_idx[axis] += step[axis];
         t_max[axis] += t_delta[axis];
         if(axis != 2)
-            ray.push_back(RayElement(ray_idx, step.z()));
+            ray.push_back(RayElement(ray_idx, z_step));
         else
             ray.back().z_last = ray_idx[axis];
     }
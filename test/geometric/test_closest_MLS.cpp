@@ -37,3 +37,135 @@ BOOST_AUTO_TEST_CASE(test_mls_serialization)
 
 
 }
+
+BOOST_AUTO_TEST_CASE(test_mls_raycast)
+{
+    MLSMapSloped mls = generateWaves();
+
+    // vertical rays have to hit the surface close to the closest surface position
+    Eigen::Vector2d max = 0.5 * mls.getSize();
+    Eigen::Vector2d min = -0.5 * mls.getSize();
+    for (double x = min.x() + 0.1; x < max.x() - 0.1; x += 0.00625*16)
+    {
+        for (double y = min.y() + 0.1; y < max.y() - 0.1; y += 0.00625*16)
+        {
+            double surface_pos;
+            BOOST_REQUIRE(mls.getClosestSurfacePos(Eigen::Vector3d(x, y, 5.0), surface_pos));
+            Eigen::Vector3d hit;
+            BOOST_REQUIRE(mls.raycast(Eigen::Vector3d(x, y, 5.0), -Eigen::Vector3d::UnitZ(), 10.0, hit));
+            BOOST_CHECK_SMALL(hit.z() - surface_pos, 1e-3);
+        }
+    }
+
+    // rays ending above the surface or leaving the map don't hit
+    double range;
+    BOOST_CHECK(!mls.raycast(Eigen::Vector3d(0, 0, 5.0), -Eigen::Vector3d::UnitZ(), 3.0, range));
+    BOOST_CHECK(!mls.raycast(Eigen::Vector3d(0, 0, 5.0), Eigen::Vector3d::UnitZ(), 10.0, range));
+    BOOST_CHECK(!mls.raycast(Eigen::Vector3d(20.0, 0, 5.0), -Eigen::Vector3d::UnitZ(), 10.0, range));
+
+    // batched rays from a common origin match the single rays
+    Eigen::Vector3d origin(0.3, -0.2, 1.5);
+    std::vector<Eigen::Vector3d> directions;
+    for(double yaw = -M_PI; yaw < M_PI; yaw += 0.05)
+        for(double pitch = -1.2; pitch < 0.0; pitch += 0.05)
+            directions.push_back(Eigen::Vector3d(std::cos(yaw) * std::cos(pitch), std::sin(yaw) * std::cos(pitch), std::sin(pitch)));
+
+    std::vector<double> ranges;
+    mls.raycast(origin, directions, 20.0, ranges, 4);
+    BOOST_REQUIRE_EQUAL(ranges.size(), directions.size());
+    size_t hits = 0;
+    for(size_t i = 0; i < directions.size(); ++i)
+    {
+        double single_range;
+        bool hit = mls.raycast(origin, directions[i], 20.0, single_range);
+        BOOST_CHECK_EQUAL(hit, !base::isInfinity<double>(ranges[i]));
+        if(hit)
+        {
+            BOOST_CHECK_EQUAL(single_range, ranges[i]);
+            // the hit point is close to the surface
+            Eigen::Vector3d hit_point = origin + single_range * directions[i];
+            double surface_pos;
+            BOOST_REQUIRE(mls.getClosestSurfacePos(hit_point, surface_pos));
+            BOOST_CHECK_SMALL(hit_point.z() - surface_pos, 0.05);
+            hits++;
+        }
+    }
+    BOOST_CHECK(hits > directions.size() / 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_mls_batch_queries)
+{
+    MLSMapSloped mls = generateWaves();
+
+    std::vector<Eigen::Vector3d> points;
+    Eigen::Vector2d max = 0.5 * mls.getSize() + Eigen::Vector2d(0.2, 0.2);
+    Eigen::Vector2d min = -0.5 * mls.getSize() - Eigen::Vector2d(0.2, 0.2);
+    for (double x = min.x(); x < max.x(); x += 0.00625*8)
+        for (double y = min.y(); y < max.y(); y += 0.00625*8)
+            points.push_back(Eigen::Vector3d(x, y, std::sin(x + y)));
+
+    std::vector<Eigen::Vector3d> contact_points;
+    std::vector<double> surface_pos;
+    size_t num_contacts = mls.getClosestContactPoint(points, contact_points, 4);
+    size_t num_surface_pos = mls.getClosestSurfacePos(points, surface_pos, 4);
+    BOOST_REQUIRE_EQUAL(contact_points.size(), points.size());
+    BOOST_REQUIRE_EQUAL(surface_pos.size(), points.size());
+
+    size_t expected_contacts = 0, expected_surface_pos = 0;
+    for(size_t i = 0; i < points.size(); ++i)
+    {
+        Eigen::Vector3d contact_point;
+        if(mls.getClosestContactPoint(points[i], contact_point))
+        {
+            expected_contacts++;
+            BOOST_CHECK_SMALL((contact_point - contact_points[i]).norm(), 1e-4);
+        }
+        else
+            BOOST_CHECK(base::isNaN(contact_points[i].x()));
+
+        double pos;
+        if(mls.getClosestSurfacePos(points[i], pos))
+        {
+            expected_surface_pos++;
+            BOOST_CHECK_SMALL(pos - surface_pos[i], 1e-4);
+        }
+        else
+            BOOST_CHECK(base::isNaN(surface_pos[i]));
+    }
+    BOOST_CHECK_EQUAL(num_contacts, expected_contacts);
+    BOOST_CHECK_EQUAL(num_surface_pos, expected_surface_pos);
+    BOOST_CHECK(expected_contacts > 0 && expected_contacts < points.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_mls_cached_planes)
+{
+    MLSMapSloped mls = generateWaves();
+
+    std::vector<Eigen::Vector3d> points;
+    Eigen::Vector2d max = 0.5 * mls.getSize();
+    Eigen::Vector2d min = -0.5 * mls.getSize();
+    for (double x = min.x(); x < max.x(); x += 0.00625*8)
+        for (double y = min.y(); y < max.y(); y += 0.00625*8)
+            points.push_back(Eigen::Vector3d(x, y, 0.0));
+
+    std::vector<double> surface_pos, cached_surface_pos;
+    mls.getClosestSurfacePos(points, surface_pos);
+    mls.updatePlanes();
+    mls.getClosestSurfacePos(points, cached_surface_pos);
+    for(size_t i = 0; i < points.size(); ++i)
+        BOOST_CHECK_EQUAL(surface_pos[i], cached_surface_pos[i]);
+
+    // merging a point invalidates the cached plane
+    Index idx;
+    Eigen::Vector3d pos_in_cell;
+    BOOST_REQUIRE(mls.toGrid(Eigen::Vector3d(0.01, 0.01, 0.0), idx, pos_in_cell));
+    BOOST_REQUIRE_EQUAL(mls.at(idx).size(), 1);
+    BOOST_CHECK(mls.at(idx).begin()->hasCachedPlane());
+    const Eigen::Vector3f normal = mls.at(idx).begin()->getNormal();
+    mls.mergePoint(Eigen::Vector3d(0.01, 0.01, mls.at(idx).begin()->getMax() + 0.01));
+    BOOST_REQUIRE_EQUAL(mls.at(idx).size(), 1);
+    const SurfacePatch<MLSConfig::SLOPE>& patch = *mls.at(idx).begin();
+    BOOST_CHECK(!patch.hasCachedPlane());
+    BOOST_CHECK(!patch.getNormal().isApprox(normal));
+    BOOST_CHECK(patch.getPlane().normal().isApprox(patch.getNormal()));
+}
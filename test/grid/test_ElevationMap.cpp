@@ -0,0 +1,157 @@
+#define BOOST_TEST_MODULE GridTest
+#include <boost/test/unit_test.hpp>
+
+#include <maps/grid/ElevationMap.hpp>
+
+using namespace ::maps::grid;
+
+static ElevationMap createSlopedMap()
+{
+    ElevationMap map(Vector2ui(60, 45), Vector2d(0.1, 0.2));
+    map.translate(Vector3d(-3.0, -4.5, 0.));
+    for(unsigned int y = 0; y < 45; ++y)
+        for(unsigned int x = 0; x < 60; ++x)
+            map.at(x, y) = 0.3 * x + std::sin(y * 0.2);
+
+    // a hole and a cell without value at the border
+    for(unsigned int y = 20; y < 25; ++y)
+        for(unsigned int x = 30; x < 33; ++x)
+            map.at(x, y) = ElevationMap::ELEVATION_DEFAULT;
+    map.at(5, 0) = ElevationMap::ELEVATION_DEFAULT;
+    return map;
+}
+
+static void checkMeanElevation(const ElevationMap& map, const ElevationMap& cached_map, const Vector3d& pos)
+{
+    const float expected = map.getMeanElevation(pos);
+    if(expected == ElevationMap::ELEVATION_DEFAULT)
+        BOOST_CHECK_EQUAL(cached_map.getMeanElevation(pos), ElevationMap::ELEVATION_DEFAULT);
+    else
+        BOOST_CHECK_CLOSE(cached_map.getMeanElevation(pos), expected, 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(test_compute_normals)
+{
+    ElevationMap map = createSlopedMap();
+    ElevationMap::NormalMap normals = map.computeNormals(4);
+    GridMapF slopes = map.computeSlopeMap(3);
+
+    BOOST_REQUIRE_EQUAL(normals.getNumCells(), map.getNumCells());
+    BOOST_REQUIRE_EQUAL(slopes.getNumCells(), map.getNumCells());
+    BOOST_CHECK_EQUAL(normals.getResolution(), map.getResolution());
+    BOOST_CHECK(normals.getLocalFrame().isApprox(map.getLocalFrame()));
+
+    size_t num_valid = 0;
+    for(unsigned int y = 0; y < 45; ++y)
+    {
+        for(unsigned int x = 0; x < 60; ++x)
+        {
+            const Eigen::Vector3f& normal = normals.at(x, y);
+            if(x == 0 || y == 0 || x == 59 || y == 44)
+            {
+                BOOST_CHECK(normal.hasNaN());
+                BOOST_CHECK_THROW(map.getNormal(Index(x, y)), std::runtime_error);
+                BOOST_CHECK_EQUAL(slopes.at(x, y), ElevationMap::ELEVATION_DEFAULT);
+                continue;
+            }
+
+            const Vector3d expected = map.getNormal(Index(x, y));
+            if(expected.hasNaN())
+            {
+                BOOST_CHECK(normal.hasNaN());
+                BOOST_CHECK_EQUAL(slopes.at(x, y), ElevationMap::ELEVATION_DEFAULT);
+                continue;
+            }
+            // all normals are computed by the same formula
+            BOOST_CHECK_EQUAL(normal.cast<double>(), expected);
+            BOOST_CHECK_CLOSE(slopes.at(x, y), std::acos(expected.z()), 1e-3);
+            num_valid++;
+        }
+    }
+    // border, the hole with its neighbours and the neighbours of the border cell without value
+    BOOST_CHECK_EQUAL(num_valid, 58 * 43 - (5 * 7 - 4) - 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_normal_cache)
+{
+    ElevationMap map = createSlopedMap();
+    ElevationMap cached_map(map);
+    BOOST_CHECK(!cached_map.hasNormalCache());
+    cached_map.enableNormalCache();
+    BOOST_CHECK(cached_map.hasNormalCache());
+
+    for(double x = -2.85; x < 2.85; x += 0.07)
+    {
+        for(double y = -4.25; y < 4.25; y += 0.13)
+        {
+            checkMeanElevation(map, cached_map, Vector3d(x, y, 0.));
+        }
+    }
+    BOOST_CHECK_THROW(cached_map.getMeanElevation(Vector3d(-2.95, 0., 0.)), std::runtime_error);
+
+    // setElevation keeps the cached normals up to date
+    map.at(10, 10) = 4.f;
+    cached_map.setElevation(Index(10, 10), 4.f);
+    for(unsigned int y = 9; y <= 11; ++y)
+    {
+        for(unsigned int x = 9; x <= 11; ++x)
+        {
+            Vector3d pos;
+            map.fromGrid(Index(x, y), pos);
+            pos += Vector3d(0.02, -0.03, 0.);
+            checkMeanElevation(map, cached_map, pos);
+        }
+    }
+
+    // filling the hole makes its normals valid
+    for(unsigned int y = 20; y < 25; ++y)
+        for(unsigned int x = 30; x < 33; ++x)
+            cached_map.setElevation(Index(x, y), 1.f);
+    BOOST_CHECK(cached_map.getNormalCache().at(31, 22).isApprox(Vector3d(0, 0, 1).cast<float>()));
+    BOOST_CHECK(!cached_map.getNormalCache().at(30, 19).hasNaN());
+
+    // the cache is equal to the normals computed in one pass
+    for(unsigned int y = 0; y < 45; ++y)
+        for(unsigned int x = 0; x < 60; ++x)
+        {
+            const Eigen::Vector3f& cached = cached_map.getNormalCache().at(x, y);
+            const Eigen::Vector3f computed = cached_map.computeNormals().at(x, y);
+            BOOST_CHECK(cached == computed || (cached.hasNaN() && computed.hasNaN()));
+        }
+
+    // a direct write outdates the cache, the normals are computed until it is updated
+    map = cached_map;
+    map.disableNormalCache();
+    cached_map.at(40, 30) = -2.f;
+    map.at(40, 30) = -2.f;
+    Vector3d pos;
+    map.fromGrid(Index(40, 31), pos);
+    checkMeanElevation(map, cached_map, pos);
+    cached_map.updateNormalCache(Index(40, 30));
+    checkMeanElevation(map, cached_map, pos);
+    BOOST_CHECK_EQUAL(cached_map.getNormalCache().at(40, 31).cast<double>(), map.getNormal(Index(40, 31)));
+
+    // writes through the grid interface are detected as well
+    GridMapF& grid = cached_map;
+    grid.at(20, 15) = 3.f;
+    map.at(20, 15) = 3.f;
+    BOOST_CHECK(!cached_map.getNormalCache().at(20, 16).isApprox(map.getNormal(Index(20, 16)).cast<float>()));
+    for(const Index& idx : {Index(20, 14), Index(21, 15), Index(20, 16)})
+    {
+        map.fromGrid(idx, pos);
+        checkMeanElevation(map, cached_map, pos);
+        BOOST_CHECK_EQUAL(cached_map.getNormal(idx), map.getNormal(idx));
+    }
+    cached_map.updateCaches();
+    const ElevationMap::NormalMap normals = map.computeNormals();
+    for(unsigned int y = 0; y < 45; ++y)
+        for(unsigned int x = 0; x < 60; ++x)
+        {
+            const Eigen::Vector3f& cached = cached_map.getNormalCache().at(x, y);
+            const Eigen::Vector3f& computed = normals.at(x, y);
+            BOOST_CHECK(cached == computed || (cached.hasNaN() && computed.hasNaN()));
+        }
+
+    cached_map.disableNormalCache();
+    BOOST_CHECK(!cached_map.hasNormalCache());
+}
@@ -0,0 +1,164 @@
+#define BOOST_TEST_MODULE GridTest
+#include <boost/test/unit_test.hpp>
+
+#include <maps/grid/EuclideanDistanceField.hpp>
+#include <maps/grid/OccupancyGridMap.hpp>
+
+#include <set>
+
+using namespace ::maps::grid;
+
+namespace
+{
+    struct IndexCompare
+    {
+        bool operator()(const Eigen::Vector3i& a, const Eigen::Vector3i& b) const
+        {
+            return std::lexicographical_compare(a.data(), a.data() + 3, b.data(), b.data() + 3);
+        }
+    };
+    typedef std::set<Eigen::Vector3i, IndexCompare> ObstacleSet;
+
+    /** Compares all voxels of the field with the distance to the closest obstacle */
+    void checkAgainstBruteForce(const EuclideanDistanceField& field, const ObstacleSet& obstacles, float tolerance)
+    {
+        Eigen::Vector3i idx;
+        for(idx.z() = field.getZMinIndex(); idx.z() < field.getZMaxIndex(); ++idx.z())
+            for(idx.y() = 0; idx.y() < (int)field.getNumCells().y(); ++idx.y())
+                for(idx.x() = 0; idx.x() < (int)field.getNumCells().x(); ++idx.x())
+                {
+                    double expected = field.getMaxDistance();
+                    for(const Eigen::Vector3i& obstacle : obstacles)
+                        expected = std::min(expected, (idx - obstacle).cast<double>().cwiseProduct(field.getResolution()).norm());
+                    BOOST_CHECK_SMALL(field.getDistance(idx) - expected, (double)tolerance);
+                    BOOST_CHECK_EQUAL(field.isOccupied(idx), obstacles.count(idx) > 0);
+                }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_incremental_updates)
+{
+    const Eigen::Vector3d resolution(0.1, 0.1, 0.2);
+    EuclideanDistanceField field(Vector2ui(30, 25), resolution, -5, 10, 1.5f);
+    const float tolerance = 0.1f * resolution.minCoeff();
+
+    srand(42);
+    ObstacleSet obstacles;
+    for(int i = 0; i < 20; ++i)
+    {
+        Eigen::Vector3i idx(rand() % 30, rand() % 25, rand() % 15 - 5);
+        BOOST_CHECK(field.setOccupied(idx, true));
+        obstacles.insert(idx);
+    }
+    BOOST_CHECK(!field.setOccupied(Eigen::Vector3i(0, 0, 10), true));
+    BOOST_CHECK(field.hasPendingChanges());
+    field.update();
+    BOOST_CHECK(!field.hasPendingChanges());
+    checkAgainstBruteForce(field, obstacles, tolerance);
+
+    // remove half of the obstacles
+    size_t i = 0;
+    for(ObstacleSet::iterator it = obstacles.begin(); it != obstacles.end(); ++i)
+    {
+        if(i % 2 == 0)
+        {
+            field.setOccupied(*it, false);
+            it = obstacles.erase(it);
+        }
+        else
+            ++it;
+    }
+    field.update();
+    checkAgainstBruteForce(field, obstacles, tolerance);
+
+    // insert and remove in the same batch
+    const Eigen::Vector3i transient(15, 12, 2);
+    field.setOccupied(transient, true);
+    field.setOccupied(Eigen::Vector3i(3, 4, 0), true);
+    obstacles.insert(Eigen::Vector3i(3, 4, 0));
+    field.setOccupied(transient, false);
+    obstacles.erase(transient);
+    field.update();
+    checkAgainstBruteForce(field, obstacles, tolerance);
+
+    // remove all
+    for(const Eigen::Vector3i& idx : obstacles)
+        field.setOccupied(idx, false);
+    obstacles.clear();
+    field.update();
+    checkAgainstBruteForce(field, obstacles, tolerance);
+}
+
+BOOST_AUTO_TEST_CASE(test_interpolation)
+{
+    const Eigen::Vector3d resolution(0.1, 0.1, 0.1);
+    EuclideanDistanceField field(Vector2ui(40, 40), resolution, 0, 40, 10.f);
+
+    const Eigen::Vector3i obstacle(20, 20, 20);
+    field.setOccupied(obstacle, true);
+    field.update();
+
+    Eigen::Vector3d obstacle_center = (obstacle.cast<double>() + Eigen::Vector3d::Constant(0.5)).cwiseProduct(resolution);
+    float distance;
+    BOOST_REQUIRE(field.getDistance(obstacle_center, distance));
+    BOOST_CHECK_EQUAL(distance, 0.f);
+    BOOST_CHECK(!field.getDistance(Eigen::Vector3d(-0.05, 0.5, 0.5), distance));
+
+    // on a voxel center the interpolation returns the voxel distance
+    Eigen::Vector3d gradient;
+    const Eigen::Vector3d position = obstacle_center + Eigen::Vector3d(0.5, 0., 0.);
+    BOOST_REQUIRE(field.getInterpolatedDistance(position, distance, &gradient));
+    BOOST_CHECK_CLOSE(distance, 0.5f, 1e-3);
+    BOOST_CHECK_CLOSE(gradient.x(), 1., 1e-3);
+
+    // the gradient points away from the obstacle
+    const Eigen::Vector3d direction = Eigen::Vector3d(0.3, -0.7, 0.4).normalized();
+    BOOST_REQUIRE(field.getInterpolatedDistance(obstacle_center + 1.234 * direction, distance, &gradient));
+    BOOST_CHECK_SMALL(distance - 1.234f, 0.05f);
+    BOOST_CHECK_GT(gradient.normalized().dot(direction), 0.95);
+}
+
+BOOST_AUTO_TEST_CASE(test_occupancy_map_changes)
+{
+    Vector2ui num_cells(60, 60);
+    Eigen::Vector3d resolution(0.1, 0.1, 0.1);
+    OccupancyConfiguration config;
+    OccupancyGridMap grid(num_cells, resolution, config);
+    grid.setChangeTracking(true);
+    EuclideanDistanceField field(grid, 0.f, 2.f, 1.f);
+
+    Eigen::Vector3d sensor_origin(0.55, 3.05, 1.05);
+    for(unsigned i = 0; i < 5; i++)
+        for(double y = 1.0; y < 5.0; y += 0.1)
+            grid.mergePoint(sensor_origin, Eigen::Vector3d(5.05, y, 0.55));
+    BOOST_CHECK(!grid.getChangedVoxels().empty());
+
+    field.integrateChanges(grid);
+    BOOST_CHECK(grid.getChangedVoxels().empty());
+
+    unsigned num_occupied = 0;
+    Eigen::Vector3i idx;
+    for(idx.z() = field.getZMinIndex(); idx.z() < field.getZMaxIndex(); ++idx.z())
+        for(idx.y() = 0; idx.y() < (int)num_cells.y(); ++idx.y())
+            for(idx.x() = 0; idx.x() < (int)num_cells.x(); ++idx.x())
+            {
+                Eigen::Vector3d center;
+                BOOST_REQUIRE(grid.fromVoxelGrid(idx, center));
+                BOOST_CHECK_EQUAL(field.isOccupied(idx), grid.isOccupied(center));
+                num_occupied += field.isOccupied(idx);
+            }
+    BOOST_CHECK(num_occupied > 0);
+
+    // half a meter in front of the wall
+    float distance;
+    BOOST_REQUIRE(field.getDistance(Eigen::Vector3d(4.55, 3.05, 0.55), distance));
+    BOOST_CHECK_CLOSE(distance, 0.5f, 1e-3);
+
+    // a measurement behind the wall clears it
+    for(unsigned i = 0; i < 10; i++)
+        grid.mergePoint(sensor_origin, Eigen::Vector3d(5.95, 3.05, 0.45));
+    field.integrateChanges(grid);
+    BOOST_CHECK(!field.isOccupied(Eigen::Vector3i(50, 30, 5)));
+    BOOST_REQUIRE(field.getDistance(Eigen::Vector3d(5.05, 3.05, 0.55), distance));
+    BOOST_CHECK_GT(distance, 0.f);
+}
@@ -275,6 +275,82 @@ BOOST_AUTO_TEST_CASE(test_grid_minmax)
     delete grid_min;
 }
 
+BOOST_AUTO_TEST_CASE(test_grid_parallel_reductions)
+{
+    // large enough to be split into several blocks
+    Vector2ui num_cells(1000, 700);
+    const float defaults[] = {std::numeric_limits<float>::quiet_NaN(), -1.f};
+    for(float default_value : defaults)
+    {
+        GridMap<float> grid(num_cells, Vector2d(0.1, 0.1), default_value);
+        BOOST_CHECK(grid.calculateCellExtents(4).isEmpty());
+
+        srand(11);
+        for(int i = 0; i < 20000; ++i)
+            grid.at(100 + rand() % 700, 50 + rand() % 600) = (rand() % 10000) * 0.01f;
+        // duplicate of the maximum, the first one has to be returned
+        grid.at(5, 3) = 200.f;
+        grid.at(900, 600) = 200.f;
+        grid.at(999, 699) = -50.f;
+
+        float min = std::numeric_limits<float>::max(), max = -std::numeric_limits<float>::max();
+        CellExtents expected_extents;
+        for(unsigned int y = 0; y < num_cells.y(); ++y)
+        {
+            for(unsigned int x = 0; x < num_cells.x(); ++x)
+            {
+                if(grid.isDefault(grid.at(x, y)))
+                    continue;
+                min = std::min(min, grid.at(x, y));
+                max = std::max(max, grid.at(x, y));
+                expected_extents.extend(Vector2ui(x, y));
+            }
+        }
+
+        BOOST_CHECK_EQUAL(&grid.getMax(false, 4), &grid.at(5, 3));
+        BOOST_CHECK_EQUAL(&grid.getMin(false, 4), &grid.at(999, 699));
+        BOOST_CHECK_EQUAL(grid.getMax(false, 4), grid.getMax(false, 1));
+        BOOST_CHECK_EQUAL(grid.getMin(false, 4), grid.getMin(false, 1));
+
+        float range_min, range_max;
+        CellExtents extents;
+        BOOST_CHECK(grid.calculateValueRange(range_min, range_max, extents, 4));
+        BOOST_CHECK_EQUAL(range_min, min);
+        BOOST_CHECK_EQUAL(range_max, max);
+        BOOST_CHECK_EQUAL(extents.min(), expected_extents.min());
+        BOOST_CHECK_EQUAL(extents.max(), expected_extents.max());
+        BOOST_CHECK_EQUAL(grid.calculateCellExtents(4).min(), expected_extents.min());
+        BOOST_CHECK_EQUAL(grid.calculateCellExtents(4).max(), expected_extents.max());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_grid_bool_reductions)
+{
+    // std::vector<bool> has no contiguous cells, the serial reductions are used
+    GridMap<bool> grid(Vector2ui(30, 20), Vector2d(0.1, 0.1), false);
+    BOOST_CHECK(grid.calculateCellExtents().isEmpty());
+    BOOST_CHECK_EQUAL(grid.getMax(), false);
+    BOOST_CHECK_EQUAL(grid.getMax(false), false);
+
+    *(grid.begin() + 3 + 4 * 30) = true;
+    *(grid.begin() + 25 + 11 * 30) = true;
+    const GridMap<bool>& const_grid = grid;
+    BOOST_CHECK_EQUAL(const_grid.at(3, 4), true);
+    BOOST_CHECK_EQUAL(grid.getMax(), true);
+    BOOST_CHECK_EQUAL(grid.getMin(), false);
+    BOOST_CHECK_EQUAL(grid.getMin(false), true);
+
+    CellExtents extents = grid.calculateCellExtents(4);
+    BOOST_CHECK_EQUAL(extents.min(), Vector2ui(3, 4));
+    BOOST_CHECK_EQUAL(extents.max(), Vector2ui(25, 11));
+
+    bool min, max;
+    BOOST_CHECK(grid.calculateValueRange(min, max, extents));
+    BOOST_CHECK_EQUAL(min, true);
+    BOOST_CHECK_EQUAL(max, true);
+    BOOST_CHECK_EQUAL(extents.max(), Vector2ui(25, 11));
+}
+
 BOOST_AUTO_TEST_CASE(test_grid_clear)
 {
     Vector2ui num_cells(100, 200);
@@ -181,3 +181,139 @@ BOOST_AUTO_TEST_CASE(test_gridmap_keys)
 
     delete grid_map;
 }
+
+BOOST_AUTO_TEST_CASE(test_layer_handles)
+{
+    LayeredGridMap grid_map(num_cells, resolution);
+    grid_map.addLayer<double>("double_grid", 0.);
+    grid_map.addLayer<int>("int_grid", 0);
+
+    LayeredGridMap::LayerHandle<double> double_handle = grid_map.getLayerHandle<double>("double_grid");
+    LayeredGridMap::LayerHandle<int> int_handle = grid_map.getLayerHandle<int>("int_grid");
+
+    BOOST_CHECK_EQUAL(&grid_map.getLayer(double_handle), &grid_map.getLayer<double>("double_grid"));
+    BOOST_CHECK_EQUAL(&grid_map.getLayer(int_handle), &grid_map.getLayer<int>("int_grid"));
+
+    // the type is checked when the handle is created
+    BOOST_CHECK_THROW(grid_map.getLayerHandle<int>("double_grid"), std::runtime_error);
+    BOOST_CHECK_THROW(grid_map.getLayerHandle<int>("no_grid"), std::out_of_range);
+    BOOST_CHECK_THROW(grid_map.getLayer(LayeredGridMap::LayerHandle<int>()), std::out_of_range);
+
+    // removing a layer only invalidates its own handle
+    grid_map.removeLayer("double_grid");
+    BOOST_CHECK_THROW(grid_map.getLayer(double_handle), std::out_of_range);
+    BOOST_CHECK_EQUAL(&grid_map.getLayer(int_handle), &grid_map.getLayer<int>("int_grid"));
+
+    grid_map.addLayer<double>("double_grid", 0.);
+    BOOST_CHECK_THROW(grid_map.getLayer(double_handle), std::out_of_range);
+
+    grid_map.removeAllLayers();
+    BOOST_CHECK_THROW(grid_map.getLayer(int_handle), std::out_of_range);
+    BOOST_CHECK_THROW(grid_map.getLayer(double_handle), std::out_of_range);
+
+    // layers added afterwards don't take over the indices of the stale handles
+    grid_map.addLayer<int>("int_grid", 0);
+    grid_map.addLayer<double>("double_grid", 0.);
+    BOOST_CHECK_THROW(grid_map.getLayer(int_handle), std::out_of_range);
+    BOOST_CHECK_THROW(grid_map.getLayer(double_handle), std::out_of_range);
+    BOOST_CHECK_EQUAL(&grid_map.getLayer(grid_map.getLayerHandle<int>("int_grid")), &grid_map.getLayer<int>("int_grid"));
+
+    // handles can only be used with the map which created them
+    LayeredGridMap other_map(num_cells, resolution);
+    other_map.addLayer<std::string>("int_grid", "");
+    other_map.addLayer<std::string>("double_grid", "");
+    BOOST_CHECK_THROW(other_map.getLayer(grid_map.getLayerHandle<int>("int_grid")), std::out_of_range);
+    BOOST_CHECK_THROW(other_map.getLayer(grid_map.getLayerHandle<double>("double_grid")), std::out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE(test_shared_layers)
+{
+    LayeredGridMap grid_map(num_cells, resolution);
+    grid_map.addSharedLayer<float>("a", 1.f);
+    grid_map.addLayer<float>("separate", 2.f);
+    LayeredGridMap::SharedLayer<uint8_t>& flags = grid_map.addSharedLayer<uint8_t>("flags", 3);
+    flags.at(5, 7) = 4;
+
+    // adding layers grows the shared memory, the cells are kept
+    for (int i = 0; i < 10; ++i)
+        grid_map.addSharedLayer<double>("d" + std::to_string(i), i);
+    BOOST_CHECK_EQUAL((&grid_map.getLayer<uint8_t, BufferGrid<uint8_t> >("flags")), &flags);
+    BOOST_CHECK_EQUAL(flags.at(5, 7), 4);
+    BOOST_CHECK_EQUAL(flags.at(6, 7), 3);
+    BOOST_CHECK_EQUAL((grid_map.getLayer<float, BufferGrid<float> >("a").at(99, 99)), 1.f);
+    BOOST_CHECK_EQUAL((grid_map.getLayer<double, BufferGrid<double> >("d9").at(0, 0)), 9.);
+
+    // the layers are aligned and follow each other in one allocation
+    const LayeredGridMap::SharedLayer<float>& a = grid_map.getLayer<float, BufferGrid<float> >("a");
+    const char* a_cells = reinterpret_cast<const char*>(a.getCells());
+    const char* flags_cells = reinterpret_cast<const char*>(flags.getCells());
+    BOOST_CHECK_EQUAL(reinterpret_cast<size_t>(a_cells) % LayeredGridMap::SHARED_LAYER_ALIGNMENT, 0);
+    BOOST_CHECK_EQUAL(reinterpret_cast<size_t>(flags_cells) % LayeredGridMap::SHARED_LAYER_ALIGNMENT, 0);
+    BOOST_CHECK(flags_cells >= a_cells + num_cells.prod() * sizeof(float));
+    BOOST_CHECK(flags_cells < a_cells + num_cells.prod() * sizeof(float) + LayeredGridMap::SHARED_LAYER_ALIGNMENT);
+
+    // the type of the storage is checked as well
+    BOOST_CHECK_THROW(grid_map.getLayer<float>("a"), std::runtime_error);
+    BOOST_CHECK_THROW(grid_map.getLayerHandle<float>("a"), std::runtime_error);
+    BOOST_CHECK_THROW(grid_map.addSharedLayer<float>("separate", 0.f), std::out_of_range);
+    BOOST_CHECK_THROW(flags.resize(Vector2ui(10, 10)), std::runtime_error);
+
+    // kernels over shared and separate layers
+    LayeredGridMap::LayerHandle<float, BufferGrid<float> > a_handle = grid_map.getLayerHandle<float, BufferGrid<float> >("a");
+    LayeredGridMap::LayerHandle<float> separate_handle = grid_map.getLayerHandle<float>("separate");
+    LayeredGridMap::LayerHandle<uint8_t, BufferGrid<uint8_t> > flags_handle = grid_map.getLayerHandle<uint8_t, BufferGrid<uint8_t> >("flags");
+    grid_map.parallelForEachCell(4, [](float &a_value, float separate_value, uint8_t flag)
+    {
+        a_value = separate_value * flag;
+    }, a_handle, separate_handle, flags_handle);
+    BOOST_CHECK_EQUAL(grid_map.getLayer(a_handle).at(5, 7), 8.f);
+    BOOST_CHECK_EQUAL(grid_map.getLayer(a_handle).at(0, 0), 6.f);
+
+    grid_map.removeLayer("flags");
+    BOOST_CHECK_THROW(grid_map.getLayer(flags_handle), std::out_of_range);
+    grid_map.addSharedLayer<int>("i", 5);
+    BOOST_CHECK_EQUAL(grid_map.getLayer(a_handle).at(5, 7), 8.f);
+
+    grid_map.removeAllLayers();
+    BOOST_CHECK_THROW(grid_map.getLayer(a_handle), std::out_of_range);
+    BOOST_CHECK_EQUAL(grid_map.addSharedLayer<int>("i", 6).at(1, 2), 6);
+}
+
+BOOST_AUTO_TEST_CASE(test_for_each_cell)
+{
+    LayeredGridMap grid_map(num_cells, resolution);
+    grid_map.addLayer<float>("a", 0.f);
+    grid_map.addLayer<float>("b", 0.f);
+    grid_map.addLayer<double>("sum", 0.);
+
+    LayeredGridMap::LayerHandle<float> a = grid_map.getLayerHandle<float>("a");
+    LayeredGridMap::LayerHandle<float> b = grid_map.getLayerHandle<float>("b");
+    LayeredGridMap::LayerHandle<double> sum = grid_map.getLayerHandle<double>("sum");
+
+    for (unsigned int y = 0; y < num_cells.y(); ++y)
+    {
+        for (unsigned int x = 0; x < num_cells.x(); ++x)
+        {
+            grid_map.getLayer(a).at(x, y) = x;
+            grid_map.getLayer(b).at(x, y) = y;
+        }
+    }
+
+    grid_map.forEachCell([](float a_value, float b_value, double &sum_value)
+    {
+        sum_value = a_value + b_value;
+    }, a, b, sum);
+
+    for (unsigned int y = 0; y < num_cells.y(); ++y)
+        for (unsigned int x = 0; x < num_cells.x(); ++x)
+            BOOST_CHECK_EQUAL(grid_map.getLayer(sum).at(x, y), x + y);
+
+    grid_map.parallelForEachCell(4, [](float a_value, float b_value, double &sum_value)
+    {
+        sum_value = a_value * b_value;
+    }, a, b, sum);
+
+    for (unsigned int y = 0; y < num_cells.y(); ++y)
+        for (unsigned int x = 0; x < num_cells.x(); ++x)
+            BOOST_CHECK_EQUAL(grid_map.getLayer(sum).at(x, y), x * y);
+}
@@ -315,3 +315,227 @@ BOOST_AUTO_TEST_CASE(test_mapAccess2)
 }*/
 
 
+
+namespace
+{
+    /** Fills each cell with random non-overlapping patches, leaving some cells empty */
+    void fillRandomPatches(MultiLevelGridMap<Patch>& grid)
+    {
+        srand(42);
+        for(size_t y = 0; y < grid.getNumCells().y(); ++y)
+        {
+            for(size_t x = 0; x < grid.getNumCells().x(); ++x)
+            {
+                int num_patches = rand() % 4 - 1;
+                double height = rand() % 100 * 0.1;
+                for(int i = 0; i < num_patches; ++i)
+                {
+                    double min = height + rand() % 10 * 0.1;
+                    double max = min + rand() % 10 * 0.1;
+                    grid.at(x, y).insert(Patch(min, max));
+                    height = max + 0.5;
+                }
+            }
+        }
+        grid.setDisjointPatches(true);
+    }
+
+    /** Fills each cell with random patches of different sizes which may overlap */
+    void fillOverlappingPatches(MultiLevelGridMap<Patch>& grid)
+    {
+        srand(23);
+        for(size_t y = 0; y < grid.getNumCells().y(); ++y)
+        {
+            for(size_t x = 0; x < grid.getNumCells().x(); ++x)
+            {
+                int num_patches = rand() % 6;
+                for(int i = 0; i < num_patches; ++i)
+                {
+                    double min = rand() % 100 * 0.1;
+                    double max = min + rand() % 80 * 0.1;
+                    grid.at(x, y).insert(Patch(min, max));
+                }
+            }
+        }
+    }
+
+    typedef MultiLevelGridMap<Patch>::PatchVector PatchVector;
+
+    PatchVector bruteForceIntersection(const MultiLevelGridMap<Patch>& grid, const Index& minIdx, const Index& maxIdx, double minHeight, double maxHeight)
+    {
+        PatchVector ret;
+        for(int y = minIdx.y(); y < maxIdx.y(); y++)
+            for(int x = minIdx.x(); x < maxIdx.x(); x++)
+                for(const Patch& p : grid.at(x, y))
+                    if(::maps::tools::overlap(p.getMin(), p.getMax(), minHeight, maxHeight))
+                        ret.emplace_back(Index(x, y), &p);
+        return ret;
+    }
+
+    void checkSamePatches(PatchVector a, PatchVector b)
+    {
+        auto cmp = [](const PatchVector::value_type& l, const PatchVector::value_type& r) { return l.second < r.second; };
+        std::sort(a.begin(), a.end(), cmp);
+        std::sort(b.begin(), b.end(), cmp);
+        BOOST_REQUIRE_EQUAL(a.size(), b.size());
+        for(size_t i = 0; i < a.size(); ++i)
+        {
+            BOOST_CHECK_EQUAL(a[i].first, b[i].first);
+            BOOST_CHECK_EQUAL(a[i].second, b[i].second);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_intersect_aabb)
+{
+    MultiLevelGridMap<Patch> grid(Vector2ui(37, 21), Eigen::Vector2d(0.5, 0.5));
+    fillRandomPatches(grid);
+
+    for(int pyramid = 0; pyramid < 2; ++pyramid)
+    {
+        if(pyramid)
+            grid.enableHeightPyramid();
+
+        for(int i = 0; i < 200; ++i)
+        {
+            Eigen::Vector3d min(rand() % 200 * 0.1, rand() % 120 * 0.1, rand() % 150 * 0.1 - 1.0);
+            Eigen::Vector3d max = min + Eigen::Vector3d(rand() % 50 * 0.1, rand() % 50 * 0.1, rand() % 30 * 0.1);
+            Eigen::AlignedBox3d box(min, max);
+
+            Index minIdx = Index((min.head<2>() / 0.5).cast<int>()).cwiseMax(0);
+            Index maxIdx = Index((max.head<2>() / 0.5).cast<int>()).cwiseMin(Index(37, 21));
+            checkSamePatches(grid.intersectAABB(box), bruteForceIntersection(grid, minIdx, maxIdx, min.z(), max.z()));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_intersect_cuboid)
+{
+    MultiLevelGridMap<Patch> grid(Vector2ui(37, 21), Eigen::Vector2d(0.5, 0.5));
+    fillRandomPatches(grid);
+
+    for(int pyramid = 0; pyramid < 2; ++pyramid)
+    {
+        if(pyramid)
+            grid.enableHeightPyramid();
+
+        Eigen::AlignedBox3d box(Eigen::Vector3d(2.2, 1.3, 3.0), Eigen::Vector3d(11.7, 8.1, 4.5));
+        Index minIdx, maxIdx;
+        BOOST_REQUIRE(grid.toGrid(box.min(), minIdx));
+        BOOST_REQUIRE(grid.toGrid(box.max(), maxIdx));
+        PatchVector expected = bruteForceIntersection(grid, minIdx, maxIdx, box.min().z(), box.max().z());
+
+        size_t num_intersections;
+        MultiLevelGridMap<Patch>::View view = grid.intersectCuboid(box, num_intersections);
+        BOOST_CHECK_EQUAL(num_intersections, expected.size());
+        BOOST_CHECK_EQUAL(view.getNumCells(), Vector2ui(maxIdx.x() - minIdx.x(), maxIdx.y() - minIdx.y()));
+
+        PatchVector found;
+        for(unsigned int y = 0; y < view.getNumCells().y(); ++y)
+            for(unsigned int x = 0; x < view.getNumCells().x(); ++x)
+                for(const Patch* p : view.at(x, y))
+                    found.emplace_back(Index(x, y) + minIdx, p);
+        checkSamePatches(found, expected);
+
+        // the sparse view only stores cells containing intersections
+        MultiLevelGridMap<Patch>::SparseView sparse_view = grid.intersectCuboidSparse(box, num_intersections);
+        BOOST_CHECK_EQUAL(num_intersections, expected.size());
+        BOOST_CHECK_EQUAL(sparse_view.getNumCells(), view.getNumCells());
+        found.clear();
+        size_t num_stored = 0;
+        for(MultiLevelGridMap<Patch>::SparseView::const_iterator it = sparse_view.begin(); it != sparse_view.end(); ++it, ++num_stored)
+        {
+            BOOST_CHECK(!it->second.empty());
+            for(const Patch* p : it->second)
+                found.emplace_back(Index(sparse_view.getIndex(it) + minIdx), p);
+        }
+        BOOST_CHECK(num_stored < sparse_view.getNumCells().prod());
+        checkSamePatches(found, expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_intersect_overlapping_patches)
+{
+    MultiLevelGridMap<Patch> grid(Vector2ui(23, 17), Eigen::Vector2d(0.5, 0.5));
+    fillOverlappingPatches(grid);
+    BOOST_REQUIRE(!grid.hasDisjointPatches());
+
+    // a large patch sorted before a small one, the box only overlaps the large patch
+    grid.at(0, 0).clear();
+    grid.at(0, 0).insert(Patch(0.0, 10.0));
+    grid.at(0, 0).insert(Patch(6.0, 7.0));
+    BOOST_CHECK_EQUAL(grid.intersectAABB(Eigen::AlignedBox3d(Eigen::Vector3d(0, 0, 8.0), Eigen::Vector3d(0.9, 0.9, 9.0))).size(), 1);
+
+    for(int pyramid = 0; pyramid < 2; ++pyramid)
+    {
+        if(pyramid)
+            grid.enableHeightPyramid();
+
+        for(int i = 0; i < 200; ++i)
+        {
+            Eigen::Vector3d min(rand() % 110 * 0.1, rand() % 80 * 0.1, rand() % 150 * 0.1 - 1.0);
+            Eigen::Vector3d max = min + Eigen::Vector3d(rand() % 50 * 0.1, rand() % 50 * 0.1, rand() % 30 * 0.1);
+            Eigen::AlignedBox3d box(min, max);
+
+            Index minIdx = Index((min.head<2>() / 0.5).cast<int>()).cwiseMax(0);
+            Index maxIdx = Index((max.head<2>() / 0.5).cast<int>()).cwiseMin(Index(23, 17));
+            checkSamePatches(grid.intersectAABB(box), bruteForceIntersection(grid, minIdx, maxIdx, min.z(), max.z()));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_height_pyramid_resize)
+{
+    MultiLevelGridMap<Patch> grid(Vector2ui(10, 10), Eigen::Vector2d(1.0, 1.0));
+    grid.at(3, 4).insert(Patch(1.0, 2.0));
+    grid.enableHeightPyramid();
+
+    // modifications through the grid interface are applied with the next update
+    grid.resize(Vector2ui(20, 30));
+    BOOST_REQUIRE(grid.hasHeightPyramid());
+    grid.at(15, 25).insert(Patch(5.0, 6.0));
+    Eigen::AlignedBox3d box(Eigen::Vector3d(0, 0, 5.5), Eigen::Vector3d(20, 30, 7.0));
+    BOOST_CHECK_EQUAL(grid.intersectAABB(box).size(), 1);
+    grid.updateHeightPyramid(Index(15, 25));
+    BOOST_CHECK_EQUAL(grid.getHeightPyramid().getNumCells(), Vector2ui(20, 30));
+    BOOST_CHECK_EQUAL(grid.getHeightPyramid().getRange().max, 6.0);
+
+    grid.moveBy(Index(2, 1));
+    BOOST_CHECK_EQUAL(grid.intersectAABB(box).front().first, Index(17, 26));
+    grid.updateHeightPyramid();
+    BOOST_CHECK(grid.getHeightPyramid().getCell(Index(15, 25)).isEmpty());
+    BOOST_CHECK_EQUAL(grid.getHeightPyramid().getCell(Index(17, 26)).min, 5.0);
+
+    // writes through a base class reference are detected as well
+    GridMap<LevelList<Patch> >& base = grid;
+    base.at(4, 5).insert(Patch(8.0, 9.0));
+    BOOST_CHECK_EQUAL(grid.intersectAABB(Eigen::AlignedBox3d(Eigen::Vector3d(0, 0, 8.5), Eigen::Vector3d(20, 30, 9.0))).size(), 1);
+    grid.updateHeightPyramid();
+    BOOST_CHECK_EQUAL(grid.getHeightPyramid().getRange().max, 9.0);
+
+    grid.clear();
+    BOOST_CHECK_EQUAL(grid.intersectAABB(box).size(), 0);
+    grid.updateHeightPyramid();
+    BOOST_CHECK(grid.getHeightPyramid().getRange().isEmpty());
+    BOOST_CHECK_THROW(grid.updateHeightPyramid(Index(20, 0)), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_height_pyramid_update)
+{
+    MultiLevelGridMap<Patch> grid(Vector2ui(10, 10), Eigen::Vector2d(1.0, 1.0));
+    grid.enableHeightPyramid();
+    BOOST_CHECK(grid.getHeightPyramid().getRange().isEmpty());
+
+    grid.at(3, 4).insert(Patch(1.0, 2.0));
+    grid.updateHeightPyramid(Index(3, 4));
+    BOOST_CHECK_EQUAL(grid.getHeightPyramid().getRange().min, 1.0);
+    BOOST_CHECK_EQUAL(grid.getHeightPyramid().getRange().max, 2.0);
+
+    Eigen::AlignedBox3d box(Eigen::Vector3d(0, 0, 1.5), Eigen::Vector3d(10, 10, 3.0));
+    BOOST_CHECK_EQUAL(grid.intersectAABB(box).size(), 1);
+
+    grid.at(3, 4).clear();
+    grid.updateHeightPyramid(Index(3, 4));
+    BOOST_CHECK(grid.getHeightPyramid().getRange().isEmpty());
+    BOOST_CHECK_EQUAL(grid.intersectAABB(box).size(), 0);
+}
@@ -0,0 +1,221 @@
+#define BOOST_TEST_MODULE GridTest
+#include <boost/test/unit_test.hpp>
+
+#include <maps/grid/MLSMap.hpp>
+
+using namespace ::maps::grid;
+
+namespace
+{
+    /** Dense scan of a slightly tilted ground plane with an overhang above a part of it */
+    std::vector<Eigen::Vector3d> generateScan()
+    {
+        std::vector<Eigen::Vector3d> points;
+        srand(42);
+        for(double x = 0.0025; x < 2.0; x += 0.01)
+            for(double y = 0.0025; y < 2.0; y += 0.01)
+            {
+                const double noise = 0.004 * ((double)rand() / RAND_MAX - 0.5);
+                points.push_back(Eigen::Vector3d(x, y, 0.1 * x + 0.05 * y + noise));
+                if(x > 1.0 && y > 1.0)
+                    points.push_back(Eigen::Vector3d(x, y, 1.5 + noise));
+            }
+        return points;
+    }
+
+    template<MLSConfig::update_model Type>
+    void mergeScan(MLSMap<Type>& map, const std::vector<Eigen::Vector3d>& points, unsigned num_scans)
+    {
+        base::TransformWithCovariance identity;
+        for(unsigned i = 0; i < num_scans; ++i)
+            map.mergePointCloud(points, identity);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_pre_aggregation_slope)
+{
+    MLSConfig config;
+    config.updateModel = MLSConfig::SLOPE;
+    MLSMapSloped map(Vector2ui(20, 20), Vector2d(0.1, 0.1), config);
+    MLSMapSloped aggregated_map(Vector2ui(20, 20), Vector2d(0.1, 0.1), config);
+    aggregated_map.setPreAggregation(true);
+    BOOST_CHECK(aggregated_map.isPreAggregation());
+
+    const std::vector<Eigen::Vector3d> points = generateScan();
+    mergeScan(map, points, 2);
+    mergeScan(aggregated_map, points, 2);
+
+    for(unsigned x = 0; x < 20; ++x)
+        for(unsigned y = 0; y < 20; ++y)
+        {
+            const MLSMapSloped::CellType& cell = map.at(x, y);
+            const MLSMapSloped::CellType& aggregated_cell = aggregated_map.at(x, y);
+            BOOST_REQUIRE_EQUAL(cell.size(), (x >= 10 && y >= 10) ? 2u : 1u);
+            BOOST_REQUIRE_EQUAL(cell.size(), aggregated_cell.size());
+            for(MLSMapSloped::CellType::const_iterator it = cell.begin(), it_aggr = aggregated_cell.begin(); it != cell.end(); ++it, ++it_aggr)
+            {
+                BOOST_CHECK(it->getCenter().isApprox(it_aggr->getCenter(), 1e-4));
+                BOOST_CHECK_GT(it->getNormal().dot(it_aggr->getNormal()), 0.9999);
+                BOOST_CHECK_CLOSE(it->getMin(), it_aggr->getMin(), 1e-3);
+                BOOST_CHECK_CLOSE(it->getMax(), it_aggr->getMax(), 1e-3);
+            }
+        }
+}
+
+BOOST_AUTO_TEST_CASE(test_pre_aggregation_kalman)
+{
+    MLSConfig config;
+    config.updateModel = MLSConfig::KALMAN;
+    MLSMapKalman map(Vector2ui(20, 20), Vector2d(0.1, 0.1), config);
+    MLSMapKalman aggregated_map(Vector2ui(20, 20), Vector2d(0.1, 0.1), config);
+    aggregated_map.setPreAggregation(true);
+
+    const std::vector<Eigen::Vector3d> points = generateScan();
+    mergeScan(map, points, 2);
+    mergeScan(aggregated_map, points, 2);
+
+    for(unsigned x = 0; x < 20; ++x)
+        for(unsigned y = 0; y < 20; ++y)
+        {
+            const MLSMapKalman::CellType& cell = map.at(x, y);
+            const MLSMapKalman::CellType& aggregated_cell = aggregated_map.at(x, y);
+            BOOST_REQUIRE_EQUAL(cell.size(), aggregated_cell.size());
+            for(MLSMapKalman::CellType::const_iterator it = cell.begin(), it_aggr = aggregated_cell.begin(); it != cell.end(); ++it, ++it_aggr)
+            {
+                BOOST_CHECK_SMALL(it->getMean() - it_aggr->getMean(), 1e-4f);
+                BOOST_CHECK_SMALL(it->getHeight() - it_aggr->getHeight(), 1e-4f);
+                BOOST_CHECK_CLOSE(it->getVariance(), it_aggr->getVariance(), 1e-1);
+            }
+        }
+}
+
+namespace
+{
+    /** Merges the patch like MLSMap did with a linear scan of the cell and a recursive compaction */
+    template<MLSConfig::update_model Type>
+    class LinearScanCell
+    {
+    public:
+        typedef SurfacePatch<Type> Patch;
+        typedef LevelList<Patch> CellType;
+
+        LinearScanCell(const MLSConfig& config) : config(config) {}
+
+        void mergePatch(const Patch& new_patch)
+        {
+            for(typename CellType::iterator patch_it = list.begin(); patch_it != list.end(); patch_it++)
+            {
+                if(patch_it->merge(new_patch, config))
+                {
+                    mergePatchRecursive(patch_it);
+                    return;
+                }
+                else if(new_patch < *patch_it)
+                    break;
+            }
+            list.insert(new_patch);
+        }
+
+        CellType list;
+
+    private:
+        void mergePatchRecursive(typename CellType::iterator& patch)
+        {
+            for(typename CellType::iterator patch_it = list.begin(); patch_it != list.end(); patch_it++)
+            {
+                if(patch_it == patch)
+                    continue;
+                else if(patch_it < patch && patch_it->merge(*patch, config))
+                {
+                    patch = list.erase(patch);
+                    patch = list.end();
+                    mergePatchRecursive(patch_it);
+                    return;
+                }
+                else if(patch < patch_it)
+                {
+                    if(patch->merge(*patch_it, config))
+                    {
+                        patch_it = list.erase(patch_it);
+                        mergePatchRecursive(patch);
+                    }
+                    return;
+                }
+            }
+        }
+
+        MLSConfig config;
+    };
+
+    /** Merges random points of several levels and gaps into a single cell and compares it with the linear scan */
+    template<MLSConfig::update_model Type>
+    void checkAgainstLinearScan(const MLSConfig& config, double max_variance = 0.01)
+    {
+        MLSMap<Type> map(Vector2ui(1, 1), Vector2d(0.1, 0.1), config);
+        LinearScanCell<Type> reference(config);
+
+        srand(1337);
+        for(unsigned i = 0; i < 5000; ++i)
+        {
+            // levels every meter, most points close to a level, some of the levels are joined by points in between
+            const int level = rand() % 20;
+            const double offset = (level % 4 == 0 && rand() % 50 == 0) ? 1.0 * rand() / RAND_MAX : 0.02 * rand() / RAND_MAX;
+            const Eigen::Vector3d point(0.1 * rand() / RAND_MAX, 0.1 * rand() / RAND_MAX, level + offset);
+            const double variance = 0.0001 + max_variance * rand() / RAND_MAX;
+
+            Eigen::Vector3d pos_in_cell;
+            Index idx;
+            BOOST_REQUIRE(map.toGrid(point, idx, pos_in_cell));
+            map.mergePoint(point, variance);
+            reference.mergePatch(SurfacePatch<Type>(pos_in_cell.cast<float>(), variance));
+
+            BOOST_REQUIRE_EQUAL(map.at(0, 0).size(), reference.list.size());
+            BOOST_REQUIRE(std::equal(reference.list.begin(), reference.list.end(), map.at(0, 0).begin()));
+        }
+        BOOST_CHECK_GT(reference.list.size(), 1u);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_merge_patch_multi_level)
+{
+    MLSConfig config;
+    config.gapSize = 0.3f;
+    config.updateModel = MLSConfig::SLOPE;
+    checkAgainstLinearScan<MLSConfig::SLOPE>(config);
+
+    config.gapSize = 0.2f;
+    config.updateModel = MLSConfig::KALMAN;
+    checkAgainstLinearScan<MLSConfig::KALMAN>(config);
+
+    // the merge tolerance of KALMAN patches depends on the variances
+    checkAgainstLinearScan<MLSConfig::KALMAN>(config, 0.3);
+}
+
+BOOST_AUTO_TEST_CASE(test_merge_patch_kalman_variances)
+{
+    MLSConfig config;
+    config.gapSize = 0.2f;
+    config.updateModel = MLSConfig::KALMAN;
+    MLSMap<MLSConfig::KALMAN> map(Vector2ui(1, 1), Vector2d(0.1, 0.1), config);
+    LinearScanCell<MLSConfig::KALMAN> reference(config);
+
+    // an uncertain patch below a certain one, inserted without merging them
+    const SurfacePatch<MLSConfig::KALMAN> uncertain(Eigen::Vector3f(0.f, 0.f, 0.f), 1.f);
+    const SurfacePatch<MLSConfig::KALMAN> certain(Eigen::Vector3f(0.f, 0.f, 0.5f), 0.0001f);
+    map.at(0, 0).insert(uncertain);
+    map.at(0, 0).insert(certain);
+    reference.list.insert(uncertain);
+    reference.list.insert(certain);
+
+    // the next patch below can't be merged, but the uncertain patch further below can
+    const SurfacePatch<MLSConfig::KALMAN> new_patch(Eigen::Vector3f(0.f, 0.f, 0.8f), 0.0001f);
+    BOOST_REQUIRE(!SurfacePatch<MLSConfig::KALMAN>(certain).merge(new_patch, config));
+    BOOST_REQUIRE(SurfacePatch<MLSConfig::KALMAN>(uncertain).merge(new_patch, config));
+    map.mergePatch(Index(0, 0), new_patch);
+    reference.mergePatch(new_patch);
+
+    BOOST_REQUIRE_EQUAL(map.at(0, 0).size(), reference.list.size());
+    BOOST_CHECK(std::equal(reference.list.begin(), reference.list.end(), map.at(0, 0).begin()));
+    // merged instead of inserted as third patch
+    BOOST_CHECK_EQUAL(map.at(0, 0).size(), 2);
+}
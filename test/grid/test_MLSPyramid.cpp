@@ -0,0 +1,175 @@
+#define BOOST_TEST_MODULE GridTest
+#include <boost/test/unit_test.hpp>
+
+#include <maps/grid/MLSPyramid.hpp>
+
+using namespace ::maps::grid;
+
+static double wave(double x, double y)
+{
+    return std::cos(x * M_PI / 2.5) * std::sin(y * M_PI / 2.5);
+}
+
+template<class Map>
+static void mergeWaves(Map& map, double min_x, double max_x, double min_y, double max_y)
+{
+    for(double x = min_x; x < max_x; x += 0.0125)
+        for(double y = min_y; y < max_y; y += 0.0125)
+            map.mergePoint(Eigen::Vector3d(x, y, wave(x, y)));
+}
+
+BOOST_AUTO_TEST_CASE(test_patch_translate)
+{
+    MLSConfig config;
+    const Eigen::Vector3f offset(0.3f, -0.2f, 0.1f);
+    const Eigen::Vector3f points[] = {Eigen::Vector3f(0.01f, 0.02f, 0.1f), Eigen::Vector3f(-0.02f, 0.01f, 0.12f),
+                                      Eigen::Vector3f(0.02f, -0.01f, 0.09f), Eigen::Vector3f(-0.01f, -0.02f, 0.11f)};
+
+    SurfacePatch<MLSConfig::SLOPE> patch(points[0], 0.01f), moved_patch(points[0] + offset, 0.01f);
+    for(int i = 1; i < 4; ++i)
+    {
+        BOOST_REQUIRE(patch.merge(SurfacePatch<MLSConfig::SLOPE>(points[i], 0.01f), config));
+        BOOST_REQUIRE(moved_patch.merge(SurfacePatch<MLSConfig::SLOPE>(points[i] + offset, 0.01f), config));
+    }
+    patch.translate(offset);
+    BOOST_CHECK(patch.getCenter().isApprox(moved_patch.getCenter(), 1e-5));
+    BOOST_CHECK(patch.getNormal().isApprox(moved_patch.getNormal(), 1e-3));
+    BOOST_CHECK_CLOSE(patch.getMin(), moved_patch.getMin(), 1e-4);
+    BOOST_CHECK_CLOSE(patch.getMax(), moved_patch.getMax(), 1e-4);
+
+    SurfacePatch<MLSConfig::KALMAN> kalman(points[0], 0.01f);
+    kalman.translate(offset);
+    BOOST_CHECK_CLOSE(kalman.getMean(), points[0].z() + offset.z(), 1e-4);
+    BOOST_CHECK_CLOSE(kalman.getMax(), points[0].z() + offset.z(), 1e-4);
+}
+
+BOOST_AUTO_TEST_CASE(test_mls_pyramid)
+{
+    MLSConfig config;
+    config.updateModel = MLSConfig::SLOPE;
+    MLSPyramidSloped pyramid(Vector2ui(120, 100), Vector2d(0.05, 0.05), config, 3);
+    BOOST_REQUIRE_EQUAL(pyramid.getNumLevels(), 3);
+    BOOST_CHECK_EQUAL(pyramid.getLevel(1).getNumCells(), Vector2ui(60, 50));
+    BOOST_CHECK_EQUAL(pyramid.getLevel(2).getNumCells(), Vector2ui(30, 25));
+    BOOST_CHECK_EQUAL(pyramid.getLevel(2).getResolution(), Vector2d(0.2, 0.2));
+
+    base::Transform3d frame = base::Transform3d::Identity();
+    frame.translation() << 3.0, 2.5, 0.;
+    pyramid.setLocalFrame(frame);
+
+    // map with the resolution of level 1 fed directly
+    MLSMapSloped direct(Vector2ui(60, 50), Vector2d(0.1, 0.1), config);
+    direct.getLocalFrame() = frame;
+
+    mergeWaves(pyramid, -3.0, 0.0, -2.5, 2.5);
+    mergeWaves(direct, -3.0, 0.0, -2.5, 2.5);
+    BOOST_CHECK(pyramid.hasDirtyCells());
+    pyramid.update(4);
+    BOOST_CHECK(!pyramid.hasDirtyCells());
+
+    for(double x = -2.9; x < -0.1; x += 0.07)
+    {
+        for(double y = -2.4; y < 2.4; y += 0.07)
+        {
+            const Eigen::Vector3d point(x, y, 0.);
+            for(size_t level = 0; level < 3; ++level)
+            {
+                double surface_pos;
+                BOOST_REQUIRE(pyramid.getLevel(level).getClosestSurfacePos(point, surface_pos));
+                BOOST_CHECK_SMALL(surface_pos - wave(x, y), 0.02 * (1 << level));
+            }
+            double pyramid_pos, direct_pos;
+            BOOST_REQUIRE(pyramid.getLevel(1).getClosestSurfacePos(point, pyramid_pos));
+            BOOST_REQUIRE(direct.getClosestSurfacePos(point, direct_pos));
+            BOOST_CHECK_SMALL(pyramid_pos - direct_pos, 1e-3);
+        }
+    }
+    // the second half wasn't measured yet
+    double surface_pos;
+    BOOST_CHECK(!pyramid.getLevel(2).getClosestSurfacePos(Eigen::Vector3d(1.0, 0.0, 0.0), surface_pos));
+
+    // incremental updates lead to the same result as rebuilding all levels
+    mergeWaves(pyramid, 0.0, 3.0, -2.5, 0.0);
+    pyramid.update();
+    MLSPyramidSloped rebuilt(pyramid);
+    rebuilt.rebuild();
+    for(size_t level = 1; level < 3; ++level)
+    {
+        const MLSMapSloped& incremental = pyramid.getLevel(level);
+        const MLSMapSloped& complete = rebuilt.getLevel(level);
+        for(unsigned int y = 0; y < incremental.getNumCells().y(); ++y)
+        {
+            for(unsigned int x = 0; x < incremental.getNumCells().x(); ++x)
+            {
+                BOOST_REQUIRE_EQUAL(incremental.at(x, y).size(), complete.at(x, y).size());
+                BOOST_CHECK(std::equal(incremental.at(x, y).begin(), incremental.at(x, y).end(), complete.at(x, y).begin()));
+            }
+        }
+    }
+    BOOST_CHECK(pyramid.getLevel(2).getClosestSurfacePos(Eigen::Vector3d(1.0, -1.0, 0.0), surface_pos));
+}
+
+BOOST_AUTO_TEST_CASE(test_mls_pyramid_height_pyramid)
+{
+    MLSConfig config;
+    config.updateModel = MLSConfig::SLOPE;
+    MLSPyramidSloped pyramid(Vector2ui(120, 100), Vector2d(0.05, 0.05), config, 3);
+    pyramid.enableHeightPyramid();
+
+    mergeWaves(pyramid, 0.5, 5.5, 0.5, 4.5);
+    pyramid.update(4);
+
+    // the incrementally updated height pyramids match the ones built from the cells
+    for(size_t level = 0; level < 3; ++level)
+    {
+        BOOST_REQUIRE(pyramid.getLevel(level).hasHeightPyramid());
+        MLSMapSloped rebuilt(pyramid.getLevel(level));
+        rebuilt.enableHeightPyramid();
+        const MinMaxPyramid& incremental = pyramid.getLevel(level).getHeightPyramid();
+        const MinMaxPyramid& complete = rebuilt.getHeightPyramid();
+        BOOST_REQUIRE_EQUAL(incremental.getNumLevels(), complete.getNumLevels());
+        for(size_t i = 0; i < incremental.getNumLevels(); ++i)
+            for(unsigned int y = 0; y < incremental.getNumBlocks(i).y(); ++y)
+                for(unsigned int x = 0; x < incremental.getNumBlocks(i).x(); ++x)
+                    BOOST_CHECK(incremental.getBlock(i, x, y) == complete.getBlock(i, x, y));
+        BOOST_CHECK(!incremental.getRange().isEmpty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_mls_pyramid_lod)
+{
+    MLSConfig config;
+    config.updateModel = MLSConfig::KALMAN;
+    MLSPyramidKalman pyramid(Vector2ui(101, 101), Vector2d(0.05, 0.05), config, 3);
+    BOOST_CHECK_EQUAL(pyramid.getLevel(1).getNumCells(), Vector2ui(51, 51));
+    BOOST_CHECK_EQUAL(pyramid.getLevel(2).getNumCells(), Vector2ui(26, 26));
+
+    BOOST_CHECK_EQUAL(pyramid.getLevelForResolution(0.01), 0);
+    BOOST_CHECK_EQUAL(pyramid.getLevelForResolution(0.05), 0);
+    BOOST_CHECK_EQUAL(pyramid.getLevelForResolution(0.15), 1);
+    BOOST_CHECK_EQUAL(pyramid.getLevelForResolution(10.), 2);
+
+    // by default the finest level is used
+    BOOST_CHECK_EQUAL(pyramid.getLevelForDistance(100.), 0);
+    pyramid.setLodDistance(2.0);
+    BOOST_CHECK_EQUAL(pyramid.getLevelForDistance(1.0), 0);
+    BOOST_CHECK_EQUAL(pyramid.getLevelForDistance(2.0), 0);
+    BOOST_CHECK_EQUAL(pyramid.getLevelForDistance(3.0), 1);
+    BOOST_CHECK_EQUAL(pyramid.getLevelForDistance(5.0), 2);
+    BOOST_CHECK_EQUAL(pyramid.getLevelForDistance(100.), 2);
+
+    // a step is visible on the fine level only close to the viewer
+    for(double x = 0.0; x < 5.0; x += 0.02)
+        for(double y = 0.0; y < 5.0; y += 0.02)
+            pyramid.mergePoint(Eigen::Vector3d(x, y, x < 2.5 ? 0.0 : 0.5));
+    pyramid.update();
+
+    double surface_pos;
+    BOOST_REQUIRE(pyramid.getClosestSurfacePos(Eigen::Vector3d(2.52, 1.0, 1.0), Eigen::Vector3d(2.52, 1.0, 2.0), surface_pos));
+    BOOST_CHECK_SMALL(surface_pos - 0.5, 0.05);
+    // the coarsest cell covers both sides of the step and keeps the upper surface
+    BOOST_REQUIRE(pyramid.getClosestSurfacePos(Eigen::Vector3d(2.52, 1.0, 1.0), Eigen::Vector3d(2.52, 1.0, 7.0), surface_pos));
+    BOOST_CHECK_SMALL(surface_pos - 0.5, 0.05);
+    BOOST_CHECK_EQUAL(pyramid.getLevel(2).at(12, 5).size(), 1);
+    BOOST_CHECK(pyramid.getLevel(2).at(12, 5).begin()->isVertical());
+}
@@ -0,0 +1,182 @@
+#define BOOST_TEST_MODULE GridTest
+#include <boost/test/unit_test.hpp>
+
+#include <maps/grid/MinMaxPyramid.hpp>
+#include <maps/grid/ElevationMap.hpp>
+
+using namespace ::maps::grid;
+
+BOOST_AUTO_TEST_CASE(test_pyramid_levels)
+{
+    MinMaxPyramid pyramid(Vector2ui(5, 3));
+    BOOST_CHECK_EQUAL(pyramid.getNumLevels(), 4);
+    BOOST_CHECK_EQUAL(pyramid.getNumBlocks(1), Vector2ui(3, 2));
+    BOOST_CHECK_EQUAL(pyramid.getNumBlocks(3), Vector2ui(1, 1));
+    BOOST_CHECK(pyramid.getRange().isEmpty());
+
+    BOOST_CHECK(!MinMaxPyramid().isInitialized());
+    BOOST_CHECK(MinMaxPyramid().getRange().isEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(test_pyramid_region_queries)
+{
+    const Vector2ui num_cells(23, 17);
+    std::vector<MinMaxPyramid::Range> cells(num_cells.prod());
+    MinMaxPyramid pyramid(num_cells);
+
+    srand(7);
+    for(unsigned int y = 0; y < num_cells.y(); ++y)
+    {
+        for(unsigned int x = 0; x < num_cells.x(); ++x)
+        {
+            if(rand() % 3 == 0)
+                continue;
+            float min = rand() % 100 * 0.1f;
+            MinMaxPyramid::Range range(min, min + rand() % 10 * 0.1f);
+            cells[x + y * num_cells.x()] = range;
+            pyramid.update(Index(x, y), range);
+        }
+    }
+
+    // incremental and full build agree
+    MinMaxPyramid built(num_cells);
+    for(unsigned int y = 0; y < num_cells.y(); ++y)
+        for(unsigned int x = 0; x < num_cells.x(); ++x)
+            built.setCell(Index(x, y), cells[x + y * num_cells.x()]);
+    built.updateLevels();
+    BOOST_CHECK(built.getRange() == pyramid.getRange());
+
+    for(int i = 0; i < 500; ++i)
+    {
+        Index min_idx(rand() % 30 - 3, rand() % 20 - 3);
+        Index max_idx = min_idx + Index(rand() % 15, rand() % 15);
+        float min_height = rand() % 110 * 0.1f;
+        float max_height = min_height + rand() % 10 * 0.1f;
+
+        MinMaxPyramid::Range expected;
+        std::vector<Index> expected_cells;
+        for(int y = std::max(min_idx.y(), 0); y < std::min<int>(max_idx.y(), num_cells.y()); ++y)
+        {
+            for(int x = std::max(min_idx.x(), 0); x < std::min<int>(max_idx.x(), num_cells.x()); ++x)
+            {
+                const MinMaxPyramid::Range& cell = cells[x + y * num_cells.x()];
+                expected.extend(cell);
+                if(cell.overlaps(min_height, max_height))
+                    expected_cells.push_back(Index(x, y));
+            }
+        }
+
+        BOOST_CHECK(pyramid.getRange(min_idx, max_idx) == expected);
+        BOOST_CHECK_EQUAL(pyramid.overlaps(min_idx, max_idx, min_height, max_height), !expected_cells.empty());
+
+        std::vector<Index> visited;
+        pyramid.visitOverlapping(min_idx, max_idx, min_height, max_height, [&visited](const Index& idx)
+        {
+            visited.push_back(idx);
+            return false;
+        });
+        std::sort(visited.begin(), visited.end());
+        std::sort(expected_cells.begin(), expected_cells.end());
+        BOOST_CHECK(visited == expected_cells);
+    }
+
+    // removing the data of all cells empties the pyramid
+    for(unsigned int y = 0; y < num_cells.y(); ++y)
+        for(unsigned int x = 0; x < num_cells.x(); ++x)
+            pyramid.update(Index(x, y), MinMaxPyramid::Range());
+    BOOST_CHECK(pyramid.getRange().isEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(test_pyramid_cell_extents)
+{
+    MinMaxPyramid pyramid(Vector2ui(37, 19));
+    BOOST_CHECK(pyramid.getCellExtents().isEmpty());
+
+    pyramid.update(Index(20, 7), MinMaxPyramid::Range(1.f, 1.f));
+    CellExtents extents = pyramid.getCellExtents();
+    BOOST_CHECK_EQUAL(extents.min(), Vector2ui(20, 7));
+    BOOST_CHECK_EQUAL(extents.max(), Vector2ui(20, 7));
+
+    pyramid.update(Index(3, 18), MinMaxPyramid::Range(0.f, 2.f));
+    pyramid.update(Index(36, 2), MinMaxPyramid::Range(-1.f, 0.f));
+    extents = pyramid.getCellExtents();
+    BOOST_CHECK_EQUAL(extents.min(), Vector2ui(3, 2));
+    BOOST_CHECK_EQUAL(extents.max(), Vector2ui(36, 18));
+}
+
+BOOST_AUTO_TEST_CASE(test_elevationmap_pyramid)
+{
+    ElevationMap map(Vector2ui(50, 40), Vector2d(0.1, 0.1));
+    ElevationMap map_pyramid(map);
+    map_pyramid.enableHeightPyramid();
+
+    srand(3);
+    for(int i = 0; i < 100; ++i)
+    {
+        Index idx(10 + rand() % 30, 5 + rand() % 20);
+        float elevation = rand() % 100 * 0.1f;
+        map.at(idx) = elevation;
+        map_pyramid.setElevation(idx, elevation);
+    }
+
+    BOOST_CHECK(map.getElevationRange() == map_pyramid.getElevationRange());
+    BOOST_CHECK_EQUAL(map.calculateCellExtents().min(), map_pyramid.calculateCellExtents().min());
+    BOOST_CHECK_EQUAL(map.calculateCellExtents().max(), map_pyramid.calculateCellExtents().max());
+    for(int i = 0; i < 100; ++i)
+    {
+        Index min_idx(rand() % 50, rand() % 40);
+        Index max_idx = min_idx + Index(rand() % 20, rand() % 20);
+        BOOST_CHECK(map.getElevationRange(min_idx, max_idx) == map_pyramid.getElevationRange(min_idx, max_idx));
+    }
+
+    // cells modified directly outdate the pyramid until the next update
+    map_pyramid.at(0, 0) = -5.f;
+    BOOST_CHECK_EQUAL(map_pyramid.getElevationRange().first, -5.f);
+    BOOST_CHECK_EQUAL(map_pyramid.calculateCellExtents().min(), Vector2ui(0, 0));
+    map_pyramid.updateHeightPyramid(Index(0, 0));
+    BOOST_CHECK_EQUAL(map_pyramid.getHeightPyramid().getRange().min, -5.f);
+    BOOST_CHECK_EQUAL(map_pyramid.getElevationRange().first, -5.f);
+    BOOST_CHECK_EQUAL(map_pyramid.calculateCellExtents().min(), Vector2ui(0, 0));
+
+    // writes through the grid interface are detected as well
+    GridMapF& grid = map_pyramid;
+    grid.at(1, 1) = -7.f;
+    BOOST_CHECK(map_pyramid.getHeightPyramid().getRange().min == -5.f);
+    BOOST_CHECK_EQUAL(map_pyramid.getElevationRange().first, -7.f);
+    map_pyramid.updateCaches();
+    BOOST_CHECK_EQUAL(map_pyramid.getHeightPyramid().getRange().min, -7.f);
+    BOOST_CHECK(map.getElevationRange(Index(20, 10), Index(30, 20)) == map_pyramid.getElevationRange(Index(20, 10), Index(30, 20)));
+
+    // a resize outdates the pyramid as well
+    map_pyramid.resize(Vector2ui(60, 40));
+    map_pyramid.setElevation(Index(55, 39), 20.f);
+    BOOST_CHECK_EQUAL(map_pyramid.getHeightPyramid().getNumCells(), Vector2ui(60, 40));
+    BOOST_CHECK_EQUAL(map_pyramid.getElevationRange().second, 20.f);
+}
+
+BOOST_AUTO_TEST_CASE(test_elevationmap_pyramid_empty_cells)
+{
+    // with a custom default value the extents are calculated without pyramid
+    ElevationMap map(Vector2ui(20, 10), Vector2d(0.1, 0.1), 0.f);
+    map.at(3, 4) = 2.f;
+    map.at(7, 1) = std::numeric_limits<float>::quiet_NaN();
+    map.at(9, 9) = ElevationMap::ELEVATION_DEFAULT;
+    ElevationMap map_pyramid(map);
+    map_pyramid.enableHeightPyramid();
+
+    BOOST_CHECK(map.getElevationRange() == std::make_pair(0.f, 2.f));
+    BOOST_CHECK(map_pyramid.getElevationRange() == map.getElevationRange());
+    BOOST_CHECK(map_pyramid.getElevationRange(Index(5, 0), Index(10, 5)) == map.getElevationRange(Index(5, 0), Index(10, 5)));
+    BOOST_CHECK_EQUAL(map_pyramid.calculateCellExtents().min(), map.calculateCellExtents().min());
+    BOOST_CHECK_EQUAL(map_pyramid.calculateCellExtents().max(), map.calculateCellExtents().max());
+
+    // with the default ELEVATION_DEFAULT the pyramid skips NaN cells like getElevationRange
+    ElevationMap nan_map(Vector2ui(20, 10), Vector2d(0.1, 0.1));
+    nan_map.setElevation(Index(3, 4), 2.f);
+    nan_map.setElevation(Index(7, 1), std::numeric_limits<float>::quiet_NaN());
+    BOOST_CHECK_EQUAL(nan_map.calculateCellExtents(2).min(), Vector2ui(3, 1));
+    BOOST_CHECK_EQUAL(nan_map.calculateCellExtents(2).max(), Vector2ui(7, 4));
+    nan_map.enableHeightPyramid();
+    BOOST_CHECK_EQUAL(nan_map.calculateCellExtents().min(), Vector2ui(3, 4));
+    BOOST_CHECK_EQUAL(nan_map.calculateCellExtents().max(), Vector2ui(3, 4));
+}
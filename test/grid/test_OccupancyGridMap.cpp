@@ -0,0 +1,399 @@
+#define BOOST_TEST_MODULE GridTest
+#include <boost/test/unit_test.hpp>
+
+#include <maps/grid/OccupancyGridMap.hpp>
+#include <maps/grid/IntervalOccupancyGridMap.hpp>
+
+using namespace ::maps::grid;
+
+BOOST_AUTO_TEST_CASE(test_quantized_occupancy_patch)
+{
+    // fixed-point conversion
+    BOOST_CHECK_CLOSE(QuantizedOccupancyPatch::decodeLogOdds(QuantizedOccupancyPatch::encodeLogOdds(1.3f)), 1.3f, 0.1);
+    BOOST_CHECK_EQUAL(QuantizedOccupancyPatch::encodeLogOdds(1000.f), std::numeric_limits<int16_t>::max());
+    BOOST_CHECK_EQUAL(QuantizedOccupancyPatch::encodeLogOdds(-1000.f), std::numeric_limits<int16_t>::min());
+
+    // saturating updates
+    QuantizedOccupancyPatch patch;
+    for(unsigned i = 0; i < 100; i++)
+        patch.updateLogOdds(0.85f, -2.f, 3.5f);
+    BOOST_CHECK_CLOSE(patch.getLogOdds(), 3.5f, 0.1);
+    for(unsigned i = 0; i < 100; i++)
+        patch.updateLogOdds(-0.4f, -2.f, 3.5f);
+    BOOST_CHECK_CLOSE(patch.getLogOdds(), -2.f, 0.1);
+
+    // probability table against the analytic solution
+    for(float log_odds = -6.f; log_odds < 6.f; log_odds += 0.137f)
+    {
+        QuantizedOccupancyPatch q(log_odds);
+        BOOST_CHECK_SMALL(q.getPropability() - OccupancyPatch::probability(log_odds), 0.005);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_quantized_occupancy_grid_map)
+{
+    Vector2ui num_cells(100, 100);
+    Eigen::Vector3d resolution(0.1, 0.1, 0.1);
+    OccupancyConfiguration config;
+
+    OccupancyGridMap grid(num_cells, resolution, config);
+    QuantizedOccupancyGridMap quantized_grid(num_cells, resolution, config);
+
+    Eigen::Vector3d sensor_origin(0.55, 0.55, 1.05);
+    for(unsigned i = 0; i < 5; i++)
+    {
+        for(double y = 1.0; y < 9.0; y += 0.5)
+        {
+            Eigen::Vector3d measurement(8.55, y, 0.25);
+            grid.mergePoint(sensor_origin, measurement);
+            quantized_grid.mergePoint(sensor_origin, measurement);
+        }
+    }
+
+    unsigned occupied = 0, free_space = 0;
+    for(double x = 0.05; x < 9.0; x += 0.1)
+    {
+        for(double y = 0.05; y < 9.0; y += 0.1)
+        {
+            for(double z = 0.05; z < 1.2; z += 0.1)
+            {
+                Eigen::Vector3d point(x, y, z);
+                BOOST_CHECK_EQUAL(grid.isOccupied(point), quantized_grid.isOccupied(point));
+                BOOST_CHECK_EQUAL(grid.isFreeSpace(point), quantized_grid.isFreeSpace(point));
+                occupied += grid.isOccupied(point);
+                free_space += grid.isFreeSpace(point);
+            }
+        }
+    }
+    BOOST_CHECK(occupied > 0);
+    BOOST_CHECK(free_space > 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_occupancy_batch_operations)
+{
+    Vector2ui num_cells(100, 100);
+    Eigen::Vector3d resolution(0.1, 0.1, 0.1);
+    OccupancyConfiguration config;
+
+    OccupancyGridMap grid(num_cells, resolution, config);
+    OccupancyGridMap batch_grid(num_cells, resolution, config);
+    grid.getLocalFrame().translation() << 0.5 * grid.getSize(), 0;
+    batch_grid.getLocalFrame().translation() << 0.5 * batch_grid.getSize(), 0;
+
+    Eigen::Vector3d sensor_origin(0.05, 0.05, 1.05);
+    std::vector<Eigen::Vector3d> measurements;
+    for(double y = -4.0; y < 4.0; y += 0.25)
+        measurements.push_back(Eigen::Vector3d(4.0, y, 0.25));
+    // outside of the grid
+    measurements.push_back(Eigen::Vector3d(6.0, 0.0, 0.25));
+
+    for(unsigned i = 0; i < 3; i++)
+    {
+        for(const Eigen::Vector3d& measurement : measurements)
+        {
+            try
+            {
+                grid.mergePoint(sensor_origin, measurement);
+            }
+            catch(const std::runtime_error& e) {}
+        }
+        batch_grid.mergePointCloud(sensor_origin, measurements);
+    }
+
+    std::vector<Eigen::Vector3d> points;
+    for(double x = -5.0; x < 5.0; x += 0.1)
+        for(double y = -5.0; y < 5.0; y += 0.1)
+            points.push_back(Eigen::Vector3d(x, y, 0.65));
+
+    std::vector<bool> free_space;
+    batch_grid.filterFreeSpace(points, free_space);
+    BOOST_REQUIRE_EQUAL(free_space.size(), points.size());
+
+    unsigned num_free = 0;
+    for(size_t i = 0; i < points.size(); i++)
+    {
+        bool expected = false;
+        try
+        {
+            expected = grid.isFreeSpace(points[i]);
+        }
+        catch(const std::runtime_error& e) {}
+        BOOST_CHECK_EQUAL(free_space[i], expected);
+        num_free += free_space[i];
+    }
+    BOOST_CHECK(num_free > 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_occupancy_pruning)
+{
+    Vector2ui num_cells(100, 100);
+    Eigen::Vector3d resolution(0.1, 0.1, 0.1);
+    OccupancyConfiguration config;
+
+    Eigen::Vector3d sensor_origin(0.55, 0.55, 1.05);
+    std::vector<Eigen::Vector3d> measurements;
+    for(double y = 1.0; y < 9.0; y += 0.1)
+        measurements.push_back(Eigen::Vector3d(8.55, y, 0.25));
+
+    OccupancyGridMap grid(num_cells, resolution, config);
+    for(unsigned i = 0; i < 10; i++)
+        grid.mergePointCloud(sensor_origin, measurements);
+    OccupancyGridMap pruned_grid(grid);
+    OccupancyGridMap incrementally_pruned_grid(grid);
+
+    // voxels with information are kept
+    const size_t num_voxels = grid.getNumVoxels();
+    BOOST_CHECK_EQUAL(pruned_grid.prune(), 0);
+    BOOST_CHECK_EQUAL(pruned_grid.getNumVoxels(), num_voxels);
+
+    // clamped free space
+    pruned_grid.setPruneFreeSpace(true);
+    const size_t num_removed = pruned_grid.prune();
+    BOOST_CHECK(num_removed > 0);
+    BOOST_CHECK_EQUAL(pruned_grid.getNumVoxels(), num_voxels - num_removed);
+    BOOST_CHECK(pruned_grid.getMemoryUsage() < grid.getMemoryUsage());
+
+    // spread over several calls
+    incrementally_pruned_grid.setPruneFreeSpace(true);
+    size_t num_incrementally_removed = 0;
+    for(unsigned i = 0; i < 100; i++)
+        num_incrementally_removed += incrementally_pruned_grid.prune(num_cells.x());
+    BOOST_CHECK_EQUAL(num_incrementally_removed, num_removed);
+
+    for(double x = 0.05; x < 9.0; x += 0.1)
+    {
+        for(double y = 0.05; y < 9.0; y += 0.1)
+        {
+            for(double z = 0.05; z < 1.2; z += 0.1)
+            {
+                Eigen::Vector3d point(x, y, z);
+                BOOST_CHECK_EQUAL(grid.isOccupied(point), pruned_grid.isOccupied(point));
+                BOOST_CHECK(!pruned_grid.isFreeSpace(point) || grid.isFreeSpace(point));
+            }
+        }
+    }
+
+    // the memory budget triggers the pruning
+    OccupancyGridMap budget_grid(num_cells, resolution, config);
+    budget_grid.setPruneFreeSpace(true);
+    budget_grid.setMemoryBudget(pruned_grid.getMemoryUsage() + 1);
+    for(unsigned i = 0; i < 10; i++)
+        budget_grid.mergePointCloud(sensor_origin, measurements);
+    // pruned voxels start from the prior again, so the budget isn't met after each cloud
+    BOOST_CHECK_LT(budget_grid.getNumVoxels(), grid.getNumVoxels());
+    BOOST_CHECK_GT(budget_grid.getNumVoxels(), pruned_grid.getNumVoxels());
+
+    // a budget which can't be met keeps all voxels
+    OccupancyGridMap unmet_budget_grid(num_cells, resolution, config);
+    unmet_budget_grid.setMemoryBudget(1);
+    for(unsigned i = 0; i < 10; i++)
+        unmet_budget_grid.mergePointCloud(sensor_origin, measurements);
+    BOOST_CHECK_EQUAL(unmet_budget_grid.getNumVoxels(), grid.getNumVoxels());
+
+    // setting the budget again retries the pruning
+    unmet_budget_grid.setPruneFreeSpace(true);
+    unmet_budget_grid.setMemoryBudget(pruned_grid.getMemoryUsage() + 1);
+    unmet_budget_grid.mergePointCloud(sensor_origin, measurements);
+    BOOST_CHECK_LT(unmet_budget_grid.getNumVoxels(), grid.getNumVoxels());
+}
+
+BOOST_AUTO_TEST_CASE(test_occupancy_interval_column)
+{
+    // random range updates against a dense column, 0 marks unknown voxels
+    const int32_t offset = 20;
+    std::vector<int32_t> dense(60, std::numeric_limits<int32_t>::min());
+    OccupancyIntervalColumn column;
+    srand(42);
+    for(unsigned i = 0; i < 2000; i++)
+    {
+        const int32_t begin = rand() % 60 - offset;
+        const int32_t end = std::min<int32_t>(begin + rand() % 8, 60 - offset);
+        const int16_t update = rand() % 2 ? 400 : -300;
+        column.update(begin, end, update, -2000, 3000);
+        for(int32_t z = begin; z < end; z++)
+        {
+            int32_t& value = dense[z + offset];
+            if(value == std::numeric_limits<int32_t>::min())
+                value = 0;
+            value = std::min(std::max(value + update, -2000), 3000);
+        }
+
+        for(int32_t z = -offset; z < 60 - offset; z++)
+        {
+            const OccupancyInterval* interval = column.find(z);
+            if(dense[z + offset] == std::numeric_limits<int32_t>::min())
+                BOOST_REQUIRE(interval == NULL);
+            else
+            {
+                BOOST_REQUIRE(interval != NULL);
+                BOOST_REQUIRE_EQUAL(interval->log_odds, dense[z + offset]);
+            }
+        }
+
+        // intervals are sorted, disjoint and adjacent ones differ
+        const std::vector<OccupancyInterval>& intervals = column.getIntervals();
+        for(size_t j = 0; j < intervals.size(); j++)
+        {
+            BOOST_REQUIRE_LT(intervals[j].begin, intervals[j].end);
+            if(j > 0)
+            {
+                BOOST_REQUIRE_LE(intervals[j - 1].end, intervals[j].begin);
+                BOOST_REQUIRE(intervals[j - 1].end != intervals[j].begin || intervals[j - 1].log_odds != intervals[j].log_odds);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_interval_occupancy_grid_map)
+{
+    Vector2ui num_cells(100, 100);
+    Eigen::Vector3d resolution(0.1, 0.1, 0.1);
+    OccupancyConfiguration config;
+
+    QuantizedOccupancyGridMap voxel_grid(num_cells, resolution, config);
+    boost::shared_ptr<IntervalOccupancyGridMap> interval_grid(new IntervalOccupancyGridMap(num_cells, resolution, config));
+    voxel_grid.getLocalFrame().translation() << 0.5 * voxel_grid.getSize(), 0;
+    interval_grid->getLocalFrame().translation() << 0.5 * interval_grid->getSize(), 0;
+
+    // usable as free space map
+    boost::shared_ptr<OccupancyGridMapBase> base = interval_grid;
+    BOOST_CHECK(base->hasSameFrame(voxel_grid.getLocalFrame(), num_cells, voxel_grid.getResolution()));
+
+    // repeated scans of a static scene from slightly varying positions
+    srand(42);
+    std::vector<Eigen::Vector3d> measurements;
+    for(unsigned j = 0; j < 500; j++)
+    {
+        const Eigen::Vector2d direction = Eigen::Vector2d::Random().normalized();
+        measurements.push_back(Eigen::Vector3d(4.5 * direction.x(), 4.5 * direction.y(), 1.5 * Eigen::Vector2d::Random().x()));
+    }
+    for(unsigned i = 0; i < 20; i++)
+    {
+        const Eigen::Vector3d sensor_origin = Eigen::Vector3d(0., 0., 1.) + 0.05 * Eigen::Vector3d::Random();
+        voxel_grid.mergePointCloud(sensor_origin, measurements);
+        base->mergePointCloud(sensor_origin, measurements);
+    }
+
+    // same log-odds in every voxel
+    size_t num_voxels = 0;
+    for(unsigned int y = 0; y < num_cells.y(); ++y)
+    {
+        for(unsigned int x = 0; x < num_cells.x(); ++x)
+        {
+            const DiscreteTree<QuantizedOccupancyPatch>& tree = voxel_grid.at(x, y);
+            for(const std::pair<const int32_t, QuantizedOccupancyPatch>& voxel : tree)
+            {
+                OccupancyInterval::LogOddsType log_odds;
+                BOOST_REQUIRE(interval_grid->getEncodedLogOdds(Eigen::Vector3i(x, y, voxel.first), log_odds));
+                BOOST_CHECK_EQUAL(log_odds, voxel.second.getEncodedLogOdds());
+            }
+            num_voxels += tree.size();
+        }
+    }
+    BOOST_CHECK_EQUAL(interval_grid->getNumVoxels(), num_voxels);
+    // the rays are almost horizontal, so the free space runs in a column are short
+    BOOST_CHECK_LT(interval_grid->getNumIntervals(), num_voxels * 2 / 3);
+
+    std::vector<Eigen::Vector3d> points;
+    for(double x = -5.0; x < 5.0; x += 0.1)
+        for(double y = -5.0; y < 5.0; y += 0.1)
+            for(double z = -1.55; z < 1.6; z += 0.3)
+                points.push_back(Eigen::Vector3d(x, y, z));
+
+    std::vector<bool> free_space, expected_free_space;
+    base->filterFreeSpace(points, free_space);
+    voxel_grid.filterFreeSpace(points, expected_free_space);
+    BOOST_CHECK(free_space == expected_free_space);
+    for(const Eigen::Vector3d& point : points)
+    {
+        BOOST_CHECK_EQUAL(base->isOccupied(point), voxel_grid.isOccupied(point));
+        BOOST_CHECK_EQUAL(base->isFreeSpace(point), voxel_grid.isFreeSpace(point));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_occupancy_range_limits)
+{
+    Vector2ui num_cells(100, 100);
+    Eigen::Vector3d resolution(0.1, 0.1, 0.1);
+    OccupancyConfiguration config;
+    config.max_range = 3.f;
+    config.min_range = 1.f;
+
+    OccupancyGridMap grid(num_cells, resolution, config);
+    IntervalOccupancyGridMap interval_grid(num_cells, resolution, config);
+    grid.getLocalFrame().translation() << 0.5 * grid.getSize(), 0;
+    interval_grid.getLocalFrame().translation() << 0.5 * interval_grid.getSize(), 0;
+    OccupancyGridMapBase* maps[2] = {&grid, &interval_grid};
+
+    // off the voxel centers, rays ending exactly on one are dropped by the traversal
+    const Eigen::Vector3d sensor_origin(0.02, 0.03, 1.04);
+    for(OccupancyGridMapBase* map : maps)
+    {
+        for(unsigned i = 0; i < 5; i++)
+        {
+            // beyond the maximum range and outside of the grid
+            map->mergePoint(sensor_origin, Eigen::Vector3d(4.02, 0.03, 1.04));
+            map->mergePoint(sensor_origin, Eigen::Vector3d(0.02, 10.03, 1.04));
+            // within the range limits
+            map->mergePoint(sensor_origin, Eigen::Vector3d(-2.02, 0.03, 1.04));
+            // within the minimum range
+            map->mergePoint(sensor_origin, Eigen::Vector3d(0.02, -0.57, 1.04));
+        }
+
+        // the rays start at the minimum range
+        BOOST_CHECK(!map->isFreeSpace(Eigen::Vector3d(0.55, 0.05, 1.05)));
+        BOOST_CHECK(map->isFreeSpace(Eigen::Vector3d(1.55, 0.05, 1.05)));
+        BOOST_CHECK(map->isFreeSpace(Eigen::Vector3d(2.85, 0.05, 1.05)));
+        BOOST_CHECK(map->isFreeSpace(Eigen::Vector3d(0.05, 2.85, 1.05)));
+        BOOST_CHECK(map->isFreeSpace(Eigen::Vector3d(-1.55, 0.05, 1.05)));
+
+        // no updates beyond the maximum range
+        BOOST_CHECK(!map->isFreeSpace(Eigen::Vector3d(3.55, 0.05, 1.05)));
+        BOOST_CHECK(!map->isOccupied(Eigen::Vector3d(4.02, 0.03, 1.04)));
+        BOOST_CHECK(!map->isFreeSpace(Eigen::Vector3d(0.05, 3.55, 1.05)));
+
+        BOOST_CHECK(map->isOccupied(Eigen::Vector3d(-2.02, 0.03, 1.04)));
+        BOOST_CHECK(!map->isOccupied(Eigen::Vector3d(0.02, -0.57, 1.04)));
+        BOOST_CHECK(!map->isFreeSpace(Eigen::Vector3d(0.05, -0.35, 1.05)));
+    }
+
+    // rays without return are clipped to the grid
+    OccupancyGridMap unlimited_grid(num_cells, resolution, OccupancyConfiguration());
+    IntervalOccupancyGridMap unlimited_interval_grid(num_cells, resolution, OccupancyConfiguration());
+    unlimited_grid.getLocalFrame().translation() << 0.5 * unlimited_grid.getSize(), 0;
+    unlimited_interval_grid.getLocalFrame().translation() << 0.5 * unlimited_interval_grid.getSize(), 0;
+    OccupancyGridMapBase* unlimited_maps[2] = {&unlimited_grid, &unlimited_interval_grid};
+    for(OccupancyGridMapBase* map : unlimited_maps)
+    {
+        for(unsigned i = 0; i < 5; i++)
+            map->mergeFreeSpaceRay(sensor_origin, Eigen::Vector3d(20.02, 0.03, 1.04));
+        BOOST_CHECK(map->isFreeSpace(Eigen::Vector3d(0.55, 0.05, 1.05)));
+        BOOST_CHECK(map->isFreeSpace(Eigen::Vector3d(4.95, 0.05, 1.05)));
+        BOOST_CHECK_THROW(map->mergePoint(sensor_origin, Eigen::Vector3d(20.02, 0.03, 1.04)), std::runtime_error);
+    }
+
+    // far ends are clipped before the traversal, also for grids which aren't centered at the origin
+    OccupancyGridMap shifted_grid(num_cells, resolution, OccupancyConfiguration());
+    IntervalOccupancyGridMap shifted_interval_grid(num_cells, resolution, OccupancyConfiguration());
+    shifted_grid.getLocalFrame().translation() << 2.0, 7.0, 0;
+    shifted_interval_grid.getLocalFrame().translation() << 2.0, 7.0, 0;
+    OccupancyGridMapBase* shifted_maps[2] = {&shifted_grid, &shifted_interval_grid};
+    for(OccupancyGridMapBase* map : shifted_maps)
+    {
+        for(unsigned i = 0; i < 5; i++)
+        {
+            map->mergeFreeSpaceRay(sensor_origin, Eigen::Vector3d(1e12, 0.03, 1.04));
+            map->mergeFreeSpaceRay(sensor_origin, Eigen::Vector3d(-1e12, 0.03, 1.04));
+            map->mergeFreeSpaceRay(sensor_origin, Eigen::Vector3d(0.02, -1e12, 1.04));
+        }
+        BOOST_CHECK(map->isFreeSpace(Eigen::Vector3d(7.95, 0.05, 1.05)));
+        BOOST_CHECK(map->isFreeSpace(Eigen::Vector3d(-1.95, 0.05, 1.05)));
+        BOOST_CHECK(map->isFreeSpace(Eigen::Vector3d(0.05, -6.95, 1.05)));
+        BOOST_CHECK(!map->isFreeSpace(Eigen::Vector3d(0.05, 2.95, 1.05)));
+
+        // non-finite ends are rejected
+        BOOST_CHECK_THROW(map->mergeFreeSpaceRay(sensor_origin, Eigen::Vector3d(NAN, 0.03, 1.04)), std::runtime_error);
+        BOOST_CHECK_THROW(map->mergeFreeSpaceRay(sensor_origin, Eigen::Vector3d(0.02, std::numeric_limits<double>::infinity(), 1.04)), std::runtime_error);
+        BOOST_CHECK_THROW(map->mergePoint(sensor_origin, Eigen::Vector3d(0.02, 0.03, NAN)), std::runtime_error);
+    }
+}
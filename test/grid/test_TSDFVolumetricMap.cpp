@@ -0,0 +1,206 @@
+#define BOOST_TEST_MODULE GridTest
+#include <boost/test/unit_test.hpp>
+
+#include <maps/grid/TSDFVolumetricMap.hpp>
+
+#include <chrono>
+
+using namespace ::maps::grid;
+
+namespace
+{
+    TSDFVolumetricMap createMap(float truncation)
+    {
+        TSDFVolumetricMap map(Vector2ui(200, 200), Vector3d(0.05, 0.05, 0.05), truncation);
+        map.getLocalFrame().translation() << 0.5 * map.getSize(), 0;
+        return map;
+    }
+
+    size_t countVoxels(const TSDFVolumetricMap& map)
+    {
+        size_t count = 0;
+        for(const DiscreteTree<TSDFPatch>& tree : map)
+            count += tree.size();
+        return count;
+    }
+
+    /** Rays from the left side of the map to a wall on the right side */
+    void createRays(std::vector<Eigen::Vector3d>& origins, std::vector<Eigen::Vector3d>& measurements, size_t count)
+    {
+        srand(42);
+        for(size_t i = 0; i < count; ++i)
+        {
+            origins.push_back(Eigen::Vector3d(-4.5, 0., 1.) + 0.2 * Eigen::Vector3d::Random());
+            const Eigen::Vector2d wall = 4. * Eigen::Vector2d::Random();
+            measurements.push_back(Eigen::Vector3d(4.5, wall.x(), 1. + 0.2 * wall.y()));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_truncation_band_integration)
+{
+    std::vector<Eigen::Vector3d> origins, measurements;
+    createRays(origins, measurements, 20);
+
+    for(size_t i = 0; i < origins.size(); ++i)
+    {
+        TSDFVolumetricMap full = createMap(0.2f);
+        TSDFVolumetricMap band = createMap(0.2f);
+        band.setIntegrationMode(TSDFVolumetricMap::TRUNCATION_BAND);
+
+        full.mergePoint(origins[i], measurements[i]);
+        band.mergePoint(origins[i], measurements[i]);
+
+        // the voxels of the band are updated exactly like in full ray mode
+        for(unsigned int y = 0; y < band.getNumCells().y(); ++y)
+        {
+            for(unsigned int x = 0; x < band.getNumCells().x(); ++x)
+            {
+                for(const std::pair<const int32_t, TSDFPatch>& voxel : band.at(x, y))
+                {
+                    BOOST_REQUIRE(full.at(x, y).hasCell(voxel.first));
+                    const TSDFPatch& expected = full.at(x, y).getCellAt(voxel.first);
+                    BOOST_CHECK_EQUAL(voxel.second.getDistance(), expected.getDistance());
+                    BOOST_CHECK_EQUAL(voxel.second.getVariance(), expected.getVariance());
+                    BOOST_CHECK_LE(std::abs(voxel.second.getDistance()), 0.2f + 0.1f);
+                }
+            }
+        }
+
+        BOOST_CHECK_LT(countVoxels(band), countVoxels(full) / 5);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_voxel_update)
+{
+    std::vector<Eigen::Vector3d> origins, measurements;
+    createRays(origins, measurements, 20);
+
+    for(size_t i = 0; i < origins.size(); ++i)
+    {
+        TSDFVolumetricMap map = createMap(0.2f);
+        map.mergePoint(origins[i], measurements[i], 0.01);
+
+        const Eigen::Vector3d normal = (measurements[i] - origins[i]).normalized();
+        const double ray_length = (measurements[i] - origins[i]).norm();
+        const float res_sigma_inv = (5.2f * 5.2f) / (2.f * map.getVoxelResolution().squaredNorm());
+        for(unsigned int y = 0; y < map.getNumCells().y(); ++y)
+        {
+            for(unsigned int x = 0; x < map.getNumCells().x(); ++x)
+            {
+                for(const std::pair<const int32_t, TSDFPatch>& voxel : map.at(x, y))
+                {
+                    Eigen::Vector3d cell_center;
+                    BOOST_REQUIRE(map.fromVoxelGrid(Eigen::Vector3i(x, y, voxel.first), cell_center));
+
+                    // reference: projection of the sensor origin on the plane through the cell center
+                    Eigen::Hyperplane<double, 3> plane(normal, cell_center);
+                    Eigen::Vector3d point_on_ray = plane.projection(origins[i]);
+                    const float phi = std::exp(-(point_on_ray - cell_center).squaredNorm() * res_sigma_inv);
+
+                    TSDFPatch expected;
+                    expected.update(ray_length - (point_on_ray - origins[i]).norm(), 0.01 / phi, 0.2f);
+                    BOOST_CHECK_CLOSE(voxel.second.getDistance(), expected.getDistance(), 1e-3);
+
+                    // the last voxel of a ray can be updated twice
+                    const float single_update = expected.getVariance();
+                    expected.update(ray_length - (point_on_ray - origins[i]).norm(), 0.01 / phi, 0.2f);
+                    BOOST_CHECK(std::abs(voxel.second.getVariance() / single_update - 1.f) < 1e-3 ||
+                                std::abs(voxel.second.getVariance() / expected.getVariance() - 1.f) < 1e-3);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_free_space_carving)
+{
+    TSDFVolumetricMap band = createMap(0.2f);
+    band.setIntegrationMode(TSDFVolumetricMap::TRUNCATION_BAND);
+    band.setFreeSpaceStride(4);
+    BOOST_CHECK_EQUAL(band.getFreeSpaceStride(), 4);
+
+    const Eigen::Vector3d origin(-4.5, 0.01, 1.01);
+    const Eigen::Vector3d measurement(4.5, 0.01, 1.01);
+    band.mergePoint(origin, measurement);
+
+    TSDFVolumetricMap no_carving = createMap(0.2f);
+    no_carving.setIntegrationMode(TSDFVolumetricMap::TRUNCATION_BAND);
+    no_carving.mergePoint(origin, measurement);
+
+    // about one voxel every 4 voxels in front of the band
+    const size_t carved = countVoxels(band) - countVoxels(no_carving);
+    BOOST_CHECK_GT(carved, 40);
+    BOOST_CHECK_LT(carved, 50);
+
+    // carved voxels are set to the truncation distance
+    const Eigen::Vector3d free_space(-2., 0.01, 1.01);
+    Eigen::Vector3i idx;
+    for(int i = 0; i < 4; ++i)
+    {
+        BOOST_REQUIRE(band.toVoxelGrid(free_space + Eigen::Vector3d(i * 0.05, 0., 0.), idx));
+        if(band.hasVoxelCell(idx))
+            BOOST_CHECK_CLOSE(band.getVoxelCell(idx).getDistance(), 0.2f, 1e-3);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_pruning)
+{
+    std::vector<Eigen::Vector3d> origins, measurements;
+    createRays(origins, measurements, 50);
+
+    TSDFVolumetricMap map = createMap(0.2f);
+    for(size_t i = 0; i < origins.size(); ++i)
+        map.mergePoint(origins[i], measurements[i]);
+    TSDFVolumetricMap pruned(map);
+
+    // spread over several calls
+    size_t num_removed = 0;
+    for(unsigned int i = 0; i < pruned.getNumCells().y(); ++i)
+        num_removed += pruned.prune(pruned.getNumCells().x());
+    BOOST_CHECK_GT(num_removed, 0);
+    BOOST_CHECK_EQUAL(countVoxels(pruned), countVoxels(map) - num_removed);
+    BOOST_CHECK_EQUAL(pruned.prune(), 0);
+
+    // only the voxels close to the surface are kept
+    for(unsigned int y = 0; y < map.getNumCells().y(); ++y)
+    {
+        for(unsigned int x = 0; x < map.getNumCells().x(); ++x)
+        {
+            for(const std::pair<const int32_t, TSDFPatch>& voxel : map.at(x, y))
+            {
+                const bool near_surface = voxel.second.getDistance() < 0.2f;
+                BOOST_CHECK_EQUAL(pruned.at(x, y).hasCell(voxel.first), near_surface);
+                if(near_surface)
+                    BOOST_CHECK_EQUAL(pruned.at(x, y).getCellAt(voxel.first).getDistance(), voxel.second.getDistance());
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_truncation_band_benchmark)
+{
+    std::vector<Eigen::Vector3d> origins, measurements;
+    createRays(origins, measurements, 5000);
+
+    TSDFVolumetricMap full = createMap(0.2f);
+    TSDFVolumetricMap band = createMap(0.2f);
+    band.setIntegrationMode(TSDFVolumetricMap::TRUNCATION_BAND);
+    TSDFVolumetricMap carving = createMap(0.2f);
+    carving.setIntegrationMode(TSDFVolumetricMap::TRUNCATION_BAND);
+    carving.setFreeSpaceStride(8);
+
+    TSDFVolumetricMap* maps[3] = {&full, &band, &carving};
+    const char* names[3] = {"full ray", "truncation band", "truncation band + carving"};
+    for(int m = 0; m < 3; ++m)
+    {
+        auto start = std::chrono::system_clock::now();
+        for(size_t i = 0; i < origins.size(); ++i)
+            maps[m]->mergePoint(origins[i], measurements[i]);
+        auto end = std::chrono::system_clock::now();
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+        std::cout << "TSDF integration of " << origins.size() << " 9m rays, " << names[m] << ": "
+                  << elapsed.count() << "ms, " << countVoxels(*maps[m]) << " voxels" << std::endl;
+    }
+}
@@ -0,0 +1,149 @@
+#define BOOST_TEST_MODULE GridTest
+#include <boost/test/unit_test.hpp>
+
+#include <maps/grid/TraversabilityMap3d.hpp>
+
+using namespace ::maps::grid;
+
+typedef TraversabilityMap3d<TraversabilityNodeBase *> TravMap;
+
+struct TravMapFixture
+{
+    TravMapFixture()
+        : map(Vector2ui(10, 10), Eigen::Vector2d(0.1, 0.1), boost::shared_ptr<maps::LocalMapData>(new maps::LocalMapData()))
+    {
+        // two levels in each cell, connected to the same level of the 4-neighbours
+        for(int y = 0; y < 10; ++y)
+        {
+            for(int x = 0; x < 10; ++x)
+            {
+                for(int level = 0; level < 2; ++level)
+                {
+                    TraversabilityNodeBase *node = new TraversabilityNodeBase(level * 2.f + x * 0.01f, Index(x, y));
+                    node->setType(level == 0 ? TraversabilityNodeBase::TRAVERSABLE : TraversabilityNodeBase::OBSTACLE);
+                    map.at(x, y).insert(node);
+                    nodes.push_back(node);
+                }
+            }
+        }
+        for(TraversabilityNodeBase *node : nodes)
+        {
+            const Index &idx = node->getIndex();
+            const Index neighbours[4] = {idx + Index(1, 0), idx + Index(-1, 0), idx + Index(0, 1), idx + Index(0, -1)};
+            for(const Index &n : neighbours)
+            {
+                if(!n.isInside(map.getNumCells()))
+                    continue;
+                for(TraversabilityNodeBase *other : map.at(n))
+                    if(other->getType() == node->getType())
+                        node->addConnection(other);
+            }
+        }
+    }
+
+    ~TravMapFixture()
+    {
+        for(TraversabilityNodeBase *node : nodes)
+            delete node;
+    }
+
+    TravMap map;
+    std::vector<TraversabilityNodeBase *> nodes;
+};
+
+BOOST_FIXTURE_TEST_CASE(test_compact_graph, TravMapFixture)
+{
+    std::vector<const TraversabilityNodeBase *> source;
+    const CompactTraversabilityGraph graph = map.compact(&source);
+
+    BOOST_REQUIRE_EQUAL(graph.getNumNodes(), nodes.size());
+    BOOST_REQUIRE_EQUAL(source.size(), nodes.size());
+
+    size_t num_connections = 0;
+    for(const TraversabilityNodeBase *node : nodes)
+        num_connections += node->getConnections().size();
+    BOOST_CHECK_EQUAL(graph.getNumConnections(), num_connections);
+
+    for(const CompactTraversabilityNode *node : graph.getNodes())
+    {
+        const TraversabilityNodeBase *orig = source[graph.getNodeId(node)];
+        BOOST_CHECK_EQUAL(node->getIndex(), orig->getIndex());
+        BOOST_CHECK_EQUAL(node->getHeight(), orig->getHeight());
+        BOOST_CHECK_EQUAL(node->getType(), orig->getType());
+        BOOST_CHECK_EQUAL(node->isExpanded(), false);
+        BOOST_CHECK(map.getNodePosition(node).isApprox(map.getNodePosition(orig)));
+
+        // the connections refer to the same nodes in the same order
+        BOOST_REQUIRE_EQUAL(graph.getConnections(node).size(), orig->getConnections().size());
+        size_t i = 0;
+        for(const CompactTraversabilityNode *con : graph.getConnections(node))
+        {
+            BOOST_CHECK_EQUAL(source[graph.getNodeId(con)], orig->getConnections()[i]);
+            ++i;
+        }
+
+        const Index right = node->getIndex() + Index(1, 0);
+        const CompactTraversabilityNode *connected = graph.getConnectedNode(node, right);
+        if(right.x() < 10)
+        {
+            BOOST_REQUIRE(connected != nullptr);
+            BOOST_CHECK_EQUAL(source[graph.getNodeId(connected)], orig->getConnectedNode(right));
+        }
+        else
+            BOOST_CHECK(connected == nullptr);
+    }
+
+    // the nodes of a cell are ordered by height
+    for(int y = 0; y < 10; ++y)
+    {
+        for(int x = 0; x < 10; ++x)
+        {
+            CompactTraversabilityGraph::NodeRange<const CompactTraversabilityNode> cell = graph.getNodes(Index(x, y));
+            BOOST_REQUIRE_EQUAL(cell.size(), 2);
+            float last_height = -1.f;
+            for(const CompactTraversabilityNode *node : cell)
+            {
+                BOOST_CHECK_EQUAL(node->getIndex(), Index(x, y));
+                BOOST_CHECK_GT(node->getHeight(), last_height);
+                last_height = node->getHeight();
+            }
+        }
+    }
+    BOOST_CHECK_THROW(graph.getNodes(Index(10, 0)), std::out_of_range);
+}
+
+BOOST_FIXTURE_TEST_CASE(test_compact_graph_flags, TravMapFixture)
+{
+    nodes[3]->setExpanded();
+    nodes[4]->setType(TraversabilityNodeBase::HOLE);
+    std::vector<const TraversabilityNodeBase *> source;
+    CompactTraversabilityGraph graph = map.compact(&source);
+
+    for(CompactTraversabilityNode *node : graph.getNodes())
+    {
+        BOOST_CHECK_EQUAL(node->isExpanded(), source[graph.getNodeId(node)] == nodes[3]);
+        BOOST_CHECK_EQUAL(node->getType(), source[graph.getNodeId(node)]->getType());
+
+        node->setExpanded();
+        node->setType(TraversabilityNodeBase::UNSET);
+        BOOST_CHECK_EQUAL(node->isExpanded(), true);
+        BOOST_CHECK_EQUAL(node->getType(), TraversabilityNodeBase::UNSET);
+    }
+
+    graph.setAllNotExpanded();
+    for(const CompactTraversabilityNode *node : graph.getNodes())
+    {
+        BOOST_CHECK_EQUAL(node->isExpanded(), false);
+        BOOST_CHECK_EQUAL(node->getType(), TraversabilityNodeBase::UNSET);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_compact_graph_missing_node)
+{
+    TraversabilityNodeBase a(0.f, Index(0, 0));
+    TraversabilityNodeBase b(0.f, Index(1, 0));
+    a.addConnection(&b);
+
+    std::vector<const TraversabilityNodeBase *> nodes(1, &a);
+    BOOST_CHECK_THROW(CompactTraversabilityGraph(Vector2ui(2, 1), nodes), std::runtime_error);
+}
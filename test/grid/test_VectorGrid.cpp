@@ -74,3 +74,97 @@ BOOST_AUTO_TEST_CASE(test_get_range)
     BOOST_CHECK(range.first == (vector_grid.begin() + 1));
     BOOST_CHECK(range.second == (vector_grid.end() - 1)); 
 }
+
+BOOST_AUTO_TEST_CASE(test_unchecked_access_and_rows)
+{
+    VectorGrid<int> vector_grid(Vector2ui(5, 3), -1);
+    for(unsigned int y = 0; y < 3; ++y)
+        for(unsigned int x = 0; x < 5; ++x)
+            vector_grid.at(x, y) = x + 10 * y;
+
+    for(unsigned int y = 0; y < 3; ++y)
+    {
+        VectorGrid<int>::ConstRowSpan row = static_cast<const VectorGrid<int>&>(vector_grid).getRow(y);
+        BOOST_REQUIRE_EQUAL(row.size, 5);
+        for(unsigned int x = 0; x < 5; ++x)
+        {
+            BOOST_CHECK_EQUAL(vector_grid.atUnchecked(x, y), vector_grid.at(x, y));
+            BOOST_CHECK_EQUAL(vector_grid.atUnchecked(Index(x, y)), vector_grid.at(Index(x, y)));
+            BOOST_CHECK_EQUAL(&row[x], &vector_grid.at(x, y));
+        }
+    }
+
+    // rows are writable
+    for(int& cell : vector_grid.getRow(1))
+        cell = 7;
+    BOOST_CHECK_EQUAL(vector_grid.at(0, 1), 7);
+    BOOST_CHECK_EQUAL(vector_grid.at(4, 1), 7);
+    BOOST_CHECK_EQUAL(vector_grid.at(4, 0), 4);
+    BOOST_CHECK_EQUAL(vector_grid.at(0, 2), 20);
+
+    BOOST_CHECK_THROW(vector_grid.getRow(3), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_visit_tiles)
+{
+    VectorGrid<int> vector_grid(Vector2ui(7, 5), 0);
+
+    // each cell is covered by exactly one tile
+    std::vector<int> visits(7 * 5, 0);
+    size_t num_tiles = 0;
+    vector_grid.visitTiles(Vector2ui(3, 2), [&](const Index& tile_min, const Index& tile_max)
+    {
+        BOOST_CHECK((tile_max.array() - tile_min.array() <= Eigen::Array2i(3, 2)).all());
+        BOOST_CHECK((tile_min.array() < tile_max.array()).all());
+        for(int y = tile_min.y(); y < tile_max.y(); ++y)
+            for(int x = tile_min.x(); x < tile_max.x(); ++x)
+                visits[x + y * 7]++;
+        num_tiles++;
+    });
+    BOOST_CHECK_EQUAL(num_tiles, 3 * 3);
+    for(int count : visits)
+        BOOST_CHECK_EQUAL(count, 1);
+
+    // tiles larger than the grid
+    num_tiles = 0;
+    vector_grid.visitTiles(Vector2ui(10, 10), [&](const Index& tile_min, const Index& tile_max)
+    {
+        BOOST_CHECK_EQUAL(tile_min, Index(0, 0));
+        BOOST_CHECK_EQUAL(tile_max, Index(7, 5));
+        num_tiles++;
+    });
+    BOOST_CHECK_EQUAL(num_tiles, 1);
+
+    BOOST_CHECK_THROW(vector_grid.visitTiles(Vector2ui(0, 2), [](const Index&, const Index&) {}), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_modification_tracking)
+{
+    VectorGrid<int> vector_grid(Vector2ui(4, 6), -1);
+    vector_grid.at(1, 1) = 3;
+    BOOST_CHECK(!vector_grid.hasModifiedRows());
+
+    vector_grid.setModificationTracking(true);
+    const VectorGrid<int>& const_grid = vector_grid;
+    BOOST_CHECK_EQUAL(const_grid.at(1, 1), 3);
+    BOOST_CHECK(!vector_grid.hasModifiedRows());
+
+    vector_grid.at(2, 3) = 5;
+    vector_grid.getRow(5)[0] = 1;
+    BOOST_CHECK(vector_grid.hasModifiedRows());
+    BOOST_CHECK(!vector_grid.hasAllRowsModified());
+    for(unsigned int y = 0; y < 6; ++y)
+        BOOST_CHECK_EQUAL(vector_grid.isRowModified(y), y == 3 || y == 5);
+
+    vector_grid.resetModifiedRows();
+    BOOST_CHECK(!vector_grid.hasModifiedRows());
+    BOOST_CHECK(!vector_grid.isRowModified(3));
+
+    vector_grid.resize(Vector2ui(4, 8));
+    BOOST_CHECK(vector_grid.hasAllRowsModified());
+    BOOST_CHECK(vector_grid.isRowModified(7));
+
+    vector_grid.setModificationTracking(false);
+    vector_grid.clear();
+    BOOST_CHECK(!vector_grid.hasModifiedRows());
+}
@@ -0,0 +1,100 @@
+#define BOOST_TEST_MODULE OperationsTest
+#include <boost/test/unit_test.hpp>
+
+#include <maps/operations/GridInterpolation.hpp>
+
+using namespace ::maps::grid;
+using ::maps::operations::GridInterpolation;
+
+static double plane(int x, int y)
+{
+    return 0.1 * x - 0.05 * y + 2.0;
+}
+
+/** Samples of a plane on the corners and inside of the cells [10, 70] x [10, 50] */
+static GridMapF createSampledPlane(float default_value)
+{
+    GridMapF grid(Vector2ui(80, 60), Vector2d(0.1, 0.1), default_value);
+    const Index corners[] = {Index(10, 10), Index(70, 10), Index(10, 50), Index(70, 50)};
+    for(const Index& corner : corners)
+        grid.at(corner) = plane(corner.x(), corner.y());
+
+    srand(42);
+    for(int i = 0; i < 80; ++i)
+    {
+        const Index idx(11 + rand() % 59, 11 + rand() % 39);
+        grid.at(idx) = plane(idx.x(), idx.y());
+    }
+    return grid;
+}
+
+BOOST_AUTO_TEST_CASE(test_interpolate)
+{
+    for(float default_value : {(float)NAN, std::numeric_limits<float>::infinity()})
+    {
+        GridMapF grid = createSampledPlane(default_value);
+        GridInterpolation::interpolate(grid, 4);
+
+        // the convex hull of the samples is filled with the plane, the rest stays empty
+        for(unsigned int y = 0; y < 60; ++y)
+        {
+            for(unsigned int x = 0; x < 80; ++x)
+            {
+                if(x >= 10 && x <= 70 && y >= 10 && y <= 50)
+                {
+                    BOOST_REQUIRE(!grid.isDefault(grid.at(x, y)));
+                    BOOST_CHECK_SMALL(grid.at(x, y) - plane(x, y), 1e-4);
+                }
+                else
+                    BOOST_CHECK(grid.isDefault(grid.at(x, y)));
+            }
+        }
+    }
+
+    // the interpolation doesn't depend on the number of threads
+    GridMapF single = createSampledPlane(NAN);
+    GridMapF multi = createSampledPlane(NAN);
+    for(unsigned int x = 0; x < 80; ++x)
+    {
+        single.at(x, 30) += 0.3 * std::sin(x);
+        multi.at(x, 30) += 0.3 * std::sin(x);
+    }
+    GridInterpolation::interpolate(single, 1);
+    GridInterpolation::interpolate(multi, 8);
+    BOOST_CHECK(std::equal(single.begin(), single.end(), multi.begin(), [](float a, float b)
+    {
+        return a == b || (std::isnan(a) && std::isnan(b));
+    }));
+}
+
+BOOST_AUTO_TEST_CASE(test_interpolate_push_pull)
+{
+    GridMapF grid = createSampledPlane(NAN);
+    const GridMapF samples(grid);
+    GridInterpolation::interpolatePushPull(grid, 4);
+
+    float min = samples.getMin(false), max = samples.getMax(false);
+    for(unsigned int y = 0; y < 60; ++y)
+    {
+        for(unsigned int x = 0; x < 80; ++x)
+        {
+            BOOST_REQUIRE(!grid.isDefault(grid.at(x, y)));
+            if(!samples.isDefault(samples.at(x, y)))
+                BOOST_CHECK_EQUAL(grid.at(x, y), samples.at(x, y));
+            BOOST_CHECK(grid.at(x, y) >= min - 1e-4 && grid.at(x, y) <= max + 1e-4);
+        }
+    }
+
+    // a constant grid is filled with the constant
+    GridMap<int> constant(Vector2ui(37, 21), Vector2d(0.1, 0.1), -1);
+    constant.at(3, 4) = 5;
+    constant.at(30, 17) = 5;
+    GridInterpolation::interpolatePushPull(constant);
+    for(int value : constant)
+        BOOST_CHECK_EQUAL(value, 5);
+
+    // a grid without values stays empty
+    GridMapF empty(Vector2ui(10, 10), Vector2d(0.1, 0.1), NAN);
+    GridInterpolation::interpolatePushPull(empty);
+    BOOST_CHECK(std::isnan(empty.at(5, 5)));
+}
@@ -0,0 +1,164 @@
+#define BOOST_TEST_MODULE OperationsTest
+#include <boost/test/unit_test.hpp>
+
+#include <maps/operations/GridStencil.hpp>
+
+using namespace ::maps::grid;
+using ::maps::operations::GridStencil;
+
+static GridMapF createGrid(float default_value)
+{
+    GridMapF grid(Vector2ui(150, 90), Vector2d(0.1, 0.1), default_value);
+    for(unsigned int y = 0; y < 90; ++y)
+        for(unsigned int x = 0; x < 150; ++x)
+            grid.at(x, y) = std::sin(x * 0.1) * std::cos(y * 0.07);
+    for(unsigned int y = 40; y < 44; ++y)
+        for(unsigned int x = 70; x < 75; ++x)
+            grid.at(x, y) = default_value;
+    return grid;
+}
+
+BOOST_AUTO_TEST_CASE(test_apply)
+{
+    GridMapF grid = createGrid(NAN);
+
+    // count the cells with value in the 3x3 neighborhood
+    GridMap<int> counts(grid, VectorGrid<int>(grid.getNumCells(), -1));
+    GridStencil::apply(grid, counts, 1, [](const GridStencil::Neighborhood<float>& n)
+    {
+        int count = 0;
+        for(int dy = -1; dy <= 1; ++dy)
+            for(int dx = -1; dx <= 1; ++dx)
+                count += !n.isDefault(dx, dy);
+        return count;
+    }, GridStencil::BORDER_DEFAULT, 4);
+
+    BOOST_CHECK_EQUAL(counts.at(10, 10), 9);
+    BOOST_CHECK_EQUAL(counts.at(0, 0), 4);
+    BOOST_CHECK_EQUAL(counts.at(149, 50), 6);
+    BOOST_CHECK_EQUAL(counts.at(69, 39), 8);
+    BOOST_CHECK_EQUAL(counts.at(72, 42), 0);
+
+    // clamped borders repeat the border cells
+    GridMapF shifted = GridStencil::apply(grid, 2, [](const GridStencil::Neighborhood<float>& n)
+    {
+        return n(-2, 0);
+    }, GridStencil::BORDER_CLAMP);
+    BOOST_CHECK_EQUAL(shifted.at(0, 5), grid.at(0, 5));
+    BOOST_CHECK_EQUAL(shifted.at(1, 5), grid.at(0, 5));
+    BOOST_CHECK_EQUAL(shifted.at(100, 5), grid.at(98, 5));
+
+    BOOST_CHECK_THROW(GridStencil::apply(grid, grid, 1, [](const GridStencil::Neighborhood<float>& n) { return n.center(); }),
+                      std::runtime_error);
+    GridMapF small(Vector2ui(10, 10), Vector2d(0.1, 0.1), 0.f);
+    BOOST_CHECK_THROW(GridStencil::apply(grid, small, 1, [](const GridStencil::Neighborhood<float>& n) { return n.center(); }),
+                      std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_convolve)
+{
+    for(float default_value : {(float)NAN, std::numeric_limits<float>::infinity()})
+    {
+        GridMapF grid = createGrid(default_value);
+        Eigen::MatrixXf kernel = GridStencil::gaussianKernel(2, 1.0);
+        BOOST_CHECK_CLOSE(kernel.sum(), 1.f, 1e-4);
+
+        GridMapF smoothed = GridStencil::convolve(grid, kernel, true, false, GridStencil::BORDER_DEFAULT, 3);
+        GridMapF filled = GridStencil::convolve(grid, kernel, true, true);
+
+        // the reference implementation with the generic functor interface
+        GridMapF expected = GridStencil::apply(grid, 2, [&kernel](const GridStencil::Neighborhood<float>& n)
+        {
+            double sum = 0., weight_sum = 0.;
+            for(int dy = -2; dy <= 2; ++dy)
+            {
+                for(int dx = -2; dx <= 2; ++dx)
+                {
+                    if(n.isDefault(dx, dy))
+                        continue;
+                    sum += kernel(dy + 2, dx + 2) * n(dx, dy);
+                    weight_sum += kernel(dy + 2, dx + 2);
+                }
+            }
+            return weight_sum > 0. ? float(sum / weight_sum) : n.getGrid().getDefaultValue();
+        });
+
+        for(unsigned int y = 0; y < 90; ++y)
+        {
+            for(unsigned int x = 0; x < 150; ++x)
+            {
+                if(grid.isDefault(grid.at(x, y)))
+                {
+                    BOOST_CHECK(smoothed.isDefault(smoothed.at(x, y)));
+                    if(!grid.isDefault(expected.at(x, y)))
+                        BOOST_CHECK_SMALL(filled.at(x, y) - expected.at(x, y), 1e-5f);
+                    continue;
+                }
+                BOOST_CHECK_SMALL(smoothed.at(x, y) - expected.at(x, y), 1e-5f);
+                BOOST_CHECK_EQUAL(smoothed.at(x, y), filled.at(x, y));
+            }
+        }
+        // the hole is smaller than the kernel, so it is filled completely
+        BOOST_CHECK(!grid.isDefault(filled.at(72, 42)));
+        BOOST_CHECK(!grid.isDefault(filled.at(70, 40)));
+
+        // plain convolution is missing next to missing cells
+        Eigen::MatrixXf laplace(3, 3);
+        laplace << 0, 1, 0,
+                   1, -4, 1,
+                   0, 1, 0;
+        GridMapF laplacian = GridStencil::convolve(grid, laplace, false);
+        BOOST_CHECK(grid.isDefault(laplacian.at(0, 10)));
+        BOOST_CHECK(grid.isDefault(laplacian.at(69, 41)));
+        BOOST_CHECK(!grid.isDefault(laplacian.at(68, 41)));
+        BOOST_CHECK_SMALL(laplacian.at(20, 20) - (grid.at(19, 20) + grid.at(21, 20) + grid.at(20, 19) + grid.at(20, 21) - 4 * grid.at(20, 20)), 1e-6f);
+
+        // non-finite cells with a zero weight don't change the result
+        GridMapF infinite_corner = grid;
+        infinite_corner.at(21, 21) = -std::numeric_limits<float>::infinity();
+        GridMapF corner_laplacian = GridStencil::convolve(infinite_corner, laplace, false);
+        BOOST_CHECK_EQUAL(corner_laplacian.at(20, 20), laplacian.at(20, 20));
+
+        BOOST_CHECK_THROW(GridStencil::convolve(grid, Eigen::MatrixXf::Ones(2, 2)), std::runtime_error);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_dilate_erode)
+{
+    GridMap<int> grid(Vector2ui(200, 130), Vector2d(0.1, 0.1), -1);
+    grid.at(10, 10) = 5;
+    grid.at(12, 11) = 7;
+    grid.at(199, 0) = 3;
+    grid.at(100, 100) = 0;
+    for(unsigned int x = 50; x < 60; ++x)
+        grid.at(x, 60) = 2;
+
+    GridMap<int> dilated = GridStencil::dilate(grid, 3, 4);
+    GridMap<int> eroded = GridStencil::erode(grid, 3);
+
+    // compare against the brute force neighborhood
+    for(int y = 0; y < 130; ++y)
+    {
+        for(int x = 0; x < 200; ++x)
+        {
+            int max = -1, min = -1;
+            for(int ny = std::max(y - 3, 0); ny <= std::min(y + 3, 129); ++ny)
+            {
+                for(int nx = std::max(x - 3, 0); nx <= std::min(x + 3, 199); ++nx)
+                {
+                    const int value = grid.at(nx, ny);
+                    if(value == -1)
+                        continue;
+                    max = max == -1 ? value : std::max(max, value);
+                    min = min == -1 ? value : std::min(min, value);
+                }
+            }
+            BOOST_REQUIRE_EQUAL(dilated.at(x, y), max);
+            BOOST_REQUIRE_EQUAL(eroded.at(x, y), min);
+        }
+    }
+    BOOST_CHECK_EQUAL(dilated.at(13, 13), 7);
+    BOOST_CHECK_EQUAL(eroded.at(13, 13), 5);
+    BOOST_CHECK_EQUAL(dilated.at(196, 3), 3);
+    BOOST_CHECK_EQUAL(dilated.at(195, 3), -1);
+}
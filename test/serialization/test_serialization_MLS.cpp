@@ -73,6 +73,42 @@ BOOST_AUTO_TEST_CASE(test_mls_surfacepatchkalman_serialization)
     BOOST_CHECK(sp_i.getNormal() == sp_o.getNormal());
 }
 
+BOOST_AUTO_TEST_CASE(test_occupancypatch_serialization)
+{
+    OccupancyPatch op_o(0.73);
+    op_o.updateLogOdds(0.4f);
+
+    std::stringstream stream;
+    boost::archive::binary_oarchive oa(stream);
+    oa << op_o;
+
+    // deserialize from string stream
+    boost::archive::binary_iarchive *ia = new boost::archive::binary_iarchive(stream);
+    OccupancyPatch op_i;
+    (*ia) >> op_i;
+
+    BOOST_CHECK(op_i.getLogOdds() == op_o.getLogOdds());
+    BOOST_CHECK(sizeof(OccupancyPatch) == sizeof(float));
+}
+
+BOOST_AUTO_TEST_CASE(test_tsdfpatch_serialization)
+{
+    TSDFPatch tp_o(0.3f, 0.02f);
+
+    std::stringstream stream;
+    boost::archive::binary_oarchive oa(stream);
+    oa << tp_o;
+
+    // deserialize from string stream
+    boost::archive::binary_iarchive *ia = new boost::archive::binary_iarchive(stream);
+    TSDFPatch tp_i;
+    (*ia) >> tp_i;
+
+    BOOST_CHECK(tp_i.getDistance() == tp_o.getDistance());
+    BOOST_CHECK(tp_i.getVariance() == tp_o.getVariance());
+    BOOST_CHECK(sizeof(TSDFPatch) == 2 * sizeof(float));
+}
+
 BOOST_AUTO_TEST_CASE(test_mls_serialization)
 {
     //    GridConfig conf(300, 300, 0.05, 0.05, -7.5, -7.5);
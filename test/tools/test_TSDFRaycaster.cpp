@@ -0,0 +1,119 @@
+#define BOOST_TEST_MODULE ToolsTest
+#include <boost/test/unit_test.hpp>
+
+#include <maps/tools/TSDFRaycaster.hpp>
+
+using namespace ::maps::grid;
+using namespace ::maps::tools;
+
+/** TSDF of a wall at x = 4 and a floor at z = 0, observed from the sensor position */
+TSDFVolumetricMap::Ptr createScene(const Eigen::Vector3d& sensor)
+{
+    TSDFVolumetricMap::Ptr map(new TSDFVolumetricMap(Vector2ui(200, 200), Vector3d(0.05, 0.05, 0.05), 0.2f));
+    map->getLocalFrame().translation() << 0.5 * map->getSize(), 0;
+    map->setIntegrationMode(TSDFVolumetricMap::TRUNCATION_BAND);
+
+    for(double y = -3.; y <= 3.; y += 0.02)
+    {
+        for(double z = 0.02; z <= 2.; z += 0.02)
+            map->mergePoint(sensor, Eigen::Vector3d(4., y, z));
+        for(double x = -3.; x < 4.; x += 0.02)
+            map->mergePoint(sensor, Eigen::Vector3d(x, y, 0.));
+    }
+    return map;
+}
+
+BOOST_AUTO_TEST_CASE(test_cast_ray)
+{
+    const Eigen::Vector3d sensor(-1., 0., 1.);
+    TSDFRaycaster raycaster;
+    raycaster.setTSDFMap(createScene(sensor));
+
+    float range;
+    Eigen::Vector3f normal;
+    BOOST_REQUIRE(raycaster.castRay(sensor, Eigen::Vector3d::UnitX(), range, normal));
+    BOOST_CHECK_SMALL(range - 5.f, 0.01f);
+    BOOST_CHECK_GT(normal.dot(-Eigen::Vector3f::UnitX()), 0.99f);
+
+    BOOST_REQUIRE(raycaster.castRay(sensor, -Eigen::Vector3d::UnitZ(), range, normal));
+    BOOST_CHECK_SMALL(range - 1.f, 0.01f);
+    BOOST_CHECK_GT(normal.dot(Eigen::Vector3f::UnitZ()), 0.99f);
+
+    // nothing was observed behind the sensor
+    BOOST_CHECK(!raycaster.castRay(sensor, -Eigen::Vector3d::UnitX(), range, normal));
+    BOOST_CHECK(!raycaster.castRay(sensor, Eigen::Vector3d::UnitZ(), range, normal));
+
+    // the wall is out of range
+    raycaster.setRangeLimits(0., 4.);
+    BOOST_CHECK(!raycaster.castRay(sensor, Eigen::Vector3d::UnitX(), range, normal));
+}
+
+BOOST_AUTO_TEST_CASE(test_spherical_model)
+{
+    const Eigen::Vector3d sensor(-1., 0., 1.);
+    TSDFRaycaster raycaster;
+    raycaster.setTSDFMap(createScene(sensor));
+
+    const TSDFRaycaster::SensorModel model = TSDFRaycaster::SensorModel::spherical(41, 11, -0.4, 0.4, -0.1, 0.1);
+    BOOST_CHECK(model.getRayDirection(20, 5).isApprox(Eigen::Vector3d::UnitX()));
+
+    TSDFRaycaster::RangeImage image;
+    raycaster.raycast(base::Transform3d(Eigen::Translation3d(sensor)), model, image, 4);
+    BOOST_REQUIRE_EQUAL(image.ranges.size(), 41 * 11);
+
+    for(unsigned v = 0; v < model.height; ++v)
+    {
+        for(unsigned u = 0; u < model.width; ++u)
+        {
+            const Eigen::Vector3d direction = model.getRayDirection(u, v);
+            BOOST_REQUIRE(!std::isnan(image.getRange(u, v)));
+            BOOST_CHECK_SMALL(image.getRange(u, v) - 5. / direction.x(), 0.02);
+            BOOST_CHECK_GT(image.getNormal(u, v).dot(-Eigen::Vector3f::UnitX()), 0.98f);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_pinhole_model)
+{
+    const Eigen::Vector3d sensor(-1., 0., 1.);
+    TSDFRaycaster raycaster;
+    raycaster.setTSDFMap(createScene(sensor));
+
+    // camera looking along x, tilted down by 30 degrees
+    const double tilt = M_PI / 6.;
+    Eigen::Matrix3d camera2body;
+    camera2body << 0, 0, 1,
+                  -1, 0, 0,
+                   0, -1, 0;
+    base::Transform3d sensor2map = Eigen::Translation3d(sensor) * Eigen::AngleAxisd(tilt, Eigen::Vector3d::UnitY());
+    sensor2map.linear() *= camera2body;
+
+    const TSDFRaycaster::SensorModel model = TSDFRaycaster::SensorModel::pinhole(32, 24, 30., 30., 15.5, 11.5);
+    TSDFRaycaster::RangeImage image;
+    raycaster.raycast(sensor2map, model, image);
+
+    size_t floor_hits = 0;
+    for(unsigned v = 0; v < model.height; ++v)
+    {
+        for(unsigned u = 0; u < model.width; ++u)
+        {
+            const Eigen::Vector3d direction = sensor2map.linear() * model.getRayDirection(u, v);
+            BOOST_REQUIRE(!std::isnan(image.getRange(u, v)));
+
+            // the hit is either on the floor or on the wall
+            const Eigen::Vector3d hit = sensor + image.getRange(u, v) * direction;
+            if(std::abs(hit.z()) < 0.02)
+            {
+                BOOST_CHECK_GT(image.getNormal(u, v).dot(Eigen::Vector3f::UnitZ()), 0.95f);
+                floor_hits++;
+            }
+            else
+            {
+                BOOST_CHECK_SMALL(hit.x() - 4., 0.02);
+                BOOST_CHECK_GT(image.getNormal(u, v).dot(-Eigen::Vector3f::UnitX()), 0.95f);
+            }
+        }
+    }
+    BOOST_CHECK_GT(floor_hits, 0);
+    BOOST_CHECK_LT(floor_hits, model.width * model.height);
+}
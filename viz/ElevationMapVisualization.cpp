@@ -77,7 +77,7 @@ void ElevationMapVisualization::updateMainNode ( osg::Node* node )
 osg::HeightField* ElevationMapVisualization::createHeighField()
 {
     // create height field
-    maps::grid::ElevationMap& elev_map = p->data;    
+    const maps::grid::ElevationMap& elev_map = p->data;
 
     osg::HeightField* heightField = new osg::HeightField();
     heightField->allocate(elev_map.getNumCells().x(), elev_map.getNumCells().y());
@@ -94,9 +94,10 @@ osg::HeightField* ElevationMapVisualization::createHeighField()
 
     for (unsigned int r = 0; r < heightField->getNumRows(); r++) 
     {
+        maps::grid::ElevationMap::ConstRowSpan row = elev_map.getRow(r);
         for (unsigned int c = 0; c < heightField->getNumColumns(); c++) 
         {
-            double cell_value = elev_map.at(maps::grid::Index(c, r));
+            double cell_value = row[c];
 
             if( cell_value !=  default_value)
                 heightField->setHeight(c, r, cell_value);
@@ -110,7 +111,7 @@ osg::HeightField* ElevationMapVisualization::createHeighField()
 
 osg::Image* ElevationMapVisualization::createTextureImage()
 {
-    maps::grid::ElevationMap& elev_map = p->data; 
+    const maps::grid::ElevationMap& elev_map = p->data;
 
     osg::Image* image = new osg::Image(); 
 
@@ -130,10 +131,11 @@ osg::Image* ElevationMapVisualization::createTextureImage()
     // fill image with color
     for (unsigned int y = 0; y < elev_map.getNumCells().y(); ++y)
     {
+        maps::grid::ElevationMap::ConstRowSpan row = elev_map.getRow(y);
         for (unsigned int x = 0; x < elev_map.getNumCells().x(); ++x)
         {
             /** Get the cell value **/
-            double cell_value = elev_map.at(maps::grid::Index(x, y));
+            double cell_value = row[x];
 
             double normalize_value = (cell_value-elev_range.first)/scaling;
             osg::Vec4f col(1.0,1.0,0.6,1.0);
@@ -108,9 +108,10 @@ struct DataHold : public GridMapVisualization::Data
 
         for (unsigned int r = 0; r < heightField->getNumRows(); r++) 
         {
+            const auto row = grid.getRow(r);
             for (unsigned int c = 0; c < heightField->getNumColumns(); c++) 
             {
-                GridT cell_value = grid.at(maps::grid::Index(c, r));
+                GridT cell_value = row[c];
 
                 if( cell_value !=  default_value)
                     heightField->setHeight(c, r, cell_value);
@@ -143,10 +144,11 @@ struct DataHold : public GridMapVisualization::Data
         // fill image with color
         for (unsigned int y = 0; y < grid.getNumCells().y(); ++y)
         {
+            const auto row = grid.getRow(y);
             for (unsigned int x = 0; x < grid.getNumCells().x(); ++x)
             {
                 /** Get the cell value **/
-                GridT cell_value = grid.at(maps::grid::Index(x, y));
+                GridT cell_value = row[x];
 
                 double normalize_value = (double)(cell_value - min)/scaling;
                 osg::Vec4f col(1.0,1.0,0.6,1.0);
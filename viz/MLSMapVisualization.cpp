@@ -39,10 +39,10 @@ struct PatchVisualizer
         p.getRange(minZ, maxZ);
         minZ -= 5e-4f;
         maxZ += 5e-4f;
-        Eigen::Vector3f normal = p.getNormal();
-        if(normal.allFinite())
+        const Eigen::Hyperplane<float, 3> plane = p.getPlane();
+        if(plane.normal().allFinite())
         {
-            geode.drawPlane(Eigen::Hyperplane<float, 3>(p.getNormal(), p.getCenter()), minZ, maxZ);
+            geode.drawPlane(plane, minZ, maxZ);
         }
         else
         {
@@ -92,6 +92,8 @@ public:
     {
         // reset local frames since they are modelled separately in the OSG tree
         mls.getLocalFrame() = base::Transform3d::Identity();
+        // the patches are drawn on each update of the OSG tree
+        mls.updatePlanes();
         boost::shared_ptr<maps::grid::OccupancyGridMap> grid;
         if(mls.hasFreeSpaceMap() && (grid = boost::dynamic_pointer_cast<maps::grid::OccupancyGridMap>(mls.getFreeSpaceMap())))
             grid->getLocalFrame() = base::Transform3d::Identity();